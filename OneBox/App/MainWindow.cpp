@@ -40,7 +40,7 @@ MainWindow::MainWindow(QWidget *parent) :
     this->setWindowTitle(tr("All in One ToolBox"));
 
     // Set Menu Bar Version Info
-    ui->menuVersion->addAction("V1.2 2026-Jun-01");
+    ui->menuVersion->addAction("V1.3 2026-Oct-19");
 }
 
 MainWindow::~MainWindow()
@@ -1,11 +1,125 @@
 #include <QApplication>
+#include <QCoreApplication>
+#include <QStringList>
+#include <stdio.h>
+#include <string.h>
 #include "MainWindow.h"
+#include "TcpServer.h"
+#include "TcpLoadGenerator.h"
+
+/*
+ Headless modes, no window is shown,
+
+ OneBox --tcp-echo <port>
+    TCPServer echoes every rx message, target of --tcp-load
+
+ OneBox --tcp-load <ip>:<port> [--conn N] [--rate R] [--concurrency K]
+                               [--size S] [--duration SEC]
+    TCPLoadGenerator, open loop if R > 0, otherwise closed loop
+*/
+
+static void printUsage()
+{
+    printf("Usage: OneBox --tcp-echo <port>\n"
+           "       OneBox --tcp-load <ip>:<port> [--conn N] [--rate R] [--concurrency K] [--size S] [--duration SEC]\n");
+}
+
+static int runTcpEcho(QCoreApplication &app, const QStringList &args)
+{
+    TCPServer server;
+    uint16_t port = args.value(args.indexOf("--tcp-echo") + 1).toUShort();
+
+    server.setEchoEnabled(true);
+
+    if(0 == port || !server.beginListen(QHostAddress::Any, port))
+    {
+        printUsage();
+        return 1;
+    }
+
+    printf("TCP echo server on port %d\n", server.getListenPort());
+    fflush(stdout);
+
+    return app.exec();
+}
+
+static int runTcpLoad(QCoreApplication &app, const QStringList &args)
+{
+    struct TCP_LOAD_CONFIG config;
+    QString target = args.value(args.indexOf("--tcp-load") + 1);
+    int pos = target.lastIndexOf(':');
+
+    if(pos <= 0)
+    {
+        printUsage();
+        return 1;
+    }
+
+    config.address = QHostAddress(target.left(pos));
+    config.port = target.mid(pos + 1).toUShort();
+
+    for(int i = 0; i < args.size() - 1; i++)
+    {
+        if("--conn" == args.at(i))
+        {
+            config.connectionCnt = args.at(i + 1).toUInt();
+        }
+        else if("--rate" == args.at(i))
+        {
+            config.ratePerSec = args.at(i + 1).toUInt();
+        }
+        else if("--concurrency" == args.at(i))
+        {
+            config.concurrency = args.at(i + 1).toUInt();
+        }
+        else if("--size" == args.at(i))
+        {
+            config.payloadSize = args.at(i + 1).toUInt();
+        }
+        else if("--duration" == args.at(i))
+        {
+            config.durationInMs = args.at(i + 1).toUInt() * 1000;
+        }
+    }
+
+    TCPLoadGenerator generator;
+    QObject::connect(&generator, SIGNAL(loadFinished()), &app, SLOT(quit()));
+
+    if(!generator.start(config))
+    {
+        printf("Invalid target %s\n", qPrintable(target));
+        return 1;
+    }
+
+    // Stop by Ctrl+C is not handled, run with --duration
+    int ret = app.exec();
+
+    printf("%s", qPrintable(generator.getReport()));
+
+    return ret;
+}
 
 int main(int argc, char *argv[])
 {
+    for(int i = 1; i < argc; i++)
+    {
+        if(0 == strcmp(argv[i], "--tcp-echo") || 0 == strcmp(argv[i], "--tcp-load"))
+        {
+            QCoreApplication app(argc, argv);
+            QStringList args = app.arguments();
+
+            if(args.contains("--tcp-echo"))
+            {
+                return runTcpEcho(app, args);
+            }
+
+            return runTcpLoad(app, args);
+        }
+    }
+
     QApplication a(argc, argv);
     MainWindow w;
     w.show();
-    
+
     return a.exec();
 }
@@ -0,0 +1,91 @@
+/**********************************************************************
+PACKAGE:        Communication
+FILE:           ModbusASCII.cpp
+COPYRIGHT (C):  All rights reserved.
+
+PURPOSE:        Modbus ASCII master on serial COM port
+**********************************************************************/
+
+#include "ModbusASCII.h"
+#include <QDebug>
+
+//#define MODBUSASCII_DEBUG_PRINT
+
+ModbusASCII::ModbusASCII(ModbusCommBase *parent) :
+    ModbusRTU(parent),
+    badFrameCnt(0)
+{
+}
+
+ModbusASCII::~ModbusASCII()
+{
+    qDebug() << "~ModbusASCII()";
+}
+
+uint32_t ModbusASCII::getBadFrameCnt() const
+{
+    return badFrameCnt;
+}
+
+int ModbusASCII::writeDataToModbus(const char *txData, int len)
+{
+    // RTU ADU without CRC is address + PDU
+    if(NULL == txData || len <= MODBUS_CRC_LENGTH ||
+            len - MODBUS_CRC_LENGTH + ModbusAsciiFrame::LRC_LEN > ModbusAsciiFrame::MAX_BINARY_LEN)
+    {
+        return 0;
+    }
+
+    uint32_t asciiLen = ModbusAsciiFrame::encode(m_asciiTxBuf, (const uint8_t *)txData, len - MODBUS_CRC_LENGTH);
+
+#ifdef MODBUSASCII_DEBUG_PRINT
+    qDebug() << "ModbusASCII Tx:" << QByteArray(m_asciiTxBuf, asciiLen);
+#endif
+
+    return ModbusRTU::writeDataToModbus(m_asciiTxBuf, asciiLen);
+}
+
+void ModbusASCII::readDataFromModbus(QByteArray data)
+{
+    QList<QByteArray> frames;
+    uint8_t aduBuf[ModbusRtuFrame::MAX_ADU_LEN];
+
+    // Decoded frame + CRC16 must fit RTU ADU
+    MODBUS_STATIC_ASSERT((int)ModbusAsciiFrame::MAX_BINARY_LEN - (int)ModbusAsciiFrame::LRC_LEN + (int)MODBUS_CRC_LENGTH
+                         <= (int)ModbusRtuFrame::MAX_ADU_LEN, ascii_frame_fits_rtu_adu);
+
+    if(data.isEmpty())
+    {
+        return;
+    }
+
+    // Emit signal
+    emit newDataReady(data);
+
+    rxFramer.pushData(data, frames);
+
+    for(int i = 0; i < frames.size(); i++)
+    {
+        const QByteArray &frame = frames.at(i);
+        uint32_t len = ModbusAsciiFrame::decode(aduBuf, frame.constData(), frame.size());
+
+        if(0 == len)
+        {
+            // Line without ':' is noise, not a frame
+            if(!frame.isEmpty())
+            {
+                badFrameCnt++;
+
+                qDebug() << "ModbusASCII bad frame, len =" << frame.size();
+                rejectResponseFrame("ModbusASCII LRC or hex is bad");
+            }
+
+            continue;
+        }
+
+        // Replace LRC by CRC16, address is kept
+        uint32_t aduLen = ModbusRtuFrame::encode(aduBuf, len - ModbusRtuFrame::HEADER_LEN, aduBuf[0]);
+
+        parseResponsePacket(QByteArray((const char *)aduBuf, aduLen));
+    }
+}
@@ -0,0 +1,55 @@
+/**********************************************************************
+PACKAGE:        Communication
+FILE:           ModbusASCII.h
+COPYRIGHT (C):  All rights reserved.
+
+PURPOSE:        Modbus ASCII master on serial COM port
+**********************************************************************/
+
+#ifndef MODBUSASCII_H
+#define MODBUSASCII_H
+
+#include "ModbusRTU.h"
+#include "ModbusPdu.h"
+#include "StreamFramer.h"
+
+/*
+ Modbus ASCII differs from RTU in framing only, so ModbusASCII is a
+ ModbusRTU with another codec at the COM port:
+
+    Tx: RTU ADU of Tx FIFO -> ':' + hex(address + PDU + LRC) + CRLF
+    Rx: ModbusAsciiFramer -> hex decode, LRC check -> RTU ADU
+
+ Tx FIFO, request merge, retransmit, response timeout and circuit breaker,
+ transactions and signals are those of ModbusRTU. The response path is
+ the one of RTU as well, a decoded frame gets its CRC16 back before it is
+ parsed, so response checks stay in one place.
+
+ COM port and Modbus settings are read from the same ini groups as
+ ModbusRTU, ASCII devices usually want DataBits=7 there. Frames are
+ twice as long as RTU, the response timeout follows measured RTT.
+*/
+class ModbusASCII : public ModbusRTU
+{
+    Q_OBJECT
+
+public:
+    explicit ModbusASCII(ModbusCommBase *parent = 0);
+    virtual ~ModbusASCII();
+
+    // Count of received frames dropped by bad LRC or hex chars
+    uint32_t getBadFrameCnt() const;
+
+protected slots:
+    virtual void readDataFromModbus(QByteArray data);
+
+protected:
+    virtual int writeDataToModbus(const char *txData, int len);
+
+private:
+    ModbusAsciiFramer rxFramer;
+    char m_asciiTxBuf[ModbusAsciiFrame::MAX_ADU_LEN];
+    uint32_t badFrameCnt;
+};
+
+#endif // MODBUSASCII_H
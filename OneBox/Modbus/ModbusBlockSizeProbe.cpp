@@ -0,0 +1,275 @@
+/**********************************************************************
+PACKAGE:        Communication
+FILE:           ModbusBlockSizeProbe.cpp
+COPYRIGHT (C):  All rights reserved.
+
+PURPOSE:        Find the largest read/write request a Modbus device accepts
+**********************************************************************/
+
+#include "ModbusBlockSizeProbe.h"
+#include <QVector>
+#include <QDebug>
+
+#include "ModbusPdu.h"
+
+// Exception of a request longer than the device accepts
+#define MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE     0x03
+
+ModbusBlockSizeProbe::ModbusBlockSizeProbe(ModbusCommBase *modbusP, QObject *parent) :
+    QObject(parent),
+    modbusP(modbusP),
+    deviceId(-1),
+    phase(PHASE_IDLE),
+    functionCode(MB_FUNC_NONE),
+    regOffset(0),
+    probeWrite(false),
+    lowerRegCnt(0),
+    upperRegCnt(0),
+    candidateRegCnt(0)
+{
+    if(NULL != modbusP)
+    {
+        blockSize = modbusP->getBlockSize();
+    }
+}
+
+ModbusBlockSizeProbe::ModbusBlockSizeProbe(ModbusTCP *tcpP, QObject *parent) :
+    QObject(parent),
+    tcpP(tcpP),
+    deviceId(-1),
+    phase(PHASE_IDLE),
+    functionCode(MB_FUNC_NONE),
+    regOffset(0),
+    probeWrite(false),
+    lowerRegCnt(0),
+    upperRegCnt(0),
+    candidateRegCnt(0)
+{
+    if(NULL != tcpP)
+    {
+        blockSize = tcpP->getBlockSize();
+    }
+}
+
+ModbusBlockSizeProbe::ModbusBlockSizeProbe(ModbusTCPPool *poolP, int deviceId, QObject *parent) :
+    QObject(parent),
+    poolP(poolP),
+    deviceId(deviceId),
+    phase(PHASE_IDLE),
+    functionCode(MB_FUNC_NONE),
+    regOffset(0),
+    probeWrite(false),
+    lowerRegCnt(0),
+    upperRegCnt(0),
+    candidateRegCnt(0)
+{
+    if(NULL != poolP)
+    {
+        blockSize = poolP->getBlockSize(deviceId);
+    }
+}
+
+bool ModbusBlockSizeProbe::start(uint8_t functionCode, uint16_t regOffset, bool probeWrite)
+{
+    if(PHASE_IDLE != phase)
+    {
+        return false;
+    }
+
+    if(MB_FUNC_READ_HOLDING_REGISTER != functionCode && MB_FUNC_READ_INPUT_REGISTER != functionCode)
+    {
+        return false;
+    }
+
+    if(modbusP.isNull() && tcpP.isNull() && poolP.isNull())
+    {
+        return false;
+    }
+
+    this->functionCode = functionCode;
+    this->regOffset = regOffset;
+    this->probeWrite = probeWrite;
+
+    // Most devices accept the standard, try it first
+    phase = PHASE_READ;
+    lowerRegCnt = 0;
+    upperRegCnt = MODBUS_MAX_READ_REG_CNT;
+    candidateRegCnt = upperRegCnt;
+
+    issueCandidate();
+
+    return true;
+}
+
+bool ModbusBlockSizeProbe::isRunning() const
+{
+    return (PHASE_IDLE != phase);
+}
+
+struct MODBUS_BLOCK_SIZE ModbusBlockSizeProbe::getBlockSize() const
+{
+    return blockSize;
+}
+
+void ModbusBlockSizeProbe::handleTransaction(ModbusTransaction transaction)
+{
+    if(PHASE_IDLE == phase)
+    {
+        return;
+    }
+
+    // Registers to write back, read with a block not larger than the read size
+    if(PHASE_WRITE_READ == phase)
+    {
+        if(!transaction.isOk())
+        {
+            finish(false);
+            return;
+        }
+
+        QByteArray data = transaction.getData();
+        QVector<uint16_t> values(candidateRegCnt);
+
+        for(int i = 0; i < values.size() && (i + 1) * 2 <= data.size(); i++)
+        {
+            values[i] = modbusGetUint16((const uint8_t *)data.constData() + i * 2);
+        }
+
+        phase = PHASE_WRITE;
+        issue(MB_FUNC_WRITE_MULTIPLE_REGISTERS, candidateRegCnt, (const char *)values.constData());
+        return;
+    }
+
+    bool accepted = transaction.isOk();
+    bool refused = (ModbusTransaction::STATUS_TIMEOUT == transaction.getStatus()) ||
+                   (ModbusTransaction::STATUS_EXCEPTION == transaction.getStatus() &&
+                    MODBUS_EXCEPTION_ILLEGAL_DATA_VALUE == transaction.getExceptionCode());
+
+    if(!accepted && !refused)
+    {
+#ifdef MODBUS_BLOCK_SIZE_PROBE_DEBUG_TRACE
+        qDebug() << "ModbusBlockSizeProbe::handleTransaction() stopped, status" << transaction.getStatus()
+                 << "exception" << transaction.getExceptionCode() << "regCnt" << candidateRegCnt;
+#endif
+        finish(false);
+        return;
+    }
+
+    if(!narrow(accepted))
+    {
+        issueCandidate();
+        return;
+    }
+
+    // Even a single register is refused
+    if(0 == lowerRegCnt)
+    {
+        finish(false);
+        return;
+    }
+
+    if(PHASE_READ == phase)
+    {
+        blockSize.maxReadRegCnt = lowerRegCnt;
+
+        if(!probeWrite)
+        {
+            finish(true);
+            return;
+        }
+
+        // Registers to write back are read in one request
+        phase = PHASE_WRITE;
+        lowerRegCnt = 0;
+        upperRegCnt = (blockSize.maxReadRegCnt < MODBUS_MAX_WRITE_REG_CNT) ? blockSize.maxReadRegCnt : MODBUS_MAX_WRITE_REG_CNT;
+        candidateRegCnt = upperRegCnt;
+
+        issueCandidate();
+        return;
+    }
+
+    blockSize.maxWriteRegCnt = lowerRegCnt;
+    finish(true);
+}
+
+void ModbusBlockSizeProbe::issue(uint8_t functionCode, uint16_t regCnt, const char *dataP)
+{
+    ModbusTransaction transaction;
+
+    if(!modbusP.isNull())
+    {
+        transaction = modbusP->transact(functionCode, regOffset, regCnt, dataP);
+    }
+    else if(!tcpP.isNull())
+    {
+        transaction = tcpP->transact(functionCode, regOffset, regCnt, dataP);
+    }
+    else if(!poolP.isNull())
+    {
+        transaction = poolP->transact(deviceId, functionCode, regOffset, regCnt, dataP);
+    }
+    else
+    {
+        // Transport is gone
+        finish(false);
+        return;
+    }
+
+    // Always queued, also if rejected at once
+    transaction.onFinished(this, SLOT(handleTransaction(ModbusTransaction)));
+}
+
+void ModbusBlockSizeProbe::issueCandidate()
+{
+    if(PHASE_READ == phase)
+    {
+        issue(functionCode, candidateRegCnt);
+    }
+    else
+    {
+        phase = PHASE_WRITE_READ;
+        issue(MB_FUNC_READ_HOLDING_REGISTER, candidateRegCnt);
+    }
+}
+
+bool ModbusBlockSizeProbe::narrow(bool accepted)
+{
+    if(accepted)
+    {
+        lowerRegCnt = candidateRegCnt;
+    }
+    else
+    {
+        upperRegCnt = candidateRegCnt - 1;
+    }
+
+    if(lowerRegCnt >= upperRegCnt)
+    {
+        return true;
+    }
+
+    candidateRegCnt = (lowerRegCnt + upperRegCnt + 1) / 2;
+
+    return false;
+}
+
+void ModbusBlockSizeProbe::finish(bool ok)
+{
+    phase = PHASE_IDLE;
+
+    if(!modbusP.isNull())
+    {
+        modbusP->setBlockSize(blockSize);
+    }
+    else if(!tcpP.isNull())
+    {
+        tcpP->setBlockSize(blockSize);
+    }
+    else if(!poolP.isNull())
+    {
+        poolP->setBlockSize(deviceId, blockSize);
+    }
+
+    // Emit signal
+    emit finished(ok, blockSize);
+}
@@ -0,0 +1,117 @@
+/**********************************************************************
+PACKAGE:        Communication
+FILE:           ModbusBlockSizeProbe.h
+COPYRIGHT (C):  All rights reserved.
+
+PURPOSE:        Find the largest read/write request a Modbus device accepts
+**********************************************************************/
+
+#ifndef MODBUSBLOCKSIZEPROBE_H
+#define MODBUSBLOCKSIZEPROBE_H
+
+#include <stdint.h>
+#include <QObject>
+#include <QPointer>
+
+#include "ModbusData.h"
+#include "ModbusTransaction.h"
+#include "ModbusCommBase.h"
+#include "ModbusTCP.h"
+#include "ModbusTCPPool.h"
+
+/*
+ Many devices answer fewer registers per request than the standard
+ allows, with exception 03 (illegal data value) or no response at all.
+ The probe finds the largest block by binary search,
+
+    candidate = standard maximum first, most devices accept it
+    accepted:               lower bound = candidate
+    exception 03/timeout:   upper bound = candidate - 1
+    candidate = (lower bound + upper bound + 1) / 2 until both meet
+
+ so at most 7 requests find the read size. The write size is searched
+ the same way with FC16 requests writing back the registers just read,
+ a register changed by the device between the read and the write gets
+ its old value back, only probe writes on configuration registers.
+
+ Once done, the result is cached in the transport, setBlockSize() of
+ ModbusCommBase, ModbusTCP or ModbusTCPPool. addPoll() of ModbusTCPPool
+ splits polls into the largest blocks of each device, the others only
+ keep the size for the application to split its own requests.
+
+ Any other result, e.g. exception 02 because the registers from
+ regOffset end before the block, or a parked device, stops the probe,
+ a size not found yet keeps its cached value.
+*/
+class ModbusBlockSizeProbe : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ModbusBlockSizeProbe(ModbusCommBase *modbusP, QObject *parent = 0);
+    explicit ModbusBlockSizeProbe(ModbusTCP *tcpP, QObject *parent = 0);
+    ModbusBlockSizeProbe(ModbusTCPPool *poolP, int deviceId, QObject *parent = 0);
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:       start
+    PURPOSE:        Start probing, finished() is emitted once done
+    ARGUMENTS:      uint8_t functionCode    -- MB_FUNC_READ_HOLDING_REGISTER or
+                                               MB_FUNC_READ_INPUT_REGISTER
+                    uint16_t regOffset      -- start of MODBUS_MAX_READ_REG_CNT
+                                               registers the device maps
+                    bool probeWrite         -- probe FC16 as well, writes back the
+                                               holding registers read from regOffset
+    RETURNS:        true - started, false - running already or invalid argument
+    -----------------------------------------------------------------------*/
+    bool start(uint8_t functionCode, uint16_t regOffset, bool probeWrite = false);
+
+    bool isRunning() const;
+
+    // Result of last probe, the cached sizes of the transport before
+    struct MODBUS_BLOCK_SIZE getBlockSize() const;
+
+signals:
+    // ok false: stopped by an unexpected result, only sizes found before are cached
+    void finished(bool ok, const struct MODBUS_BLOCK_SIZE &blockSize);
+
+private slots:
+    void handleTransaction(ModbusTransaction transaction);
+
+private:
+    enum PHASE
+    {
+        PHASE_IDLE = 0,
+        PHASE_READ,             // Read size search
+        PHASE_WRITE_READ,       // Read the registers to write back
+        PHASE_WRITE             // Write size search
+    };
+
+    QPointer<ModbusCommBase> modbusP;
+    QPointer<ModbusTCP> tcpP;
+    QPointer<ModbusTCPPool> poolP;
+    int deviceId;
+
+    PHASE phase;
+    uint8_t functionCode;
+    uint16_t regOffset;
+    bool probeWrite;
+
+    uint16_t lowerRegCnt;       // Largest block accepted
+    uint16_t upperRegCnt;       // Largest block not refused yet
+    uint16_t candidateRegCnt;   // Block of the outstanding request
+
+    struct MODBUS_BLOCK_SIZE blockSize;
+
+    // Queue a request on the transport, the result comes to handleTransaction()
+    void issue(uint8_t functionCode, uint16_t regCnt, const char *dataP = NULL);
+
+    // Request of the current candidate
+    void issueCandidate();
+
+    // Narrow the search by result of candidate, true: search is done
+    bool narrow(bool accepted);
+
+    // Store result in the transport and report it
+    void finish(bool ok);
+};
+
+#endif // MODBUSBLOCKSIZEPROBE_H
@@ -9,3 +9,13 @@ ModbusCommBase::ModbusCommBase(QObject *parent) :
 ModbusCommBase::~ModbusCommBase()
 {
 }
+
+void ModbusCommBase::setBlockSize(const struct MODBUS_BLOCK_SIZE &blockSize)
+{
+    m_blockSize = blockSize;
+}
+
+struct MODBUS_BLOCK_SIZE ModbusCommBase::getBlockSize() const
+{
+    return m_blockSize;
+}
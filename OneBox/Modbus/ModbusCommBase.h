@@ -3,6 +3,7 @@
 
 #include <QObject>
 #include "ModbusData.h"
+#include "ModbusTransaction.h"
 
 
 class ModbusCommBase : public QObject
@@ -31,14 +32,32 @@ public:
     -----------------------------------------------------------------------*/
     virtual bool writeMultiRegisters(uint16_t regOffset, const char *dataP, uint16_t regCnt) = 0;
 
+    /*-----------------------------------------------------------------------
+    FUNCTION:       transact
+    PURPOSE:        Queue a request and track its own result
+    ARGUMENTS:      uint8_t functionCode    -- function code of request
+                    uint16_t regOffset      -- register offset address
+                    uint16_t regCnt         -- count of registers
+                    const char *dataP       -- regCnt uint16_t in host byte order of write
+    RETURNS:        Handle completed by response, exception or timeout,
+                    STATUS_REJECTED at once if not supported or Tx queue is full
+    -----------------------------------------------------------------------*/
+    virtual ModbusTransaction transact(uint8_t functionCode, uint16_t regOffset, uint16_t regCnt, const char *dataP = NULL) = 0;
+
+    // Largest request of device, the standard until set, e.g. by ModbusBlockSizeProbe,
+    // cached for the application, requests are not split
+    void setBlockSize(const struct MODBUS_BLOCK_SIZE &blockSize);
+    struct MODBUS_BLOCK_SIZE getBlockSize() const;
+
 signals:
-    void reportModbusResponseValue(struct MODBUS_READ_FEEDBACK s);
+    void reportModbusResponseValue(const struct MODBUS_READ_FEEDBACK &s);
 
 public slots:
 
 protected:
 
 protected:
+    struct MODBUS_BLOCK_SIZE m_blockSize;
 
 };
 
@@ -0,0 +1,485 @@
+/**********************************************************************
+PACKAGE:        Communication
+FILE:           ModbusCoroutine.h
+COPYRIGHT (C):  All rights reserved.
+
+PURPOSE:        C++20 coroutine front-end of ModbusTransaction and TCPClient
+**********************************************************************/
+
+#ifndef MODBUSCOROUTINE_H
+#define MODBUSCOROUTINE_H
+
+#include <QtGlobal>
+
+/*
+ Optional, the project is built as C++98. Only compilers with coroutine
+ support and Qt 5.10 or later (functor invokeMethod()) enable it,
+ otherwise the header is empty. Add CONFIG += c++2a to the .pro to use.
+
+ A flow is a coroutine returning ModbusTask, it starts at once and runs
+ in the event loop of the executor object passed to the awaitables,
+ the transport itself by default:
+
+    ModbusTask<bool> commission(ModbusCommBase *mb)
+    {
+        ModbusTransaction t = co_await modbusReadHolding(mb, 0x100, 4);
+        if(!t.isOk())
+        {
+            co_return false;
+        }
+
+        uint16_t value = 1;
+        t = co_await modbusWriteMultiple(mb, 0x200, (const char *)&value, 1);
+        co_return t.isOk();
+    }
+
+ A suspended flow costs its coroutine frame and one transaction, no
+ thread or state machine object, so thousands may be outstanding. A
+ flow is always resumed by a queued call, never inside the transport.
+ A flow whose executor is deleted is never resumed, its frame leaks.
+*/
+#if defined(__cpp_impl_coroutine) && (QT_VERSION >= 0x050A00)
+
+#define MODBUS_COROUTINE_ENABLED
+
+#include <coroutine>
+#include <exception>
+#include <type_traits>
+#include <utility>
+#include <QObject>
+#include <QPointer>
+#include <QTimer>
+#include <QMetaObject>
+
+#include "ModbusCommBase.h"
+#include "ModbusTransaction.h"
+#include "ModbusTCP.h"
+#include "ModbusTCPPool.h"
+#include "TcpClient.h"
+
+// Resume coroutine from the event loop of executor
+inline void modbusResumeLater(QObject *executor, std::coroutine_handle<> handle)
+{
+    if(NULL == executor)
+    {
+        return;
+    }
+
+    QMetaObject::invokeMethod(executor, [handle]() { handle.resume(); }, Qt::QueuedConnection);
+}
+
+template<typename T>
+class ModbusTask;
+
+/*
+ Promise parts shared by ModbusTask<T> and ModbusTask<void>. The task
+ starts eagerly, at the end it resumes the flow awaiting it, or frees
+ itself if the ModbusTask object is already gone (detached flow).
+*/
+class ModbusTaskPromiseBase
+{
+public:
+    struct FinalAwaiter
+    {
+        bool await_ready() const noexcept
+        {
+            return false;
+        }
+
+        template<typename PROMISE>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<PROMISE> handle) noexcept
+        {
+            ModbusTaskPromiseBase &promise = handle.promise();
+
+            if(promise.continuation)
+            {
+                return promise.continuation;
+            }
+
+            if(promise.detached)
+            {
+                handle.destroy();
+            }
+
+            return std::noop_coroutine();
+        }
+
+        void await_resume() const noexcept
+        {
+        }
+    };
+
+    std::suspend_never initial_suspend() const noexcept
+    {
+        return std::suspend_never();
+    }
+
+    FinalAwaiter final_suspend() const noexcept
+    {
+        return FinalAwaiter();
+    }
+
+    // Exceptions are not used in this project
+    void unhandled_exception()
+    {
+        std::terminate();
+    }
+
+    std::coroutine_handle<> continuation;   // Flow awaiting this task
+    bool detached = false;                  // True: ModbusTask object is destroyed
+};
+
+template<typename T>
+class ModbusTaskPromise : public ModbusTaskPromiseBase
+{
+public:
+    ModbusTask<T> get_return_object();
+
+    void return_value(T value)
+    {
+        result = std::move(value);
+    }
+
+    T result = T();
+};
+
+template<>
+class ModbusTaskPromise<void> : public ModbusTaskPromiseBase
+{
+public:
+    ModbusTask<void> get_return_object();
+
+    void return_void()
+    {
+    }
+};
+
+/*
+ Handle of a flow, move only. co_await it from another flow to wait for
+ its result. Dropping it does not stop the flow, which then frees itself.
+*/
+template<typename T = void>
+class ModbusTask
+{
+public:
+    typedef ModbusTaskPromise<T> promise_type;
+    typedef std::coroutine_handle<promise_type> HANDLE;
+
+    explicit ModbusTask(HANDLE handle) :
+        handle(handle)
+    {
+    }
+
+    ModbusTask(ModbusTask &&other) noexcept :
+        handle(std::exchange(other.handle, HANDLE()))
+    {
+    }
+
+    ModbusTask(const ModbusTask &) = delete;
+    ModbusTask &operator=(const ModbusTask &) = delete;
+
+    ~ModbusTask()
+    {
+        if(!handle)
+        {
+            return;
+        }
+
+        if(handle.done())
+        {
+            handle.destroy();
+        }
+        else
+        {
+            handle.promise().detached = true;
+        }
+    }
+
+    bool isDone() const
+    {
+        return !handle || handle.done();
+    }
+
+    bool await_ready() const
+    {
+        return isDone();
+    }
+
+    void await_suspend(std::coroutine_handle<> awaiting)
+    {
+        handle.promise().continuation = awaiting;
+    }
+
+    T await_resume()
+    {
+        if constexpr(!std::is_void<T>::value)
+        {
+            return std::move(handle.promise().result);
+        }
+    }
+
+private:
+    HANDLE handle;
+};
+
+template<typename T>
+inline ModbusTask<T> ModbusTaskPromise<T>::get_return_object()
+{
+    return ModbusTask<T>(std::coroutine_handle<ModbusTaskPromise<T> >::from_promise(*this));
+}
+
+inline ModbusTask<void> ModbusTaskPromise<void>::get_return_object()
+{
+    return ModbusTask<void>(std::coroutine_handle<ModbusTaskPromise<void> >::from_promise(*this));
+}
+
+/*
+ co_await gives the finished ModbusTransaction. The transport finishes
+ it in its own thread, the flow is resumed in the thread of executor.
+*/
+class ModbusTransactionAwaiter
+{
+public:
+    ModbusTransactionAwaiter(const ModbusTransaction &transaction, QObject *executor) :
+        transaction(transaction),
+        executor(executor)
+    {
+    }
+
+    bool await_ready() const
+    {
+        return transaction.isFinished();
+    }
+
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        this->handle = handle;
+        transaction.onFinished(&ModbusTransactionAwaiter::handleFinished, this);
+    }
+
+    ModbusTransaction await_resume() const
+    {
+        return transaction;
+    }
+
+private:
+    ModbusTransaction transaction;
+    QPointer<QObject> executor;
+    std::coroutine_handle<> handle;
+
+    // Called inside the transport, the awaiter lives in the suspended frame
+    static void handleFinished(const ModbusTransaction &, void *contextP)
+    {
+        ModbusTransactionAwaiter *awaiterP = static_cast<ModbusTransactionAwaiter *>(contextP);
+
+        modbusResumeLater(awaiterP->executor.data(), awaiterP->handle);
+    }
+};
+
+// Await any transaction, executor: object whose thread runs the flow
+inline ModbusTransactionAwaiter modbusAwait(const ModbusTransaction &transaction, QObject *executor)
+{
+    return ModbusTransactionAwaiter(transaction, executor);
+}
+
+/*-----------------------------------------------------------------------
+FUNCTION:       modbusReadHolding/modbusWriteMultiple
+PURPOSE:        Awaitable requests of ModbusRTU/ModbusASCII, overloads for ModbusTCP below
+ARGUMENTS:      ModbusCommBase *mb      -- transport
+                uint16_t regOffset      -- register offset address
+                uint16_t regCnt         -- count of registers
+                const char *dataP       -- regCnt uint16_t in host byte order
+                QObject *executor       -- thread the flow runs in, NULL: mb
+RETURNS:        Awaiter, co_await gives the finished ModbusTransaction
+-----------------------------------------------------------------------*/
+inline ModbusTransactionAwaiter modbusReadHolding(ModbusCommBase *mb, uint16_t regOffset, uint16_t regCnt,
+                                                  QObject *executor = NULL)
+{
+    return ModbusTransactionAwaiter(mb->transact(MB_FUNC_READ_HOLDING_REGISTER, regOffset, regCnt),
+                                    (NULL == executor) ? mb : executor);
+}
+
+inline ModbusTransactionAwaiter modbusWriteMultiple(ModbusCommBase *mb, uint16_t regOffset, const char *dataP,
+                                                    uint16_t regCnt, QObject *executor = NULL)
+{
+    return ModbusTransactionAwaiter(mb->transact(MB_FUNC_WRITE_MULTIPLE_REGISTERS, regOffset, regCnt, dataP),
+                                    (NULL == executor) ? mb : executor);
+}
+
+// Awaitable requests of ModbusTCP, not a ModbusCommBase, executor NULL: mb
+inline ModbusTransactionAwaiter modbusReadHolding(ModbusTCP *mb, uint16_t regOffset, uint16_t regCnt,
+                                                  QObject *executor = NULL)
+{
+    return ModbusTransactionAwaiter(mb->transact(MB_FUNC_READ_HOLDING_REGISTER, regOffset, regCnt),
+                                    (NULL == executor) ? mb : executor);
+}
+
+inline ModbusTransactionAwaiter modbusWriteMultiple(ModbusTCP *mb, uint16_t regOffset, const char *dataP,
+                                                    uint16_t regCnt, QObject *executor = NULL)
+{
+    return ModbusTransactionAwaiter(mb->transact(MB_FUNC_WRITE_MULTIPLE_REGISTERS, regOffset, regCnt, dataP),
+                                    (NULL == executor) ? mb : executor);
+}
+
+// Awaitable requests of a ModbusTCPPool device, executor NULL: pool
+inline ModbusTransactionAwaiter modbusReadHolding(ModbusTCPPool *pool, int deviceId, uint16_t regOffset,
+                                                  uint16_t regCnt, QObject *executor = NULL)
+{
+    return ModbusTransactionAwaiter(pool->transact(deviceId, MB_FUNC_READ_HOLDING_REGISTER, regOffset, regCnt),
+                                    (NULL == executor) ? pool : executor);
+}
+
+inline ModbusTransactionAwaiter modbusReadInput(ModbusTCPPool *pool, int deviceId, uint16_t regOffset,
+                                                uint16_t regCnt, QObject *executor = NULL)
+{
+    return ModbusTransactionAwaiter(pool->transact(deviceId, MB_FUNC_READ_INPUT_REGISTER, regOffset, regCnt),
+                                    (NULL == executor) ? pool : executor);
+}
+
+inline ModbusTransactionAwaiter modbusWriteSingle(ModbusTCPPool *pool, int deviceId, uint16_t regOffset,
+                                                  uint16_t regValue, QObject *executor = NULL)
+{
+    return ModbusTransactionAwaiter(pool->transact(deviceId, MB_FUNC_WRITE_REGISTER, regOffset, 1,
+                                                   (const char *)&regValue),
+                                    (NULL == executor) ? pool : executor);
+}
+
+inline ModbusTransactionAwaiter modbusWriteMultiple(ModbusTCPPool *pool, int deviceId, uint16_t regOffset,
+                                                    const char *dataP, uint16_t regCnt, QObject *executor = NULL)
+{
+    return ModbusTransactionAwaiter(pool->transact(deviceId, MB_FUNC_WRITE_MULTIPLE_REGISTERS, regOffset, regCnt, dataP),
+                                    (NULL == executor) ? pool : executor);
+}
+
+/*
+ co_await gives the next frame of newDataReady(QByteArray), split by the
+ framer of the client, or an empty QByteArray on timeout or disconnect.
+ Frames received while no readFrame() is awaited are not buffered here,
+ send the request and co_await the response in the same flow step.
+*/
+class TCPClientFrameAwaiter
+{
+public:
+    TCPClientFrameAwaiter(TCPClient *client, int timeoutInMs, QObject *executor) :
+        client(client),
+        executor((NULL == executor) ? client : executor),
+        timeoutInMs(timeoutInMs)
+    {
+    }
+
+    TCPClientFrameAwaiter(const TCPClientFrameAwaiter &) = delete;
+    TCPClientFrameAwaiter &operator=(const TCPClientFrameAwaiter &) = delete;
+
+    bool await_ready() const
+    {
+        return (NULL == client || !client->getRunningStatus());
+    }
+
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        this->handle = handle;
+
+        // Slots run in the thread of executor
+        frameConnection = QObject::connect(client, static_cast<void (TCPClient::*)(QByteArray)>(&TCPClient::newDataReady),
+                                           executor, [this](QByteArray frame) { complete(frame); });
+        stateConnection = QObject::connect(client, &TCPClient::connectionChanged,
+                                           executor, [this](bool connected) { if(!connected) complete(QByteArray()); });
+
+        // Flow runs in the thread of executor, so does the timer
+        if(timeoutInMs >= 0)
+        {
+            timeoutTmr.setSingleShot(true);
+            timeoutConnection = QObject::connect(&timeoutTmr, &QTimer::timeout,
+                                                 executor, [this]() { complete(QByteArray()); });
+            timeoutTmr.start(timeoutInMs);
+        }
+    }
+
+    QByteArray await_resume() const
+    {
+        return frame;
+    }
+
+private:
+    TCPClient *client;
+    QObject *executor;
+    int timeoutInMs;
+
+    QMetaObject::Connection frameConnection;
+    QMetaObject::Connection stateConnection;
+    QMetaObject::Connection timeoutConnection;
+    QTimer timeoutTmr;
+
+    QByteArray frame;
+    std::coroutine_handle<> handle;
+
+    void complete(const QByteArray &data)
+    {
+        // Only the first of frame/disconnect/timeout counts
+        if(!frameConnection)
+        {
+            return;
+        }
+
+        QObject::disconnect(frameConnection);
+        QObject::disconnect(stateConnection);
+        QObject::disconnect(timeoutConnection);
+        frameConnection = QMetaObject::Connection();
+
+        timeoutTmr.stop();
+        frame = data;
+
+        modbusResumeLater(executor, handle);
+    }
+};
+
+/*-----------------------------------------------------------------------
+FUNCTION:       readFrame
+PURPOSE:        Awaitable next rx frame of client
+ARGUMENTS:      TCPClient *client       -- connected client
+                int timeoutInMs         -- < 0: no timeout
+                QObject *executor       -- thread the flow runs in, NULL: client
+RETURNS:        Awaiter, co_await gives the frame, empty on timeout/disconnect
+-----------------------------------------------------------------------*/
+inline TCPClientFrameAwaiter readFrame(TCPClient *client, int timeoutInMs = -1, QObject *executor = NULL)
+{
+    return TCPClientFrameAwaiter(client, timeoutInMs, executor);
+}
+
+// co_await modbusDelay(executor, ms), pause a flow without blocking the thread
+class ModbusDelayAwaiter
+{
+public:
+    ModbusDelayAwaiter(QObject *executor, int delayInMs) :
+        executor(executor),
+        delayInMs(delayInMs)
+    {
+    }
+
+    bool await_ready() const
+    {
+        return (NULL == executor);
+    }
+
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        QTimer::singleShot(delayInMs, executor, [handle]() { handle.resume(); });
+    }
+
+    void await_resume() const
+    {
+    }
+
+private:
+    QObject *executor;
+    int delayInMs;
+};
+
+inline ModbusDelayAwaiter modbusDelay(QObject *executor, int delayInMs)
+{
+    return ModbusDelayAwaiter(executor, delayInMs);
+}
+
+#endif // __cpp_impl_coroutine
+
+#endif // MODBUSCOROUTINE_H
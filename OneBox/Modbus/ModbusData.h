@@ -2,6 +2,7 @@
 #define MODBUS_DATA_STRUCT_H
 
 #include <stdint.h>
+#include <QByteArray>
 
 #define MODBUS_CRC_LENGTH 2
 
@@ -9,6 +10,12 @@
 #define MODBUS_RESPONSE_MSG_START_LEN_2 2
 #define MODBUS_RESPONSE_MSG_START_LEN_4 4
 
+#define MODBUS_MAX_READ_REG_CNT     125     /*! Registers of one FC03/FC04 request. */
+#define MODBUS_MAX_WRITE_REG_CNT    123     /*! Registers of one FC16 request. */
+#define MODBUS_MAX_PDU_LEN          253     /*! Function code + data. */
+#define MODBUS_FILE_REFERENCE_TYPE  6       /*! Reference type of FC20/FC21 sub-request. */
+#define MODBUS_MAX_FILE_RECORD_NO   9999    /*! Records of a file are 0 - 9999. */
+
 
 #define MB_ADDRESS_BROADCAST    ( 0 )   /*! Modbus broadcast address. */
 #define MB_ADDRESS_MIN          ( 1 )   /*! Smallest possible slave address. */
@@ -28,6 +35,8 @@
 #define MB_FUNC_DIAG_GET_COM_EVENT_CNT        ( 11 )
 #define MB_FUNC_DIAG_GET_COM_EVENT_LOG        ( 12 )
 #define MB_FUNC_OTHER_REPORT_SLAVEID          ( 17 )
+#define MB_FUNC_READ_FILE_RECORD              ( 20 )
+#define MB_FUNC_WRITE_FILE_RECORD             ( 21 )
 #define MB_FUNC_ERROR                         ( 128 )
 
 typedef enum
@@ -36,12 +45,49 @@ typedef enum
     MODBUS_RD_OPT = 1
 }MODBUS_RD_WR_OPT;
 
+// Request metadata queued with the Tx frame
+struct MODBUS_REQUEST_INFO
+{
+    uint16_t address;       // Reg address
+    uint16_t len;           // Reg count
+    uint16_t rdwrFlag;      // 0: write, 1: read
+};
+
+// Read response reported to host, copying it only adds a reference to buffer
 struct MODBUS_READ_FEEDBACK
 {
     uint16_t address;       // Reg address
-    uint16_t buffer[256];
-    uint16_t len;           // Reg count, len= (active size of buffer[])/2
+    uint16_t len;           // Reg count, len = buffer.size() / 2
     uint16_t rdwrFlag;      // 0: write, 1: read
+    QByteArray buffer;      // Registers as received, big endian, implicitly shared
+
+    MODBUS_READ_FEEDBACK() :
+        address(0),
+        len(0),
+        rdwrFlag(MODBUS_RD_OPT)
+    {
+    }
+};
+
+// Largest request a device accepts, many devices accept less than the standard
+struct MODBUS_BLOCK_SIZE
+{
+    uint16_t maxReadRegCnt;     // Registers of one FC03/FC04 request
+    uint16_t maxWriteRegCnt;    // Registers of one FC16 request
+
+    MODBUS_BLOCK_SIZE() :
+        maxReadRegCnt(MODBUS_MAX_READ_REG_CNT),
+        maxWriteRegCnt(MODBUS_MAX_WRITE_REG_CNT)
+    {
+    }
+};
+
+// Sub-request of FC20/FC21, a record is one register
+struct MODBUS_FILE_RECORD
+{
+    uint16_t fileNo;
+    uint16_t recordNo;          // First record, 0 - MODBUS_MAX_FILE_RECORD_NO
+    uint16_t recordLen;         // Count of records
 };
 
 typedef enum{
@@ -0,0 +1,465 @@
+/**********************************************************************
+PACKAGE:        Communication
+FILE:           ModbusFileTransfer.cpp
+COPYRIGHT (C):  All rights reserved.
+
+PURPOSE:        Bulk transfer of a local file by Modbus file records, FC20/FC21
+**********************************************************************/
+
+#include "ModbusFileTransfer.h"
+#include <QDebug>
+
+#include "ModbusPdu.h"
+#include "CRCUtility.h"
+
+// Last file number of the data
+#define MODBUS_MAX_FILE_NO      0xFFFF
+
+ModbusFileTransfer::ModbusFileTransfer(ModbusTCPPool *poolP, int deviceId, QObject *parent) :
+    QObject(parent),
+    poolP(poolP),
+    deviceId(deviceId),
+    running(false),
+    reading(false),
+    totalBytes(0),
+    issuedBytes(0),
+    doneBytes(0),
+    nextRecordIndex(0),
+    crc(0)
+{
+    setConfig(MODBUS_FILE_TRANSFER_CONFIG());
+}
+
+ModbusFileTransfer::~ModbusFileTransfer()
+{
+    stop();
+}
+
+void ModbusFileTransfer::setConfig(const struct MODBUS_FILE_TRANSFER_CONFIG &config)
+{
+    if(running)
+    {
+        return;
+    }
+
+    this->config = config;
+
+    if(0 == this->config.fileNo)
+    {
+        this->config.fileNo = 1;
+    }
+
+    if(0 == this->config.recordsPerFile || this->config.recordsPerFile > MODBUS_MAX_FILE_RECORD_NO + 1)
+    {
+        this->config.recordsPerFile = MODBUS_MAX_FILE_RECORD_NO + 1;
+    }
+
+    if(0 == this->config.maxRecordLen)
+    {
+        this->config.maxRecordLen = 1;
+    }
+
+    if(0 == this->config.maxOutstandingCnt)
+    {
+        this->config.maxOutstandingCnt = 1;
+    }
+}
+
+const struct MODBUS_FILE_TRANSFER_CONFIG &ModbusFileTransfer::getConfig() const
+{
+    return config;
+}
+
+bool ModbusFileTransfer::startRead(const QString &filePath, qint64 byteCnt)
+{
+    if(running)
+    {
+        errorString = "Transfer is running";
+        return false;
+    }
+
+    // Checked before the file is truncated
+    if(!checkRange(byteCnt))
+    {
+        return false;
+    }
+
+    reading = true;
+
+    return start(filePath, QIODevice::WriteOnly | QIODevice::Truncate, byteCnt);
+}
+
+bool ModbusFileTransfer::startWrite(const QString &filePath)
+{
+    if(running)
+    {
+        errorString = "Transfer is running";
+        return false;
+    }
+
+    reading = false;
+
+    return start(filePath, QIODevice::ReadOnly, 0);
+}
+
+void ModbusFileTransfer::abort()
+{
+    stop();
+}
+
+bool ModbusFileTransfer::isRunning() const
+{
+    return running;
+}
+
+uint32_t ModbusFileTransfer::getCrc() const
+{
+    return crc;
+}
+
+QString ModbusFileTransfer::getErrorString() const
+{
+    return errorString;
+}
+
+void ModbusFileTransfer::handleTransaction(ModbusTransaction transaction)
+{
+    int index = -1;
+
+    for(int i = 0; i < chunkList.size(); i++)
+    {
+        if(chunkList.at(i).transaction == transaction)
+        {
+            index = i;
+            break;
+        }
+    }
+
+    // Response of an aborted transfer
+    if(index < 0)
+    {
+        return;
+    }
+
+    struct CHUNK chunk = chunkList.takeAt(index);
+
+    if(!transaction.isOk())
+    {
+        fail(QString("Records at byte %1 failed, status %2, exception %3")
+             .arg(chunk.offset).arg(transaction.getStatus()).arg(transaction.getExceptionCode()));
+        return;
+    }
+
+    QByteArray response = transaction.getData();
+    ModbusPduView pdu(response.constData(), response.size());
+
+    if(reading)
+    {
+        // Records of chunk, the pad of an odd byte count included
+        QByteArray data((int)((chunk.byteCnt + 1) / 2 * 2), 0);
+
+        if(!ModbusPdu<MB_FUNC_READ_FILE_RECORD>::decodeResponse(pdu, chunk.recordList.constData(),
+                                                                chunk.recordList.size(), (uint8_t *)data.data()))
+        {
+            fail(QString("Invalid response of records at byte %1").arg(chunk.offset));
+            return;
+        }
+
+        data.truncate((int)chunk.byteCnt);
+        readDataMap.insert(chunk.offset, data);
+
+        if(!flushReadData())
+        {
+            fail(file.errorString());
+            return;
+        }
+    }
+    else
+    {
+        if(!ModbusPdu<MB_FUNC_WRITE_FILE_RECORD>::decodeResponse(pdu, (const uint8_t *)chunk.request.constData(),
+                                                                 chunk.request.size()))
+        {
+            fail(QString("Invalid response of records at byte %1").arg(chunk.offset));
+            return;
+        }
+
+        doneBytes += chunk.byteCnt;
+
+        // Emit signal
+        emit progress(doneBytes, totalBytes);
+    }
+
+    // Aborted by a slot of progress()
+    if(!running)
+    {
+        return;
+    }
+
+    if(doneBytes >= totalBytes)
+    {
+        complete();
+        return;
+    }
+
+    issueChunks();
+}
+
+bool ModbusFileTransfer::start(const QString &filePath, QIODevice::OpenMode mode, qint64 byteCnt)
+{
+    if(poolP.isNull())
+    {
+        errorString = "Transport is gone";
+        return false;
+    }
+
+    file.setFileName(filePath);
+
+    if(!file.open(mode))
+    {
+        errorString = file.errorString();
+        return false;
+    }
+
+    if(!reading)
+    {
+        byteCnt = file.size();
+
+        if(!checkRange(byteCnt))
+        {
+            file.close();
+            return false;
+        }
+    }
+
+    running = true;
+    totalBytes = byteCnt;
+    issuedBytes = 0;
+    doneBytes = 0;
+    nextRecordIndex = 0;
+    crc = 0;
+    errorString.clear();
+
+    issueChunks();
+
+    // Failed at once, e.g. transport queue full
+    return running;
+}
+
+bool ModbusFileTransfer::checkRange(qint64 byteCnt)
+{
+    if(byteCnt <= 0)
+    {
+        errorString = "No data to transfer";
+        return false;
+    }
+
+    if(config.recordNo >= config.recordsPerFile)
+    {
+        errorString = "First record beyond the end of file";
+        return false;
+    }
+
+    uint64_t recordCnt = ((uint64_t)byteCnt + 1) / 2;
+    uint64_t lastFileNo = config.fileNo + (config.recordNo + recordCnt - 1) / config.recordsPerFile;
+
+    if(lastFileNo > MODBUS_MAX_FILE_NO)
+    {
+        errorString = "Data exceeds the last file";
+        return false;
+    }
+
+    return true;
+}
+
+void ModbusFileTransfer::issueChunks()
+{
+    // Read data waiting for the data before counts as outstanding, buffer stays bounded
+    while(running && issuedBytes < totalBytes &&
+          (uint32_t)(chunkList.size() + readDataMap.size()) < config.maxOutstandingCnt)
+    {
+        if(poolP.isNull())
+        {
+            fail("Transport is gone");
+            return;
+        }
+
+        struct CHUNK chunk;
+
+        if(!buildChunk(chunk))
+        {
+            fail(file.errorString());
+            return;
+        }
+
+        chunk.transaction = poolP->transactPdu(deviceId, chunk.request);
+        chunkList.append(chunk);
+
+        // Always queued, also if rejected at once
+        chunk.transaction.onFinished(this, SLOT(handleTransaction(ModbusTransaction)));
+    }
+}
+
+bool ModbusFileTransfer::buildChunk(struct CHUNK &chunk)
+{
+    uint64_t totalRecordCnt = ((uint64_t)totalBytes + 1) / 2;
+
+    // Response data length of read (0xF5), request of write limits the sub-requests
+    uint32_t maxPduLen = reading ? (uint32_t)(ModbusPdu<MB_FUNC_READ_FILE_RECORD>::RESPONSE_HEADER_LEN +
+                                              ModbusPdu<MB_FUNC_READ_FILE_RECORD>::MAX_RESPONSE_BYTE_CNT) :
+                                   (uint32_t)(ModbusPdu<MB_FUNC_WRITE_FILE_RECORD>::REQUEST_HEADER_LEN +
+                                              ModbusPdu<MB_FUNC_WRITE_FILE_RECORD>::MAX_REQUEST_BYTE_CNT);
+    uint32_t pduLen = reading ? (uint32_t)ModbusPdu<MB_FUNC_READ_FILE_RECORD>::RESPONSE_HEADER_LEN :
+                                (uint32_t)ModbusPdu<MB_FUNC_WRITE_FILE_RECORD>::REQUEST_HEADER_LEN;
+    uint32_t subHeaderLen = reading ? (uint32_t)ModbusPdu<MB_FUNC_READ_FILE_RECORD>::SUB_RESPONSE_HEADER_LEN :
+                                      (uint32_t)ModbusPdu<MB_FUNC_WRITE_FILE_RECORD>::SUB_REQUEST_HEADER_LEN;
+
+    chunk.offset = issuedBytes;
+    chunk.recordList.clear();
+
+    while(nextRecordIndex < totalRecordCnt && pduLen + subHeaderLen + sizeof(uint16_t) <= maxPduLen)
+    {
+        // Sub-requests of read are limited by the byte count of request as well
+        if(reading && chunk.recordList.size() >= ModbusPdu<MB_FUNC_READ_FILE_RECORD>::MAX_SUB_REQUEST_CNT)
+        {
+            break;
+        }
+
+        uint64_t recordNo = config.recordNo + nextRecordIndex;
+        uint64_t recordLen = (maxPduLen - pduLen - subHeaderLen) / sizeof(uint16_t);
+        struct MODBUS_FILE_RECORD record;
+
+        record.fileNo = (uint16_t)(config.fileNo + recordNo / config.recordsPerFile);
+        record.recordNo = (uint16_t)(recordNo % config.recordsPerFile);
+
+        if(recordLen > config.maxRecordLen)
+        {
+            recordLen = config.maxRecordLen;
+        }
+
+        // Never across the end of file
+        if(recordLen > config.recordsPerFile - record.recordNo)
+        {
+            recordLen = config.recordsPerFile - record.recordNo;
+        }
+
+        if(recordLen > totalRecordCnt - nextRecordIndex)
+        {
+            recordLen = totalRecordCnt - nextRecordIndex;
+        }
+
+        record.recordLen = (uint16_t)recordLen;
+        chunk.recordList.append(record);
+
+        pduLen += subHeaderLen + record.recordLen * sizeof(uint16_t);
+        nextRecordIndex += record.recordLen;
+    }
+
+    // Pad of an odd byte count is not data
+    qint64 endBytes = (qint64)(nextRecordIndex * sizeof(uint16_t));
+
+    if(endBytes > totalBytes)
+    {
+        endBytes = totalBytes;
+    }
+
+    chunk.byteCnt = endBytes - chunk.offset;
+    issuedBytes = endBytes;
+
+    uint8_t pduBuf[MODBUS_MAX_PDU_LEN];
+    uint32_t len = 0;
+
+    if(reading)
+    {
+        len = ModbusPdu<MB_FUNC_READ_FILE_RECORD>::encodeRequest(pduBuf, chunk.recordList.constData(),
+                                                                 chunk.recordList.size());
+    }
+    else
+    {
+        // Chunks are built in file order, CRC follows the file
+        QByteArray data = file.read(chunk.byteCnt);
+
+        if(data.size() != chunk.byteCnt)
+        {
+            return false;
+        }
+
+        crc = CRCUtility::instance()->crc32(crc, (const uint8_t *)data.constData(), data.size());
+
+        if(0 != data.size() % 2)
+        {
+            data.append('\0');
+        }
+
+        len = ModbusPdu<MB_FUNC_WRITE_FILE_RECORD>::encodeRequest(pduBuf, chunk.recordList.constData(),
+                                                                  chunk.recordList.size(),
+                                                                  (const uint8_t *)data.constData());
+    }
+
+    chunk.request = QByteArray((const char *)pduBuf, len);
+
+    return true;
+}
+
+bool ModbusFileTransfer::flushReadData()
+{
+    while(running && !readDataMap.isEmpty() && readDataMap.begin().key() == doneBytes)
+    {
+        QByteArray data = readDataMap.take(doneBytes);
+
+        if(file.write(data) != data.size())
+        {
+            return false;
+        }
+
+        crc = CRCUtility::instance()->crc32(crc, (const uint8_t *)data.constData(), data.size());
+        doneBytes += data.size();
+
+        // Emit signal
+        emit progress(doneBytes, totalBytes);
+    }
+
+    return true;
+}
+
+void ModbusFileTransfer::complete()
+{
+    stop();
+
+    if(config.checkCrc && crc != config.expectedCrc)
+    {
+        errorString = QString("CRC mismatch, 0x%1 instead of 0x%2")
+                      .arg(crc, 8, 16, QChar('0')).arg(config.expectedCrc, 8, 16, QChar('0'));
+
+        // Emit signal
+        emit finished(false, crc);
+        return;
+    }
+
+    // Emit signal
+    emit finished(true, crc);
+}
+
+void ModbusFileTransfer::fail(const QString &error)
+{
+#ifdef MODBUS_FILE_TRANSFER_DEBUG_TRACE
+    qDebug() << "ModbusFileTransfer::fail()" << error << "done" << doneBytes << "of" << totalBytes;
+#endif
+
+    errorString = error;
+    stop();
+
+    // Emit signal
+    emit finished(false, crc);
+}
+
+void ModbusFileTransfer::stop()
+{
+    running = false;
+    chunkList.clear();
+    readDataMap.clear();
+
+    if(file.isOpen())
+    {
+        file.close();
+    }
+}
@@ -0,0 +1,178 @@
+/**********************************************************************
+PACKAGE:        Communication
+FILE:           ModbusFileTransfer.h
+COPYRIGHT (C):  All rights reserved.
+
+PURPOSE:        Bulk transfer of a local file by Modbus file records, FC20/FC21
+**********************************************************************/
+
+#ifndef MODBUSFILETRANSFER_H
+#define MODBUSFILETRANSFER_H
+
+#include <stdint.h>
+#include <QObject>
+#include <QPointer>
+#include <QFile>
+#include <QList>
+#include <QMap>
+#include <QVector>
+#include <QByteArray>
+#include <QString>
+
+#include "ModbusData.h"
+#include "ModbusTransaction.h"
+#include "ModbusTCPPool.h"
+
+struct MODBUS_FILE_TRANSFER_CONFIG
+{
+    uint16_t fileNo;            // File of the first record, 1 at least
+    uint16_t recordNo;          // First record in that file
+    uint32_t recordsPerFile;    // Records of each device file, data continues at record 0 of the next file
+    uint16_t maxRecordLen;      // Records of a sub-request, smaller if the PDU is full, 121 fills a read
+    uint32_t maxOutstandingCnt; // Requests in flight, set connectionCnt of the pool device alike
+    bool checkCrc;              // Compare CRC-32 of all data with expectedCrc once done
+    uint32_t expectedCrc;
+
+    MODBUS_FILE_TRANSFER_CONFIG() :
+        fileNo(1),
+        recordNo(0),
+        recordsPerFile(MODBUS_MAX_FILE_RECORD_NO + 1),
+        maxRecordLen(121),
+        maxOutstandingCnt(4),
+        checkCrc(false),
+        expectedCrc(0)
+    {
+    }
+};
+
+/*
+ Reads device file records into a local file or writes a local file to
+ them. The data is a byte stream over consecutive records, 2 bytes per
+ record, big endian as on the wire, starting at recordNo of fileNo.
+
+ Every request packs as many sub-requests as the standard takes, a
+ read 2 + n * (2 + 2 * len) bytes of response, its data length at most
+ 0xF5, a write 2 + n * (7 + 2 * len) bytes of request within the PDU of
+ 253 bytes. A sub-request never crosses the end of a device file.
+
+ Up to maxOutstandingCnt requests are queued on ModbusTCPPool at once,
+ the pool sends them on the parallel connections of the device, so the
+ round trips overlap. Responses may arrive in any order, a read keeps
+ them until the data before is complete and writes the local file
+ strictly in order, at most maxOutstandingCnt requests of data are
+ buffered whatever the size of the file.
+
+ CRC-32 (as zlib) of the data is updated in file order as it is written
+ to disk or read from it, with checkCrc the transfer fails on mismatch.
+ An odd byte count pads the last record with 0 on write, the pad is
+ neither read back nor part of the CRC.
+
+ Any exception, timeout or malformed response stops the transfer, a
+ partly read file is kept up to the data completed in order.
+*/
+class ModbusFileTransfer : public QObject
+{
+    Q_OBJECT
+public:
+    ModbusFileTransfer(ModbusTCPPool *poolP, int deviceId, QObject *parent = 0);
+    virtual ~ModbusFileTransfer();
+
+    // Ignored while running
+    void setConfig(const struct MODBUS_FILE_TRANSFER_CONFIG &config);
+    const struct MODBUS_FILE_TRANSFER_CONFIG &getConfig() const;
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:       startRead
+    PURPOSE:        Read records of device into a local file, FC20
+    ARGUMENTS:      const QString &filePath -- local file, truncated
+                    qint64 byteCnt          -- bytes to read from the records
+    RETURNS:        true - started, false - running already, invalid
+                    argument or file not opened, see getErrorString()
+    -----------------------------------------------------------------------*/
+    bool startRead(const QString &filePath, qint64 byteCnt);
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:       startWrite
+    PURPOSE:        Write a local file to records of device, FC21
+    ARGUMENTS:      const QString &filePath -- local file, not empty
+    RETURNS:        true - started, false - running already, invalid
+                    argument or file not opened, see getErrorString()
+    -----------------------------------------------------------------------*/
+    bool startWrite(const QString &filePath);
+
+    // Stop the transfer, finished() is not emitted, responses in flight are ignored
+    void abort();
+
+    bool isRunning() const;
+
+    // CRC-32 of the data transferred in order so far
+    uint32_t getCrc() const;
+
+    // Reason of the last failure
+    QString getErrorString() const;
+
+signals:
+    // Bytes done in order on read, acknowledged on write
+    void progress(qint64 doneBytes, qint64 totalBytes);
+
+    void finished(bool ok, uint32_t crc);
+
+private slots:
+    void handleTransaction(ModbusTransaction transaction);
+
+private:
+    // One request in flight
+    struct CHUNK
+    {
+        qint64 offset;                          // Byte offset of its data
+        qint64 byteCnt;                         // Bytes of data, pad excluded
+        QVector<struct MODBUS_FILE_RECORD> recordList;
+        QByteArray request;                     // Request PDU, the echo of write
+        ModbusTransaction transaction;
+    };
+
+    QPointer<ModbusTCPPool> poolP;
+    int deviceId;
+
+    struct MODBUS_FILE_TRANSFER_CONFIG config;
+
+    QFile file;
+    bool running;
+    bool reading;               // True: FC20, false: FC21
+
+    qint64 totalBytes;
+    qint64 issuedBytes;         // Bytes of all chunks issued
+    qint64 doneBytes;
+    uint64_t nextRecordIndex;   // Record of the next chunk from the first record
+
+    QList<struct CHUNK> chunkList;          // Outstanding, in order of issue
+    QMap<qint64, QByteArray> readDataMap;   // Read data by offset, waiting for the data before
+
+    uint32_t crc;
+    QString errorString;
+
+    // Check config and byte count, open the file
+    bool start(const QString &filePath, QIODevice::OpenMode mode, qint64 byteCnt);
+
+    // False if the records of byteCnt end beyond file 0xFFFF
+    bool checkRange(qint64 byteCnt);
+
+    // Queue chunks up to maxOutstandingCnt
+    void issueChunks();
+
+    // Sub-requests of the next chunk, packed into one PDU, false: file error
+    bool buildChunk(struct CHUNK &chunk);
+
+    // Write read data in order to the file, false: file error
+    bool flushReadData();
+
+    // Verify CRC once all is done
+    void complete();
+
+    void fail(const QString &error);
+
+    // Close file and forget chunks
+    void stop();
+};
+
+#endif // MODBUSFILETRANSFER_H
@@ -0,0 +1,698 @@
+/**********************************************************************
+PACKAGE:        Communication
+FILE:           ModbusPdu.h
+COPYRIGHT (C):  All rights reserved.
+
+PURPOSE:        Modbus PDU codec and ADU framing shared by all transports
+**********************************************************************/
+
+#ifndef MODBUSPDU_H
+#define MODBUSPDU_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include "ModbusData.h"
+#include "CRCUtility.h"
+
+/*
+ Requests are encoded in place, straight into the buffer the transport
+ queues or sends, without zero fill or intermediate copy,
+
+    uint8_t *aduP = (uint8_t *)fifoBuf->getPushBuffer();
+    uint32_t pduLen = ModbusPdu<MB_FUNC_READ_HOLDING_REGISTER>::encodeRequest(
+                          ModbusTcpFrame::getPdu(aduP), regOffset, regCnt);
+    fifoBuf->commitData(ModbusTcpFrame::encode(aduP, pduLen, transactionId, unitId));
+
+ Field layout of each function code is given by the enum constants of
+ ModbusPdu<FC>, buffer capacity is checked against them at compile time
+ with MODBUS_STATIC_ASSERT. Responses are decoded through ModbusPduView,
+ which returns 0/NULL rather than read past the received frame.
+
+ A new function code only needs a ModbusPdu<FC> specialization, every
+ transport framing (ModbusTcpFrame, ModbusRtuFrame, ModbusAsciiFrame) can carry it.
+*/
+
+// Compile time check, C++98 has no static_assert, division by zero fails to compile
+#define MODBUS_STATIC_ASSERT(cond, name) enum { modbus_static_assert_##name = 1 / (int)(!!(cond)) }
+
+// Big endian 16-bit field
+inline void modbusPutUint16(uint8_t *dataP, uint16_t value)
+{
+    dataP[0] = (uint8_t)(value >> 8);
+    dataP[1] = (uint8_t)(value & 0x00ff);
+}
+
+inline uint16_t modbusGetUint16(const uint8_t *dataP)
+{
+    return (uint16_t)(((uint16_t)dataP[0] << 8) | dataP[1]);
+}
+
+/*
+ Bounds-checked read only view of a received PDU, function code first.
+ The frame must outlive the view.
+*/
+class ModbusPduView
+{
+public:
+    ModbusPduView(const void *pduP = NULL, uint32_t len = 0) :
+        m_dataP((const uint8_t *)pduP),
+        m_len((NULL == pduP) ? 0 : len)
+    {
+    }
+
+    // Length of PDU, 0 if the frame is malformed
+    uint32_t getLen() const
+    {
+        return m_len;
+    }
+
+    // True: len bytes from offset are inside the PDU
+    bool contains(uint32_t offset, uint32_t len) const
+    {
+        return (offset <= m_len && len <= m_len - offset);
+    }
+
+    // Field at offset, 0 if out of range
+    uint8_t getUint8(uint32_t offset) const
+    {
+        return contains(offset, 1) ? m_dataP[offset] : 0;
+    }
+
+    uint16_t getUint16(uint32_t offset) const
+    {
+        return contains(offset, 2) ? modbusGetUint16(m_dataP + offset) : 0;
+    }
+
+    // len bytes from offset, NULL if out of range
+    const uint8_t *getData(uint32_t offset, uint32_t len) const
+    {
+        return contains(offset, len) ? (m_dataP + offset) : NULL;
+    }
+
+    // Function code of request, exception bit cleared
+    uint8_t getFunctionCode() const
+    {
+        return (uint8_t)(getUint8(0) & ~MB_FUNC_ERROR);
+    }
+
+    // True: exception response, see getExceptionCode()
+    bool isException() const
+    {
+        return contains(0, 2) && 0 != (m_dataP[0] & MB_FUNC_ERROR);
+    }
+
+    uint8_t getExceptionCode() const
+    {
+        return isException() ? m_dataP[1] : 0;
+    }
+
+private:
+    const uint8_t *m_dataP;
+    uint32_t m_len;
+};
+
+/*
+ Codec of one function code, only the specializations below exist.
+ encodeRequest() writes the whole request PDU and returns its length,
+ the caller checks the arguments and the buffer capacity.
+*/
+template<uint8_t FC>
+class ModbusPdu;
+
+// FC03/FC04: read registers
+template<uint8_t FC>
+class ModbusReadRegistersPdu
+{
+public:
+    enum
+    {
+        FUNCTION_CODE = FC,
+        REQUEST_LEN = 5,            // Function code + address + count
+        RESPONSE_HEADER_LEN = 2,    // Function code + byte count
+        MAX_RESPONSE_LEN = RESPONSE_HEADER_LEN + MODBUS_MAX_READ_REG_CNT * 2
+    };
+
+    static uint32_t encodeRequest(uint8_t *pduP, uint16_t regOffset, uint16_t regCnt)
+    {
+        pduP[0] = FC;
+        modbusPutUint16(pduP + 1, regOffset);
+        modbusPutUint16(pduP + 3, regCnt);
+
+        return REQUEST_LEN;
+    }
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		decodeResponse
+    PURPOSE:		Find the registers of a read response
+    ARGUMENTS:		const ModbusPduView &pdu    -- response PDU
+                    uint16_t &regCnt            -- count of registers in response
+    RETURNS:		Registers as received, big endian, NULL if malformed
+    -----------------------------------------------------------------------*/
+    static const uint8_t *decodeResponse(const ModbusPduView &pdu, uint16_t &regCnt)
+    {
+        uint8_t byteCnt = pdu.getUint8(1);
+        const uint8_t *regP = pdu.getData(RESPONSE_HEADER_LEN, byteCnt);
+
+        regCnt = 0;
+
+        if(FC != pdu.getUint8(0) || NULL == regP || 0 != (byteCnt % 2))
+        {
+            return NULL;
+        }
+
+        regCnt = byteCnt / 2;
+
+        return regP;
+    }
+};
+
+template<>
+class ModbusPdu<MB_FUNC_READ_HOLDING_REGISTER> : public ModbusReadRegistersPdu<MB_FUNC_READ_HOLDING_REGISTER>
+{
+};
+
+template<>
+class ModbusPdu<MB_FUNC_READ_INPUT_REGISTER> : public ModbusReadRegistersPdu<MB_FUNC_READ_INPUT_REGISTER>
+{
+};
+
+// FC06: write single register, the response echoes the request
+template<>
+class ModbusPdu<MB_FUNC_WRITE_REGISTER>
+{
+public:
+    enum
+    {
+        FUNCTION_CODE = MB_FUNC_WRITE_REGISTER,
+        REQUEST_LEN = 5,            // Function code + address + value
+        RESPONSE_LEN = 5
+    };
+
+    static uint32_t encodeRequest(uint8_t *pduP, uint16_t regOffset, uint16_t regValue)
+    {
+        pduP[0] = FUNCTION_CODE;
+        modbusPutUint16(pduP + 1, regOffset);
+        modbusPutUint16(pduP + 3, regValue);
+
+        return REQUEST_LEN;
+    }
+
+    // False if malformed
+    static bool decodeResponse(const ModbusPduView &pdu, uint16_t &regOffset, uint16_t &regValue)
+    {
+        if(FUNCTION_CODE != pdu.getUint8(0) || !pdu.contains(0, RESPONSE_LEN))
+        {
+            return false;
+        }
+
+        regOffset = pdu.getUint16(1);
+        regValue = pdu.getUint16(3);
+
+        return true;
+    }
+};
+
+// FC16: write multiple registers
+template<>
+class ModbusPdu<MB_FUNC_WRITE_MULTIPLE_REGISTERS>
+{
+public:
+    enum
+    {
+        FUNCTION_CODE = MB_FUNC_WRITE_MULTIPLE_REGISTERS,
+        REQUEST_HEADER_LEN = 6,     // Function code + address + count + byte count
+        MAX_REQUEST_LEN = REQUEST_HEADER_LEN + MODBUS_MAX_WRITE_REG_CNT * 2,
+        RESPONSE_LEN = 5            // Function code + address + count
+    };
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		encodeRequest
+    PURPOSE:		Encode write multiple registers request
+    ARGUMENTS:		uint8_t *pduP           -- output, MAX_REQUEST_LEN bytes at least
+                    uint16_t regOffset      -- register offset address
+                    const void *valueP      -- regCnt values in host byte order, may be unaligned
+                    uint16_t regCnt         -- count of registers, MODBUS_MAX_WRITE_REG_CNT at most
+    RETURNS:		Length of PDU
+    -----------------------------------------------------------------------*/
+    static uint32_t encodeRequest(uint8_t *pduP, uint16_t regOffset, const void *valueP, uint16_t regCnt)
+    {
+        const uint8_t *srcP = (const uint8_t *)valueP;
+        uint8_t *dstP = pduP + REQUEST_HEADER_LEN;
+
+        pduP[0] = FUNCTION_CODE;
+        modbusPutUint16(pduP + 1, regOffset);
+        modbusPutUint16(pduP + 3, regCnt);
+        pduP[5] = (uint8_t)(regCnt * sizeof(uint16_t));
+
+        for(uint32_t i = 0; i < regCnt; i++)
+        {
+            uint16_t value;
+            memcpy(&value, srcP + i * sizeof(uint16_t), sizeof(uint16_t));
+
+            modbusPutUint16(dstP + i * sizeof(uint16_t), value);
+        }
+
+        return REQUEST_HEADER_LEN + regCnt * sizeof(uint16_t);
+    }
+
+    // False if malformed
+    static bool decodeResponse(const ModbusPduView &pdu, uint16_t &regOffset, uint16_t &regCnt)
+    {
+        if(FUNCTION_CODE != pdu.getUint8(0) || !pdu.contains(0, RESPONSE_LEN))
+        {
+            return false;
+        }
+
+        regOffset = pdu.getUint16(1);
+        regCnt = pdu.getUint16(3);
+
+        return true;
+    }
+};
+
+// FC20: read file record, sub-requests of one or more files
+template<>
+class ModbusPdu<MB_FUNC_READ_FILE_RECORD>
+{
+public:
+    enum
+    {
+        FUNCTION_CODE = MB_FUNC_READ_FILE_RECORD,
+        REQUEST_HEADER_LEN = 2,         // Function code + byte count
+        SUB_REQUEST_LEN = 7,            // Reference type + file + record + length
+        MAX_REQUEST_BYTE_CNT = 0xF5,
+        RESPONSE_HEADER_LEN = 2,        // Function code + response data length
+        SUB_RESPONSE_HEADER_LEN = 2,    // File response length + reference type
+        MAX_RESPONSE_BYTE_CNT = 0xF5,   // Response data length of the standard, below the PDU limit
+        MAX_SUB_REQUEST_CNT = MAX_REQUEST_BYTE_CNT / SUB_REQUEST_LEN
+    };
+
+    // Length of request and response PDU of the sub-requests
+    static uint32_t getRequestLen(uint32_t recordCnt)
+    {
+        return REQUEST_HEADER_LEN + recordCnt * SUB_REQUEST_LEN;
+    }
+
+    static uint32_t getResponseLen(const struct MODBUS_FILE_RECORD *recordP, uint32_t recordCnt)
+    {
+        uint32_t len = RESPONSE_HEADER_LEN;
+
+        for(uint32_t i = 0; i < recordCnt; i++)
+        {
+            len += SUB_RESPONSE_HEADER_LEN + recordP[i].recordLen * sizeof(uint16_t);
+        }
+
+        return len;
+    }
+
+    // Caller keeps request and response data within MAX_REQUEST_BYTE_CNT/MAX_RESPONSE_BYTE_CNT
+    static uint32_t encodeRequest(uint8_t *pduP, const struct MODBUS_FILE_RECORD *recordP, uint32_t recordCnt)
+    {
+        uint8_t *subP = pduP + REQUEST_HEADER_LEN;
+
+        pduP[0] = FUNCTION_CODE;
+        pduP[1] = (uint8_t)(recordCnt * SUB_REQUEST_LEN);
+
+        for(uint32_t i = 0; i < recordCnt; i++)
+        {
+            subP[0] = MODBUS_FILE_REFERENCE_TYPE;
+            modbusPutUint16(subP + 1, recordP[i].fileNo);
+            modbusPutUint16(subP + 3, recordP[i].recordNo);
+            modbusPutUint16(subP + 5, recordP[i].recordLen);
+            subP += SUB_REQUEST_LEN;
+        }
+
+        return getRequestLen(recordCnt);
+    }
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		decodeResponse
+    PURPOSE:		Copy the records of each sub-response in request order
+    ARGUMENTS:		const ModbusPduView &pdu    -- response PDU
+                    const struct MODBUS_FILE_RECORD *recordP -- sub-requests of request
+                    uint32_t recordCnt          -- count of sub-requests
+                    uint8_t *dataP              -- output, records as received, big endian
+    RETURNS:		false if malformed or a sub-response does not match its request
+    -----------------------------------------------------------------------*/
+    static bool decodeResponse(const ModbusPduView &pdu, const struct MODBUS_FILE_RECORD *recordP,
+                               uint32_t recordCnt, uint8_t *dataP)
+    {
+        uint32_t offset = RESPONSE_HEADER_LEN;
+        uint32_t endOffset = RESPONSE_HEADER_LEN + pdu.getUint8(1);
+
+        if(FUNCTION_CODE != pdu.getUint8(0) || !pdu.contains(0, endOffset))
+        {
+            return false;
+        }
+
+        for(uint32_t i = 0; i < recordCnt; i++)
+        {
+            uint32_t dataLen = recordP[i].recordLen * sizeof(uint16_t);
+            const uint8_t *subP = pdu.getData(offset, SUB_RESPONSE_HEADER_LEN + dataLen);
+
+            // File response length counts reference type + data
+            if(NULL == subP || (uint32_t)subP[0] != dataLen + 1 || MODBUS_FILE_REFERENCE_TYPE != subP[1])
+            {
+                return false;
+            }
+
+            memcpy(dataP, subP + SUB_RESPONSE_HEADER_LEN, dataLen);
+            dataP += dataLen;
+            offset += SUB_RESPONSE_HEADER_LEN + dataLen;
+        }
+
+        return (offset == endOffset);
+    }
+};
+
+// FC21: write file record, the response echoes the request
+template<>
+class ModbusPdu<MB_FUNC_WRITE_FILE_RECORD>
+{
+public:
+    enum
+    {
+        FUNCTION_CODE = MB_FUNC_WRITE_FILE_RECORD,
+        REQUEST_HEADER_LEN = 2,         // Function code + request data length
+        SUB_REQUEST_HEADER_LEN = 7,     // Reference type + file + record + length
+        MAX_REQUEST_BYTE_CNT = 0xFB
+    };
+
+    static uint32_t getRequestLen(const struct MODBUS_FILE_RECORD *recordP, uint32_t recordCnt)
+    {
+        uint32_t len = REQUEST_HEADER_LEN;
+
+        for(uint32_t i = 0; i < recordCnt; i++)
+        {
+            len += SUB_REQUEST_HEADER_LEN + recordP[i].recordLen * sizeof(uint16_t);
+        }
+
+        return len;
+    }
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		encodeRequest
+    PURPOSE:		Encode write file record request
+    ARGUMENTS:		uint8_t *pduP           -- output, MODBUS_MAX_PDU_LEN bytes at least
+                    const struct MODBUS_FILE_RECORD *recordP -- sub-requests
+                    uint32_t recordCnt      -- count of sub-requests, request fits PDU
+                    const uint8_t *dataP    -- records of all sub-requests in order, big endian
+    RETURNS:		Length of PDU
+    -----------------------------------------------------------------------*/
+    static uint32_t encodeRequest(uint8_t *pduP, const struct MODBUS_FILE_RECORD *recordP, uint32_t recordCnt,
+                                  const uint8_t *dataP)
+    {
+        uint8_t *subP = pduP + REQUEST_HEADER_LEN;
+
+        pduP[0] = FUNCTION_CODE;
+
+        for(uint32_t i = 0; i < recordCnt; i++)
+        {
+            uint32_t dataLen = recordP[i].recordLen * sizeof(uint16_t);
+
+            subP[0] = MODBUS_FILE_REFERENCE_TYPE;
+            modbusPutUint16(subP + 1, recordP[i].fileNo);
+            modbusPutUint16(subP + 3, recordP[i].recordNo);
+            modbusPutUint16(subP + 5, recordP[i].recordLen);
+            memcpy(subP + SUB_REQUEST_HEADER_LEN, dataP, dataLen);
+
+            subP += SUB_REQUEST_HEADER_LEN + dataLen;
+            dataP += dataLen;
+        }
+
+        pduP[1] = (uint8_t)(subP - pduP - REQUEST_HEADER_LEN);
+
+        return subP - pduP;
+    }
+
+    // False if the response is not the echo of request
+    static bool decodeResponse(const ModbusPduView &pdu, const uint8_t *requestP, uint32_t requestLen)
+    {
+        const uint8_t *responseP = pdu.getData(0, requestLen);
+
+        return (NULL != responseP && pdu.getLen() == requestLen && 0 == memcmp(responseP, requestP, requestLen));
+    }
+};
+
+MODBUS_STATIC_ASSERT((int)ModbusPdu<MB_FUNC_READ_FILE_RECORD>::MAX_REQUEST_BYTE_CNT + 2 <= MODBUS_MAX_PDU_LEN, read_file_request_fits_pdu);
+MODBUS_STATIC_ASSERT((int)ModbusPdu<MB_FUNC_READ_FILE_RECORD>::MAX_RESPONSE_BYTE_CNT + 2 <= MODBUS_MAX_PDU_LEN, read_file_response_fits_pdu);
+MODBUS_STATIC_ASSERT((int)ModbusPdu<MB_FUNC_WRITE_FILE_RECORD>::MAX_REQUEST_BYTE_CNT + 2 <= MODBUS_MAX_PDU_LEN, write_file_request_fits_pdu);
+MODBUS_STATIC_ASSERT((int)ModbusPdu<MB_FUNC_WRITE_MULTIPLE_REGISTERS>::MAX_REQUEST_LEN <= MODBUS_MAX_PDU_LEN, write_request_fits_pdu);
+MODBUS_STATIC_ASSERT((int)ModbusPdu<MB_FUNC_READ_HOLDING_REGISTER>::MAX_RESPONSE_LEN <= MODBUS_MAX_PDU_LEN, read_response_fits_pdu);
+
+/*
+ Modbus TCP ADU: MBAP header + PDU
+
+ | transaction ID(2) | protocol ID(2) | length(2) | unit ID(1) | PDU |
+
+ length counts unit ID + PDU.
+*/
+class ModbusTcpFrame
+{
+public:
+    enum
+    {
+        HEADER_LEN = 7,
+        TRAILER_LEN = 0,
+        MAX_ADU_LEN = HEADER_LEN + MODBUS_MAX_PDU_LEN + TRAILER_LEN
+    };
+
+    // Where the PDU of a request is encoded
+    static uint8_t *getPdu(uint8_t *aduP)
+    {
+        return aduP + HEADER_LEN;
+    }
+
+    // Fill header in front of the encoded PDU, return length of ADU
+    static uint32_t encode(uint8_t *aduP, uint32_t pduLen, uint16_t transactionId, uint8_t unitId, uint16_t protocolId = 0)
+    {
+        modbusPutUint16(aduP, transactionId);
+        modbusPutUint16(aduP + 2, protocolId);
+        modbusPutUint16(aduP + 4, (uint16_t)(pduLen + 1));
+        aduP[6] = unitId;
+
+        return HEADER_LEN + pduLen;
+    }
+
+    // Refresh length after the PDU of a queued ADU is rewritten, header fields are kept
+    static uint32_t reframe(uint8_t *aduP, uint32_t pduLen)
+    {
+        return encode(aduP, pduLen, modbusGetUint16(aduP), aduP[6], modbusGetUint16(aduP + 2));
+    }
+
+    // PDU of a received ADU, empty view if header is malformed
+    static ModbusPduView decode(const void *aduP, uint32_t len)
+    {
+        const uint8_t *dataP = (const uint8_t *)aduP;
+
+        if(NULL == aduP || len <= HEADER_LEN)
+        {
+            return ModbusPduView();
+        }
+
+        // Never trust length field beyond the received bytes
+        uint32_t pduLen = modbusGetUint16(dataP + 4);
+        if(0 == pduLen || pduLen - 1 > len - HEADER_LEN)
+        {
+            return ModbusPduView();
+        }
+
+        return ModbusPduView(dataP + HEADER_LEN, pduLen - 1);
+    }
+
+    // Transaction ID of a received ADU, 0 if too short
+    static uint16_t getTransactionId(const void *aduP, uint32_t len)
+    {
+        return (NULL == aduP || len < 2) ? 0 : modbusGetUint16((const uint8_t *)aduP);
+    }
+};
+
+/*
+ Modbus RTU ADU: slave address + PDU + CRC16, CRC is little endian
+*/
+class ModbusRtuFrame
+{
+public:
+    enum
+    {
+        HEADER_LEN = 1,
+        TRAILER_LEN = MODBUS_CRC_LENGTH,
+        MAX_ADU_LEN = HEADER_LEN + MODBUS_MAX_PDU_LEN + TRAILER_LEN
+    };
+
+    // Where the PDU of a request is encoded
+    static uint8_t *getPdu(uint8_t *aduP)
+    {
+        return aduP + HEADER_LEN;
+    }
+
+    // Fill address and CRC around the encoded PDU, return length of ADU
+    static uint32_t encode(uint8_t *aduP, uint32_t pduLen, uint8_t slaveAddr)
+    {
+        uint32_t index = HEADER_LEN + pduLen;
+
+        aduP[0] = slaveAddr;
+
+        uint16_t crc = CRCUtility::instance()->modbus_crc16(aduP, index);
+        aduP[index++] = (uint8_t)(crc & 0x00ff);    // CRC low-8bit
+        aduP[index++] = (uint8_t)(crc >> 8);        // CRC high-8bit
+
+        return index;
+    }
+
+    // Refresh CRC after the PDU of a queued ADU is rewritten, address is kept
+    static uint32_t reframe(uint8_t *aduP, uint32_t pduLen)
+    {
+        return encode(aduP, pduLen, aduP[0]);
+    }
+
+    // PDU of a received ADU, CRC is checked by the caller
+    static ModbusPduView decode(const void *aduP, uint32_t len)
+    {
+        if(NULL == aduP || len <= HEADER_LEN + TRAILER_LEN)
+        {
+            return ModbusPduView();
+        }
+
+        return ModbusPduView((const uint8_t *)aduP + HEADER_LEN, len - HEADER_LEN - TRAILER_LEN);
+    }
+};
+
+/*
+ Modbus ASCII ADU: ':' + hex chars of (slave address + PDU + LRC) + CRLF
+
+ Each byte is sent as 2 upper case hex chars, lower case is accepted on
+ receive. LRC is the two's complement of the 8-bit sum of address and
+ PDU, so the sum of all decoded bytes including LRC is 0.
+
+ Hex is encoded and decoded by table, one lookup per char and no branch
+ per char, an invalid char is detected once at the end of the frame.
+*/
+class ModbusAsciiFrame
+{
+public:
+    enum
+    {
+        START_CHAR = ':',
+        HEADER_LEN = 1,                 // ':'
+        TRAILER_LEN = 2,                // CRLF
+        LRC_LEN = 1,
+        MAX_BINARY_LEN = 1 + MODBUS_MAX_PDU_LEN + LRC_LEN,
+        MAX_ADU_LEN = HEADER_LEN + 2 * MAX_BINARY_LEN + TRAILER_LEN
+    };
+
+    // Two's complement of the 8-bit sum
+    static uint8_t getLrc(const uint8_t *dataP, uint32_t len)
+    {
+        uint8_t sum = 0;
+
+        for(uint32_t i = 0; i < len; i++)
+        {
+            sum += dataP[i];
+        }
+
+        return (uint8_t)(0 - sum);
+    }
+
+    // Encode binary address + PDU into asciiP with room of MAX_ADU_LEN, return length of ADU
+    static uint32_t encode(char *asciiP, const uint8_t *dataP, uint32_t len)
+    {
+        static const char hexChar[] = "0123456789ABCDEF";
+        uint8_t sum = 0;
+        char *outP = asciiP;
+
+        *outP++ = START_CHAR;
+
+        for(uint32_t i = 0; i < len; i++)
+        {
+            uint8_t value = dataP[i];
+
+            sum += value;
+            *outP++ = hexChar[value >> 4];
+            *outP++ = hexChar[value & 0x0f];
+        }
+
+        uint8_t lrc = (uint8_t)(0 - sum);
+        *outP++ = hexChar[lrc >> 4];
+        *outP++ = hexChar[lrc & 0x0f];
+        *outP++ = '\r';
+        *outP++ = '\n';
+
+        return outP - asciiP;
+    }
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:       decode
+    PURPOSE:        Decode hex chars between ':' and CRLF, check LRC
+    ARGUMENTS:      uint8_t *dataP      -- binary address + PDU + LRC, room of MAX_BINARY_LEN
+                    const char *hexP    -- hex chars without ':' and CRLF
+                    uint32_t hexLen     -- count of hex chars
+    RETURNS:        Length of address + PDU, LRC excluded
+                    0 - odd count, not a hex char, too short/long or bad LRC
+    -----------------------------------------------------------------------*/
+    static uint32_t decode(uint8_t *dataP, const char *hexP, uint32_t hexLen)
+    {
+        const uint8_t *valueTable = getHexValueTable();
+        const uint8_t *inP = (const uint8_t *)hexP;
+        uint32_t len = hexLen / 2;
+        uint8_t invalid = 0;
+        uint8_t sum = 0;
+
+        // At least address + function code + LRC
+        if(NULL == hexP || 0 != (hexLen & 1) || len < 3 || len > MAX_BINARY_LEN)
+        {
+            return 0;
+        }
+
+        for(uint32_t i = 0; i < len; i++)
+        {
+            uint8_t high = valueTable[inP[0]];
+            uint8_t low = valueTable[inP[1]];
+
+            invalid |= high | low;
+            dataP[i] = (uint8_t)((high << 4) | (low & 0x0f));
+            sum += dataP[i];
+            inP += 2;
+        }
+
+        if(0 != (invalid & 0xf0) || 0 != sum)
+        {
+            return 0;
+        }
+
+        return len - LRC_LEN;
+    }
+
+private:
+    // Value of hex char, 0xff for other chars
+    static const uint8_t *getHexValueTable()
+    {
+        static const uint8_t valueTable[256] =
+        {
+#define MODBUS_HEX_INVALID_ROW 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, \
+                               0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff
+            MODBUS_HEX_INVALID_ROW,     // 0x00
+            MODBUS_HEX_INVALID_ROW,     // 0x10
+            MODBUS_HEX_INVALID_ROW,     // 0x20
+            0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,                     // '0'-'9'
+            0xff, 10, 11, 12, 13, 14, 15, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,   // 'A'-'F'
+            MODBUS_HEX_INVALID_ROW,     // 0x50
+            0xff, 10, 11, 12, 13, 14, 15, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,   // 'a'-'f'
+            MODBUS_HEX_INVALID_ROW,     // 0x70
+            MODBUS_HEX_INVALID_ROW,     // 0x80
+            MODBUS_HEX_INVALID_ROW,
+            MODBUS_HEX_INVALID_ROW,
+            MODBUS_HEX_INVALID_ROW,
+            MODBUS_HEX_INVALID_ROW,
+            MODBUS_HEX_INVALID_ROW,
+            MODBUS_HEX_INVALID_ROW,
+            MODBUS_HEX_INVALID_ROW      // 0xF0
+#undef MODBUS_HEX_INVALID_ROW
+        };
+
+        return valueTable;
+    }
+};
+
+#endif // MODBUSPDU_H
@@ -25,7 +25,10 @@ ModbusRTU::ModbusRTU(ModbusCommBase *parent) :
     logFile(new FileLog),
     logPath("./Log/"),
     txBufLen(0),
-    modbusRTUReadOpt(false)
+    modbusRTUReadOpt(false),
+    requestMergeEnabled(true),
+    txTimeInMs(0),
+    rtoTmr(new QTimer)
 {
     // Prepend the exe absolute path
     m_settingFile.prepend(QUtilityBox::instance()->getAppDirPath());
@@ -38,8 +41,10 @@ ModbusRTU::ModbusRTU(ModbusCommBase *parent) :
     // Init Com Port for Modbus
     comPortInit();
 
-    // Init FIFO buffer
-    fifoBuf = new FIFOBuffer();
+    // Init FIFO buffer, a slot holds request info or one Tx frame
+    fifoBuf = new FIFOBuffer(TX_FIFO_DEPTH, TX_BUF_SIZE);
+    memset(&txRequestInfo, 0, sizeof(struct MODBUS_REQUEST_INFO));
+    memset(&m_mbRxCheckStruct, 0, sizeof(struct MODBUS_RX_MSG_STRUCT));
 
     // Init Tx buffer for transmit
     m_comTxBuf= new char [TX_BUF_SIZE];
@@ -47,12 +52,30 @@ ModbusRTU::ModbusRTU(ModbusCommBase *parent) :
 
     // Init timeout response check
     connect(periodTxTmr, SIGNAL(timeout()), this, SLOT(periodTxService()));
+
+    // Deadline of each request, the ResponseTime setting until RTT is measured
+    struct MODBUS_RTO_CONFIG rtoConfig;
+    rtoConfig.initialRtoInMs = periodTxMaxTimeInMs;
+    rtoEstimator.setConfig(rtoConfig);
+    rtoClock.start();
+
+    rtoTmr->setSingleShot(true);
+    connect(rtoTmr, SIGNAL(timeout()), this, SLOT(handleResponseTimeout()));
+
     startPeriodTxService();
 }
 
 ModbusRTU::~ModbusRTU()
 {
     qDebug() << "~ModbusRTU()";
+
+    // Requests are never answered
+    txTransaction.finish(ModbusTransaction::STATUS_CANCELLED);
+    while(!txTransactionQueue.isEmpty())
+    {
+        txTransactionQueue.dequeue().finish(ModbusTransaction::STATUS_CANCELLED);
+    }
+
     delete currentSetting;
 
     comPortDeInit();
@@ -67,6 +90,7 @@ ModbusRTU::~ModbusRTU()
 
     delete intervalTime;
     delete periodTxTmr;
+    delete rtoTmr;
 
     delete fifoBuf;
 }
@@ -480,7 +504,6 @@ void ModbusRTU::parseResponseDataFromCOM()
 
 void ModbusRTU::parseResponsePacket(QByteArray responseData)
 {
-    QString logStr;
     QByteArray rxNACKData = responseData;
     rxNACKData[1] = rxNACKData[1] - 0x80;
 
@@ -497,47 +520,89 @@ void ModbusRTU::parseResponsePacket(QByteArray responseData)
         if(checkTxRxConformity(m_comTxBuf, responseData.data()) ||
                 checkTxRxConformity(m_comTxBuf, rxNACKData.data()))
         {
+            // Any response proves the device alive, only a first transmit gives a clean RTT (Karn)
+            if(false == getResponseFlag)
+            {
+                if(0 == txRetryTimes)
+                {
+                    rtoEstimator.addSample((uint32_t)(rtoClock.elapsed() - txTimeInMs));
+                }
+
+                rtoTmr->stop();
+
+                if(rtoEstimator.onResponse())
+                {
+                    // Emit signal
+                    emit deviceParked(false);
+                }
+            }
+
+            // Once received msg from ModbusRTU, then reset Tx error count
+            // When tx msg > 10 and there's no feedback, then reInitModbusComm()
+            txErrorCnt = 0;
+
             //qDebug("getResponseFlag");
             getResponseFlag = true;
         }
         else
         {
+            // Request waiting keeps its deadline, a frame after it is done is dropped,
+            // getResponseFlag is left alone or the master never transmits again
             qDebug("Invalid Response Data, checkTxRxConformity fail");
-            getResponseFlag = false;
             return;
         }
     }
     else
     {
-        getResponseFlag = false;
-
         qDebug("crc16 is bad = 0x%04X", crc16);
-        isTxRxOkFlag = false;
-
-        logStr.clear();
-        logStr.append("crc16 is bad");
-        // Update log
-        updateLogData(logStr);
+        rejectResponseFrame("crc16 is bad");
 
         return;
     }
 
 
+    ModbusPduView pdu = ModbusRtuFrame::decode(responseData.constData(), responseData.size());
+
+    // Exception response of the request
+    if(pdu.isException())
+    {
+        qDebug("Exception response, exception code = 0x%02x", pdu.getExceptionCode());
+
+        txTransaction.finish(ModbusTransaction::STATUS_EXCEPTION, QByteArray(), pdu.getExceptionCode());
+        txTransaction = ModbusTransaction();
+        return;
+    }
+
     if(0 == memcmp((char *)responseData.data(), (char *)&m_mbRxCheckStruct, m_mbRxCheckStruct.len))
     {
-        MODBUS_RX_MSG_STRUCT *feedbackMsg = (MODBUS_RX_MSG_STRUCT *)responseData.data();
+        struct MODBUS_READ_FEEDBACK feedback;
+        const uint8_t *regP = NULL;
+        uint16_t regCnt = 0;
+        bool isLenOk = true;
 
-        switch(feedbackMsg->functionCode)
+        switch(pdu.getUint8(0))
         {
         case MB_FUNC_READ_HOLDING_REGISTER:
 
-            if(readFeedbackStruct.len != (feedbackMsg->data[0] / sizeof(uint16_t)))
+            regP = ModbusPdu<MB_FUNC_READ_HOLDING_REGISTER>::decodeResponse(pdu, regCnt);
+            if(NULL == regP)
+            {
+                qDebug() << "invalid rx length! responseData.size() =" << responseData.size();
+
+                txTransaction.finish(ModbusTransaction::STATUS_INVALID_RESPONSE);
+                txTransaction = ModbusTransaction();
+                return;
+            }
+
+            if(txRequestInfo.len != regCnt)
             {
-                readFeedbackStruct.len = (feedbackMsg->data[0] / sizeof(uint16_t));
-                qDebug() << "invalid rx length! readFeedbackStruct.len =" << readFeedbackStruct.len << ",(feedbackMsg->data[0]/sizeof(uint16_t)=" << feedbackMsg->data[0] / sizeof(uint16_t);
+                qDebug() << "invalid rx length! txRequestInfo.len =" << txRequestInfo.len << ", regCnt =" << regCnt;
+                txRequestInfo.len = regCnt;
+                isLenOk = false;
             }
 
-            memcpy((char *)readFeedbackStruct.buffer, (char *)&(feedbackMsg->data[1]), feedbackMsg->data[0]);
+            // Registers only, receivers share the buffer
+            feedback.buffer = QByteArray((const char *)regP, regCnt * sizeof(uint16_t));
 
             break;
         case MB_FUNC_WRITE_MULTIPLE_REGISTERS:
@@ -547,7 +612,7 @@ void ModbusRTU::parseResponsePacket(QByteArray responseData)
         }
 
 #ifdef MODBUSRTU_DEBUG_PRINT
-        qDebug() << "readFeedbackStruct.len = " << readFeedbackStruct.len << "readFeedbackStruct.address = " << readFeedbackStruct.address;
+        qDebug() << "txRequestInfo.len = " << txRequestInfo.len << "txRequestInfo.address = " << txRequestInfo.address;
         qDebug() << "emit(reportModbusResponseValue)";
 #endif
 
@@ -555,14 +620,35 @@ void ModbusRTU::parseResponsePacket(QByteArray responseData)
         // Write operation do not need to notice host
         if(true == modbusRTUReadOpt)
         {
-            emit(reportModbusResponseValue(readFeedbackStruct));
+            feedback.address = txRequestInfo.address;
+            feedback.len = txRequestInfo.len;
+            feedback.rdwrFlag = txRequestInfo.rdwrFlag;
+
+            emit(reportModbusResponseValue(feedback));
         }
 
+        // Register count of a read response must match the request
+        txTransaction.finish(isLenOk ? ModbusTransaction::STATUS_DONE : ModbusTransaction::STATUS_INVALID_RESPONSE,
+                             feedback.buffer);
     }
     else
     {
        qDebug() << "memcmp m_mbRxCheckStruct fail";
+
+       txTransaction.finish(ModbusTransaction::STATUS_INVALID_RESPONSE);
     }
+
+    txTransaction = ModbusTransaction();
+}
+
+void ModbusRTU::rejectResponseFrame(const QString &logStr)
+{
+    // getResponseFlag is left alone, a request waiting still times out by rtoTmr,
+    // garbage while idle must not block the next transmit
+    isTxRxOkFlag = false;
+
+    // Update log
+    updateLogData(logStr);
 }
 
 uint16_t ModbusRTU::do_crc16(const char *addr, uint16_t len)
@@ -585,6 +671,40 @@ uint8_t ModbusRTU::getSlaveAddr() const
     return m_devAddr;
 }
 
+void ModbusRTU::setBaudRate(BaudRateType baudRate)
+{
+    if(NULL != comPort)
+    {
+        comPort->setBaudRate(baudRate);
+    }
+}
+
+BaudRateType ModbusRTU::getBaudRate() const
+{
+    return (NULL == comInitData) ? BAUD9600 : comInitData->baudrate;
+}
+
+void ModbusRTU::setTxRetryTimes(uint32_t cnt)
+{
+    TX_RETRY_MAX_TIMES = cnt;
+    TX_ERROR_MAX_CNT = 10 * TX_RETRY_MAX_TIMES;
+}
+
+uint32_t ModbusRTU::getTxRetryTimes() const
+{
+    return TX_RETRY_MAX_TIMES;
+}
+
+void ModbusRTU::setErrorCheckEnabled(bool flag)
+{
+    errorCheckFlag = flag;
+}
+
+bool ModbusRTU::isErrorCheckEnabled() const
+{
+    return errorCheckFlag;
+}
+
 bool ModbusRTU::getModbusCommOk()
 {
     return isTxRxOkFlag;
@@ -594,45 +714,56 @@ void ModbusRTU::setModbusTimeOut(int timeoutInMs)
 {
     periodTxMaxTimeInMs = timeoutInMs;
 
+    // Timeout until RTT is measured again
+    {
+        QMutexLocker locker(&mutex);
+        struct MODBUS_RTO_CONFIG rtoConfig = rtoEstimator.getConfig();
+
+        rtoConfig.initialRtoInMs = timeoutInMs;
+        rtoEstimator.setConfig(rtoConfig);
+    }
+
     // Restart period Tx timer
     startPeriodTxService();
 }
 
+int ModbusRTU::getModbusTimeOut() const
+{
+    return periodTxMaxTimeInMs;
+}
+
 void ModbusRTU::periodTxService()
 {
     uint32_t len = 0;
     QMutexLocker locker(&mutex);
 
+    // Deadline of the request waiting for response is handled by handleResponseTimeout()
     if(false == getResponseFlag)
     {
-        if(++txRetryTimes > TX_RETRY_MAX_TIMES)
-        {
-            txRetryTimes = 0;
-
-            // Tx error count increased
-            txErrorCnt++;
-        }
-        else
-        {
-            retransmitTask();
-            return;
-        }
+        return;
     }
-    else
+
+    // Response of last request was not understood
+    txTransaction.finish(ModbusTransaction::STATUS_INVALID_RESPONSE);
+    txTransaction = ModbusTransaction();
+
+    // Parked device only gets a probe now and then
+    if(0 != fifoBuf->getCount() && !rtoEstimator.allowRequest(rtoClock.elapsed()))
     {
-        // 2020-Mar-21 add this logic
-        // Once received msg from ModbusRTU, then reset Tx error count
-        // When tx msg > 10 and there's no feedback, then reInitModbusComm()
-        txErrorCnt = 0;
+        dropQueuedRequests();
+        return;
     }
 
-    // Clear buffer
-    memset(m_comTxBuf, 0, TX_BUF_SIZE);
-
     // Pop data from FIFO
-    if(true == fifoBuf->popData((char *)&readFeedbackStruct, len))
+    if(true == fifoBuf->popData((char *)&txRequestInfo, len))
     {
-        if(MODBUS_WR_OPT == readFeedbackStruct.rdwrFlag)
+        // Null for requests queued without handle
+        if(!txTransactionQueue.isEmpty())
+        {
+            txTransaction = txTransactionQueue.dequeue();
+        }
+
+        if(MODBUS_WR_OPT == txRequestInfo.rdwrFlag)
         {
             modbusRTUReadOpt = false;
         }
@@ -646,8 +777,11 @@ void ModbusRTU::periodTxService()
 
     if(true == fifoBuf->popData(m_comTxBuf, txBufLen))
     {
-        // Reset response flag
-        getResponseFlag = false;
+        // First transmit of the request
+        txRetryTimes = 0;
+
+        // Requests queued behind must not change the check of this one
+        updateRxCheck();
 
     #ifdef MODBUSRTU_DEBUG_PRINT
         // Restart interval time
@@ -674,23 +808,90 @@ void ModbusRTU::periodTxService()
     #endif
 
         // Send data package to ModbusRTU
-        writeDataToModbus(m_comTxBuf, txBufLen);
+        transmitRequest();
     }
 
 }
 
-void ModbusRTU::retransmitTask()
+void ModbusRTU::handleResponseTimeout()
 {
-    QString logStr;
+    bool parked = false;
+
+    {
+        QMutexLocker locker(&mutex);
+
+        if(true == getResponseFlag)
+        {
+            return;
+        }
+
+        // Each timeout doubles the deadline of the retransmit
+        rtoEstimator.onTimeout();
+
+        if(++txRetryTimes <= TX_RETRY_MAX_TIMES)
+        {
+            retransmitTask();
+            return;
+        }
+
+        txRetryTimes = 0;
+
+        // Tx error count increased
+        txErrorCnt++;
+
+        // Give up the request waiting for response, next one is sent at next Tx period
+        getResponseFlag = true;
+        txTransaction.finish(ModbusTransaction::STATUS_TIMEOUT);
+        txTransaction = ModbusTransaction();
+
+        parked = rtoEstimator.onFailure(rtoClock.elapsed());
+    }
+
+    if(parked)
+    {
+        // Emit signal
+        emit deviceParked(true);
+    }
+}
 
+void ModbusRTU::transmitRequest()
+{
     // Reset response flag
     getResponseFlag = false;
 
+    // Send data package to ModbusRTU
+    writeDataToModbus(m_comTxBuf, txBufLen);
+
+    txTimeInMs = rtoClock.elapsed();
+    rtoTmr->start(rtoEstimator.getRto());
+}
+
+void ModbusRTU::dropQueuedRequests()
+{
+    uint32_t len = 0;
+    char tempBuf[TX_BUF_SIZE];
+
+    while(fifoBuf->popData(tempBuf, len))
+    {
+        fifoBuf->popData(tempBuf, len);
+
+        if(!txTransactionQueue.isEmpty())
+        {
+            txTransactionQueue.dequeue().finish(ModbusTransaction::STATUS_UNREACHABLE);
+        }
+    }
+}
+
+
+void ModbusRTU::retransmitTask()
+{
+    QString logStr;
+
     // If m_comTxBuf is not empty(0x00...)
     if(0 != txBufLen)
     {
         // Send data package to ModbusRTU
-        writeDataToModbus(m_comTxBuf, txBufLen);
+        transmitRequest();
 
     #ifdef MODBUSRTU_DEBUG_PRINT
         // Restart interval time
@@ -777,6 +978,33 @@ bool ModbusRTU::checkTxRxConformity(const char *txBufP, const char *rxBufP)
     return retFlag;
 }
 
+void ModbusRTU::updateRxCheck()
+{
+    memset((char *)&m_mbRxCheckStruct, 0, sizeof(struct MODBUS_RX_MSG_STRUCT));
+
+    // Address + function code + register address + count at least
+    if(txBufLen < 6)
+    {
+        return;
+    }
+
+    // Fill rx msg check format from the Tx frame, a merged request included
+    m_mbRxCheckStruct.address = (uint8_t)m_comTxBuf[0];
+    m_mbRxCheckStruct.functionCode = (uint8_t)m_comTxBuf[1];
+
+    if(MODBUS_RD_OPT == txRequestInfo.rdwrFlag)
+    {
+        // Byte count is checked against txRequestInfo.len by parseResponsePacket()
+        m_mbRxCheckStruct.len = 2;
+    }
+    else
+    {
+        // Response of write echoes register address and count
+        memcpy(m_mbRxCheckStruct.data, m_comTxBuf + 2, 4);
+        m_mbRxCheckStruct.len = 6;
+    }
+}
+
 bool ModbusRTU::reInitModbusComm()
 {
     bool ret = false;
@@ -807,124 +1035,146 @@ bool ModbusRTU::reInitModbusComm()
     return ret;
 }
 
-bool ModbusRTU::readHoldRegisters(uint16_t regOffset, uint16_t regCnt)
+void ModbusRTU::setRequestMergeEnabled(bool flag)
 {
-    bool ret = false;
-    uint32_t index = 0;
-    uint16_t crc = 0;
-    struct MODBUS_READ_FEEDBACK tempFeedBackStruct;
-    memset(&tempFeedBackStruct, 0, sizeof(struct MODBUS_READ_FEEDBACK));
-
-    if(0 == regCnt)
-    {
-        return ret;
-    }
-
     QMutexLocker locker(&mutex);
 
-    // Clear buffer
-    memset(m_comTxBuf, 0, TX_BUF_SIZE);
-    memset((char *)&m_mbRxCheckStruct, 0, sizeof(struct MODBUS_RX_MSG_STRUCT));
-
-    m_comTxBuf[index++] = m_devAddr;
-    m_comTxBuf[index++] = MB_FUNC_READ_HOLDING_REGISTER;
+    requestMergeEnabled = flag;
+}
 
-    // Note: For Modbus RTU communication, data are big endian!
-    // CRC16 is little endian!
-    m_comTxBuf[index++] = (uint8_t)(regOffset >> 8);        // reg address high-8bit
-    m_comTxBuf[index++] = (uint8_t)(regOffset & 0x00ff);    // reg address low-8bit
+void ModbusRTU::setRtoConfig(const struct MODBUS_RTO_CONFIG &config)
+{
+    QMutexLocker locker(&mutex);
 
-    m_comTxBuf[index++] = (uint8_t)(regCnt >> 8);        // reg count high-8bit
-    m_comTxBuf[index++] = (uint8_t)(regCnt & 0x00ff);    // reg count low-8bit
+    rtoEstimator.setConfig(config);
+}
 
-    crc = CRCUtility::instance()->modbus_crc16((uint8_t *)m_comTxBuf, index);
+struct MODBUS_RTO_CONFIG ModbusRTU::getRtoConfig()
+{
+    QMutexLocker locker(&mutex);
 
-    m_comTxBuf[index++] = (uint8_t)(crc & 0x00ff);    // CRC low-8bit
-    m_comTxBuf[index++] = (uint8_t)(crc >> 8);        // CRC high-8bit
+    return rtoEstimator.getConfig();
+}
 
-    tempFeedBackStruct.address = regOffset;
-    tempFeedBackStruct.len = regCnt;
-    tempFeedBackStruct.rdwrFlag = MODBUS_RD_OPT;
+uint32_t ModbusRTU::getRto()
+{
+    QMutexLocker locker(&mutex);
 
-    // Fill rx msg check format
-    m_mbRxCheckStruct.address = m_devAddr;
-    m_mbRxCheckStruct.functionCode = MB_FUNC_READ_HOLDING_REGISTER;
-    m_mbRxCheckStruct.data[0] = regCnt * sizeof(uint16_t);
+    return rtoEstimator.getRto();
+}
 
-    // This is a bug, readHoldRegisters() will be call several times sequently
-    // m_mbRxCheckStruct will be overwrite, so here just fill the check len as 2
-    m_mbRxCheckStruct.len = 2;
+bool ModbusRTU::isDeviceParked()
+{
+    QMutexLocker locker(&mutex);
 
-    // Push data to FIFO
-    fifoBuf->pushData((char *)&tempFeedBackStruct, sizeof(struct MODBUS_READ_FEEDBACK));
-    // Push data to FIFO
-    ret = fifoBuf->pushData(m_comTxBuf, index);
+    return rtoEstimator.isParked();
+}
 
-    return ret;
+bool ModbusRTU::readHoldRegisters(uint16_t regOffset, uint16_t regCnt)
+{
+    return queueRequest(MB_FUNC_READ_HOLDING_REGISTER, regOffset, regCnt, NULL, ModbusTransaction());
 }
 
 bool ModbusRTU::writeMultiRegisters(uint16_t regOffset, const char *dataP, uint16_t regCnt)
 {
-    bool ret = false;
-    uint32_t index = 0;
-    uint16_t crc = 0;
-    struct MODBUS_READ_FEEDBACK tempFeedBackStruct;
-    memset(&tempFeedBackStruct, 0, sizeof(struct MODBUS_READ_FEEDBACK));
+    return queueRequest(MB_FUNC_WRITE_MULTIPLE_REGISTERS, regOffset, regCnt, dataP, ModbusTransaction());
+}
 
-    if(NULL == dataP || 0 == regCnt)
+ModbusTransaction ModbusRTU::transact(uint8_t functionCode, uint16_t regOffset, uint16_t regCnt, const char *dataP)
+{
+    // Completed in the thread of slots of this object
+    ModbusTransaction transaction(functionCode, regOffset, regCnt, thread());
+
+    if(!queueRequest(functionCode, regOffset, regCnt, dataP, transaction))
     {
-        return ret;
+        transaction.finish(ModbusTransaction::STATUS_REJECTED);
     }
 
-    QMutexLocker locker(&mutex);
-
-    // Clear buffer
-    memset(m_comTxBuf, 0, TX_BUF_SIZE);
-    memset((char *)&m_mbRxCheckStruct, 0, sizeof(struct MODBUS_RX_MSG_STRUCT));
+    return transaction;
+}
 
-    m_comTxBuf[index++] = m_devAddr;
-    m_comTxBuf[index++] = MB_FUNC_WRITE_MULTIPLE_REGISTERS;
+bool ModbusRTU::queueRequest(uint8_t functionCode, uint16_t regOffset, uint16_t regCnt, const char *dataP,
+                             const ModbusTransaction &transaction)
+{
+    uint8_t *pduP = NULL;
+    uint32_t pduLen = 0;
 
-    // Note: For Modbus RTU communication, data are big endian!
-    // CRC16 is little endian!
-    m_comTxBuf[index++] = (uint8_t)(regOffset >> 8);        // reg address high-8bit
-    m_comTxBuf[index++] = (uint8_t)(regOffset & 0x00ff);    // reg address low-8bit
+    if(MB_FUNC_READ_HOLDING_REGISTER == functionCode)
+    {
+        if(0 == regCnt)
+        {
+            return false;
+        }
+    }
+    else if(MB_FUNC_WRITE_MULTIPLE_REGISTERS == functionCode)
+    {
+        // More registers do not fit in one PDU
+        if(NULL == dataP || 0 == regCnt || regCnt > MODBUS_MAX_WRITE_REG_CNT)
+        {
+            return false;
+        }
+    }
+    else
+    {
+        return false;
+    }
 
-    m_comTxBuf[index++] = (uint8_t)(regCnt >> 8);        // reg count high-8bit
-    m_comTxBuf[index++] = (uint8_t)(regCnt & 0x00ff);    // reg count low-8bit
+    QMutexLocker locker(&mutex);
 
-    m_comTxBuf[index++] = (uint8_t)(regCnt * sizeof(uint16_t));   // length in bytes
+    // Folded into a queued request, no new Tx frame
+    struct MODBUS_REQUEST_INFO mergedInfo;
+    if(requestMergeEnabled &&
+       ModbusRequestCoalescer<ModbusRtuFrame>::merge(fifoBuf, txTransactionQueue, functionCode, regOffset, regCnt,
+                                                     dataP, transaction, mergedInfo))
+    {
+        return true;
+    }
 
-    for(uint32_t i = 0; i < regCnt; i++)
+    // Request info and Tx frame take 2 slots, never overwrite queued requests
+    if(txTransactionQueue.size() >= TX_FIFO_DEPTH / 2)
     {
-        uint16_t value = *((uint16_t *)dataP + i);
+        return false;
+    }
 
-        m_comTxBuf[index++] = (uint8_t)(value >> 8);        // data high-8bit
-        m_comTxBuf[index++] = (uint8_t)(value & 0x00ff);    // data low-8bit
+    // Rx check is set once the request is popped for transmit, see updateRxCheck()
+    if(MB_FUNC_READ_HOLDING_REGISTER == functionCode)
+    {
+        pduP = beginRequest(regOffset, regCnt, MODBUS_RD_OPT, transaction);
+        pduLen = ModbusPdu<MB_FUNC_READ_HOLDING_REGISTER>::encodeRequest(pduP, regOffset, regCnt);
+    }
+    else
+    {
+        pduP = beginRequest(regOffset, regCnt, MODBUS_WR_OPT, transaction);
+        pduLen = ModbusPdu<MB_FUNC_WRITE_MULTIPLE_REGISTERS>::encodeRequest(pduP, regOffset, dataP, regCnt);
     }
 
-    crc = CRCUtility::instance()->modbus_crc16((uint8_t *)m_comTxBuf, index);
+    return commitRequest(pduLen);
+}
 
-    m_comTxBuf[index++] = (uint8_t)(crc & 0x00ff);    // CRC low-8bit
-    m_comTxBuf[index++] = (uint8_t)(crc >> 8);        // CRC high-8bit
+uint8_t *ModbusRTU::beginRequest(uint16_t regOffset, uint16_t regCnt, uint16_t rdwrFlag, const ModbusTransaction &transaction)
+{
+    struct MODBUS_REQUEST_INFO requestInfo;
 
-    tempFeedBackStruct.address = regOffset;
-    tempFeedBackStruct.len = regCnt;
-    tempFeedBackStruct.rdwrFlag = MODBUS_WR_OPT;
+    // Tx FIFO slot must hold the biggest request
+    MODBUS_STATIC_ASSERT((int)TX_BUF_SIZE >= (int)ModbusRtuFrame::MAX_ADU_LEN, tx_buf_fits_adu);
 
-    // Fill rx msg check format
-    m_mbRxCheckStruct.address = m_devAddr;
-    m_mbRxCheckStruct.functionCode = MB_FUNC_WRITE_MULTIPLE_REGISTERS;
-    m_mbRxCheckStruct.data[0] = (uint8_t)(regOffset >> 8);        // reg address high-8bit
-    m_mbRxCheckStruct.data[1] = (uint8_t)(regOffset & 0x00ff);    // reg address low-8bit
-    m_mbRxCheckStruct.data[2] = (uint8_t)(regCnt >> 8);        // reg count high-8bit
-    m_mbRxCheckStruct.data[3] = (uint8_t)(regCnt & 0x00ff);    // reg count low-8bit
-    m_mbRxCheckStruct.len = 6;
+    requestInfo.address = regOffset;
+    requestInfo.len = regCnt;
+    requestInfo.rdwrFlag = rdwrFlag;
 
     // Push data to FIFO
-    fifoBuf->pushData((char *)&tempFeedBackStruct, sizeof(struct MODBUS_READ_FEEDBACK));
-    // Push data to FIFO
-    ret = fifoBuf->pushData(m_comTxBuf, index);
+    fifoBuf->pushData((char *)&requestInfo, sizeof(struct MODBUS_REQUEST_INFO));
+    txTransactionQueue.enqueue(transaction);
 
-    return ret;
+    // Tx frame is encoded in the next FIFO slot, m_comTxBuf may still be retransmitted
+    return ModbusRtuFrame::getPdu((uint8_t *)fifoBuf->getPushBuffer());
+}
+
+bool ModbusRTU::commitRequest(uint32_t pduLen)
+{
+    uint8_t *aduP = (uint8_t *)fifoBuf->getPushBuffer();
+    uint32_t aduLen = ModbusRtuFrame::encode(aduP, pduLen, m_devAddr);
+
+    // Push data to FIFO
+    return fifoBuf->commitData(aduLen);
 }
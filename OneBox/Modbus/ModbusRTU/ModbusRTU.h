@@ -7,8 +7,13 @@
 #include <QTimer>
 #include <QTime>
 #include <QMutex>
+#include <QQueue>
+#include <QElapsedTimer>
 
 #include "ModbusCommBase.h"
+#include "ModbusPdu.h"
+#include "ModbusRequestCoalescer.h"
+#include "ModbusRtoEstimator.h"
 
 #include "QSerialPort.h"
 #include "FifoBuffer.h"
@@ -32,6 +37,7 @@ public:
 
     // Set Modbus communication timeout, Unit:ms
     void setModbusTimeOut(int timeoutInMs);
+    int getModbusTimeOut() const;
 
     // Re-Init Modbus communication
     bool reInitModbusComm();
@@ -42,6 +48,32 @@ public:
     // Get modbus slave address
     uint8_t getSlaveAddr() const;
 
+    // Baud rate of the opened COM port, kept until reInitModbusComm() loads the ini file again
+    void setBaudRate(BaudRateType baudRate);
+    BaudRateType getBaudRate() const;
+
+    // Retransmit times of a request without response
+    void setTxRetryTimes(uint32_t cnt);
+    uint32_t getTxRetryTimes() const;
+
+    // False: COM port is not re-opened after repeated errors
+    void setErrorCheckEnabled(bool flag);
+    bool isErrorCheckEnabled() const;
+
+    // Merge equal reads and adjacent writes in Tx FIFO, see ModbusRequestCoalescer, default true
+    void setRequestMergeEnabled(bool flag);
+
+    // Response timeout estimator and circuit breaker, see ModbusRtoEstimator.
+    // Timeout before the first RTT sample is the ResponseTime setting unless set here
+    void setRtoConfig(const struct MODBUS_RTO_CONFIG &config);
+    struct MODBUS_RTO_CONFIG getRtoConfig();
+
+    // Response timeout of next transmit
+    uint32_t getRto();
+
+    // True: device is parked after repeated timeouts, requests fail except probes
+    bool isDeviceParked();
+
     /*-----------------------------------------------------------------------
     FUNCTION:       readHoldRegisters
     PURPOSE:        Read holding registers from modbusRTU slave device
@@ -61,23 +93,43 @@ public:
     -----------------------------------------------------------------------*/
     virtual bool writeMultiRegisters(uint16_t regOffset, const char *dataP, uint16_t regCnt);
 
+    // MB_FUNC_READ_HOLDING_REGISTER/WRITE_MULTIPLE_REGISTERS, see ModbusCommBase
+    virtual ModbusTransaction transact(uint8_t functionCode, uint16_t regOffset, uint16_t regCnt, const char *dataP = NULL);
+
 signals:
     void newDataReady(QByteArray);
     void newDataTx(QByteArray);
 
+    // Device is parked by circuit breaker or answers again
+    void deviceParked(bool parked);
+
 protected slots:
-    void readDataFromModbus(QByteArray data);      //Read data from PLC
+    virtual void readDataFromModbus(QByteArray data);      //Read data from PLC
 
 private slots:
     void periodTxService();
     void retransmitTask();
 
+    // No response before the deadline of the request
+    void handleResponseTimeout();
+
+protected:
+    // Write data to modbus, data is the RTU ADU of m_comTxBuf
+    virtual int writeDataToModbus(const char *txData, int len);
+
+    // Parse Rx Packet and show Reg data value, responseData is a RTU ADU
+    void parseResponsePacket(QByteArray responseData);
+
+    // Response frame is broken, keep waiting for a valid one
+    void rejectResponseFrame(const QString &logStr);
+
 private:
 
     enum
     {
         RX_BUF_SIZE  = 1000,
-        TX_BUF_SIZE  = 300
+        TX_BUF_SIZE  = 300,
+        TX_FIFO_DEPTH = 100
     };
 
     QString m_settingFile;
@@ -118,18 +170,36 @@ private:
 
     uint32_t txBufLen;  // Modbus Tx buffer length
 
-    // Modbus rx data from client
+    // Modbus rx data from client, start of the response of the Tx frame on the wire
     struct MODBUS_RX_MSG_STRUCT m_mbRxCheckStruct;
 
-    // Modbus read back strutct report to host
-    struct MODBUS_READ_FEEDBACK readFeedbackStruct;
+    // Request info of the Tx frame waiting for response
+    struct MODBUS_REQUEST_INFO txRequestInfo;
+
+    // Handles of requests in Tx FIFO, same order, null if queued without handle
+    QQueue<ModbusTransaction> txTransactionQueue;
+
+    // Handle of the Tx frame waiting for response
+    ModbusTransaction txTransaction;
 
     // Flag used to indicate read/write operation of ModbusRTU communication
     // True: read operation, False: write operation
     bool modbusRTUReadOpt;
 
-    // Write data to modbus
-    int writeDataToModbus(const char *txData, int len);
+    // True: equal reads and adjacent writes are merged in Tx FIFO
+    bool requestMergeEnabled;
+
+    // Response timeout of the device from measured RTT
+    ModbusRtoEstimator rtoEstimator;
+    QElapsedTimer rtoClock;
+    int64_t txTimeInMs;     // Time of last transmit
+    QTimer *rtoTmr;         // Deadline of the request waiting for response
+
+    // Transmit m_comTxBuf and start its response deadline
+    void transmitRequest();
+
+    // Fail queued requests of a parked device
+    void dropQueuedRequests();
 
     bool comPortInit();     // Init Com Port to Printer
     void comPortDeInit();   // Release/DeInit Com Port to Printer
@@ -143,8 +213,15 @@ private:
     // CRC16 operation
     uint16_t do_crc16(const char *addr, uint16_t len);
 
-    // Parse Rx Packet and show Reg data value
-    void parseResponsePacket(QByteArray responseData);
+    // Check and queue request, transaction may be null
+    bool queueRequest(uint8_t functionCode, uint16_t regOffset, uint16_t regCnt, const char *dataP,
+                      const ModbusTransaction &transaction);
+
+    // Queue request info, return where to encode the request PDU in Tx FIFO
+    uint8_t *beginRequest(uint16_t regOffset, uint16_t regCnt, uint16_t rdwrFlag, const ModbusTransaction &transaction);
+
+    // Add address and CRC to the encoded request PDU and queue it
+    bool commitRequest(uint32_t pduLen);
 
     // Parse Response Data
     void parseResponseDataFromCOM();
@@ -158,6 +235,9 @@ private:
     // Check Rx msg is the right feedback for Tx msg
     bool checkTxRxConformity(const char *txBufP, const char *rxBufP);
 
+    // Expected response of the Tx frame in m_comTxBuf, set when it is popped for transmit
+    void updateRxCheck();
+
 };
 
 #endif // MODBUSRTU_H
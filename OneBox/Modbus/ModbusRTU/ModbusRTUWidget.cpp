@@ -76,7 +76,7 @@ void ModbusRTUWidget::bindModel(ModbusRTU *modbusRTUP)
         m_modbusRTU = modbusRTUP;
         connect(m_modbusRTU, SIGNAL(newDataReady(QByteArray)), this, SLOT(readDataFromModbus(QByteArray)));
         connect(m_modbusRTU, SIGNAL(newDataTx(QByteArray)), this, SLOT(updateTxDataToLog(QByteArray)));
-        connect(m_modbusRTU, SIGNAL(reportModbusResponseValue(MODBUS_READ_FEEDBACK)), this, SLOT(handleModbusResponseValue(MODBUS_READ_FEEDBACK)));
+        connect(m_modbusRTU, SIGNAL(reportModbusResponseValue(const MODBUS_READ_FEEDBACK &)), this, SLOT(handleModbusResponseValue(const MODBUS_READ_FEEDBACK &)));
 
         setSlaveAddr(m_modbusRTU->getSlaveAddr());
     }
@@ -351,7 +351,7 @@ void ModbusRTUWidget::updateTxDataToLog(QByteArray data)
     intervalTime->restart();
 }
 
-void ModbusRTUWidget::handleModbusResponseValue(MODBUS_READ_FEEDBACK data)
+void ModbusRTUWidget::handleModbusResponseValue(const MODBUS_READ_FEEDBACK &data)
 {
     QString logStr;
     logStr.clear();
@@ -359,11 +359,9 @@ void ModbusRTUWidget::handleModbusResponseValue(MODBUS_READ_FEEDBACK data)
     logStr.append(tr("Modbus Response:\n"));
     logStr.append(tr("Address:%1\n").arg(data.address));
     logStr.append(tr("Data:"));
-    for(int i = 0; i < data.len; i++)
+    for(int i = 0; i < data.buffer.size(); i++)
     {
-        logStr.append(QString::number((uint8_t)data.buffer[2*i], 16).rightJustified(2, '0').toUpper());
-        logStr.append(" ");
-        logStr.append(QString::number((uint8_t)data.buffer[2*i + 1], 16).rightJustified(2, '0').toUpper());
+        logStr.append(QString::number((uint8_t)data.buffer.at(i), 16).rightJustified(2, '0').toUpper());
         logStr.append(" ");
     }
 
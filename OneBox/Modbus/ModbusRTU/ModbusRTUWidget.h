@@ -87,7 +87,7 @@ private slots:
 
     void readDataFromModbus(QByteArray data);
     void updateTxDataToLog(QByteArray data);
-    void handleModbusResponseValue(MODBUS_READ_FEEDBACK data);
+    void handleModbusResponseValue(const MODBUS_READ_FEEDBACK &data);
 
 private:
 
@@ -124,9 +124,6 @@ private:
     // Modbus rx data from client
     struct MODBUS_RX_MSG_STRUCT m_mbRxCheckStruct;
 
-    // Modbus read back strutct report to host
-    struct MODBUS_READ_FEEDBACK readFeedbackStruct;
-
     bool hexFormatFlag; // This flag is used to enable hex format show
     bool autoClearRxFlag; // This flag is used to clear rx buffer automatically
 
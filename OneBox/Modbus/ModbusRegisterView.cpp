@@ -0,0 +1,316 @@
+/**********************************************************************
+PACKAGE:        Communication
+FILE:           ModbusRegisterView.cpp
+COPYRIGHT (C):  All rights reserved.
+
+PURPOSE:        Typed decoding of Modbus register data with word order
+**********************************************************************/
+
+#include "ModbusRegisterView.h"
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MODBUS_REGISTER_VIEW_SSE2
+#include <emmintrin.h>
+#endif
+
+/*-----------------------------------------------------------------------
+FUNCTION:		convertValue
+PURPOSE:		Convert one value of width bytes, independent of host byte order
+ARGUMENTS:		const uint8_t *srcP         -- source value
+                uint8_t *dstP               -- destination value
+                uint32_t width              -- bytes of value, 2/4/8
+                MODBUS_WORD_ORDER order     -- word order
+RETURNS:		None
+-----------------------------------------------------------------------*/
+static void convertValue(const uint8_t *srcP, uint8_t *dstP, uint32_t width, MODBUS_WORD_ORDER order)
+{
+    uint32_t regCnt = width / 2;
+    uint64_t value = 0;
+
+    // Compose value from the most significant byte, see ModbusRegisterView.h
+    for(uint32_t k = 0; k < width; k++)
+    {
+        uint32_t reg = k / 2;
+        uint32_t byte = k % 2;
+
+        if(WORD_ORDER_CDAB == order || WORD_ORDER_DCBA == order)
+        {
+            reg = regCnt - 1 - reg;
+        }
+
+        if(WORD_ORDER_BADC == order || WORD_ORDER_DCBA == order)
+        {
+            byte = 1 - byte;
+        }
+
+        value = (value << 8) | srcP[reg * 2 + byte];
+    }
+
+    if(2 == width)
+    {
+        uint16_t tmp = (uint16_t)value;
+        memcpy(dstP, &tmp, sizeof(tmp));
+    }
+    else if(4 == width)
+    {
+        uint32_t tmp = (uint32_t)value;
+        memcpy(dstP, &tmp, sizeof(tmp));
+    }
+    else
+    {
+        memcpy(dstP, &value, sizeof(value));
+    }
+}
+
+void ModbusRegisterView::convert(const void *srcP, void *dstP, uint32_t cnt, uint32_t width, MODBUS_WORD_ORDER order)
+{
+    const uint8_t *inP = (const uint8_t *)srcP;
+    uint8_t *outP = (uint8_t *)dstP;
+    uint32_t totalBytes = cnt * width;
+    uint32_t index = 0;
+
+    if(NULL == srcP || NULL == dstP || (2 != width && 4 != width && 8 != width))
+    {
+        return;
+    }
+
+#ifdef MODBUS_REGISTER_VIEW_SSE2
+    /*
+     On little endian x86 the loaded bytes are already DCBA, so
+     CDAB: swap bytes in each 16-bit word
+     BADC: reverse 16-bit words in each value
+     ABCD: both
+    */
+    bool swapBytes = (WORD_ORDER_ABCD == order || WORD_ORDER_CDAB == order);
+    bool reverseWords = (WORD_ORDER_ABCD == order || WORD_ORDER_BADC == order) && width > 2;
+
+    for(; index + 16 <= totalBytes; index += 16)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i *)(inP + index));
+
+        if(swapBytes)
+        {
+            x = _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+        }
+
+        if(reverseWords)
+        {
+            if(4 == width)
+            {
+                x = _mm_shufflelo_epi16(x, _MM_SHUFFLE(2, 3, 0, 1));
+                x = _mm_shufflehi_epi16(x, _MM_SHUFFLE(2, 3, 0, 1));
+            }
+            else
+            {
+                x = _mm_shufflelo_epi16(x, _MM_SHUFFLE(0, 1, 2, 3));
+                x = _mm_shufflehi_epi16(x, _MM_SHUFFLE(0, 1, 2, 3));
+            }
+        }
+
+        _mm_storeu_si128((__m128i *)(outP + index), x);
+    }
+#endif
+
+    // The rest less than 16 bytes, or all without SIMD
+    for(; index < totalBytes; index += width)
+    {
+        if(inP == outP)
+        {
+            uint8_t tmp[8];
+            convertValue(inP + index, tmp, width, order);
+            memcpy(outP + index, tmp, width);
+        }
+        else
+        {
+            convertValue(inP + index, outP + index, width, order);
+        }
+    }
+}
+
+ModbusRegisterView::ModbusRegisterView(const void *dataP, uint32_t regCnt, MODBUS_WORD_ORDER order) :
+    m_dataP((const uint8_t *)dataP),
+    m_regCnt((NULL == dataP) ? 0 : regCnt),
+    m_order(order)
+{
+}
+
+ModbusRegisterView::ModbusRegisterView(const struct MODBUS_READ_FEEDBACK &feedback, MODBUS_WORD_ORDER order) :
+    m_dataP((const uint8_t *)feedback.buffer.constData()),
+    m_regCnt(feedback.len),
+    m_order(order)
+{
+    // Never read past the buffer of a malformed feedback
+    if(m_regCnt > (uint32_t)feedback.buffer.size() / sizeof(uint16_t))
+    {
+        m_regCnt = feedback.buffer.size() / sizeof(uint16_t);
+    }
+}
+
+uint32_t ModbusRegisterView::getRegCnt() const
+{
+    return m_regCnt;
+}
+
+MODBUS_WORD_ORDER ModbusRegisterView::getWordOrder() const
+{
+    return m_order;
+}
+
+bool ModbusRegisterView::contains(uint32_t regIndex, uint32_t regCnt) const
+{
+    return (regIndex <= m_regCnt && regCnt <= m_regCnt - regIndex);
+}
+
+uint32_t ModbusRegisterView::decode(uint32_t regIndex, void *outP, uint32_t cnt, uint32_t width) const
+{
+    uint32_t regPerValue = width / 2;
+
+    if(NULL == outP || regIndex >= m_regCnt)
+    {
+        return 0;
+    }
+
+    // Only whole values inside the view
+    uint32_t maxCnt = (m_regCnt - regIndex) / regPerValue;
+    if(cnt > maxCnt)
+    {
+        cnt = maxCnt;
+    }
+
+    convert(m_dataP + regIndex * sizeof(uint16_t), outP, cnt, width, m_order);
+
+    return cnt;
+}
+
+uint16_t ModbusRegisterView::toUint16(uint32_t regIndex) const
+{
+    uint16_t value = 0;
+
+    decode(regIndex, &value, 1, sizeof(value));
+
+    return value;
+}
+
+int16_t ModbusRegisterView::toInt16(uint32_t regIndex) const
+{
+    return (int16_t)toUint16(regIndex);
+}
+
+uint32_t ModbusRegisterView::toUint32(uint32_t regIndex) const
+{
+    uint32_t value = 0;
+
+    decode(regIndex, &value, 1, sizeof(value));
+
+    return value;
+}
+
+int32_t ModbusRegisterView::toInt32(uint32_t regIndex) const
+{
+    return (int32_t)toUint32(regIndex);
+}
+
+uint64_t ModbusRegisterView::toUint64(uint32_t regIndex) const
+{
+    uint64_t value = 0;
+
+    decode(regIndex, &value, 1, sizeof(value));
+
+    return value;
+}
+
+int64_t ModbusRegisterView::toInt64(uint32_t regIndex) const
+{
+    return (int64_t)toUint64(regIndex);
+}
+
+float ModbusRegisterView::toFloat32(uint32_t regIndex) const
+{
+    float value = 0;
+
+    decode(regIndex, &value, 1, sizeof(value));
+
+    return value;
+}
+
+double ModbusRegisterView::toFloat64(uint32_t regIndex) const
+{
+    double value = 0;
+
+    decode(regIndex, &value, 1, sizeof(value));
+
+    return value;
+}
+
+QString ModbusRegisterView::toString(uint32_t regIndex, uint32_t regCnt) const
+{
+    if(!contains(regIndex, regCnt))
+    {
+        return QString();
+    }
+
+    const uint8_t *dataP = m_dataP + regIndex * sizeof(uint16_t);
+    bool swapBytes = (WORD_ORDER_BADC == m_order || WORD_ORDER_DCBA == m_order);
+    char str[MODBUS_MAX_READ_REG_CNT * 2];
+    uint32_t len = 0;
+
+    if(regCnt > MODBUS_MAX_READ_REG_CNT)
+    {
+        regCnt = MODBUS_MAX_READ_REG_CNT;
+    }
+
+    for(uint32_t i = 0; i < regCnt * 2; i++)
+    {
+        char c = (char)dataP[swapBytes ? (i ^ 1) : i];
+
+        if('\0' == c)
+        {
+            break;
+        }
+
+        str[len++] = c;
+    }
+
+    return QString::fromLatin1(str, len);
+}
+
+uint32_t ModbusRegisterView::decodeUint16(uint32_t regIndex, uint16_t *outP, uint32_t cnt) const
+{
+    return decode(regIndex, outP, cnt, sizeof(uint16_t));
+}
+
+uint32_t ModbusRegisterView::decodeInt16(uint32_t regIndex, int16_t *outP, uint32_t cnt) const
+{
+    return decode(regIndex, outP, cnt, sizeof(int16_t));
+}
+
+uint32_t ModbusRegisterView::decodeUint32(uint32_t regIndex, uint32_t *outP, uint32_t cnt) const
+{
+    return decode(regIndex, outP, cnt, sizeof(uint32_t));
+}
+
+uint32_t ModbusRegisterView::decodeInt32(uint32_t regIndex, int32_t *outP, uint32_t cnt) const
+{
+    return decode(regIndex, outP, cnt, sizeof(int32_t));
+}
+
+uint32_t ModbusRegisterView::decodeUint64(uint32_t regIndex, uint64_t *outP, uint32_t cnt) const
+{
+    return decode(regIndex, outP, cnt, sizeof(uint64_t));
+}
+
+uint32_t ModbusRegisterView::decodeInt64(uint32_t regIndex, int64_t *outP, uint32_t cnt) const
+{
+    return decode(regIndex, outP, cnt, sizeof(int64_t));
+}
+
+uint32_t ModbusRegisterView::decodeFloat32(uint32_t regIndex, float *outP, uint32_t cnt) const
+{
+    return decode(regIndex, outP, cnt, sizeof(float));
+}
+
+uint32_t ModbusRegisterView::decodeFloat64(uint32_t regIndex, double *outP, uint32_t cnt) const
+{
+    return decode(regIndex, outP, cnt, sizeof(double));
+}
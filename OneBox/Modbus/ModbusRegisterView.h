@@ -0,0 +1,125 @@
+/**********************************************************************
+PACKAGE:        Communication
+FILE:           ModbusRegisterView.h
+COPYRIGHT (C):  All rights reserved.
+
+PURPOSE:        Typed decoding of Modbus register data with word order
+**********************************************************************/
+
+#ifndef MODBUSREGISTERVIEW_H
+#define MODBUSREGISTERVIEW_H
+
+#include <stdint.h>
+#include <QString>
+
+#include "ModbusData.h"
+
+/*
+ Modbus registers are big endian 16-bit words, a 32/64-bit value spans
+ 2/4 registers and devices disagree about their order. For the registers
+ R0 = [A B], R1 = [C D] on the wire, value of each word order is,
+
+ WORD_ORDER_ABCD: A B C D, big endian, the Modbus standard
+ WORD_ORDER_CDAB: C D A B, word swapped
+ WORD_ORDER_BADC: B A D C, byte swapped
+ WORD_ORDER_DCBA: D C B A, little endian
+
+ 64-bit values follow the same rule with 4 registers, e.g. CDAB of
+ R0 R1 R2 R3 is R3 R2 R1 R0. 16-bit values are only byte swapped by
+ BADC/DCBA.
+
+ ModbusRegisterView points to the received registers, e.g. the buffer of
+ MODBUS_READ_FEEDBACK, and never copies them. Block functions decode
+ cnt values straight into the caller's array, 16 bytes at a time with
+ SSE2 shuffles where available, otherwise value by value.
+*/
+
+enum MODBUS_WORD_ORDER
+{
+    WORD_ORDER_ABCD = 0,
+    WORD_ORDER_CDAB,
+    WORD_ORDER_BADC,
+    WORD_ORDER_DCBA
+};
+
+class ModbusRegisterView
+{
+public:
+    /*-----------------------------------------------------------------------
+    FUNCTION:		ModbusRegisterView
+    PURPOSE:		View received registers, data must outlive the view
+    ARGUMENTS:		const void *dataP           -- registers as received, big endian
+                    uint32_t regCnt             -- count of registers
+                    MODBUS_WORD_ORDER order     -- word order of 32/64-bit values
+    RETURNS:		None
+    -----------------------------------------------------------------------*/
+    ModbusRegisterView(const void *dataP, uint32_t regCnt, MODBUS_WORD_ORDER order = WORD_ORDER_ABCD);
+
+    // View the registers of a read response, feedback must outlive the view
+    explicit ModbusRegisterView(const struct MODBUS_READ_FEEDBACK &feedback, MODBUS_WORD_ORDER order = WORD_ORDER_ABCD);
+
+    uint32_t getRegCnt() const;
+    MODBUS_WORD_ORDER getWordOrder() const;
+
+    // True: regCnt registers from regIndex are inside the view
+    bool contains(uint32_t regIndex, uint32_t regCnt) const;
+
+    // Single value at register index, 0 if out of range
+    uint16_t toUint16(uint32_t regIndex) const;
+    int16_t toInt16(uint32_t regIndex) const;
+    uint32_t toUint32(uint32_t regIndex) const;
+    int32_t toInt32(uint32_t regIndex) const;
+    uint64_t toUint64(uint32_t regIndex) const;
+    int64_t toInt64(uint32_t regIndex) const;
+    float toFloat32(uint32_t regIndex) const;
+    double toFloat64(uint32_t regIndex) const;
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		toString
+    PURPOSE:		Decode 2 characters per register, BADC/DCBA swap them
+    ARGUMENTS:		uint32_t regIndex   -- first register
+                    uint32_t regCnt     -- count of registers
+    RETURNS:		Latin-1 string up to the first '\0'
+    -----------------------------------------------------------------------*/
+    QString toString(uint32_t regIndex, uint32_t regCnt) const;
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		decodeUint16/decodeUint32/decodeFloat32 ...
+    PURPOSE:		Decode cnt consecutive values into host byte order
+    ARGUMENTS:		uint32_t regIndex   -- register of the first value
+                    T *outP             -- output array of cnt values
+                    uint32_t cnt        -- count of values, not registers
+    RETURNS:		The count of values decoded, less than cnt if the view ends
+    -----------------------------------------------------------------------*/
+    uint32_t decodeUint16(uint32_t regIndex, uint16_t *outP, uint32_t cnt) const;
+    uint32_t decodeInt16(uint32_t regIndex, int16_t *outP, uint32_t cnt) const;
+    uint32_t decodeUint32(uint32_t regIndex, uint32_t *outP, uint32_t cnt) const;
+    uint32_t decodeInt32(uint32_t regIndex, int32_t *outP, uint32_t cnt) const;
+    uint32_t decodeUint64(uint32_t regIndex, uint64_t *outP, uint32_t cnt) const;
+    uint32_t decodeInt64(uint32_t regIndex, int64_t *outP, uint32_t cnt) const;
+    uint32_t decodeFloat32(uint32_t regIndex, float *outP, uint32_t cnt) const;
+    uint32_t decodeFloat64(uint32_t regIndex, double *outP, uint32_t cnt) const;
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		convert
+    PURPOSE:		Convert values between Modbus registers and host byte order,
+                    the conversion is its own inverse, so it encodes as well
+    ARGUMENTS:		const void *srcP            -- source values
+                    void *dstP                  -- destination, may be srcP
+                    uint32_t cnt                -- count of values
+                    uint32_t width              -- bytes of value, 2/4/8
+                    MODBUS_WORD_ORDER order     -- word order
+    RETURNS:		None
+    -----------------------------------------------------------------------*/
+    static void convert(const void *srcP, void *dstP, uint32_t cnt, uint32_t width, MODBUS_WORD_ORDER order);
+
+private:
+    const uint8_t *m_dataP;
+    uint32_t m_regCnt;
+    MODBUS_WORD_ORDER m_order;
+
+    // Decode cnt values of width bytes, return the count decoded
+    uint32_t decode(uint32_t regIndex, void *outP, uint32_t cnt, uint32_t width) const;
+};
+
+#endif // MODBUSREGISTERVIEW_H
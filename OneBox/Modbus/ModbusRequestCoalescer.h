@@ -0,0 +1,203 @@
+/**********************************************************************
+PACKAGE:        Communication
+FILE:           ModbusRequestCoalescer.h
+COPYRIGHT (C):  All rights reserved.
+
+PURPOSE:        Merge new requests into requests queued in Tx FIFO
+**********************************************************************/
+
+#ifndef MODBUSREQUESTCOALESCER_H
+#define MODBUSREQUESTCOALESCER_H
+
+#include <stdint.h>
+#include <string.h>
+#include <QQueue>
+
+#include "ModbusData.h"
+#include "ModbusPdu.h"
+#include "ModbusTransaction.h"
+#include "FifoBuffer.h"
+
+/*
+ Tx FIFO of ModbusTCP/ModbusRTU holds 2 slots per request,
+
+    MODBUS_REQUEST_INFO | ADU encoded by FRAME | MODBUS_REQUEST_INFO | ADU ...
+
+ and the queue of transaction handles holds one per request in the same
+ order. Before a new request is queued, merge() folds it into a request
+ still waiting in the FIFO,
+
+ - a read equal to a queued read (function code, offset, count) is
+   answered by the queued one, its handle follows the queued handle
+ - a write adjacent to or overlapping a queued write is merged into it,
+   registers written by both get the new value (last write wins). Two
+   FC06 are only merged on the same register, so a device without FC16
+   never gets one; otherwise the result is a FC16 of at most
+   MODBUS_MAX_WRITE_REG_CNT registers
+
+ The queue is searched from the newest request, the search stops at a
+ request touching the registers of the new one, so a read never passes
+ a write of its registers and writes keep their order.
+*/
+template<typename FRAME>
+class ModbusRequestCoalescer
+{
+public:
+    /*-----------------------------------------------------------------------
+    FUNCTION:       merge
+    PURPOSE:        Fold a new request into a queued one
+    ARGUMENTS:      FIFOBuffer *fifoBuf                 -- Tx FIFO
+                    QQueue<ModbusTransaction> &transactionQueue -- handles of queued requests
+                    uint8_t functionCode                -- FC03/FC04/FC06/FC16
+                    uint16_t regOffset                  -- register offset address
+                    uint16_t regCnt                     -- count of registers
+                    const char *dataP                   -- regCnt uint16_t in host byte order of write
+                    const ModbusTransaction &transaction -- handle of new request, may be null
+                    struct MODBUS_REQUEST_INFO &requestInfo -- request info after merge
+    RETURNS:        true - merged, do not queue it, false - queue it as usual
+    -----------------------------------------------------------------------*/
+    static bool merge(FIFOBuffer *fifoBuf, QQueue<ModbusTransaction> &transactionQueue,
+                      uint8_t functionCode, uint16_t regOffset, uint16_t regCnt, const char *dataP,
+                      const ModbusTransaction &transaction, struct MODBUS_REQUEST_INFO &requestInfo)
+    {
+        uint32_t requestCnt = fifoBuf->getCount() / 2;
+        uint32_t newEnd = (uint32_t)regOffset + regCnt;
+        bool isWrite = (MB_FUNC_WRITE_REGISTER == functionCode || MB_FUNC_WRITE_MULTIPLE_REGISTERS == functionCode);
+
+        // Slots of a request pushed but not committed yet, or handles out of step
+        if((uint32_t)transactionQueue.size() != requestCnt || 0 != fifoBuf->getCount() % 2)
+        {
+            return false;
+        }
+
+        for(int i = (int)requestCnt - 1; i >= 0; i--)
+        {
+            uint32_t infoLen = 0;
+            uint32_t aduLen = 0;
+            struct MODBUS_REQUEST_INFO *infoP = (struct MODBUS_REQUEST_INFO *)fifoBuf->getData(2 * i, infoLen);
+            uint8_t *aduP = (uint8_t *)fifoBuf->getData(2 * i + 1, aduLen);
+
+            if(NULL == infoP || NULL == aduP || sizeof(struct MODBUS_REQUEST_INFO) != infoLen)
+            {
+                return false;
+            }
+
+            uint8_t queuedFunctionCode = FRAME::getPdu(aduP)[0];
+            uint32_t queuedEnd = (uint32_t)infoP->address + infoP->len;
+            bool isQueuedWrite = (MODBUS_WR_OPT == infoP->rdwrFlag);
+            bool isOverlapped = (regOffset < queuedEnd && infoP->address < newEnd);
+
+            if(!isWrite)
+            {
+                if(!isQueuedWrite && queuedFunctionCode == functionCode &&
+                   infoP->address == regOffset && infoP->len == regCnt)
+                {
+                    attach(transactionQueue, i, transaction);
+                    requestInfo = *infoP;
+                    return true;
+                }
+
+                // A read must not pass a write of its registers
+                if(isQueuedWrite && isOverlapped)
+                {
+                    return false;
+                }
+
+                continue;
+            }
+
+            if(isQueuedWrite && regOffset <= queuedEnd && infoP->address <= newEnd &&
+               mergeWrite(fifoBuf, 2 * i + 1, infoP, aduP, functionCode, regOffset, regCnt, dataP))
+            {
+                attach(transactionQueue, i, transaction);
+                requestInfo = *infoP;
+                return true;
+            }
+
+            // A write must not pass a read or write of its registers
+            if(isOverlapped)
+            {
+                return false;
+            }
+        }
+
+        return false;
+    }
+
+private:
+    // New request is answered by queued request index
+    static void attach(QQueue<ModbusTransaction> &transactionQueue, int index, const ModbusTransaction &transaction)
+    {
+        if(transaction.isNull())
+        {
+            return;
+        }
+
+        if(transactionQueue.at(index).isNull())
+        {
+            transactionQueue[index] = transaction;
+            return;
+        }
+
+        ModbusTransaction follower = transaction;
+        follower.follow(transactionQueue.at(index));
+    }
+
+    // Rewrite queued write in FIFO slot with the new registers on top, false: cannot merge
+    static bool mergeWrite(FIFOBuffer *fifoBuf, uint32_t slotIndex, struct MODBUS_REQUEST_INFO *infoP, uint8_t *aduP,
+                           uint8_t functionCode, uint16_t regOffset, uint16_t regCnt, const char *dataP)
+    {
+        uint8_t *pduP = FRAME::getPdu(aduP);
+        uint8_t queuedFunctionCode = pduP[0];
+        uint16_t values[MODBUS_MAX_WRITE_REG_CNT];
+        uint32_t pduLen = 0;
+
+        uint16_t mergedOffset = (regOffset < infoP->address) ? regOffset : infoP->address;
+        uint32_t mergedEnd = (uint32_t)regOffset + regCnt;
+
+        if(mergedEnd < (uint32_t)infoP->address + infoP->len)
+        {
+            mergedEnd = (uint32_t)infoP->address + infoP->len;
+        }
+
+        uint32_t mergedCnt = mergedEnd - mergedOffset;
+
+        if(mergedCnt > MODBUS_MAX_WRITE_REG_CNT)
+        {
+            return false;
+        }
+
+        if(MB_FUNC_WRITE_REGISTER == queuedFunctionCode && MB_FUNC_WRITE_REGISTER == functionCode)
+        {
+            // Same register only, the value is replaced
+            if(infoP->address != regOffset)
+            {
+                return false;
+            }
+
+            memcpy(&values[0], dataP, sizeof(uint16_t));
+            pduLen = ModbusPdu<MB_FUNC_WRITE_REGISTER>::encodeRequest(pduP, regOffset, values[0]);
+        }
+        else
+        {
+            // Queued values are big endian, after function code, offset, count and byte count of FC16
+            const uint8_t *queuedValueP = (MB_FUNC_WRITE_REGISTER == queuedFunctionCode) ? (pduP + 3) : (pduP + 6);
+
+            for(uint16_t i = 0; i < infoP->len; i++)
+            {
+                values[infoP->address - mergedOffset + i] = modbusGetUint16(queuedValueP + i * 2);
+            }
+
+            memcpy(&values[regOffset - mergedOffset], dataP, regCnt * sizeof(uint16_t));
+
+            pduLen = ModbusPdu<MB_FUNC_WRITE_MULTIPLE_REGISTERS>::encodeRequest(pduP, mergedOffset, values, mergedCnt);
+        }
+
+        infoP->address = mergedOffset;
+        infoP->len = mergedCnt;
+
+        return fifoBuf->updateData(slotIndex, FRAME::reframe(aduP, pduLen));
+    }
+};
+
+#endif // MODBUSREQUESTCOALESCER_H
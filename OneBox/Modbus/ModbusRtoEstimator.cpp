@@ -0,0 +1,164 @@
+/**********************************************************************
+PACKAGE:        Communication
+FILE:           ModbusRtoEstimator.cpp
+COPYRIGHT (C):  All rights reserved.
+
+PURPOSE:        Response timeout of a device from measured round-trip times
+**********************************************************************/
+
+#include "ModbusRtoEstimator.h"
+
+ModbusRtoEstimator::ModbusRtoEstimator(const struct MODBUS_RTO_CONFIG &config)
+{
+    setConfig(config);
+}
+
+void ModbusRtoEstimator::setConfig(const struct MODBUS_RTO_CONFIG &config)
+{
+    this->config = config;
+
+    if(this->config.maxRtoInMs < this->config.minRtoInMs)
+    {
+        this->config.maxRtoInMs = this->config.minRtoInMs;
+    }
+
+    if(this->config.maxProbeIntervalInMs < this->config.probeIntervalInMs)
+    {
+        this->config.maxProbeIntervalInMs = this->config.probeIntervalInMs;
+    }
+
+    reset();
+}
+
+const struct MODBUS_RTO_CONFIG &ModbusRtoEstimator::getConfig() const
+{
+    return config;
+}
+
+void ModbusRtoEstimator::reset()
+{
+    srttX8 = 0;
+    rttVarX4 = 0;
+    hasSample = false;
+    backoffShift = 0;
+
+    failureCnt = 0;
+    parked = false;
+    probeIntervalInMs = config.probeIntervalInMs;
+    nextProbeInMs = 0;
+}
+
+uint32_t ModbusRtoEstimator::getRto() const
+{
+    uint64_t rtoInMs = config.initialRtoInMs;
+
+    if(hasSample)
+    {
+        uint32_t varInMs = rttVarX4;    // 4 * RTTVAR
+
+        rtoInMs = (srttX8 >> 3) + ((varInMs > 1) ? varInMs : 1);
+    }
+
+    rtoInMs <<= backoffShift;
+
+    if(rtoInMs < config.minRtoInMs)
+    {
+        rtoInMs = config.minRtoInMs;
+    }
+
+    if(rtoInMs > config.maxRtoInMs)
+    {
+        rtoInMs = config.maxRtoInMs;
+    }
+
+    return (uint32_t)rtoInMs;
+}
+
+uint32_t ModbusRtoEstimator::getSrtt() const
+{
+    return srttX8 >> 3;
+}
+
+uint32_t ModbusRtoEstimator::getRttVar() const
+{
+    return rttVarX4 >> 2;
+}
+
+void ModbusRtoEstimator::addSample(uint32_t rttInMs)
+{
+    if(!hasSample)
+    {
+        srttX8 = rttInMs << 3;
+        rttVarX4 = rttInMs << 1;
+        hasSample = true;
+        return;
+    }
+
+    uint32_t srttInMs = srttX8 >> 3;
+    uint32_t errInMs = (srttInMs > rttInMs) ? (srttInMs - rttInMs) : (rttInMs - srttInMs);
+
+    // Fixed point: RTTVAR += (|err| - RTTVAR) / 4, SRTT += (R - SRTT) / 8
+    rttVarX4 = rttVarX4 - (rttVarX4 >> 2) + errInMs;
+    srttX8 = srttX8 - (srttX8 >> 3) + rttInMs;
+}
+
+void ModbusRtoEstimator::onTimeout()
+{
+    if(backoffShift < MAX_BACKOFF_SHIFT && getRto() < config.maxRtoInMs)
+    {
+        backoffShift++;
+    }
+}
+
+bool ModbusRtoEstimator::onResponse()
+{
+    bool wasParked = parked;
+
+    backoffShift = 0;
+    failureCnt = 0;
+    parked = false;
+    probeIntervalInMs = config.probeIntervalInMs;
+
+    return wasParked;
+}
+
+bool ModbusRtoEstimator::onFailure(int64_t nowInMs)
+{
+    failureCnt++;
+
+    if(parked || 0 == config.failureThreshold || failureCnt < config.failureThreshold)
+    {
+        return false;
+    }
+
+    parked = true;
+    probeIntervalInMs = config.probeIntervalInMs;
+    nextProbeInMs = nowInMs + probeIntervalInMs;
+
+    return true;
+}
+
+bool ModbusRtoEstimator::allowRequest(int64_t nowInMs)
+{
+    if(!parked)
+    {
+        return true;
+    }
+
+    if(nowInMs < nextProbeInMs)
+    {
+        return false;
+    }
+
+    // Probe now, wait longer for the next one if this one fails as well
+    probeIntervalInMs = (probeIntervalInMs > config.maxProbeIntervalInMs / 2) ?
+                        config.maxProbeIntervalInMs : (probeIntervalInMs * 2);
+    nextProbeInMs = nowInMs + probeIntervalInMs;
+
+    return true;
+}
+
+bool ModbusRtoEstimator::isParked() const
+{
+    return parked;
+}
@@ -0,0 +1,112 @@
+/**********************************************************************
+PACKAGE:        Communication
+FILE:           ModbusRtoEstimator.h
+COPYRIGHT (C):  All rights reserved.
+
+PURPOSE:        Response timeout of a device from measured round-trip times
+**********************************************************************/
+
+#ifndef MODBUSRTOESTIMATOR_H
+#define MODBUSRTOESTIMATOR_H
+
+#include <stdint.h>
+
+struct MODBUS_RTO_CONFIG
+{
+    uint32_t initialRtoInMs;        // Response timeout before the first RTT sample
+    uint32_t minRtoInMs;
+    uint32_t maxRtoInMs;            // Backoff doubles the timeout up to it
+    uint32_t failureThreshold;      // Requests failing in a row to park device, 0: never park
+    uint32_t probeIntervalInMs;     // First probe period of a parked device
+    uint32_t maxProbeIntervalInMs;  // Probe period doubles up to it
+
+    MODBUS_RTO_CONFIG() :
+        initialRtoInMs(1000),
+        minRtoInMs(20),
+        maxRtoInMs(10000),
+        failureThreshold(5),
+        probeIntervalInMs(1000),
+        maxProbeIntervalInMs(30000)
+    {
+    }
+};
+
+/*
+ One estimator per device, as the retransmission timer of TCP (RFC 6298),
+
+    first sample R:     SRTT = R, RTTVAR = R / 2
+    next samples R:     RTTVAR = 3/4 * RTTVAR + 1/4 * |SRTT - R|
+                        SRTT = 7/8 * SRTT + 1/8 * R
+    RTO = SRTT + max(1, 4 * RTTVAR), within [minRtoInMs, maxRtoInMs]
+
+ Only requests answered at their first transmit are sampled (Karn), a
+ response to a retransmitted request may belong to either transmit.
+ Every timeout doubles the RTO until a response arrives.
+
+ Circuit breaker: after failureThreshold requests in a row failed all
+ retries, the device is parked. A parked device gets one request per
+ probe interval, the others fail at once, so the bus serves the devices
+ that answer. The probe interval doubles while the device stays silent,
+ any response unparks it.
+
+ Not thread safe, used in the thread of the transport only.
+*/
+class ModbusRtoEstimator
+{
+public:
+    explicit ModbusRtoEstimator(const struct MODBUS_RTO_CONFIG &config = MODBUS_RTO_CONFIG());
+
+    // Set config and forget samples, backoff and parking
+    void setConfig(const struct MODBUS_RTO_CONFIG &config);
+    const struct MODBUS_RTO_CONFIG &getConfig() const;
+    void reset();
+
+    // Timeout of next transmit, backoff included
+    uint32_t getRto() const;
+
+    // Smoothed RTT and its variation, 0 before the first sample
+    uint32_t getSrtt() const;
+    uint32_t getRttVar() const;
+
+    // RTT of a request answered at its first transmit
+    void addSample(uint32_t rttInMs);
+
+    // A transmit timed out, back off
+    void onTimeout();
+
+    // Any response of device, return true if it was parked
+    bool onResponse();
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:       onFailure
+    PURPOSE:        A request failed after all retries
+    ARGUMENTS:      int64_t nowInMs -- monotonic time
+    RETURNS:        true - device is parked by this failure
+    -----------------------------------------------------------------------*/
+    bool onFailure(int64_t nowInMs);
+
+    // True: send a request now. A parked device returns true once per probe interval
+    bool allowRequest(int64_t nowInMs);
+
+    bool isParked() const;
+
+private:
+    enum
+    {
+        MAX_BACKOFF_SHIFT = 16
+    };
+
+    struct MODBUS_RTO_CONFIG config;
+
+    uint32_t srttX8;            // SRTT * 8
+    uint32_t rttVarX4;          // RTTVAR * 4
+    bool hasSample;
+    uint32_t backoffShift;      // RTO is doubled by each timeout
+
+    uint32_t failureCnt;        // Requests failed in a row
+    bool parked;
+    uint32_t probeIntervalInMs;
+    int64_t nextProbeInMs;
+};
+
+#endif // MODBUSRTOESTIMATOR_H
@@ -0,0 +1,597 @@
+/**********************************************************************
+PACKAGE:        Communication
+FILE:           ModbusScanner.cpp
+COPYRIGHT (C):  All rights reserved.
+
+PURPOSE:        Find Modbus devices on TCP networks and RTU buses
+**********************************************************************/
+
+#include "ModbusScanner.h"
+#include <QDebug>
+
+// Exceptions of a gateway, the target behind it did not answer
+#define MODBUS_EXCEPTION_GATEWAY_PATH_UNAVAILABLE   0x0A
+#define MODBUS_EXCEPTION_GATEWAY_TARGET_FAILED      0x0B
+
+// Probe of 1 register: 8 bytes request + 7 bytes response, 11 bits per character
+#define MODBUS_SCAN_PROBE_BITS                      ((8 + 7) * 11)
+
+ModbusScanner::ModbusScanner(QObject *parent) :
+    QObject(parent),
+    tcpPort(502),
+    doneCnt(0),
+    totalCnt(0),
+    startingJobs(false)
+{
+    setConfig(MODBUS_SCAN_CONFIG());
+}
+
+ModbusScanner::~ModbusScanner()
+{
+    stop();
+}
+
+void ModbusScanner::setConfig(const struct MODBUS_SCAN_CONFIG &config)
+{
+    this->config = config;
+
+    if(0 == this->config.maxParallelCnt)
+    {
+        this->config.maxParallelCnt = 1;
+    }
+
+    if(0 == this->config.sampleCnt)
+    {
+        this->config.sampleCnt = 1;
+    }
+
+    // Timeouts are the normal result of a scan, never park a target
+    struct MODBUS_RTO_CONFIG rtoConfig;
+    rtoConfig.initialRtoInMs = this->config.probeTimeoutInMs;
+    rtoConfig.minRtoInMs = this->config.minProbeTimeoutInMs;
+    rtoConfig.maxRtoInMs = this->config.maxProbeTimeoutInMs;
+    rtoConfig.failureThreshold = 0;
+    tcpRto.setConfig(rtoConfig);
+}
+
+const struct MODBUS_SCAN_CONFIG &ModbusScanner::getConfig() const
+{
+    return config;
+}
+
+QList<QHostAddress> ModbusScanner::getSubnetHosts(const QHostAddress &network, int prefixLen)
+{
+    QList<QHostAddress> hostList;
+
+    // /16 at most, 65534 hosts
+    if(QAbstractSocket::IPv4Protocol != network.protocol() || prefixLen < 16 || prefixLen > 32)
+    {
+        return hostList;
+    }
+
+    uint32_t mask = (32 == prefixLen) ? 0xFFFFFFFF : ~(0xFFFFFFFF >> prefixLen);
+    uint32_t first = network.toIPv4Address() & mask;
+    uint32_t last = first | ~mask;
+
+    // /31 and /32 have no network and broadcast address
+    if(prefixLen < 31)
+    {
+        first++;
+        last--;
+    }
+
+    for(uint32_t ip = first; ip <= last && ip >= first; ip++)
+    {
+        hostList.append(QHostAddress(ip));
+    }
+
+    return hostList;
+}
+
+bool ModbusScanner::startTcpScan(const QList<QHostAddress> &hostList, const QList<uint8_t> &unitIdList, uint16_t port)
+{
+    if(isRunning() || hostList.isEmpty() || unitIdList.isEmpty())
+    {
+        return false;
+    }
+
+    resultList.clear();
+    doneCnt = 0;
+    totalCnt = hostList.size() * unitIdList.size();
+
+    // RTT of the last scan may belong to another network
+    setConfig(config);
+    clock.start();
+
+    // Jobs and their ModbusTCP are made once started, see startJobs()
+    waitingHostList = hostList;
+    tcpUnitIdList = unitIdList;
+    tcpPort = port;
+
+    startJobs();
+
+    return true;
+}
+
+bool ModbusScanner::startRtuScan(ModbusRTU *modbusP, const QList<BaudRateType> &baudRateList,
+                                 uint8_t firstAddr, uint8_t lastAddr)
+{
+    if(isRunning() || NULL == modbusP || baudRateList.isEmpty())
+    {
+        return false;
+    }
+
+    if(firstAddr < MB_ADDRESS_MIN || lastAddr > MB_ADDRESS_MAX || firstAddr > lastAddr)
+    {
+        return false;
+    }
+
+    resultList.clear();
+    doneCnt = 0;
+    totalCnt = baudRateList.size() * (lastAddr - firstAddr + 1);
+
+    clock.start();
+
+    waitingJobList.append(new ModbusScanJob(this, modbusP, baudRateList, firstAddr, lastAddr));
+
+    startJobs();
+
+    return true;
+}
+
+void ModbusScanner::stop()
+{
+    QList<ModbusScanJob *> jobList = runningJobList + waitingJobList;
+
+    runningJobList.clear();
+    waitingJobList.clear();
+    waitingHostList.clear();
+
+    // A job may be inside its own slot, which called stop() from a signal of scanner
+    for(int i = 0; i < jobList.size(); i++)
+    {
+        jobList.at(i)->abort();
+        jobList.at(i)->deleteLater();
+    }
+}
+
+bool ModbusScanner::isRunning() const
+{
+    return (!runningJobList.isEmpty() || !waitingJobList.isEmpty() || !waitingHostList.isEmpty());
+}
+
+QList<struct MODBUS_SCAN_RESULT> ModbusScanner::getResults() const
+{
+    return resultList;
+}
+
+uint32_t ModbusScanner::getBaudRateValue(BaudRateType baudRate)
+{
+    switch(baudRate)
+    {
+    case BAUD1200:
+        return 1200;
+    case BAUD2400:
+        return 2400;
+    case BAUD4800:
+        return 4800;
+    case BAUD19200:
+        return 19200;
+    case BAUD38400:
+        return 38400;
+    case BAUD57600:
+        return 57600;
+    case BAUD115200:
+        return 115200;
+    case BAUD9600:
+    default:
+        return 9600;
+    }
+}
+
+void ModbusScanner::startJobs()
+{
+    startingJobs = true;
+
+    // A job failing at once frees its slot for the next in this loop
+    while((!waitingJobList.isEmpty() || !waitingHostList.isEmpty()) &&
+          (uint32_t)runningJobList.size() < config.maxParallelCnt)
+    {
+        ModbusScanJob *jobP = NULL;
+
+        if(!waitingJobList.isEmpty())
+        {
+            jobP = waitingJobList.takeFirst();
+        }
+        else
+        {
+            jobP = new ModbusScanJob(this, waitingHostList.takeFirst(), tcpPort, tcpUnitIdList);
+        }
+
+        runningJobList.append(jobP);
+        jobP->start();
+    }
+
+    startingJobs = false;
+
+    if(!isRunning())
+    {
+        // Emit signal
+        emit finished();
+    }
+}
+
+void ModbusScanner::reportDevice(const struct MODBUS_SCAN_RESULT &result)
+{
+    resultList.append(result);
+
+#ifdef MODBUS_SCANNER_DEBUG_TRACE
+    qDebug() << "ModbusScanner::reportDevice()" << result.address.toString() << result.unitId
+             << "baud" << getBaudRateValue(result.baudRate) << "rtt" << result.avgRttInMs;
+#endif
+
+    // Emit signal
+    emit deviceFound(result);
+}
+
+void ModbusScanner::reportProgress(int cnt)
+{
+    doneCnt += cnt;
+
+    // Emit signal
+    emit progress(doneCnt, totalCnt);
+}
+
+void ModbusScanner::finishJob(ModbusScanJob *jobP)
+{
+    // Not in list once stopped
+    if(!runningJobList.removeOne(jobP))
+    {
+        return;
+    }
+
+    jobP->deleteLater();
+
+    if(!startingJobs)
+    {
+        startJobs();
+    }
+}
+
+
+ModbusScanJob::ModbusScanJob(ModbusScanner *scannerP, const QHostAddress &address, uint16_t port,
+                             const QList<uint8_t> &unitIdList) :
+    QObject(NULL),
+    scannerP(scannerP),
+    modbusTcpP(NULL),
+    modbusRtuP(NULL),
+    address(address),
+    port(port),
+    targetIndex(-1),
+    foundCnt(0),
+    frameTimeInMs(0),
+    rttSumInMs(0),
+    txTimeInMs(0),
+    finished(false)
+{
+    for(int i = 0; i < unitIdList.size(); i++)
+    {
+        struct TARGET target;
+        target.unitId = unitIdList.at(i);
+        target.baudRate = BAUD9600;
+        targetList.append(target);
+    }
+}
+
+ModbusScanJob::ModbusScanJob(ModbusScanner *scannerP, ModbusRTU *modbusRtuP, const QList<BaudRateType> &baudRateList,
+                             uint8_t firstAddr, uint8_t lastAddr) :
+    QObject(NULL),
+    scannerP(scannerP),
+    modbusTcpP(NULL),
+    modbusRtuP(modbusRtuP),
+    port(0),
+    targetIndex(-1),
+    foundCnt(0),
+    frameTimeInMs(0),
+    rttSumInMs(0),
+    txTimeInMs(0),
+    finished(false)
+{
+    for(int i = 0; i < baudRateList.size(); i++)
+    {
+        for(uint32_t addr = firstAddr; addr <= lastAddr; addr++)
+        {
+            struct TARGET target;
+            target.unitId = (uint8_t)addr;
+            target.baudRate = baudRateList.at(i);
+            targetList.append(target);
+        }
+    }
+
+    rtuSetting.slaveAddr = modbusRtuP->getSlaveAddr();
+    rtuSetting.baudRate = modbusRtuP->getBaudRate();
+    rtuSetting.retryTimes = modbusRtuP->getTxRetryTimes();
+    rtuSetting.errorCheck = modbusRtuP->isErrorCheckEnabled();
+    rtuSetting.txPeriodInMs = modbusRtuP->getModbusTimeOut();
+    rtuSetting.rtoConfig = modbusRtuP->getRtoConfig();
+}
+
+ModbusScanJob::~ModbusScanJob()
+{
+    if(NULL != modbusTcpP)
+    {
+        delete modbusTcpP;
+        modbusTcpP = NULL;
+    }
+}
+
+void ModbusScanJob::start()
+{
+    const struct MODBUS_SCAN_CONFIG &config = scannerP->getConfig();
+
+    if(NULL == modbusRtuP)
+    {
+        modbusTcpP = new ModbusTCP;
+
+        // One probe at a time, no retransmit, a dead host is not retried
+        modbusTcpP->setAutoReconnect(false);
+        modbusTcpP->setConnectTimeout(config.connectTimeoutInMs);
+        modbusTcpP->setTxPeriod(config.txPeriodInMs);
+        modbusTcpP->setTxRetryTimes(0);
+        modbusTcpP->setRequestMergeEnabled(false);
+
+        connect(modbusTcpP, SIGNAL(connectionChanged(bool)), this, SLOT(handleConnectionChanged(bool)));
+        connect(modbusTcpP, SIGNAL(connectFailed(QString)), this, SLOT(handleConnectFailed(QString)));
+
+        // Probing starts once connected
+        if(!modbusTcpP->connectToServer(address, port))
+        {
+            finish();
+        }
+
+        return;
+    }
+
+    // Re-opening the COM port would load the baud rate of ini file
+    modbusRtuP->setErrorCheckEnabled(false);
+    modbusRtuP->setTxRetryTimes(0);
+    modbusRtuP->setModbusTimeOut(config.txPeriodInMs);
+
+    nextTarget();
+}
+
+void ModbusScanJob::abort()
+{
+    if(finished)
+    {
+        return;
+    }
+
+    finished = true;
+    release();
+}
+
+int ModbusScanJob::getTargetCnt() const
+{
+    return targetList.size();
+}
+
+void ModbusScanJob::handleConnectionChanged(bool connected)
+{
+    if(finished)
+    {
+        return;
+    }
+
+    if(!connected)
+    {
+        // Connection lost, the rest of unit IDs are not probed
+        finish();
+        return;
+    }
+
+    if(-1 == targetIndex)
+    {
+        modbusTcpP->startPeriodTxService();
+        nextTarget();
+    }
+}
+
+void ModbusScanJob::handleConnectFailed(QString error)
+{
+    Q_UNUSED(error);
+
+    if(!finished)
+    {
+        finish();
+    }
+}
+
+void ModbusScanJob::handleTransaction(ModbusTransaction transaction)
+{
+    if(finished)
+    {
+        return;
+    }
+
+    const struct MODBUS_SCAN_CONFIG &config = scannerP->getConfig();
+    uint32_t rttInMs = (uint32_t)(scannerP->clock.elapsed() - txTimeInMs);
+    ModbusRtoEstimator *rtoP = (NULL != modbusRtuP) ? &rtuRto : &scannerP->tcpRto;
+
+    bool answered = transaction.isOk() ||
+                    (ModbusTransaction::STATUS_EXCEPTION == transaction.getStatus() &&
+                     MODBUS_EXCEPTION_GATEWAY_PATH_UNAVAILABLE != transaction.getExceptionCode() &&
+                     MODBUS_EXCEPTION_GATEWAY_TARGET_FAILED != transaction.getExceptionCode());
+
+    // Nothing at this target
+    if(0 == result.sampleCnt && !answered)
+    {
+        scannerP->reportProgress(1);
+        nextTarget();
+        return;
+    }
+
+    if(0 == result.sampleCnt)
+    {
+        result.exceptionCode = transaction.getExceptionCode();
+        result.minRttInMs = rttInMs;
+    }
+
+    result.sampleCnt++;
+
+    if(answered)
+    {
+        result.responseCnt++;
+        result.minRttInMs = (rttInMs < result.minRttInMs) ? rttInMs : result.minRttInMs;
+        result.maxRttInMs = (rttInMs > result.maxRttInMs) ? rttInMs : result.maxRttInMs;
+        rttSumInMs += rttInMs;
+
+        // Next probes of all targets wait for this RTT
+        rtoP->addSample(rttInMs);
+    }
+
+    // Response time profile
+    if(result.sampleCnt < config.sampleCnt)
+    {
+        probe();
+        return;
+    }
+
+    result.avgRttInMs = (uint32_t)(rttSumInMs / result.responseCnt);
+    foundCnt++;
+
+    scannerP->reportDevice(result);
+
+    // Stopped by a slot of deviceFound()
+    if(finished)
+    {
+        return;
+    }
+
+    scannerP->reportProgress(1);
+    nextTarget();
+}
+
+void ModbusScanJob::nextTarget()
+{
+    const struct MODBUS_SCAN_CONFIG &config = scannerP->getConfig();
+
+    if(finished)
+    {
+        return;
+    }
+
+    targetIndex++;
+
+    if(targetIndex >= targetList.size())
+    {
+        finish();
+        return;
+    }
+
+    const struct TARGET &target = targetList.at(targetIndex);
+
+    // First address at a baud rate
+    if(NULL != modbusRtuP && (0 == targetIndex || target.baudRate != targetList.at(targetIndex - 1).baudRate))
+    {
+        // A bus runs at one baud rate
+        if(0 != foundCnt && config.stopAtFoundBaud)
+        {
+            finish();
+            return;
+        }
+
+        foundCnt = 0;
+        modbusRtuP->setBaudRate(target.baudRate);
+
+        uint32_t bps = ModbusScanner::getBaudRateValue(target.baudRate);
+        frameTimeInMs = (MODBUS_SCAN_PROBE_BITS * 1000 + bps - 1) / bps;
+
+        // RTT of another baud rate does not apply
+        struct MODBUS_RTO_CONFIG rtoConfig;
+        rtoConfig.initialRtoInMs = config.probeTimeoutInMs + frameTimeInMs;
+        rtoConfig.minRtoInMs = config.minProbeTimeoutInMs + frameTimeInMs;
+        rtoConfig.maxRtoInMs = config.maxProbeTimeoutInMs + frameTimeInMs;
+        rtoConfig.failureThreshold = 0;
+        rtuRto.setConfig(rtoConfig);
+    }
+
+    result = MODBUS_SCAN_RESULT();
+    result.address = address;
+    result.port = port;
+    result.baudRate = target.baudRate;
+    result.unitId = target.unitId;
+    rttSumInMs = 0;
+
+    probe();
+}
+
+void ModbusScanJob::probe()
+{
+    const struct MODBUS_SCAN_CONFIG &config = scannerP->getConfig();
+    ModbusRtoEstimator *rtoP = (NULL != modbusRtuP) ? &rtuRto : &scannerP->tcpRto;
+    ModbusTransaction transaction;
+
+    // Timeout of this probe is pinned, the transport must not back off
+    struct MODBUS_RTO_CONFIG rtoConfig = rtoP->getConfig();
+    rtoConfig.initialRtoInMs = rtoP->getRto();
+    rtoConfig.minRtoInMs = rtoConfig.initialRtoInMs;
+    rtoConfig.maxRtoInMs = rtoConfig.initialRtoInMs;
+    rtoConfig.failureThreshold = 0;
+
+    if(NULL != modbusRtuP)
+    {
+        modbusRtuP->setRtoConfig(rtoConfig);
+        modbusRtuP->setSlaveAddr(result.unitId);
+        transaction = modbusRtuP->transact(config.functionCode, config.regOffset, 1);
+    }
+    else
+    {
+        modbusTcpP->setRtoConfig(rtoConfig);
+        modbusTcpP->setUnitID(result.unitId);
+        transaction = modbusTcpP->transact(config.functionCode, config.regOffset, 1);
+    }
+
+    txTimeInMs = scannerP->clock.elapsed();
+
+    // Always queued, also if rejected at once
+    transaction.onFinished(this, SLOT(handleTransaction(ModbusTransaction)));
+}
+
+void ModbusScanJob::finish()
+{
+    if(finished)
+    {
+        return;
+    }
+
+    finished = true;
+
+    // Targets not probed are done as well
+    scannerP->reportProgress(targetList.size() - ((targetIndex < 0) ? 0 : targetIndex));
+
+    release();
+    scannerP->finishJob(this);
+}
+
+void ModbusScanJob::release()
+{
+    if(NULL != modbusRtuP)
+    {
+        // setModbusTimeOut() resets the timeout estimator, restore its config after it
+        modbusRtuP->setSlaveAddr(rtuSetting.slaveAddr);
+        modbusRtuP->setBaudRate(rtuSetting.baudRate);
+        modbusRtuP->setTxRetryTimes(rtuSetting.retryTimes);
+        modbusRtuP->setErrorCheckEnabled(rtuSetting.errorCheck);
+        modbusRtuP->setModbusTimeOut(rtuSetting.txPeriodInMs);
+        modbusRtuP->setRtoConfig(rtuSetting.rtoConfig);
+        modbusRtuP = NULL;
+    }
+
+    if(NULL != modbusTcpP)
+    {
+        disconnect(modbusTcpP, 0, this, 0);
+        modbusTcpP->stopPeriodTxService();
+        modbusTcpP->disconnectFromServer();
+    }
+}
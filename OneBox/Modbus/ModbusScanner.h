@@ -0,0 +1,273 @@
+/**********************************************************************
+PACKAGE:        Communication
+FILE:           ModbusScanner.h
+COPYRIGHT (C):  All rights reserved.
+
+PURPOSE:        Find Modbus devices on TCP networks and RTU buses
+**********************************************************************/
+
+#ifndef MODBUSSCANNER_H
+#define MODBUSSCANNER_H
+
+#include <stdint.h>
+#include <QObject>
+#include <QList>
+#include <QHostAddress>
+#include <QElapsedTimer>
+
+#include "ModbusData.h"
+#include "ModbusTransaction.h"
+#include "ModbusRtoEstimator.h"
+#include "ModbusTCP.h"
+#include "ModbusRTU.h"
+
+struct MODBUS_SCAN_CONFIG
+{
+    uint32_t maxParallelCnt;        // TCP endpoints probed at once
+    uint32_t connectTimeoutInMs;    // TCP connect timeout
+    uint32_t probeTimeoutInMs;      // Response timeout until the first response of scan
+    uint32_t minProbeTimeoutInMs;   // Timeout follows RTT of responses within [min, max]
+    uint32_t maxProbeTimeoutInMs;
+    uint32_t sampleCnt;             // Probes per device found, response time profile
+    uint32_t txPeriodInMs;          // Tx period of the transport while scanning
+    uint8_t functionCode;           // Probe reads 1 register, FC03, or FC04 on TCP
+    uint16_t regOffset;
+    bool stopAtFoundBaud;           // RTU: skip the next baud rates once devices answer
+
+    MODBUS_SCAN_CONFIG() :
+        maxParallelCnt(32),
+        connectTimeoutInMs(500),
+        probeTimeoutInMs(200),
+        minProbeTimeoutInMs(20),
+        maxProbeTimeoutInMs(1000),
+        sampleCnt(5),
+        txPeriodInMs(5),
+        functionCode(MB_FUNC_READ_HOLDING_REGISTER),
+        regOffset(0),
+        stopAtFoundBaud(true)
+    {
+    }
+};
+
+// Device answering the probe
+struct MODBUS_SCAN_RESULT
+{
+    QHostAddress address;       // TCP endpoint, null on RTU bus
+    uint16_t port;
+    BaudRateType baudRate;      // RTU bus
+    uint8_t unitId;             // Unit ID or slave address
+    uint8_t exceptionCode;      // Probe answered by exception, 0: by registers
+
+    // Response time profile, RTT includes up to one Tx period of queueing
+    uint32_t sampleCnt;         // Probes sent
+    uint32_t responseCnt;       // Probes answered
+    uint32_t minRttInMs;
+    uint32_t avgRttInMs;
+    uint32_t maxRttInMs;
+
+    MODBUS_SCAN_RESULT() :
+        port(0),
+        baudRate(BAUD9600),
+        unitId(0),
+        exceptionCode(0),
+        sampleCnt(0),
+        responseCnt(0),
+        minRttInMs(0),
+        avgRttInMs(0),
+        maxRttInMs(0)
+    {
+    }
+};
+
+class ModbusScanJob;
+
+/*
+ Commissioning scan,
+
+ TCP: every host of the list gets its own ModbusTCP once its turn
+ comes, at most maxParallelCnt connect and probe at once, the others
+ wait as a bare address, so a subnet costs no more transports. A host
+ refusing or not answering the connect is done after connectTimeoutInMs.
+ On a connected host the unit IDs are probed one after the other.
+
+ RTU: the given ModbusRTU sweeps the slave addresses on each baud rate,
+ its slave address, baud rate, retries, Tx period and timeout are
+ restored once done. The bus is probed one request at a time, the probe
+ is a read of 1 register, 8 bytes request and 7 bytes response, parsed
+ by the framer of ModbusRTU.
+
+ Any answer proves a device, an exception as well, except 0x0A/0x0B of
+ a gateway without the target. A found device gets sampleCnt probes for
+ its response time profile.
+
+ Timeouts adapt: a probe waits for the RTT of the responses so far
+ (SRTT + 4 * RTTVAR, see ModbusRtoEstimator) instead of a fixed worst
+ case, so silent addresses cost little. Timeouts never back off, they
+ are the normal result of a scan. On RTU the transfer time of probe and
+ response at the baud rate is added, RTT is measured per baud rate.
+*/
+class ModbusScanner : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ModbusScanner(QObject *parent = 0);
+    virtual ~ModbusScanner();
+
+    void setConfig(const struct MODBUS_SCAN_CONFIG &config);
+    const struct MODBUS_SCAN_CONFIG &getConfig() const;
+
+    // Hosts of an IPv4 subnet without network and broadcast address, e.g. 192.168.1.0/24
+    static QList<QHostAddress> getSubnetHosts(const QHostAddress &network, int prefixLen);
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:       startTcpScan
+    PURPOSE:        Probe unit IDs of TCP hosts in parallel
+    ARGUMENTS:      const QList<QHostAddress> &hostList -- hosts, e.g. getSubnetHosts()
+                    const QList<uint8_t> &unitIdList    -- unit IDs probed on each host
+                    uint16_t port                       -- Modbus TCP port
+    RETURNS:        true - started, false - running already or empty list
+    -----------------------------------------------------------------------*/
+    bool startTcpScan(const QList<QHostAddress> &hostList, const QList<uint8_t> &unitIdList, uint16_t port = 502);
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:       startRtuScan
+    PURPOSE:        Sweep slave addresses and baud rates of a RTU bus
+    ARGUMENTS:      ModbusRTU *modbusP                  -- opened bus, no other requests while scanning
+                    const QList<BaudRateType> &baudRateList -- baud rates in order of probing
+                    uint8_t firstAddr                   -- first slave address
+                    uint8_t lastAddr                    -- last slave address
+    RETURNS:        true - started, false - running already or invalid argument
+    -----------------------------------------------------------------------*/
+    bool startRtuScan(ModbusRTU *modbusP, const QList<BaudRateType> &baudRateList,
+                      uint8_t firstAddr = MB_ADDRESS_MIN, uint8_t lastAddr = MB_ADDRESS_MAX);
+
+    // Stop scanning, finished() is not emitted
+    void stop();
+
+    bool isRunning() const;
+
+    // Devices found by the last scan
+    QList<struct MODBUS_SCAN_RESULT> getResults() const;
+
+    // Bits per second of baud rate
+    static uint32_t getBaudRateValue(BaudRateType baudRate);
+
+signals:
+    void deviceFound(const struct MODBUS_SCAN_RESULT &result);
+
+    // Unit IDs or slave addresses done of all
+    void progress(int doneCnt, int totalCnt);
+
+    void finished();
+
+private:
+    friend class ModbusScanJob;
+
+    struct MODBUS_SCAN_CONFIG config;
+
+    QList<ModbusScanJob *> waitingJobList;  // RTU bus not started yet
+    QList<QHostAddress> waitingHostList;    // TCP hosts not started yet, the job is made at start
+    QList<uint8_t> tcpUnitIdList;           // Unit IDs probed on each TCP host
+    uint16_t tcpPort;
+    QList<ModbusScanJob *> runningJobList;
+    QList<struct MODBUS_SCAN_RESULT> resultList;
+
+    ModbusRtoEstimator tcpRto;      // Probe timeout of all TCP hosts
+    QElapsedTimer clock;
+
+    int doneCnt;
+    int totalCnt;
+    bool startingJobs;              // True: inside startJobs()
+
+    // Start waiting jobs up to maxParallelCnt, finished() once all are done
+    void startJobs();
+
+    // Called by job
+    void reportDevice(const struct MODBUS_SCAN_RESULT &result);
+    void reportProgress(int cnt);
+    void finishJob(ModbusScanJob *jobP);
+};
+
+/*
+ One TCP host or RTU bus of ModbusScanner, probes its targets one at a
+ time. Internal to ModbusScanner.
+*/
+class ModbusScanJob : public QObject
+{
+    Q_OBJECT
+public:
+    // TCP host, ModbusTCP is made by start() and owned by the job
+    ModbusScanJob(ModbusScanner *scannerP, const QHostAddress &address, uint16_t port, const QList<uint8_t> &unitIdList);
+
+    // RTU bus, settings of ModbusRTU are restored once done or aborted
+    ModbusScanJob(ModbusScanner *scannerP, ModbusRTU *modbusRtuP, const QList<BaudRateType> &baudRateList,
+                  uint8_t firstAddr, uint8_t lastAddr);
+
+    virtual ~ModbusScanJob();
+
+    void start();
+
+    // Stop probing at once, restore ModbusRTU, no more reports to scanner
+    void abort();
+
+    // Unit IDs or slave addresses of job
+    int getTargetCnt() const;
+
+private slots:
+    void handleConnectionChanged(bool connected);
+    void handleConnectFailed(QString error);
+    void handleTransaction(ModbusTransaction transaction);
+
+private:
+    // Unit ID or slave address at a baud rate
+    struct TARGET
+    {
+        uint8_t unitId;
+        BaudRateType baudRate;
+    };
+
+    // Settings of ModbusRTU before the scan
+    struct RTU_SETTING
+    {
+        uint8_t slaveAddr;
+        BaudRateType baudRate;
+        uint32_t retryTimes;
+        bool errorCheck;
+        int txPeriodInMs;
+        struct MODBUS_RTO_CONFIG rtoConfig;
+    };
+
+    ModbusScanner *scannerP;
+    ModbusTCP *modbusTcpP;      // Owned, NULL until started
+    ModbusRTU *modbusRtuP;      // Not owned
+    struct RTU_SETTING rtuSetting;
+
+    QHostAddress address;
+    uint16_t port;
+
+    QList<struct TARGET> targetList;
+    int targetIndex;
+    int foundCnt;               // Devices found at the baud rate of current target
+
+    ModbusRtoEstimator rtuRto;  // Probe timeout at the current baud rate, RTU only
+    uint32_t frameTimeInMs;     // Transfer time of probe and response at the baud rate
+
+    struct MODBUS_SCAN_RESULT result;   // Device of current target
+    uint64_t rttSumInMs;
+    int64_t txTimeInMs;
+    bool finished;
+
+    // Move to next target, finish job after the last one
+    void nextTarget();
+
+    // Send a probe to current target
+    void probe();
+
+    // Report the rest of targets as done and leave
+    void finish();
+
+    // Restore ModbusRTU, disconnect ModbusTCP
+    void release();
+};
+
+#endif // MODBUSSCANNER_H
@@ -13,13 +13,16 @@ PURPOSE:        Modbus TCP interface
 ModbusTCP::ModbusTCP(QObject *parent) :
     QThread(parent),
     m_tcpClient(new TCPClient),
+    m_udpClient(NULL),
+    m_transportMode(MODE_TCP),
     rxLoopBuf(new LoopBuffer),
-    fifoBuf(new FIFOBuffer),
+    fifoBuf(new FIFOBuffer(TX_FIFO_DEPTH, TX_BUF_SIZE)),
     txBufLen(0),
     m_transactionID(0x0000),
     m_protocolID(0x0000),
     m_unitID(1),
     isRunning(false),
+    txTransactionId(0),
     m_periodTxTimeInMs(100),
     periodTxTmr(NULL),
     getResponseFlag(true),
@@ -27,14 +30,34 @@ ModbusTCP::ModbusTCP(QObject *parent) :
     TX_RETRY_MAX_TIMES(1),
     txErrorCnt(0),
     TX_ERROR_MAX_CNT(10*TX_RETRY_MAX_TIMES),
-    m_autoConnectToServerFlag(true)
+    m_autoConnectToServerFlag(true),
+    requestMergeEnabled(true),
+    txTimeInMs(0),
+    rtoTmr(NULL),
+    maxOutstandingCnt(8)
 {
     // Init Tx buffer for transmit
     m_comTxBuf = new char [TX_BUF_SIZE];
     memset(m_comTxBuf, 0, TX_BUF_SIZE);
+    memset(&txRequestInfo, 0, sizeof(struct MODBUS_REQUEST_INFO));
+
+    // Until RTT is measured, a request gets one Tx period as before
+    struct MODBUS_RTO_CONFIG rtoConfig;
+    rtoConfig.initialRtoInMs = m_periodTxTimeInMs;
+    rtoEstimator.setConfig(rtoConfig);
+    rtoClock.start();
 
     bindModel(m_tcpClient);
 
+    // Response is handled from newDataReady(QByteArray), the rx FIFO is never read
+    m_tcpClient->setRxFifoEnabled(false);
+
+    // Response may be split or merged in TCP stream, only report whole ADU
+    m_tcpClient->setFramer(new MbapFramer);
+
+    // A dead server is retried in background, never blocks the Tx timer
+    m_tcpClient->setAutoReconnect(m_autoConnectToServerFlag);
+
     // Signals & slots
     connect(this, SIGNAL(startTxTimer()), this, SLOT(initTxTimer()));
     connect(this, SIGNAL(stopTxTimer()), this, SLOT(deInitTxTimer()));
@@ -43,7 +66,21 @@ ModbusTCP::ModbusTCP(QObject *parent) :
 
 ModbusTCP::~ModbusTCP()
 {
+    // Requests are never answered
+    txTransaction.finish(ModbusTransaction::STATUS_CANCELLED);
+    while(!txTransactionQueue.isEmpty())
+    {
+        txTransactionQueue.dequeue().finish(ModbusTransaction::STATUS_CANCELLED);
+    }
+
+    QHash<uint16_t, struct OUTSTANDING_REQUEST>::iterator it = outstandingHash.begin();
+    for(; outstandingHash.end() != it; ++it)
+    {
+        it.value().transaction.finish(ModbusTransaction::STATUS_CANCELLED);
+    }
+
     delete m_tcpClient;
+    delete m_udpClient;
     delete rxLoopBuf;
     delete fifoBuf;
 
@@ -73,7 +110,8 @@ void ModbusTCP::bindModel(TCPClient *clientP)
         m_tcpClient = clientP;
 
         connect(m_tcpClient, SIGNAL(newDataReady(QByteArray)), this, SLOT(updateIncomingData(QByteArray)));
-        connect(m_tcpClient, SIGNAL(connectionOut()), this, SLOT(diconnectedStatus()));
+        connect(m_tcpClient, SIGNAL(connectionChanged(bool)), this, SLOT(updateConnectionStatus(bool)));
+        connect(m_tcpClient, SIGNAL(connectFailed(QString)), this, SIGNAL(connectFailed(QString)));
     }
 }
 
@@ -87,22 +125,103 @@ void ModbusTCP::unbind()
     m_tcpClient = NULL;
 }
 
-bool ModbusTCP::connectToServer(const QHostAddress &ip, uint16_t port)
+bool ModbusTCP::setTransportMode(TRANSPORT_MODE mode)
 {
-    bool ret = false;
+    QMutexLocker locker(&mutex);
 
-    if(NULL != m_tcpClient)
+    // Queued ADUs are framed for the current mode
+    if(isRunning || isConnecting() || 0 != fifoBuf->getCount() || !outstandingHash.isEmpty())
     {
-        ret = m_tcpClient->connectToServer(ip, port);
+        return false;
     }
 
+    switch(mode)
+    {
+    case MODE_TCP:
+        if(NULL == m_tcpClient)
+        {
+            return false;
+        }
+
+        m_tcpClient->setFramer(new MbapFramer);
+        break;
+    case MODE_RTU_OVER_TCP:
+        if(NULL == m_tcpClient)
+        {
+            return false;
+        }
+
+        // Response length follows from function code, no MBAP header
+        m_tcpClient->setFramer(new ModbusRtuFramer);
+        break;
+    case MODE_UDP:
+        if(NULL == m_udpClient)
+        {
+            m_udpClient = new UDPClient;
+
+            // One ADU per datagram, no framer
+            connect(m_udpClient, SIGNAL(newDataRx(QHostAddress,int,QByteArray)),
+                    this, SLOT(updateIncomingDatagram(QHostAddress,int,QByteArray)));
+            connect(m_udpClient, SIGNAL(connectionChanged(bool)), this, SLOT(updateConnectionStatus(bool)));
+        }
+        break;
+    default:
+        return false;
+    }
+
+    m_transportMode = mode;
+
+    return true;
+}
+
+ModbusTCP::TRANSPORT_MODE ModbusTCP::getTransportMode() const
+{
+    return m_transportMode;
+}
+
+void ModbusTCP::setMaxOutstandingCnt(uint32_t cnt)
+{
+    QMutexLocker locker(&mutex);
+
+    // At least stop-and-wait, at most the requests Tx FIFO holds
+    if(cnt < 1)
+    {
+        cnt = 1;
+    }
+
+    if(cnt > TX_FIFO_DEPTH / 2)
+    {
+        cnt = TX_FIFO_DEPTH / 2;
+    }
+
+    maxOutstandingCnt = cnt;
+}
+
+bool ModbusTCP::connectToServer(const QHostAddress &ip, uint16_t port)
+{
+    bool ret = false;
+
     hostAddr = ip;
     serverPort = port;
 
-    isRunning = ret;
+    // Connectionless, the socket is bound to any local port
+    if(MODE_UDP == m_transportMode)
+    {
+        if(NULL != m_udpClient)
+        {
+            m_udpClient->setServerAddressPort(ip, port);
+            m_udpClient->initSocket();
+            ret = true;
+        }
 
-    // Emit signal
-    emit connectionChanged(isRunning);
+        return ret;
+    }
+
+    // Connected state is updated by updateConnectionStatus()
+    if(NULL != m_tcpClient)
+    {
+        ret = m_tcpClient->connectToServer(ip, port);
+    }
 
     return ret;
 }
@@ -114,12 +233,27 @@ bool ModbusTCP::connectToServer(QString ip, uint16_t port)
 
 void ModbusTCP::disconnectFromServer()
 {
+    if(MODE_UDP == m_transportMode)
+    {
+        if(NULL != m_udpClient)
+        {
+            m_udpClient->closeSocket();
+        }
+
+        return;
+    }
+
     if(NULL != m_tcpClient)
     {
         m_tcpClient->disconnectFromServer();
     }
 }
 
+bool ModbusTCP::isConnecting() const
+{
+    return (MODE_UDP != m_transportMode && NULL != m_tcpClient && m_tcpClient->isConnecting());
+}
+
 void ModbusTCP::setTransactionID(uint16_t id)
 {
     m_transactionID = id;
@@ -149,247 +283,220 @@ void ModbusTCP::setTxRetryTimes(uint32_t cnt)
 void ModbusTCP::setAutoReconnect(bool autoConnectFlag)
 {
     m_autoConnectToServerFlag = autoConnectFlag;
+
+    if(NULL != m_tcpClient)
+    {
+        m_tcpClient->setAutoReconnect(m_autoConnectToServerFlag);
+    }
 }
 
-bool ModbusTCP::readInputRegisters(uint16_t regOffset, uint16_t regCnt)
+void ModbusTCP::setConnectTimeout(uint32_t timeoutInMs)
 {
-    bool ret = false;
-    uint32_t index = 0;
-    struct MODBUS_READ_FEEDBACK tempFeedBackStruct;
-    uint16_t len = 0;
-
-    if(0 == regCnt)
+    if(NULL != m_tcpClient)
     {
-        return ret;
+        m_tcpClient->setConnectTimeout(timeoutInMs);
     }
+}
 
-    QMutexLocker locker(&mutex);
+void ModbusTCP::setBlockSize(const struct MODBUS_BLOCK_SIZE &blockSize)
+{
+    m_blockSize = blockSize;
+}
 
-    // Clear buffer
-    char txDataBuf[TX_BUF_SIZE] = {0};
-    memset(txDataBuf, 0, TX_BUF_SIZE);
-    memset(&tempFeedBackStruct, 0, sizeof(MODBUS_READ_FEEDBACK));
+struct MODBUS_BLOCK_SIZE ModbusTCP::getBlockSize() const
+{
+    return m_blockSize;
+}
 
-    // MBAP header - 7 bytes
-    txDataBuf[index++] = (uint8_t)(m_transactionID >> 8);  // transaction ID high-8bit
-    txDataBuf[index++] = (uint8_t)(m_transactionID & 0x00ff);  // transaction ID low-8bit
+void ModbusTCP::setRequestMergeEnabled(bool flag)
+{
+    QMutexLocker locker(&mutex);
 
-    txDataBuf[index++] = (uint8_t)(m_protocolID >> 8);  // protocol ID high-8bit
-    txDataBuf[index++] = (uint8_t)(m_protocolID & 0x00ff);  // protocol ID low-8bit
+    requestMergeEnabled = flag;
+}
 
-    txDataBuf[index++] = (uint8_t)(len >> 8);  // packet length high-8bit
-    txDataBuf[index++] = (uint8_t)(len & 0x00ff);  // packet length low-8bit
-    len = index;
-    txDataBuf[index++] = m_unitID;
+void ModbusTCP::setRtoConfig(const struct MODBUS_RTO_CONFIG &config)
+{
+    QMutexLocker locker(&mutex);
 
+    rtoEstimator.setConfig(config);
+}
 
-    // Function code
-    txDataBuf[index++] = MB_FUNC_READ_INPUT_REGISTER;
+uint32_t ModbusTCP::getRto()
+{
+    QMutexLocker locker(&mutex);
 
-    // Note: For Modbus communication, data are big endian!
-    txDataBuf[index++] = (uint8_t)(regOffset >> 8);        // reg address high-8bit
-    txDataBuf[index++] = (uint8_t)(regOffset & 0x00ff);    // reg address low-8bit
+    return rtoEstimator.getRto();
+}
 
-    txDataBuf[index++] = (uint8_t)(regCnt >> 8);        // reg count high-8bit
-    txDataBuf[index++] = (uint8_t)(regCnt & 0x00ff);    // reg count low-8bit
+bool ModbusTCP::isDeviceParked()
+{
+    QMutexLocker locker(&mutex);
 
-    // Calculate packet length
-    len = index - len;
-    txDataBuf[4] = (uint8_t)(len >> 8);  // packet length high-8bit
-    txDataBuf[5] = (uint8_t)(len & 0x00ff);  // packet length low-8bit
+    return rtoEstimator.isParked();
+}
 
-    tempFeedBackStruct.address = regOffset;
-    tempFeedBackStruct.len = regCnt;
-    tempFeedBackStruct.rdwrFlag = MODBUS_RD_OPT;
+bool ModbusTCP::readInputRegisters(uint16_t regOffset, uint16_t regCnt)
+{
+    return queueRequest(MB_FUNC_READ_INPUT_REGISTER, regOffset, regCnt, NULL, ModbusTransaction());
+}
 
-    // Push data to FIFO
-    fifoBuf->pushData((char *)&tempFeedBackStruct, sizeof(struct MODBUS_READ_FEEDBACK));
-    // Push data to FIFO
-    ret = fifoBuf->pushData(txDataBuf, index);
+bool ModbusTCP::readHoldRegisters(uint16_t regOffset, uint16_t regCnt)
+{
+    return queueRequest(MB_FUNC_READ_HOLDING_REGISTER, regOffset, regCnt, NULL, ModbusTransaction());
+}
 
-    return ret;
+bool ModbusTCP::writeHoldRegister(uint16_t regOffset, uint16_t regValue)
+{
+    return queueRequest(MB_FUNC_WRITE_REGISTER, regOffset, 1, (const char *)&regValue, ModbusTransaction());
 }
 
-bool ModbusTCP::readHoldRegisters(uint16_t regOffset, uint16_t regCnt)
+bool ModbusTCP::writeMultiRegisters(uint16_t regOffset, const char *dataP, uint16_t regCnt)
 {
-    bool ret = false;
-    uint32_t index = 0;
-    struct MODBUS_READ_FEEDBACK tempFeedBackStruct;
-    uint16_t len = 0;
+    return queueRequest(MB_FUNC_WRITE_MULTIPLE_REGISTERS, regOffset, regCnt, dataP, ModbusTransaction());
+}
 
-    if(0 == regCnt)
+ModbusTransaction ModbusTCP::transact(uint8_t functionCode, uint16_t regOffset, uint16_t regCnt, const char *dataP)
+{
+    // Completed in the thread of slots of this object
+    ModbusTransaction transaction(functionCode, regOffset, regCnt, thread());
+
+    if(!queueRequest(functionCode, regOffset, regCnt, dataP, transaction))
     {
-        return ret;
+        transaction.finish(ModbusTransaction::STATUS_REJECTED);
     }
 
-    QMutexLocker locker(&mutex);
+    return transaction;
+}
 
-    // Clear buffer
-    char txDataBuf[TX_BUF_SIZE] = {0};
-    memset(txDataBuf, 0, TX_BUF_SIZE);
-    memset(&tempFeedBackStruct, 0, sizeof(MODBUS_READ_FEEDBACK));
+bool ModbusTCP::queueRequest(uint8_t functionCode, uint16_t regOffset, uint16_t regCnt, const char *dataP,
+                             const ModbusTransaction &transaction)
+{
+    uint16_t rdwrFlag = MODBUS_WR_OPT;
+    uint32_t pduLen = 0;
 
-    // MBAP header - 7 bytes
-    txDataBuf[index++] = (uint8_t)(m_transactionID >> 8);  // transaction ID high-8bit
-    txDataBuf[index++] = (uint8_t)(m_transactionID & 0x00ff);  // transaction ID low-8bit
+    switch(functionCode)
+    {
+    case MB_FUNC_READ_HOLDING_REGISTER:
+    case MB_FUNC_READ_INPUT_REGISTER:
+        if(0 == regCnt)
+        {
+            return false;
+        }
 
-    txDataBuf[index++] = (uint8_t)(m_protocolID >> 8);  // protocol ID high-8bit
-    txDataBuf[index++] = (uint8_t)(m_protocolID & 0x00ff);  // protocol ID low-8bit
+        rdwrFlag = MODBUS_RD_OPT;
+        break;
+    case MB_FUNC_WRITE_REGISTER:
+        if(NULL == dataP || 1 != regCnt)
+        {
+            return false;
+        }
+        break;
+    case MB_FUNC_WRITE_MULTIPLE_REGISTERS:
+        // More registers do not fit in one PDU
+        if(NULL == dataP || 0 == regCnt || regCnt > MODBUS_MAX_WRITE_REG_CNT)
+        {
+            return false;
+        }
+        break;
+    default:
+        return false;
+    }
 
-    txDataBuf[index++] = (uint8_t)(len >> 8);  // packet length high-8bit
-    txDataBuf[index++] = (uint8_t)(len & 0x00ff);  // packet length low-8bit
-    len = index;
-    txDataBuf[index++] = m_unitID;
+    QMutexLocker locker(&mutex);
 
+    // Folded into a queued request, no new Tx frame
+    struct MODBUS_REQUEST_INFO mergedInfo;
+    bool merged = false;
 
-    // Function code
-    txDataBuf[index++] = MB_FUNC_READ_HOLDING_REGISTER;
+    if(requestMergeEnabled)
+    {
+        merged = (MODE_RTU_OVER_TCP == m_transportMode) ?
+                 ModbusRequestCoalescer<ModbusRtuFrame>::merge(fifoBuf, txTransactionQueue, functionCode, regOffset,
+                                                               regCnt, dataP, transaction, mergedInfo) :
+                 ModbusRequestCoalescer<ModbusTcpFrame>::merge(fifoBuf, txTransactionQueue, functionCode, regOffset,
+                                                               regCnt, dataP, transaction, mergedInfo);
+    }
 
-    // Note: For Modbus communication, data are big endian!
-    txDataBuf[index++] = (uint8_t)(regOffset >> 8);        // reg address high-8bit
-    txDataBuf[index++] = (uint8_t)(regOffset & 0x00ff);    // reg address low-8bit
+    if(merged)
+    {
+#ifdef MODBUS_TCP_DEBUG_TRACE
+        qDebug() << "ModbusTCP::queueRequest() merged, address =" << mergedInfo.address << "len =" << mergedInfo.len;
+#endif
+        return true;
+    }
 
-    txDataBuf[index++] = (uint8_t)(regCnt >> 8);        // reg count high-8bit
-    txDataBuf[index++] = (uint8_t)(regCnt & 0x00ff);    // reg count low-8bit
+    // Request info and Tx frame take 2 slots, never overwrite queued requests
+    if(txTransactionQueue.size() >= TX_FIFO_DEPTH / 2)
+    {
+        return false;
+    }
 
-    // Calculate packet length
-    len = index - len;
-    txDataBuf[4] = (uint8_t)(len >> 8);  // packet length high-8bit
-    txDataBuf[5] = (uint8_t)(len & 0x00ff);  // packet length low-8bit
+    uint8_t *pduP = beginRequest(regOffset, regCnt, rdwrFlag, transaction);
 
-    tempFeedBackStruct.address = regOffset;
-    tempFeedBackStruct.len = regCnt;
-    tempFeedBackStruct.rdwrFlag = MODBUS_RD_OPT;
+    switch(functionCode)
+    {
+    case MB_FUNC_READ_HOLDING_REGISTER:
+        pduLen = ModbusPdu<MB_FUNC_READ_HOLDING_REGISTER>::encodeRequest(pduP, regOffset, regCnt);
+        break;
+    case MB_FUNC_READ_INPUT_REGISTER:
+        pduLen = ModbusPdu<MB_FUNC_READ_INPUT_REGISTER>::encodeRequest(pduP, regOffset, regCnt);
+        break;
+    case MB_FUNC_WRITE_REGISTER:
+    {
+        uint16_t regValue = 0;
+        memcpy(&regValue, dataP, sizeof(uint16_t));
 
-    // Push data to FIFO
-    fifoBuf->pushData((char *)&tempFeedBackStruct, sizeof(struct MODBUS_READ_FEEDBACK));
-    // Push data to FIFO
-    ret = fifoBuf->pushData(txDataBuf, index);
+        pduLen = ModbusPdu<MB_FUNC_WRITE_REGISTER>::encodeRequest(pduP, regOffset, regValue);
+        break;
+    }
+    default:
+        pduLen = ModbusPdu<MB_FUNC_WRITE_MULTIPLE_REGISTERS>::encodeRequest(pduP, regOffset, dataP, regCnt);
+        break;
+    }
 
-    return ret;
+    return commitRequest(pduLen);
 }
 
-bool ModbusTCP::writeHoldRegister(uint16_t regOffset, uint16_t regValue)
+uint8_t *ModbusTCP::beginRequest(uint16_t regOffset, uint16_t regCnt, uint16_t rdwrFlag, const ModbusTransaction &transaction)
 {
-    bool ret = false;
-    uint32_t index = 0;
-    struct MODBUS_READ_FEEDBACK tempFeedBackStruct;
-    uint16_t len = 0;
-
-    QMutexLocker locker(&mutex);
-
-    // Clear buffer
-    char txDataBuf[TX_BUF_SIZE] = {0};
-    memset(txDataBuf, 0, TX_BUF_SIZE);
-    memset(&tempFeedBackStruct, 0, sizeof(MODBUS_READ_FEEDBACK));
-
-    // MBAP header - 7 bytes
-    txDataBuf[index++] = (uint8_t)(m_transactionID >> 8);  // transaction ID high-8bit
-    txDataBuf[index++] = (uint8_t)(m_transactionID & 0x00ff);  // transaction ID low-8bit
-
-    txDataBuf[index++] = (uint8_t)(m_protocolID >> 8);  // protocol ID high-8bit
-    txDataBuf[index++] = (uint8_t)(m_protocolID & 0x00ff);  // protocol ID low-8bit
+    struct MODBUS_REQUEST_INFO requestInfo;
 
-    txDataBuf[index++] = (uint8_t)(len >> 8);  // packet length high-8bit
-    txDataBuf[index++] = (uint8_t)(len & 0x00ff);  // packet length low-8bit
-    len = index;
-    txDataBuf[index++] = m_unitID;
+    // Tx FIFO slot must hold the biggest request
+    MODBUS_STATIC_ASSERT((int)TX_BUF_SIZE >= (int)ModbusTcpFrame::MAX_ADU_LEN, tx_buf_fits_adu);
 
+    requestInfo.address = regOffset;
+    requestInfo.len = regCnt;
+    requestInfo.rdwrFlag = rdwrFlag;
 
-    // Function code
-    txDataBuf[index++] = MB_FUNC_WRITE_REGISTER;
-
-    // Note: For Modbus communication, data are big endian!
-    txDataBuf[index++] = (uint8_t)(regOffset >> 8);        // reg address high-8bit
-    txDataBuf[index++] = (uint8_t)(regOffset & 0x00ff);    // reg address low-8bit
-
-    txDataBuf[index++] = (uint8_t)(regValue >> 8);        // reg value high-8bit
-    txDataBuf[index++] = (uint8_t)(regValue & 0x00ff);    // reg value low-8bit
-
-    // Calculate packet length
-    len = index - len;
-    txDataBuf[4] = (uint8_t)(len >> 8);  // packet length high-8bit
-    txDataBuf[5] = (uint8_t)(len & 0x00ff);  // packet length low-8bit
-
-    tempFeedBackStruct.address = regOffset;
-    tempFeedBackStruct.len = 1;
-    tempFeedBackStruct.rdwrFlag = MODBUS_WR_OPT;
-
-    // Push data to FIFO
-    fifoBuf->pushData((char *)&tempFeedBackStruct, sizeof(struct MODBUS_READ_FEEDBACK));
     // Push data to FIFO
-    ret = fifoBuf->pushData(txDataBuf, index);
+    fifoBuf->pushData((char *)&requestInfo, sizeof(struct MODBUS_REQUEST_INFO));
+    txTransactionQueue.enqueue(transaction);
 
-    return ret;
+    // Tx frame is encoded in the next FIFO slot
+    uint8_t *aduP = (uint8_t *)fifoBuf->getPushBuffer();
+
+    return (MODE_RTU_OVER_TCP == m_transportMode) ? ModbusRtuFrame::getPdu(aduP) : ModbusTcpFrame::getPdu(aduP);
 }
 
-bool ModbusTCP::writeMultiRegisters(uint16_t regOffset, const char *dataP, uint16_t regCnt)
+bool ModbusTCP::commitRequest(uint32_t pduLen)
 {
-    bool ret = false;
-    uint32_t index = 0;
-    struct MODBUS_READ_FEEDBACK tempFeedBackStruct;
-    uint16_t len = 0;
+    uint8_t *aduP = (uint8_t *)fifoBuf->getPushBuffer();
+    uint32_t aduLen = 0;
 
-    if(NULL == dataP || 0 == regCnt)
+    if(MODE_RTU_OVER_TCP == m_transportMode)
     {
-        return ret;
+        // Unit ID is the slave address behind the gateway
+        aduLen = ModbusRtuFrame::encode(aduP, pduLen, m_unitID);
     }
-
-    QMutexLocker locker(&mutex);
-
-    // Clear buffer
-    char txDataBuf[TX_BUF_SIZE] = {0};
-    memset(txDataBuf, 0, TX_BUF_SIZE);
-    memset(&tempFeedBackStruct, 0, sizeof(MODBUS_READ_FEEDBACK));
-
-    // MBAP header - 7 bytes
-    txDataBuf[index++] = (uint8_t)(m_transactionID >> 8);  // transaction ID high-8bit
-    txDataBuf[index++] = (uint8_t)(m_transactionID & 0x00ff);  // transaction ID low-8bit
-
-    txDataBuf[index++] = (uint8_t)(m_protocolID >> 8);  // protocol ID high-8bit
-    txDataBuf[index++] = (uint8_t)(m_protocolID & 0x00ff);  // protocol ID low-8bit
-
-    txDataBuf[index++] = (uint8_t)(len >> 8);  // packet length high-8bit
-    txDataBuf[index++] = (uint8_t)(len & 0x00ff);  // packet length low-8bit
-    len = index;
-    txDataBuf[index++] = m_unitID;
-
-    // Function code
-    txDataBuf[index++] = MB_FUNC_WRITE_MULTIPLE_REGISTERS;
-
-    // Note: For Modbus communication, data are big endian!
-    txDataBuf[index++] = (uint8_t)(regOffset >> 8);        // reg address high-8bit
-    txDataBuf[index++] = (uint8_t)(regOffset & 0x00ff);    // reg address low-8bit
-
-    txDataBuf[index++] = (uint8_t)(regCnt >> 8);        // reg count high-8bit
-    txDataBuf[index++] = (uint8_t)(regCnt & 0x00ff);    // reg count low-8bit
-
-    txDataBuf[index++] = (uint8_t)(regCnt * sizeof(uint16_t));   // length in bytes
-
-    for(uint32_t i = 0; i < regCnt; i++)
+    else
     {
-        uint16_t value = *((uint16_t *)dataP + i);
-
-        txDataBuf[index++] = (uint8_t)(value >> 8);        // data high-8bit
-        txDataBuf[index++] = (uint8_t)(value & 0x00ff);    // data low-8bit
+        // Transaction ID is given at first transmit, per request
+        aduLen = ModbusTcpFrame::encode(aduP, pduLen, 0, m_unitID, m_protocolID);
     }
 
-    // Calculate packet length
-    len = index - len;
-    txDataBuf[4] = (uint8_t)(len >> 8);  // packet length high-8bit
-    txDataBuf[5] = (uint8_t)(len & 0x00ff);  // packet length low-8bit
-
-
-    tempFeedBackStruct.address = regOffset;
-    tempFeedBackStruct.len = regCnt;
-    tempFeedBackStruct.rdwrFlag = MODBUS_WR_OPT;
-
-    // Push data to FIFO
-    fifoBuf->pushData((char *)&tempFeedBackStruct, sizeof(struct MODBUS_READ_FEEDBACK));
     // Push data to FIFO
-    ret = fifoBuf->pushData(txDataBuf, index);
-
-    return ret;
+    return fifoBuf->commitData(aduLen);
 }
 
 bool ModbusTCP::writeMultiRegistersInt32(uint16_t regOffset, uint32_t value)
@@ -432,51 +539,202 @@ void ModbusTCP::updateIncomingData(QByteArray data)
         // Emit signal
         emit newDataReady(data);
 
-        // Parse packet
+        // Parse packet, a late, duplicated or foreign frame leaves the request waiting
         if(parseResponsePacket(data))
         {
-        }
+            getResponseFlag = true;
 
-        getResponseFlag = true;
+            // 2020-Mar-21 add this logic
+            // Once received msg from Modbus, then reset Tx error count
+            txErrorCnt = 0;
+        }
     }
 }
 
-bool ModbusTCP::parseResponsePacket(QByteArray &responseData)
+bool ModbusTCP::isSameHost(const QHostAddress &address1, const QHostAddress &address2)
 {
-    bool ret = false;
+#if QT_VERSION >= 0x050800
+    return address1.isEqual(address2, QHostAddress::ConvertV4MappedToIPv4);
+#else
+    return (address1 == address2);
+#endif
+}
+
+void ModbusTCP::updateIncomingDatagram(QHostAddress address, int port, QByteArray data)
+{
+    struct OUTSTANDING_REQUEST request;
+    bool wasParked = false;
 
-    if(responseData.size() < MODBUS_RESPONSE_MSG_START_LEN)
+    if(data.isEmpty())
     {
-        return ret;
+        return;
     }
 
-    // Check transactionID matched
-    if((m_transactionID >> 8) != responseData[0] ||
-            (m_transactionID & 0x00ff) != responseData[1])
+    // Any host reaching the port could finish or corrupt outstanding requests, only the server answers
+    if(port != serverPort || !isSameHost(address, hostAddr))
     {
-        return ret;
+    #ifdef MODBUS_TCP_DEBUG_TRACE
+        qDebug() << "ModbusTCP::updateIncomingDatagram() drop datagram from" << address.toString() << port;
+    #endif
+        return;
     }
 
-    MODBUS_RX_MSG_STRUCT *feedbackMsg = (MODBUS_RX_MSG_STRUCT *)(responseData.data() + MODBUS_RESPONSE_MSG_START_LEN);
+    // Emit signal
+    emit newDataReady(data);
 
-    switch(feedbackMsg->functionCode)
+    // One ADU per datagram
+    ModbusPduView pdu = ModbusTcpFrame::decode(data.constData(), data.size());
+    if(0 == pdu.getLen())
     {
-    case MB_FUNC_READ_HOLDING_REGISTER:
-    case MB_FUNC_READ_INPUT_REGISTER:
+        return;
+    }
+
+    {
+        QMutexLocker locker(&mutex);
+
+        // Late or duplicated response of a request already done
+        QHash<uint16_t, struct OUTSTANDING_REQUEST>::iterator it =
+                outstandingHash.find(ModbusTcpFrame::getTransactionId(data.constData(), data.size()));
+        if(outstandingHash.end() == it)
+        {
+            return;
+        }
+
+        request = it.value();
+        outstandingHash.erase(it);
+
+        // Only a first transmit gives a clean RTT (Karn)
+        if(0 == request.retryTimes)
+        {
+            rtoEstimator.addSample((uint32_t)(rtoClock.elapsed() - request.txTimeInMs));
+        }
+
+        wasParked = rtoEstimator.onResponse();
+        txErrorCnt = 0;
+
+        // A slot is free, send next request at once
+        transmitOutstandingRequests();
+    }
+
+    if(wasParked)
+    {
+        // Emit signal
+        emit deviceParked(false);
+    }
+
+    parseResponsePdu(pdu, request.requestInfo, request.transaction);
+}
 
-        if(readFeedbackStruct.len != (feedbackMsg->data[0] / sizeof(uint16_t)))
+bool ModbusTCP::parseResponsePacket(QByteArray &responseData)
+{
+    bool ret = false;
+    ModbusPduView pdu;
+
+    if(MODE_RTU_OVER_TCP == m_transportMode)
+    {
+        const uint8_t *aduP = (const uint8_t *)responseData.constData();
+        uint32_t aduLen = responseData.size();
+
+        // Response of the addressed slave only
+        if(aduLen <= ModbusRtuFrame::HEADER_LEN + ModbusRtuFrame::TRAILER_LEN || m_unitID != aduP[0])
+        {
+            return ret;
+        }
+
+        // CRC16 is little endian
+        uint16_t crc = CRCUtility::instance()->modbus_crc16(aduP, aduLen - MODBUS_CRC_LENGTH);
+        if(aduP[aduLen - 2] != (uint8_t)(crc & 0x00ff) || aduP[aduLen - 1] != (uint8_t)(crc >> 8))
         {
         #ifdef MODBUS_TCP_DEBUG_TRACE
-            qDebug() << "invalid rx length! readFeedbackStruct.len =" << readFeedbackStruct.len
-                     << ",(feedbackMsg->data[0]/sizeof(uint16_t)=" << feedbackMsg->data[0] / sizeof(uint16_t);
+            qDebug("crc16 is bad = 0x%04X", crc);
         #endif
+            return ret;
+        }
+
+        pdu = ModbusRtuFrame::decode(aduP, aduLen);
+    }
+    else
+    {
+        pdu = ModbusTcpFrame::decode(responseData.constData(), responseData.size());
+
+        if(0 == pdu.getLen())
+        {
+            return ret;
         }
-        else
+
+        // Response of the request waiting, not a late one of an earlier request
+        if(txTransactionId != ModbusTcpFrame::getTransactionId(responseData.constData(), responseData.size()))
         {
-            memcpy((char *)readFeedbackStruct.buffer, (char *)&(feedbackMsg->data[1]), feedbackMsg->data[0]);
-            ret = true;
+            return ret;
         }
+    }
 
+    // No request waiting, e.g. a duplicated response of one already done
+    if(true == getResponseFlag)
+    {
+        return ret;
+    }
+
+    // Any response proves the device alive, only a first transmit gives a clean RTT (Karn)
+    bool wasParked = false;
+
+    {
+        QMutexLocker locker(&mutex);
+
+        if(0 == txRetryTimes)
+        {
+            rtoEstimator.addSample((uint32_t)(rtoClock.elapsed() - txTimeInMs));
+        }
+
+        wasParked = rtoEstimator.onResponse();
+    }
+
+    if(NULL != rtoTmr)
+    {
+        rtoTmr->stop();
+    }
+
+    if(wasParked)
+    {
+        // Emit signal
+        emit deviceParked(false);
+    }
+
+    // Request is done by any matched response, exception and invalid data included
+    parseResponsePdu(pdu, txRequestInfo, txTransaction);
+    txTransaction = ModbusTransaction();
+    ret = true;
+
+    return ret;
+}
+
+bool ModbusTCP::parseResponsePdu(const ModbusPduView &pdu, const struct MODBUS_REQUEST_INFO &requestInfo,
+                                 ModbusTransaction &transaction)
+{
+    bool ret = false;
+    const uint8_t *regP = NULL;
+    uint16_t regCnt = 0;
+
+    if(pdu.isException())
+    {
+    #ifdef MODBUS_TCP_DEBUG_TRACE
+        qDebug("Exception response, function code = 0x%02x, exception code = 0x%02x", pdu.getUint8(0), pdu.getExceptionCode());
+    #endif
+
+        transaction.finish(ModbusTransaction::STATUS_EXCEPTION, QByteArray(), pdu.getExceptionCode());
+
+        return ret;
+    }
+
+    switch(pdu.getUint8(0))
+    {
+    case MB_FUNC_READ_HOLDING_REGISTER:
+        regP = ModbusPdu<MB_FUNC_READ_HOLDING_REGISTER>::decodeResponse(pdu, regCnt);
+        ret = (NULL != regP && requestInfo.len == regCnt);
+        break;
+    case MB_FUNC_READ_INPUT_REGISTER:
+        regP = ModbusPdu<MB_FUNC_READ_INPUT_REGISTER>::decodeResponse(pdu, regCnt);
+        ret = (NULL != regP && requestInfo.len == regCnt);
         break;
     case MB_FUNC_WRITE_REGISTER:
         ret = true;
@@ -486,25 +744,45 @@ bool ModbusTCP::parseResponsePacket(QByteArray &responseData)
         break;
     default:
     #ifdef MODBUS_TCP_DEBUG_TRACE
-        qDebug("Invalid function code = 0x%02x", feedbackMsg->functionCode);
+        qDebug("Invalid function code = 0x%02x", pdu.getUint8(0));
     #endif
         break;
     }
 
+    if(false == ret)
+    {
+    #ifdef MODBUS_TCP_DEBUG_TRACE
+        qDebug() << "invalid rx length! requestInfo.len =" << requestInfo.len << ", regCnt =" << regCnt;
+    #endif
+
+        transaction.finish(ModbusTransaction::STATUS_INVALID_RESPONSE);
+    }
+    else if(NULL == regP)
+    {
+        // Write completed
+        transaction.finish(ModbusTransaction::STATUS_DONE);
+    }
+
     // Only read operation send feedback msg
-    if(MODBUS_RD_OPT == readFeedbackStruct.rdwrFlag && true == ret)
+    if(MODBUS_RD_OPT == requestInfo.rdwrFlag && true == ret && NULL != regP)
     {
+        struct MODBUS_READ_FEEDBACK feedback;
+
+        // Registers only, receivers share the buffer
+        feedback.address = requestInfo.address;
+        feedback.len = requestInfo.len;
+        feedback.rdwrFlag = requestInfo.rdwrFlag;
+        feedback.buffer = QByteArray((const char *)regP, regCnt * sizeof(uint16_t));
+
+        transaction.finish(ModbusTransaction::STATUS_DONE, feedback.buffer);
+
         // Emit signal
-        emit newResponseMsg(readFeedbackStruct);
+        emit newResponseMsg(feedback);
 
 #ifdef MODBUS_TCP_DEBUG_TRACE
-        qDebug() << "readFeedbackStruct.address" << readFeedbackStruct.address;
-        qDebug() << "readFeedbackStruct.len" << readFeedbackStruct.len;
-
-        for(int i = 0; i < readFeedbackStruct.len; i++)
-        {
-            qDebug("readFeedbackStruct.bufer[%d]=0x%04x", i, readFeedbackStruct.buffer[i]);
-        }
+        qDebug() << "feedback.address" << feedback.address;
+        qDebug() << "feedback.len" << feedback.len;
+        qDebug() << "feedback.buffer" << feedback.buffer.toHex();
 #endif
 
     }
@@ -512,9 +790,9 @@ bool ModbusTCP::parseResponsePacket(QByteArray &responseData)
     return ret;
 }
 
-void ModbusTCP::diconnectedStatus(void)
+void ModbusTCP::updateConnectionStatus(bool connected)
 {
-    isRunning = false;
+    isRunning = connected;
 
     // Emit signal
     emit connectionChanged(isRunning);
@@ -530,6 +808,13 @@ void ModbusTCP::initTxTimer()
         connect(periodTxTmr, SIGNAL(timeout()), this, SLOT(periodTxService()));
         periodTxTmr->start(m_periodTxTimeInMs);
     }
+
+    if(NULL == rtoTmr)
+    {
+        rtoTmr = new QTimer;
+        rtoTmr->setSingleShot(true);
+        connect(rtoTmr, SIGNAL(timeout()), this, SLOT(handleResponseTimeout()));
+    }
 }
 
 void ModbusTCP::deInitTxTimer()
@@ -541,6 +826,14 @@ void ModbusTCP::deInitTxTimer()
         delete periodTxTmr;
         periodTxTmr = NULL;
     }
+
+    if(NULL != rtoTmr)
+    {
+        rtoTmr->stop();
+        disconnect(rtoTmr, 0, this, 0);
+        delete rtoTmr;
+        rtoTmr = NULL;
+    }
 }
 
 void ModbusTCP::startPeriodTxService()
@@ -565,69 +858,296 @@ void ModbusTCP::periodTxService()
 
     //qDebug() << "ModbusTCP::periodTxService()";
 
+    // Requests wait for response side by side, see handleOutstandingTimeout()
+    if(MODE_UDP == m_transportMode)
+    {
+        transmitOutstandingRequests();
+        return;
+    }
+
+    // Deadline of the request waiting for response is handled by handleResponseTimeout()
     if(false == getResponseFlag)
     {
-        if(++txRetryTimes > TX_RETRY_MAX_TIMES)
+        return;
+    }
+
+    // Response of last request was not understood
+    txTransaction.finish(ModbusTransaction::STATUS_INVALID_RESPONSE);
+    txTransaction = ModbusTransaction();
+
+    // Parked device only gets a probe now and then
+    if(0 != fifoBuf->getCount() && !rtoEstimator.allowRequest(rtoClock.elapsed()))
+    {
+        dropQueuedRequests();
+        return;
+    }
+
+    // Pop data from FIFO
+    if(true == fifoBuf->popData((char *)&txRequestInfo, len))
+    {
+        // Null for requests queued without handle
+        if(!txTransactionQueue.isEmpty())
         {
-            txRetryTimes = 0;
+            txTransaction = txTransactionQueue.dequeue();
+        }
+    }
 
-            // Tx error count increased
-            txErrorCnt++;
+    if(true == fifoBuf->popData(m_comTxBuf, txBufLen))
+    {
+        // First transmit of the request
+        txRetryTimes = 0;
 
-            // If TxRetryTimes is too much
-            // the connection should be lost, need to connect to server again!
-            if(txErrorCnt >= TX_ERROR_MAX_CNT)
-            {
-                txErrorCnt = 0;
+        // Own transaction ID per request, retransmits keep it
+        if(MODE_TCP == m_transportMode && txBufLen > ModbusTcpFrame::HEADER_LEN)
+        {
+            txTransactionId = m_transactionID++;
+            modbusPutUint16((uint8_t *)m_comTxBuf, txTransactionId);
+        }
 
-                // Auto connect to tcp server
-                autoConnectToServer();
-            }
+        transmitRequest();
+    }
 
+}
+
+void ModbusTCP::handleResponseTimeout()
+{
+    bool parked = false;
+
+    if(MODE_UDP == m_transportMode)
+    {
+        {
+            QMutexLocker locker(&mutex);
+
+            parked = handleOutstandingTimeout();
         }
-        else
+
+        if(parked)
+        {
+            // Emit signal
+            emit deviceParked(true);
+        }
+
+        return;
+    }
+
+    {
+        QMutexLocker locker(&mutex);
+
+        if(true == getResponseFlag)
+        {
+            return;
+        }
+
+        // Each timeout doubles the deadline of the retransmit
+        rtoEstimator.onTimeout();
+
+        if(++txRetryTimes <= TX_RETRY_MAX_TIMES)
         {
             retransmitTask();
             return;
         }
+
+        txRetryTimes = 0;
+
+        // Tx error count increased
+        txErrorCnt++;
+
+        // Give up the request waiting for response, next one is sent at next Tx period
+        getResponseFlag = true;
+        txTransaction.finish(ModbusTransaction::STATUS_TIMEOUT);
+        txTransaction = ModbusTransaction();
+
+        parked = rtoEstimator.onFailure(rtoClock.elapsed());
+
+        // If TxRetryTimes is too much
+        // the connection should be lost, need to connect to server again!
+        if(txErrorCnt >= TX_ERROR_MAX_CNT)
+        {
+            txErrorCnt = 0;
+
+            // Auto connect to tcp server
+            autoConnectToServer();
+        }
     }
-    else
+
+    if(parked)
     {
-        // 2020-Mar-21 add this logic
-        // Once received msg from Modbus, then reset Tx error count
-        // When tx msg > 10 and there's no feedback, then reInitModbusComm()
-        txErrorCnt = 0;
+        // Emit signal
+        emit deviceParked(true);
     }
+}
 
-    // Clear buffer
-    memset(m_comTxBuf, 0, TX_BUF_SIZE);
+void ModbusTCP::transmitOutstandingRequests()
+{
+    uint32_t len = 0;
+    int64_t nowInMs = rtoClock.elapsed();
 
-    // Pop data from FIFO
-    if(true == fifoBuf->popData((char *)&readFeedbackStruct, len))
+    while((uint32_t)outstandingHash.size() < maxOutstandingCnt && 0 != fifoBuf->getCount())
     {
+        struct OUTSTANDING_REQUEST request;
+
+        // Parked device only gets a probe now and then
+        if(!rtoEstimator.allowRequest(nowInMs))
+        {
+            dropQueuedRequests();
+            break;
+        }
+
+        fifoBuf->popData((char *)&request.requestInfo, len);
+
+        // Null for requests queued without handle
+        if(!txTransactionQueue.isEmpty())
+        {
+            request.transaction = txTransactionQueue.dequeue();
+        }
+
+        if(!fifoBuf->popData(m_comTxBuf, txBufLen) || txBufLen <= ModbusTcpFrame::HEADER_LEN)
+        {
+            request.transaction.finish(ModbusTransaction::STATUS_CANCELLED);
+            continue;
+        }
+
+        // Own transaction ID, never one still waiting for response
+        while(outstandingHash.contains(m_transactionID))
+        {
+            m_transactionID++;
+        }
+
+        uint16_t transactionId = m_transactionID++;
+        modbusPutUint16((uint8_t *)m_comTxBuf, transactionId);
+
+        request.adu = QByteArray(m_comTxBuf, txBufLen);
+        request.retryTimes = 0;
+        request.txTimeInMs = nowInMs;
+        request.deadlineInMs = nowInMs + rtoEstimator.getRto();
+
+        outstandingHash.insert(transactionId, request);
+
+        writeDataToModbus(m_comTxBuf, txBufLen);
     }
 
-    if(true == fifoBuf->popData(m_comTxBuf, txBufLen))
+    scheduleOutstandingTimeout();
+}
+
+bool ModbusTCP::handleOutstandingTimeout()
+{
+    bool parked = false;
+    bool backoff = false;
+    int64_t nowInMs = rtoClock.elapsed();
+    QHash<uint16_t, struct OUTSTANDING_REQUEST>::iterator it = outstandingHash.begin();
+
+    while(outstandingHash.end() != it)
     {
-        // Reset response flag
-        getResponseFlag = false;
+        struct OUTSTANDING_REQUEST &request = it.value();
 
-        // Send data package to ModbusRTU
-        writeDataToModbus(m_comTxBuf, txBufLen);
+        if(request.deadlineInMs > nowInMs)
+        {
+            ++it;
+            continue;
+        }
+
+        // Requests sent together time out together, back off once per round
+        if(!backoff)
+        {
+            rtoEstimator.onTimeout();
+            backoff = true;
+        }
+
+        if(++request.retryTimes <= TX_RETRY_MAX_TIMES)
+        {
+            // Same transaction ID, a late response to the first transmit still matches
+            request.txTimeInMs = nowInMs;
+            request.deadlineInMs = nowInMs + rtoEstimator.getRto();
+
+            writeDataToModbus(request.adu.constData(), request.adu.size());
+
+            ++it;
+            continue;
+        }
+
+        // Tx error count increased
+        txErrorCnt++;
+
+        request.transaction.finish(ModbusTransaction::STATUS_TIMEOUT);
+        it = outstandingHash.erase(it);
+
+        if(rtoEstimator.onFailure(nowInMs))
+        {
+            parked = true;
+        }
     }
 
+    scheduleOutstandingTimeout();
+
+    return parked;
+}
+
+void ModbusTCP::scheduleOutstandingTimeout()
+{
+    if(NULL == rtoTmr)
+    {
+        return;
+    }
+
+    if(outstandingHash.isEmpty())
+    {
+        rtoTmr->stop();
+        return;
+    }
+
+    QHash<uint16_t, struct OUTSTANDING_REQUEST>::const_iterator it = outstandingHash.constBegin();
+    int64_t deadlineInMs = it.value().deadlineInMs;
+
+    for(++it; outstandingHash.constEnd() != it; ++it)
+    {
+        if(it.value().deadlineInMs < deadlineInMs)
+        {
+            deadlineInMs = it.value().deadlineInMs;
+        }
+    }
+
+    int64_t delayInMs = deadlineInMs - rtoClock.elapsed();
+    rtoTmr->start((delayInMs > 0) ? (int)delayInMs : 0);
 }
 
 void ModbusTCP::retransmitTask()
+{
+    // If m_comTxBuf is not empty(0x00...)
+    if(0 != txBufLen)
+    {
+        transmitRequest();
+    }
+}
+
+void ModbusTCP::transmitRequest()
 {
     // Reset response flag
     getResponseFlag = false;
 
-    // If m_comTxBuf is not empty(0x00...)
-    if(0 != txBufLen)
+    // Send data package to ModbusTCP
+    writeDataToModbus(m_comTxBuf, txBufLen);
+
+    txTimeInMs = rtoClock.elapsed();
+
+    if(NULL != rtoTmr)
     {
-        // Send data package to ModbusTCP
-        writeDataToModbus(m_comTxBuf, txBufLen);
+        rtoTmr->start(rtoEstimator.getRto());
+    }
+}
+
+void ModbusTCP::dropQueuedRequests()
+{
+    uint32_t len = 0;
+    char tempBuf[TX_BUF_SIZE];
+
+    while(fifoBuf->popData(tempBuf, len))
+    {
+        fifoBuf->popData(tempBuf, len);
+
+        if(!txTransactionQueue.isEmpty())
+        {
+            txTransactionQueue.dequeue().finish(ModbusTransaction::STATUS_UNREACHABLE);
+        }
     }
 }
 
@@ -635,14 +1155,28 @@ int ModbusTCP::writeDataToModbus(const char* txData, int len)
 {
     int ret = 0;
 
-    if(NULL == m_tcpClient)
+    if(NULL == txData || 0 == len)
     {
         return ret;
     }
 
-    if(NULL == txData || 0 == len)
+    if(MODE_UDP == m_transportMode)
     {
-        return ret;
+        if(NULL == m_udpClient)
+        {
+            return ret;
+        }
+
+        m_udpClient->sendData(txData, len);
+    }
+    else
+    {
+        if(NULL == m_tcpClient)
+        {
+            return ret;
+        }
+
+        m_tcpClient->sendData(txData, len);
     }
 
     if(isRunning)
@@ -650,8 +1184,6 @@ int ModbusTCP::writeDataToModbus(const char* txData, int len)
         ret = len;
     }
 
-    m_tcpClient->sendData(txData, len);
-
     // Emit signal
     QByteArray data(txData, len);
     emit newDataTx(data);
@@ -661,9 +1193,10 @@ int ModbusTCP::writeDataToModbus(const char* txData, int len)
 
 void ModbusTCP::autoConnectToServer()
 {
-    if(m_autoConnectToServerFlag)
+    if(m_autoConnectToServerFlag && NULL != m_tcpClient)
     {
-        if(!isRunning)
+        // Only start a new attempt, a pending attempt keeps its backoff
+        if(TCPClient::STATE_DISCONNECTED == m_tcpClient->getConnectionState())
         {
             connectToServer(hostAddr, serverPort);
         }
@@ -10,14 +10,42 @@ PURPOSE:        Modbus TCP interface
 #define MODBUSTCP_H
 
 #include "TcpClient.h"
+#include "UdpClient.h"
 #include "ModbusData.h"
+#include "ModbusPdu.h"
+#include "ModbusTransaction.h"
+#include "ModbusRequestCoalescer.h"
+#include "ModbusRtoEstimator.h"
 #include "LoopBuffer.h"
 #include "FifoBuffer.h"
 #include <QThread>
 #include <QMutex>
 #include <QTimer>
-
-
+#include <QQueue>
+#include <QHash>
+#include <QElapsedTimer>
+
+
+/*
+ Request engine of one Modbus device behind an IP endpoint. Transport
+ and framing are selected by setTransportMode(),
+
+ MODE_TCP           MBAP ADU on TCPClient, one request waiting for
+                    response, matched by transaction ID
+ MODE_RTU_OVER_TCP  RTU ADU (unit ID as slave address, CRC16) on
+                    TCPClient, for gateways tunnelling serial frames,
+                    one request waiting for response, matched by address
+ MODE_UDP           MBAP ADU per datagram on UDPClient. Every request gets
+                    its own transaction ID, up to maxOutstandingCnt
+                    requests wait for response at once with their own
+                    deadline and retransmits, a lost datagram delays only
+                    its own request. Responses are matched by transaction
+                    ID in any order, datagrams not from the server
+                    address and port are dropped.
+
+ Tx FIFO, request merge, response timeout and circuit breaker are the
+ same in every mode.
+*/
 class ModbusTCP : public QThread
 {
     Q_OBJECT
@@ -28,18 +56,30 @@ public:
     enum
     {
         RX_BUF_SIZE  = 1000,
-        TX_BUF_SIZE  = 300
+        TX_BUF_SIZE  = 300,
+        TX_FIFO_DEPTH = 100     // Request info and Tx frame take one slot each
+    };
+
+    // Transport and framing, see class description
+    enum TRANSPORT_MODE
+    {
+        MODE_TCP = 0,
+        MODE_RTU_OVER_TCP,
+        MODE_UDP
     };
 
     void run();
 
-    // Connect to Server
+    // Start connecting to Server, the result is reported by connectionChanged()/connectFailed()
     bool connectToServer(const QHostAddress &ip = QHostAddress::Any, uint16_t port = 0);
     bool connectToServer(QString ip, uint16_t port = 0);
 
-    // Disconnect from server
+    // Disconnect from server or cancel connecting, do not wait
     void disconnectFromServer();
 
+    // True: connecting, or waiting for next reconnect
+    bool isConnecting() const;
+
     /*-----------------------------------------------------------------------
     FUNCTION:		bindModel
     PURPOSE:		Bind a TCPClient model
@@ -56,9 +96,22 @@ public:
     -----------------------------------------------------------------------*/
     void unbind();
 
+    /*-----------------------------------------------------------------------
+    FUNCTION:       setTransportMode
+    PURPOSE:        Select transport and framing of requests
+    ARGUMENTS:      TRANSPORT_MODE mode -- MODE_TCP (default), MODE_RTU_OVER_TCP, MODE_UDP
+    RETURNS:        true - set, false - connected/connecting or requests are queued,
+                    or no TCPClient is bound for a TCP mode
+    -----------------------------------------------------------------------*/
+    bool setTransportMode(TRANSPORT_MODE mode);
+    TRANSPORT_MODE getTransportMode() const;
+
+    // MODE_UDP: requests waiting for response at once, 1 is stop-and-wait, default 8
+    void setMaxOutstandingCnt(uint32_t cnt);
+
     /*-----------------------------------------------------------------------
     FUNCTION:       setTransactionID
-    PURPOSE:        Set transaction ID
+    PURPOSE:        Set transaction ID of the next request, each request gets its own
     ARGUMENTS:      uint16_t id  -- transaction ID of MBPA
     RETURNS:        None
     -----------------------------------------------------------------------*/
@@ -98,12 +151,40 @@ public:
 
     /*-----------------------------------------------------------------------
     FUNCTION:       setAutoReconnect
-    PURPOSE:        Set Auto reconnect to server flag
+    PURPOSE:        Set Auto reconnect to server flag, retry with exponential backoff
     ARGUMENTS:      bool, true: auto-reconnect, false: do not auto reconnect
     RETURNS:        None
     -----------------------------------------------------------------------*/
     void setAutoReconnect(bool autoConnectFlag);
 
+    // Timeout of one connect attempt
+    void setConnectTimeout(uint32_t timeoutInMs);
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:       setRequestMergeEnabled
+    PURPOSE:        Merge new requests into queued ones, see ModbusRequestCoalescer.
+                    Disable it for registers where every write triggers an action
+    ARGUMENTS:      bool flag -- true: merge (default), false: queue every request
+    RETURNS:        None
+    -----------------------------------------------------------------------*/
+    void setRequestMergeEnabled(bool flag);
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:       setRtoConfig
+    PURPOSE:        Set response timeout estimator and circuit breaker of
+                    the device, see ModbusRtoEstimator. Timeout before the
+                    first RTT sample is the Tx period unless set here
+    ARGUMENTS:      const struct MODBUS_RTO_CONFIG &config -- RTO and parking
+    RETURNS:        None
+    -----------------------------------------------------------------------*/
+    void setRtoConfig(const struct MODBUS_RTO_CONFIG &config);
+
+    // Response timeout of next transmit
+    uint32_t getRto();
+
+    // True: device is parked after repeated timeouts, requests fail except probes
+    bool isDeviceParked();
+
     /*-----------------------------------------------------------------------
     FUNCTION:       readInputRegisters
     PURPOSE:        Read input registers from modbusRTU slave device
@@ -141,6 +222,23 @@ public:
     -----------------------------------------------------------------------*/
     bool writeMultiRegisters(uint16_t regOffset, const char *dataP, uint16_t regCnt);
 
+    /*-----------------------------------------------------------------------
+    FUNCTION:       transact
+    PURPOSE:        Queue a request and track its own result
+    ARGUMENTS:      uint8_t functionCode    -- MB_FUNC_READ_HOLDING_REGISTER/READ_INPUT_REGISTER/
+                                               WRITE_REGISTER/WRITE_MULTIPLE_REGISTERS
+                    uint16_t regOffset      -- register offset address
+                    uint16_t regCnt         -- count of registers, 1 for WRITE_REGISTER
+                    const char *dataP       -- regCnt uint16_t in host byte order of write
+    RETURNS:        Handle completed by response, exception or timeout,
+                    STATUS_REJECTED at once if invalid or Tx queue is full
+    -----------------------------------------------------------------------*/
+    ModbusTransaction transact(uint8_t functionCode, uint16_t regOffset, uint16_t regCnt, const char *dataP = NULL);
+
+    // Largest request of device, the standard until set, e.g. by ModbusBlockSizeProbe
+    void setBlockSize(const struct MODBUS_BLOCK_SIZE &blockSize);
+    struct MODBUS_BLOCK_SIZE getBlockSize() const;
+
     /*-----------------------------------------------------------------------
     FUNCTION:       writeMultiRegistersInt32
     PURPOSE:        Write 32bit value for reg via multiple registers(0x10 cmd)
@@ -167,40 +265,63 @@ public:
 
 signals:
     void connectionChanged(bool connected);
+    void connectFailed(QString error);
     void newDataReady(QByteArray);
     void newDataTx(QByteArray);
     void startTxTimer();
     void stopTxTimer();
-    void newResponseMsg(MODBUS_READ_FEEDBACK msg);
+    void newResponseMsg(const MODBUS_READ_FEEDBACK &msg);
+
+    // Device is parked by circuit breaker or answers again
+    void deviceParked(bool parked);
 
 protected slots:
     void updateIncomingData(QByteArray data);
-    void diconnectedStatus(void);
+    void updateIncomingDatagram(QHostAddress address, int port, QByteArray data);
+    void updateConnectionStatus(bool connected);
     void initTxTimer();
     void deInitTxTimer();
 
     void periodTxService();
     void retransmitTask();
 
+    // No response before the deadline of the request
+    void handleResponseTimeout();
+
 private:
 
     QMutex mutex; // Mutex locker
 
     TCPClient *m_tcpClient;
+    UDPClient *m_udpClient;     // MODE_UDP only, NULL before
+
+    TRANSPORT_MODE m_transportMode;
 
     LoopBuffer *rxLoopBuf;
     FIFOBuffer *fifoBuf;
     char *m_comTxBuf;        // Transmit buffer
     uint32_t txBufLen;  // Modbus Tx buffer length
 
-    uint16_t m_transactionID;   // ModbusTCP transaction ID
+    uint16_t m_transactionID;   // Next ModbusTCP transaction ID, one per request
     uint16_t m_protocolID;  // ModbusTCP protocol ID, always 0x0000
     uint8_t m_unitID;  // ModbusTCP unit ID
 
+    struct MODBUS_BLOCK_SIZE m_blockSize;   // Cached for the application, requests are not split
+
     bool isRunning;   // Flag to indicate tcp client is running or not
 
-    // Modbus read back strutct report to host
-    struct MODBUS_READ_FEEDBACK readFeedbackStruct;
+    // Request info of the Tx frame waiting for response
+    struct MODBUS_REQUEST_INFO txRequestInfo;
+
+    // Handles of requests in Tx FIFO, same order, null if queued without handle
+    QQueue<ModbusTransaction> txTransactionQueue;
+
+    // Handle of the Tx frame waiting for response
+    ModbusTransaction txTransaction;
+
+    // MODE_TCP: transaction ID of the Tx frame waiting for response, a late
+    // response of an earlier request never matches it
+    uint16_t txTransactionId;
 
     uint32_t m_periodTxTimeInMs;    // Period tx time in MS
     QTimer *periodTxTmr; // This timer is used to trigger period Tx service
@@ -216,15 +337,71 @@ private:
     // This flag is used to detect connection lost and auto re-connect
     bool m_autoConnectToServerFlag;
 
+    // True: equal reads and adjacent writes are merged in Tx FIFO
+    bool requestMergeEnabled;
+
+    // Response timeout of the device from measured RTT
+    ModbusRtoEstimator rtoEstimator;
+    QElapsedTimer rtoClock;
+    int64_t txTimeInMs;     // Time of last transmit
+    QTimer *rtoTmr;         // Deadline of the request waiting for response
+
+    // MODE_UDP: request sent and waiting for response
+    struct OUTSTANDING_REQUEST
+    {
+        struct MODBUS_REQUEST_INFO requestInfo;
+        ModbusTransaction transaction;
+        QByteArray adu;
+        int retryTimes;
+        int64_t txTimeInMs;         // Time of last transmit
+        int64_t deadlineInMs;
+    };
+
+    // MODE_UDP: requests waiting for response by transaction ID
+    QHash<uint16_t, struct OUTSTANDING_REQUEST> outstandingHash;
+    uint32_t maxOutstandingCnt;
+
     QHostAddress hostAddr;      // Host IP
     uint16_t serverPort;        // Host port
 
+    // IPv4 sender may arrive as ::ffff:a.b.c.d on a dual stack socket
+    static bool isSameHost(const QHostAddress &address1, const QHostAddress &address2);
+
     // Write data to modbus
     int writeDataToModbus(const char *txData, int len);
 
-    // Parse Rx Packet and show Reg data value
+    // Transmit m_comTxBuf and start its response deadline
+    void transmitRequest();
+
+    // Fail queued requests of a parked device
+    void dropQueuedRequests();
+
+    // Check and queue request, transaction may be null
+    bool queueRequest(uint8_t functionCode, uint16_t regOffset, uint16_t regCnt, const char *dataP,
+                      const ModbusTransaction &transaction);
+
+    // Queue request info, return where to encode the request PDU in Tx FIFO
+    uint8_t *beginRequest(uint16_t regOffset, uint16_t regCnt, uint16_t rdwrFlag, const ModbusTransaction &transaction);
+
+    // Add MBAP header to the encoded request PDU and queue it
+    bool commitRequest(uint32_t pduLen);
+
+    // Parse Rx Packet and show Reg data value, true: response of the request waiting
     bool parseResponsePacket(QByteArray &responseData);
 
+    // Complete transaction by response PDU, report registers read
+    bool parseResponsePdu(const ModbusPduView &pdu, const struct MODBUS_REQUEST_INFO &requestInfo,
+                          ModbusTransaction &transaction);
+
+    // MODE_UDP: send queued requests up to maxOutstandingCnt
+    void transmitOutstandingRequests();
+
+    // MODE_UDP: retransmit or fail requests past deadline, return true if device is parked
+    bool handleOutstandingTimeout();
+
+    // MODE_UDP: deadline timer for the earliest outstanding request
+    void scheduleOutstandingTimeout();
+
     // Auto connect to tcp server
     void autoConnectToServer();
 
@@ -0,0 +1,1149 @@
+/**********************************************************************
+PACKAGE:        Communication
+FILE:           ModbusTCPPool.cpp
+COPYRIGHT (C):  All rights reserved.
+
+PURPOSE:        Modbus TCP master for many devices on a small thread pool
+**********************************************************************/
+
+#include "ModbusTCPPool.h"
+#include <QMetaType>
+#include <QDebug>
+#include <string.h>
+
+//#define MODBUS_TCP_POOL_DEBUG_TRACE
+
+ModbusTCPPool::ModbusTCPPool(uint32_t threadCnt, QObject *parent) :
+    QObject(parent),
+    nextDeviceId(0),
+    nextPollId(0)
+{
+    // Results are queued from worker threads
+    qRegisterMetaType<MODBUS_READ_FEEDBACK>("MODBUS_READ_FEEDBACK");
+
+    if(0 == threadCnt)
+    {
+        threadCnt = (QThread::idealThreadCount() > 0) ? QThread::idealThreadCount() : 1;
+    }
+
+    for(uint32_t i = 0; i < threadCnt; i++)
+    {
+        QThread *thread = new QThread;
+        ModbusTCPPoolWorker *worker = new ModbusTCPPoolWorker;
+
+        worker->moveToThread(thread);
+
+        connect(thread, SIGNAL(started()), worker, SLOT(init()));
+
+        connect(worker, SIGNAL(newResponseMsg(int, const MODBUS_READ_FEEDBACK &)),
+                this, SIGNAL(newResponseMsg(int, const MODBUS_READ_FEEDBACK &)));
+        connect(worker, SIGNAL(writeCompleted(int, int, int)), this, SIGNAL(writeCompleted(int, int, int)));
+        connect(worker, SIGNAL(requestFailed(int, int, int, int)), this, SIGNAL(requestFailed(int, int, int, int)));
+        connect(worker, SIGNAL(deviceConnectionChanged(int, int)), this, SIGNAL(deviceConnectionChanged(int, int)));
+        connect(worker, SIGNAL(deviceParked(int, bool)), this, SIGNAL(deviceParked(int, bool)));
+
+        threadList.append(thread);
+        workerList.append(worker);
+        workerDeviceCntList.append(0);
+
+        thread->start();
+    }
+}
+
+ModbusTCPPool::~ModbusTCPPool()
+{
+    for(int i = 0; i < workerList.size(); i++)
+    {
+        // Sockets must be closed in the thread they live in
+        QMetaObject::invokeMethod(workerList[i], "shutdown", Qt::BlockingQueuedConnection);
+
+        threadList[i]->quit();
+        threadList[i]->wait();
+
+        delete workerList[i];
+        delete threadList[i];
+    }
+
+    workerList.clear();
+    threadList.clear();
+}
+
+int ModbusTCPPool::addDevice(const struct MODBUS_DEVICE_CONFIG &config)
+{
+    if(config.address.isNull() || 0 == config.port || 0 == config.connectionCnt)
+    {
+        return -1;
+    }
+
+    int deviceId = -1;
+    int workerIndex = 0;
+
+    {
+        QMutexLocker locker(&mutex);
+
+        // The worker with the fewest devices
+        for(int i = 1; i < workerDeviceCntList.size(); i++)
+        {
+            if(workerDeviceCntList.at(i) < workerDeviceCntList.at(workerIndex))
+            {
+                workerIndex = i;
+            }
+        }
+
+        deviceId = nextDeviceId++;
+
+        deviceWorkerHash.insert(deviceId, workerIndex);
+        workerDeviceCntList[workerIndex]++;
+    }
+
+    struct ModbusTCPPoolWorker::COMMAND command;
+    command.type = ModbusTCPPoolWorker::CMD_ADD_DEVICE;
+    command.deviceId = deviceId;
+    command.pollId = -1;
+    command.periodInMs = 0;
+    command.config = config;
+
+    // Invalid sizes fall back to the standard
+    if(0 == command.config.blockSize.maxReadRegCnt || command.config.blockSize.maxReadRegCnt > MODBUS_MAX_READ_REG_CNT)
+    {
+        command.config.blockSize.maxReadRegCnt = MODBUS_MAX_READ_REG_CNT;
+    }
+
+    if(0 == command.config.blockSize.maxWriteRegCnt || command.config.blockSize.maxWriteRegCnt > MODBUS_MAX_WRITE_REG_CNT)
+    {
+        command.config.blockSize.maxWriteRegCnt = MODBUS_MAX_WRITE_REG_CNT;
+    }
+
+    {
+        QMutexLocker locker(&mutex);
+
+        deviceBlockSizeHash.insert(deviceId, command.config.blockSize);
+    }
+
+    workerList[workerIndex]->pushCommand(command);
+
+    return deviceId;
+}
+
+void ModbusTCPPool::removeDevice(int deviceId)
+{
+    int workerIndex = -1;
+
+    {
+        QMutexLocker locker(&mutex);
+
+        workerIndex = deviceWorkerHash.value(deviceId, -1);
+        if(workerIndex < 0)
+        {
+            return;
+        }
+
+        deviceWorkerHash.remove(deviceId);
+        deviceBlockSizeHash.remove(deviceId);
+        workerDeviceCntList[workerIndex]--;
+
+        // Polls of device are removed by worker as well
+        QHash<int, int>::iterator it = pollDeviceHash.begin();
+        while(it != pollDeviceHash.end())
+        {
+            if(it.value() == deviceId)
+            {
+                it = pollDeviceHash.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+
+    struct ModbusTCPPoolWorker::COMMAND command;
+    command.type = ModbusTCPPoolWorker::CMD_REMOVE_DEVICE;
+    command.deviceId = deviceId;
+    command.pollId = -1;
+    command.periodInMs = 0;
+
+    workerList[workerIndex]->pushCommand(command);
+}
+
+int ModbusTCPPool::getDeviceCnt() const
+{
+    QMutexLocker locker(&mutex);
+
+    return deviceWorkerHash.size();
+}
+
+uint32_t ModbusTCPPool::getThreadCnt() const
+{
+    return workerList.size();
+}
+
+bool ModbusTCPPool::setBlockSize(int deviceId, const struct MODBUS_BLOCK_SIZE &blockSize)
+{
+    if(0 == blockSize.maxReadRegCnt || blockSize.maxReadRegCnt > MODBUS_MAX_READ_REG_CNT ||
+       0 == blockSize.maxWriteRegCnt || blockSize.maxWriteRegCnt > MODBUS_MAX_WRITE_REG_CNT)
+    {
+        return false;
+    }
+
+    ModbusTCPPoolWorker *worker = NULL;
+
+    {
+        QMutexLocker locker(&mutex);
+
+        int workerIndex = deviceWorkerHash.value(deviceId, -1);
+        if(workerIndex < 0)
+        {
+            return false;
+        }
+
+        worker = workerList[workerIndex];
+        deviceBlockSizeHash.insert(deviceId, blockSize);
+    }
+
+    struct ModbusTCPPoolWorker::COMMAND command;
+    command.type = ModbusTCPPoolWorker::CMD_SET_BLOCK_SIZE;
+    command.deviceId = deviceId;
+    command.pollId = -1;
+    command.periodInMs = 0;
+    command.config.blockSize = blockSize;
+
+    worker->pushCommand(command);
+
+    return true;
+}
+
+struct MODBUS_BLOCK_SIZE ModbusTCPPool::getBlockSize(int deviceId) const
+{
+    QMutexLocker locker(&mutex);
+
+    return deviceBlockSizeHash.value(deviceId);
+}
+
+ModbusTCPPoolWorker *ModbusTCPPool::getWorker(int deviceId)
+{
+    QMutexLocker locker(&mutex);
+
+    int workerIndex = deviceWorkerHash.value(deviceId, -1);
+
+    return (workerIndex < 0) ? NULL : workerList[workerIndex];
+}
+
+bool ModbusTCPPool::queueRequest(int deviceId, uint8_t functionCode, uint16_t regOffset, uint16_t regCnt,
+                                 const QByteArray &data, const ModbusTransaction &transaction, bool isPdu)
+{
+    ModbusTCPPoolWorker *worker = getWorker(deviceId);
+
+    if(NULL == worker)
+    {
+        return false;
+    }
+
+    struct ModbusTCPPoolWorker::COMMAND command;
+    command.type = ModbusTCPPoolWorker::CMD_REQUEST;
+    command.deviceId = deviceId;
+    command.pollId = -1;
+    command.periodInMs = 0;
+    command.request.functionCode = functionCode;
+    command.request.regOffset = regOffset;
+    command.request.regCnt = regCnt;
+    command.request.data = data;
+    command.request.isPdu = isPdu;
+    command.request.transaction = transaction;
+
+    worker->pushCommand(command);
+
+    return true;
+}
+
+bool ModbusTCPPool::readInputRegisters(int deviceId, uint16_t regOffset, uint16_t regCnt)
+{
+    if(0 == regCnt || regCnt > MODBUS_MAX_READ_REG_CNT)
+    {
+        return false;
+    }
+
+    return queueRequest(deviceId, MB_FUNC_READ_INPUT_REGISTER, regOffset, regCnt);
+}
+
+bool ModbusTCPPool::readHoldRegisters(int deviceId, uint16_t regOffset, uint16_t regCnt)
+{
+    if(0 == regCnt || regCnt > MODBUS_MAX_READ_REG_CNT)
+    {
+        return false;
+    }
+
+    return queueRequest(deviceId, MB_FUNC_READ_HOLDING_REGISTER, regOffset, regCnt);
+}
+
+bool ModbusTCPPool::writeHoldRegister(int deviceId, uint16_t regOffset, uint16_t regValue)
+{
+    return queueRequest(deviceId, MB_FUNC_WRITE_REGISTER, regOffset, 1,
+                        QByteArray((const char *)&regValue, sizeof(uint16_t)));
+}
+
+bool ModbusTCPPool::writeMultiRegisters(int deviceId, uint16_t regOffset, const char *dataP, uint16_t regCnt)
+{
+    if(NULL == dataP || 0 == regCnt || regCnt > MODBUS_MAX_WRITE_REG_CNT)
+    {
+        return false;
+    }
+
+    return queueRequest(deviceId, MB_FUNC_WRITE_MULTIPLE_REGISTERS, regOffset, regCnt,
+                        QByteArray(dataP, regCnt * sizeof(uint16_t)));
+}
+
+ModbusTransaction ModbusTCPPool::transact(int deviceId, uint8_t functionCode, uint16_t regOffset, uint16_t regCnt,
+                                          const char *dataP)
+{
+    ModbusTCPPoolWorker *worker = getWorker(deviceId);
+    bool valid = false;
+
+    // Completed in the worker thread, a wait there runs the worker's events
+    ModbusTransaction transaction(functionCode, regOffset, regCnt, (NULL == worker) ? NULL : worker->thread());
+
+    switch(functionCode)
+    {
+    case MB_FUNC_READ_HOLDING_REGISTER:
+    case MB_FUNC_READ_INPUT_REGISTER:
+        valid = (0 != regCnt && regCnt <= MODBUS_MAX_READ_REG_CNT);
+        break;
+    case MB_FUNC_WRITE_REGISTER:
+        valid = (NULL != dataP && 1 == regCnt);
+        break;
+    case MB_FUNC_WRITE_MULTIPLE_REGISTERS:
+        valid = (NULL != dataP && 0 != regCnt && regCnt <= MODBUS_MAX_WRITE_REG_CNT);
+        break;
+    default:
+        break;
+    }
+
+    QByteArray data;
+    if(valid && NULL != dataP)
+    {
+        data = QByteArray(dataP, regCnt * sizeof(uint16_t));
+    }
+
+    if(!valid || !queueRequest(deviceId, functionCode, regOffset, regCnt, data, transaction))
+    {
+        transaction.finish(ModbusTransaction::STATUS_REJECTED);
+    }
+
+    return transaction;
+}
+
+ModbusTransaction ModbusTCPPool::transactPdu(int deviceId, const QByteArray &pdu)
+{
+    ModbusTCPPoolWorker *worker = getWorker(deviceId);
+    uint8_t functionCode = pdu.isEmpty() ? MB_FUNC_NONE : (uint8_t)pdu.at(0);
+
+    // Completed in the worker thread, a wait there runs the worker's events
+    ModbusTransaction transaction(functionCode, 0, 0, (NULL == worker) ? NULL : worker->thread());
+
+    bool valid = (MB_FUNC_NONE != functionCode && 0 == (functionCode & MB_FUNC_ERROR) &&
+                  pdu.size() <= MODBUS_MAX_PDU_LEN);
+
+    if(!valid || !queueRequest(deviceId, functionCode, 0, 0, pdu, transaction, true))
+    {
+        transaction.finish(ModbusTransaction::STATUS_REJECTED);
+    }
+
+    return transaction;
+}
+
+int ModbusTCPPool::addPoll(int deviceId, uint8_t functionCode, uint16_t regOffset, uint16_t regCnt, uint32_t periodInMs)
+{
+    if(MB_FUNC_READ_HOLDING_REGISTER != functionCode && MB_FUNC_READ_INPUT_REGISTER != functionCode)
+    {
+        return -1;
+    }
+
+    // Any register count, the worker splits it by the block size of device
+    if(0 == regCnt || (uint32_t)regOffset + regCnt > 0x10000 || 0 == periodInMs)
+    {
+        return -1;
+    }
+
+    ModbusTCPPoolWorker *worker = NULL;
+    int pollId = -1;
+
+    {
+        QMutexLocker locker(&mutex);
+
+        int workerIndex = deviceWorkerHash.value(deviceId, -1);
+        if(workerIndex < 0)
+        {
+            return -1;
+        }
+
+        worker = workerList[workerIndex];
+        pollId = nextPollId++;
+
+        pollDeviceHash.insert(pollId, deviceId);
+    }
+
+    struct ModbusTCPPoolWorker::COMMAND command;
+    command.type = ModbusTCPPoolWorker::CMD_ADD_POLL;
+    command.deviceId = deviceId;
+    command.pollId = pollId;
+    command.periodInMs = periodInMs;
+    command.request.functionCode = functionCode;
+    command.request.regOffset = regOffset;
+    command.request.regCnt = regCnt;
+    command.request.pollId = pollId;
+
+    worker->pushCommand(command);
+
+    return pollId;
+}
+
+void ModbusTCPPool::removePoll(int pollId)
+{
+    int deviceId = -1;
+
+    {
+        QMutexLocker locker(&mutex);
+
+        deviceId = pollDeviceHash.value(pollId, -1);
+        pollDeviceHash.remove(pollId);
+    }
+
+    ModbusTCPPoolWorker *worker = getWorker(deviceId);
+
+    if(NULL == worker)
+    {
+        return;
+    }
+
+    struct ModbusTCPPoolWorker::COMMAND command;
+    command.type = ModbusTCPPoolWorker::CMD_REMOVE_POLL;
+    command.deviceId = deviceId;
+    command.pollId = pollId;
+    command.periodInMs = 0;
+
+    worker->pushCommand(command);
+}
+
+
+ModbusTCPPoolWorker::ModbusTCPPoolWorker(QObject *parent) :
+    QObject(parent),
+    timeoutWheel(TICK_IN_MS),
+    pollWheel(TICK_IN_MS),
+    tickTmr(NULL),
+    lastTickInMs(0)
+{
+}
+
+ModbusTCPPoolWorker::~ModbusTCPPoolWorker()
+{
+    shutdown();
+}
+
+void ModbusTCPPoolWorker::init()
+{
+    if(NULL != tickTmr)
+    {
+        return;
+    }
+
+    // Created in worker thread, one timer for all devices of the worker
+    tickTmr = new QTimer(this);
+    connect(tickTmr, SIGNAL(timeout()), this, SLOT(tick()));
+    tickTmr->start(TICK_IN_MS);
+
+    clock.start();
+    lastTickInMs = 0;
+}
+
+void ModbusTCPPoolWorker::shutdown()
+{
+    if(NULL != tickTmr)
+    {
+        tickTmr->stop();
+        delete tickTmr;
+        tickTmr = NULL;
+    }
+
+    QList<int> deviceIdList = deviceHash.keys();
+    for(int i = 0; i < deviceIdList.size(); i++)
+    {
+        deleteDevice(deviceHash.value(deviceIdList.at(i)));
+    }
+
+    // Requests never handled
+    {
+        QMutexLocker locker(&mutex);
+
+        for(int i = 0; i < commandList.size(); i++)
+        {
+            commandList[i].request.transaction.finish(ModbusTransaction::STATUS_CANCELLED);
+        }
+    }
+
+    qDeleteAll(pollHash);
+    pollHash.clear();
+    pollTimerList.clear();
+
+    timeoutWheel.clear();
+    pollWheel.clear();
+}
+
+void ModbusTCPPoolWorker::pushCommand(const struct COMMAND &command)
+{
+    bool wakeup = false;
+
+    {
+        QMutexLocker locker(&mutex);
+
+        wakeup = commandList.isEmpty();
+        commandList.append(command);
+    }
+
+    // One wakeup for a batch of commands
+    if(wakeup)
+    {
+        QMetaObject::invokeMethod(this, "processCommands", Qt::QueuedConnection);
+    }
+}
+
+void ModbusTCPPoolWorker::processCommands()
+{
+    QList<struct COMMAND> tempList;
+
+    {
+        QMutexLocker locker(&mutex);
+        tempList.swap(commandList);
+    }
+
+    for(int i = 0; i < tempList.size(); i++)
+    {
+        const struct COMMAND &command = tempList.at(i);
+
+        switch(command.type)
+        {
+        case CMD_ADD_DEVICE:
+            addDevice(command.deviceId, command.config);
+            break;
+        case CMD_REMOVE_DEVICE:
+            removeDevice(command.deviceId);
+            break;
+        case CMD_REQUEST:
+        {
+            DEVICE *deviceP = deviceHash.value(command.deviceId, NULL);
+
+            if(NULL != deviceP)
+            {
+                queueRequest(deviceP, command.request);
+            }
+            else
+            {
+                // Device removed before the request got here
+                ModbusTransaction transaction = command.request.transaction;
+                transaction.finish(ModbusTransaction::STATUS_CANCELLED);
+            }
+
+            break;
+        }
+        case CMD_ADD_POLL:
+            addPoll(command.pollId, command.deviceId, command.request, command.periodInMs);
+            break;
+        case CMD_REMOVE_POLL:
+            removePoll(command.pollId);
+            break;
+        case CMD_SET_BLOCK_SIZE:
+        {
+            DEVICE *deviceP = deviceHash.value(command.deviceId, NULL);
+
+            // Used from the next poll on
+            if(NULL != deviceP)
+            {
+                deviceP->config.blockSize = command.config.blockSize;
+            }
+
+            break;
+        }
+        default:
+            break;
+        }
+    }
+}
+
+void ModbusTCPPoolWorker::addDevice(int deviceId, const struct MODBUS_DEVICE_CONFIG &config)
+{
+    if(deviceHash.contains(deviceId))
+    {
+        return;
+    }
+
+    DEVICE *deviceP = new DEVICE;
+    deviceP->deviceId = deviceId;
+    deviceP->config = config;
+    deviceP->connectedCnt = 0;
+
+    struct MODBUS_RTO_CONFIG rtoConfig = config.rto;
+    rtoConfig.initialRtoInMs = config.timeoutInMs;
+    deviceP->rto.setConfig(rtoConfig);
+
+    for(uint32_t i = 0; i < config.connectionCnt; i++)
+    {
+        CONNECTION *connP = new CONNECTION;
+
+        connP->client = new TCPClient;
+        connP->deviceP = deviceP;
+        connP->timerId = timeoutWheel.allocateId();
+        connP->busy = false;
+        connP->transactionId = 0;
+        connP->retryCnt = 0;
+        connP->txTimeInMs = 0;
+
+        // Responses are handled from newDataReady(QByteArray), no FIFO copy
+        connP->client->setRxFifoEnabled(false);
+        connP->client->setFramer(new MbapFramer);
+        connP->client->setAutoReconnect(true);
+
+        connect(connP->client, SIGNAL(newDataReady(QByteArray)), this, SLOT(handleResponse(QByteArray)));
+        connect(connP->client, SIGNAL(connectionChanged(bool)), this, SLOT(handleConnectionChanged(bool)));
+
+        if(connTimerList.size() <= (int)connP->timerId)
+        {
+            connTimerList.resize(connP->timerId + 1);
+        }
+
+        connTimerList[connP->timerId] = connP;
+        connHash.insert(connP->client, connP);
+        deviceP->connList.append(connP);
+
+        connP->client->connectToServer(config.address, config.port);
+    }
+
+    deviceHash.insert(deviceId, deviceP);
+}
+
+void ModbusTCPPoolWorker::removeDevice(int deviceId)
+{
+    DEVICE *deviceP = deviceHash.value(deviceId, NULL);
+
+    if(NULL == deviceP)
+    {
+        return;
+    }
+
+    // Requests of device will never be answered
+    for(int i = 0; i < deviceP->connList.size(); i++)
+    {
+        if(deviceP->connList.at(i)->busy)
+        {
+            failRequest(deviceP, deviceP->connList.at(i)->request, ModbusTCPPool::POOL_ERROR_DEVICE_REMOVED);
+        }
+    }
+
+    for(int i = 0; i < deviceP->txQueue.size(); i++)
+    {
+        failRequest(deviceP, deviceP->txQueue.at(i), ModbusTCPPool::POOL_ERROR_DEVICE_REMOVED);
+    }
+
+    // Polls of device
+    QList<int> pollIdList = pollHash.keys();
+    for(int i = 0; i < pollIdList.size(); i++)
+    {
+        if(pollHash.value(pollIdList.at(i))->deviceId == deviceId)
+        {
+            removePoll(pollIdList.at(i));
+        }
+    }
+
+    deleteDevice(deviceP);
+}
+
+void ModbusTCPPoolWorker::deleteDevice(DEVICE *deviceP)
+{
+    // No-op for requests already failed by removeDevice()
+    for(int i = 0; i < deviceP->txQueue.size(); i++)
+    {
+        deviceP->txQueue[i].transaction.finish(ModbusTransaction::STATUS_CANCELLED);
+    }
+
+    for(int i = 0; i < deviceP->connList.size(); i++)
+    {
+        CONNECTION *connP = deviceP->connList.at(i);
+
+        if(connP->busy)
+        {
+            connP->request.transaction.finish(ModbusTransaction::STATUS_CANCELLED);
+        }
+
+        disconnect(connP->client, 0, this, 0);
+        connP->client->disconnectFromServer();
+
+        timeoutWheel.cancel(connP->timerId);
+        timeoutWheel.releaseId(connP->timerId);
+        connTimerList[connP->timerId] = NULL;
+
+        connHash.remove(connP->client);
+
+        delete connP->client;
+        delete connP;
+    }
+
+    deviceHash.remove(deviceP->deviceId);
+
+    delete deviceP;
+}
+
+void ModbusTCPPoolWorker::addPoll(int pollId, int deviceId, const struct MODBUS_POOL_REQUEST &request, uint32_t periodInMs)
+{
+    if(!deviceHash.contains(deviceId) || pollHash.contains(pollId))
+    {
+        return;
+    }
+
+    POLL *pollP = new POLL;
+    pollP->pollId = pollId;
+    pollP->deviceId = deviceId;
+    pollP->timerId = pollWheel.allocateId();
+    pollP->periodInMs = periodInMs;
+    pollP->pendingCnt = 0;
+    pollP->request = request;
+
+    if(pollTimerList.size() <= (int)pollP->timerId)
+    {
+        pollTimerList.resize(pollP->timerId + 1);
+    }
+
+    pollTimerList[pollP->timerId] = pollP;
+    pollHash.insert(pollId, pollP);
+
+    // First poll at next tick
+    pollWheel.schedule(pollP->timerId, 0);
+}
+
+void ModbusTCPPoolWorker::removePoll(int pollId)
+{
+    POLL *pollP = pollHash.value(pollId, NULL);
+
+    if(NULL == pollP)
+    {
+        return;
+    }
+
+    pollWheel.cancel(pollP->timerId);
+    pollWheel.releaseId(pollP->timerId);
+    pollTimerList[pollP->timerId] = NULL;
+
+    pollHash.remove(pollId);
+
+    delete pollP;
+}
+
+void ModbusTCPPoolWorker::queueRequest(DEVICE *deviceP, const struct MODBUS_POOL_REQUEST &request)
+{
+    if((uint32_t)deviceP->txQueue.size() >= deviceP->config.maxQueueSize)
+    {
+        failRequest(deviceP, request, ModbusTCPPool::POOL_ERROR_QUEUE_FULL);
+        return;
+    }
+
+    deviceP->txQueue.append(request);
+
+    dispatch(deviceP);
+}
+
+void ModbusTCPPoolWorker::queuePoll(DEVICE *deviceP, POLL *pollP)
+{
+    uint32_t blockRegCnt = deviceP->config.blockSize.maxReadRegCnt;
+    uint32_t regOffset = pollP->request.regOffset;
+    uint32_t regEnd = regOffset + pollP->request.regCnt;
+
+    // Counted before queuing, a request may fail at once
+    pollP->pendingCnt = (pollP->request.regCnt + blockRegCnt - 1) / blockRegCnt;
+
+    for(; regOffset < regEnd; regOffset += blockRegCnt)
+    {
+        struct MODBUS_POOL_REQUEST request = pollP->request;
+
+        request.regOffset = (uint16_t)regOffset;
+        request.regCnt = (uint16_t)((regEnd - regOffset < blockRegCnt) ? (regEnd - regOffset) : blockRegCnt);
+
+        queueRequest(deviceP, request);
+    }
+}
+
+void ModbusTCPPoolWorker::dispatch(DEVICE *deviceP)
+{
+    // Parked device only gets a probe now and then, the others fail at once
+    if(!deviceP->txQueue.isEmpty() && !deviceP->rto.allowRequest(clock.elapsed()))
+    {
+        while(!deviceP->txQueue.isEmpty())
+        {
+            failRequest(deviceP, deviceP->txQueue.takeFirst(), ModbusTCPPool::POOL_ERROR_DEVICE_PARKED);
+        }
+
+        return;
+    }
+
+    for(int i = 0; i < deviceP->connList.size() && !deviceP->txQueue.isEmpty(); i++)
+    {
+        CONNECTION *connP = deviceP->connList.at(i);
+
+        if(connP->busy || !connP->client->getRunningStatus())
+        {
+            continue;
+        }
+
+        connP->request = deviceP->txQueue.takeFirst();
+        connP->busy = true;
+        connP->retryCnt = 0;
+        connP->transactionId++;
+
+        if(!transmit(connP))
+        {
+            // Connection is just lost, keep the order of queue
+            deviceP->txQueue.prepend(connP->request);
+            connP->busy = false;
+        }
+    }
+}
+
+bool ModbusTCPPoolWorker::transmit(CONNECTION *connP)
+{
+    const struct MODBUS_POOL_REQUEST &request = connP->request;
+    const uint16_t *valueP = (const uint16_t *)request.data.constData();
+    uint32_t pduLen = 0;
+
+    // Capacity is kept, only the first transmit allocates
+    if(txBuf.size() < ModbusTcpFrame::MAX_ADU_LEN)
+    {
+        txBuf.resize(ModbusTcpFrame::MAX_ADU_LEN);
+    }
+
+    uint8_t *aduP = (uint8_t *)txBuf.data();
+    uint8_t *pduP = ModbusTcpFrame::getPdu(aduP);
+
+    // Encoded by caller, size is checked by transactPdu()
+    if(request.isPdu)
+    {
+        memcpy(pduP, request.data.constData(), request.data.size());
+        pduLen = request.data.size();
+    }
+    else switch(request.functionCode)
+    {
+    case MB_FUNC_READ_HOLDING_REGISTER:
+        pduLen = ModbusPdu<MB_FUNC_READ_HOLDING_REGISTER>::encodeRequest(pduP, request.regOffset, request.regCnt);
+        break;
+    case MB_FUNC_READ_INPUT_REGISTER:
+        pduLen = ModbusPdu<MB_FUNC_READ_INPUT_REGISTER>::encodeRequest(pduP, request.regOffset, request.regCnt);
+        break;
+    case MB_FUNC_WRITE_REGISTER:
+        pduLen = ModbusPdu<MB_FUNC_WRITE_REGISTER>::encodeRequest(pduP, request.regOffset, valueP[0]);
+        break;
+    case MB_FUNC_WRITE_MULTIPLE_REGISTERS:
+        pduLen = ModbusPdu<MB_FUNC_WRITE_MULTIPLE_REGISTERS>::encodeRequest(pduP, request.regOffset, valueP, request.regCnt);
+        break;
+    default:
+        break;
+    }
+
+    uint32_t aduLen = ModbusTcpFrame::encode(aduP, pduLen, connP->transactionId, connP->deviceP->config.unitId);
+
+    if(!connP->client->sendData(txBuf.constData(), aduLen))
+    {
+        return false;
+    }
+
+    connP->txTimeInMs = clock.elapsed();
+    timeoutWheel.schedule(connP->timerId, connP->deviceP->rto.getRto());
+
+    return true;
+}
+
+void ModbusTCPPoolWorker::finishRequest(CONNECTION *connP)
+{
+    timeoutWheel.cancel(connP->timerId);
+
+    connP->busy = false;
+}
+
+void ModbusTCPPoolWorker::failRequest(DEVICE *deviceP, const struct MODBUS_POOL_REQUEST &request, int errorCode)
+{
+    clearPollPending(request.pollId);
+
+#ifdef MODBUS_TCP_POOL_DEBUG_TRACE
+    qDebug() << "ModbusTCPPoolWorker::failRequest() device" << deviceP->deviceId
+             << "function" << request.functionCode << "error" << errorCode;
+#endif
+
+    ModbusTransaction transaction = request.transaction;
+
+    switch(errorCode)
+    {
+    case ModbusTCPPool::POOL_ERROR_TIMEOUT:
+        transaction.finish(ModbusTransaction::STATUS_TIMEOUT);
+        break;
+    case ModbusTCPPool::POOL_ERROR_QUEUE_FULL:
+        transaction.finish(ModbusTransaction::STATUS_REJECTED);
+        break;
+    case ModbusTCPPool::POOL_ERROR_INVALID_RESPONSE:
+        transaction.finish(ModbusTransaction::STATUS_INVALID_RESPONSE);
+        break;
+    case ModbusTCPPool::POOL_ERROR_DEVICE_REMOVED:
+        transaction.finish(ModbusTransaction::STATUS_CANCELLED);
+        break;
+    case ModbusTCPPool::POOL_ERROR_DEVICE_PARKED:
+        transaction.finish(ModbusTransaction::STATUS_UNREACHABLE);
+        break;
+    default:
+        // Modbus exception code
+        transaction.finish(ModbusTransaction::STATUS_EXCEPTION, QByteArray(), (uint8_t)errorCode);
+        break;
+    }
+
+    // Emit signal
+    emit requestFailed(deviceP->deviceId, request.functionCode, request.regOffset, errorCode);
+}
+
+void ModbusTCPPoolWorker::clearPollPending(int pollId)
+{
+    if(pollId < 0)
+    {
+        return;
+    }
+
+    POLL *pollP = pollHash.value(pollId, NULL);
+
+    if(NULL != pollP && pollP->pendingCnt > 0)
+    {
+        pollP->pendingCnt--;
+    }
+}
+
+void ModbusTCPPoolWorker::tick()
+{
+    QList<uint32_t> expiredIds;
+    int64_t nowInMs = clock.elapsed();
+    uint32_t elapsedInMs = (uint32_t)(nowInMs - lastTickInMs);
+
+    lastTickInMs = nowInMs;
+
+    // Polls due
+    pollWheel.advance(elapsedInMs, expiredIds);
+
+    for(int i = 0; i < expiredIds.size(); i++)
+    {
+        POLL *pollP = pollTimerList.value(expiredIds.at(i), NULL);
+
+        if(NULL == pollP)
+        {
+            continue;
+        }
+
+        pollWheel.schedule(pollP->timerId, pollP->periodInMs);
+
+        // A slow device gets fewer polls instead of a growing queue
+        if(0 != pollP->pendingCnt)
+        {
+            continue;
+        }
+
+        DEVICE *deviceP = deviceHash.value(pollP->deviceId, NULL);
+
+        if(NULL != deviceP)
+        {
+            queuePoll(deviceP, pollP);
+        }
+    }
+
+    // Response timeouts
+    expiredIds.clear();
+    timeoutWheel.advance(elapsedInMs, expiredIds);
+
+    for(int i = 0; i < expiredIds.size(); i++)
+    {
+        CONNECTION *connP = connTimerList.value(expiredIds.at(i), NULL);
+
+        if(NULL == connP || !connP->busy)
+        {
+            continue;
+        }
+
+        // Each timeout doubles the deadline of the retransmit
+        connP->deviceP->rto.onTimeout();
+
+        if(connP->retryCnt < connP->deviceP->config.retryTimes)
+        {
+            connP->retryCnt++;
+
+            // Same transaction ID, a late response of the first transmit is accepted
+            if(transmit(connP))
+            {
+                continue;
+            }
+        }
+
+        struct MODBUS_POOL_REQUEST request = connP->request;
+
+        finishRequest(connP);
+        failRequest(connP->deviceP, request, ModbusTCPPool::POOL_ERROR_TIMEOUT);
+
+        if(connP->deviceP->rto.onFailure(nowInMs))
+        {
+            // Emit signal
+            emit deviceParked(connP->deviceP->deviceId, true);
+        }
+
+        dispatch(connP->deviceP);
+    }
+}
+
+void ModbusTCPPoolWorker::handleResponse(QByteArray adu)
+{
+    CONNECTION *connP = connHash.value(sender(), NULL);
+
+    if(NULL == connP)
+    {
+        return;
+    }
+
+    parseResponse(connP, adu);
+
+    dispatch(connP->deviceP);
+}
+
+void ModbusTCPPoolWorker::parseResponse(CONNECTION *connP, const QByteArray &adu)
+{
+    ModbusPduView pdu = ModbusTcpFrame::decode(adu.constData(), adu.size());
+
+    // Function code + exception code/byte count at least
+    if(!pdu.contains(0, 2) || !connP->busy)
+    {
+        return;
+    }
+
+    // Response of a request already timed out
+    if(ModbusTcpFrame::getTransactionId(adu.constData(), adu.size()) != connP->transactionId)
+    {
+        return;
+    }
+
+    struct MODBUS_POOL_REQUEST request = connP->request;
+    DEVICE *deviceP = connP->deviceP;
+
+    // Only a first transmit gives a clean RTT (Karn)
+    if(0 == connP->retryCnt)
+    {
+        deviceP->rto.addSample((uint32_t)(clock.elapsed() - connP->txTimeInMs));
+    }
+
+    if(deviceP->rto.onResponse())
+    {
+        // Emit signal
+        emit deviceParked(deviceP->deviceId, false);
+    }
+
+    finishRequest(connP);
+
+    if(pdu.isException() && pdu.getFunctionCode() == request.functionCode)
+    {
+        failRequest(deviceP, request, pdu.getExceptionCode());
+        return;
+    }
+
+    if(pdu.getUint8(0) != request.functionCode)
+    {
+        failRequest(deviceP, request, ModbusTCPPool::POOL_ERROR_INVALID_RESPONSE);
+        return;
+    }
+
+    // Response PDU is decoded by the caller
+    if(request.isPdu)
+    {
+        request.transaction.finish(ModbusTransaction::STATUS_DONE,
+                                   QByteArray((const char *)pdu.getData(0, pdu.getLen()), pdu.getLen()));
+        return;
+    }
+
+    if(MB_FUNC_READ_HOLDING_REGISTER == request.functionCode || MB_FUNC_READ_INPUT_REGISTER == request.functionCode)
+    {
+        const uint8_t *regP = NULL;
+        uint16_t regCnt = 0;
+
+        if(MB_FUNC_READ_HOLDING_REGISTER == request.functionCode)
+        {
+            regP = ModbusPdu<MB_FUNC_READ_HOLDING_REGISTER>::decodeResponse(pdu, regCnt);
+        }
+        else
+        {
+            regP = ModbusPdu<MB_FUNC_READ_INPUT_REGISTER>::decodeResponse(pdu, regCnt);
+        }
+
+        if(NULL == regP || regCnt != request.regCnt)
+        {
+            failRequest(deviceP, request, ModbusTCPPool::POOL_ERROR_INVALID_RESPONSE);
+            return;
+        }
+
+        struct MODBUS_READ_FEEDBACK feedback;
+
+        // Same layout as ModbusTCP, registers are kept big endian
+        feedback.address = request.regOffset;
+        feedback.len = request.regCnt;
+        feedback.rdwrFlag = MODBUS_RD_OPT;
+        feedback.buffer = QByteArray((const char *)regP, regCnt * sizeof(uint16_t));
+
+        clearPollPending(request.pollId);
+
+        // Same buffer as the signal, no copy
+        request.transaction.finish(ModbusTransaction::STATUS_DONE, feedback.buffer);
+
+        // Emit signal
+        emit newResponseMsg(deviceP->deviceId, feedback);
+    }
+    else
+    {
+        clearPollPending(request.pollId);
+
+        request.transaction.finish(ModbusTransaction::STATUS_DONE);
+
+        // Emit signal
+        emit writeCompleted(deviceP->deviceId, request.regOffset, request.regCnt);
+    }
+}
+
+void ModbusTCPPoolWorker::handleConnectionChanged(bool connected)
+{
+    CONNECTION *connP = connHash.value(sender(), NULL);
+
+    if(NULL == connP)
+    {
+        return;
+    }
+
+    DEVICE *deviceP = connP->deviceP;
+
+    // Request of a lost connection is sent again on another connection
+    if(!connected && connP->busy)
+    {
+        timeoutWheel.cancel(connP->timerId);
+        connP->busy = false;
+
+        deviceP->txQueue.prepend(connP->request);
+    }
+
+    int connectedCnt = 0;
+    for(int i = 0; i < deviceP->connList.size(); i++)
+    {
+        if(deviceP->connList.at(i)->client->getRunningStatus())
+        {
+            connectedCnt++;
+        }
+    }
+
+    if(connectedCnt != deviceP->connectedCnt)
+    {
+        deviceP->connectedCnt = connectedCnt;
+
+        // Emit signal
+        emit deviceConnectionChanged(deviceP->deviceId, connectedCnt);
+    }
+
+    dispatch(deviceP);
+}
@@ -0,0 +1,386 @@
+/**********************************************************************
+PACKAGE:        Communication
+FILE:           ModbusTCPPool.h
+COPYRIGHT (C):  All rights reserved.
+
+PURPOSE:        Modbus TCP master for many devices on a small thread pool
+**********************************************************************/
+
+#ifndef MODBUSTCPPOOL_H
+#define MODBUSTCPPOOL_H
+
+#include <QObject>
+#include <QThread>
+#include <QMutex>
+#include <QTimer>
+#include <QHash>
+#include <QList>
+#include <QVector>
+#include <QByteArray>
+#include <QHostAddress>
+#include <QElapsedTimer>
+
+#include "TcpClient.h"
+#include "ModbusData.h"
+#include "ModbusPdu.h"
+#include "ModbusTransaction.h"
+#include "ModbusRtoEstimator.h"
+#include "TimerWheel.h"
+
+/*
+ ModbusTCP owns one TCPClient, one device and one timer per object, which
+ does not scale to hundreds of devices. ModbusTCPPool polls all devices
+ from threadCnt worker threads,
+
+ ModbusTCPPool (caller thread)
+    |-- worker 0 (QThread): device 0, 2, 4 ...  one tick timer, 2 TimerWheels
+    |-- worker 1 (QThread): device 1, 3, 5 ...  one tick timer, 2 TimerWheels
+
+ A device is assigned to the worker with the fewest devices. Each device
+ has connectionCnt TCPClient connections with one outstanding request on
+ each, the requests of a device are queued and sent on the first idle
+ connection, so a slow device never blocks the others.
+
+ Request timeouts and poll periods are TimerWheel timers of the worker,
+ the encoding buffer is shared by all devices of the worker. Only the
+ tick timer and connections cost per thread/device, not a QThread each.
+
+ All public functions are thread safe, they only queue a command to the
+ worker. Results are reported by signals in the thread of the pool.
+*/
+
+struct MODBUS_DEVICE_CONFIG
+{
+    QHostAddress address;
+    uint16_t port;
+    uint8_t unitId;
+
+    uint32_t connectionCnt;     // Parallel connections, one outstanding request on each
+    uint32_t timeoutInMs;       // Response timeout of one transmit before the first RTT sample
+    uint32_t retryTimes;        // Retransmit times before requestFailed()
+    uint32_t maxQueueSize;      // Requests waiting for an idle connection
+    struct MODBUS_RTO_CONFIG rto;   // Adaptive timeout and circuit breaker, rto.initialRtoInMs is ignored
+    struct MODBUS_BLOCK_SIZE blockSize; // Largest request of device, polls are split into blocks of it
+
+    MODBUS_DEVICE_CONFIG() :
+        port(502),
+        unitId(1),
+        connectionCnt(1),
+        timeoutInMs(1000),
+        retryTimes(1),
+        maxQueueSize(256)
+    {
+    }
+};
+
+class ModbusTCPPoolWorker;
+
+class ModbusTCPPool : public QObject
+{
+    Q_OBJECT
+public:
+    // threadCnt, 0: QThread::idealThreadCount()
+    explicit ModbusTCPPool(uint32_t threadCnt = DEFAULT_THREAD_CNT, QObject *parent = 0);
+    virtual ~ModbusTCPPool();
+
+    // Error code of requestFailed(), Modbus exception codes are 1 ~ 255
+    enum POOL_ERROR_CODE
+    {
+        POOL_ERROR_TIMEOUT = 0x100,
+        POOL_ERROR_QUEUE_FULL = 0x101,
+        POOL_ERROR_INVALID_RESPONSE = 0x102,
+        POOL_ERROR_DEVICE_REMOVED = 0x103,
+        POOL_ERROR_DEVICE_PARKED = 0x104
+    };
+
+    enum
+    {
+        DEFAULT_THREAD_CNT = 2
+    };
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		addDevice
+    PURPOSE:		Add a device and start connecting to it in background
+    ARGUMENTS:		const struct MODBUS_DEVICE_CONFIG &config -- address and timing
+    RETURNS:		Device ID used by the other functions, -1: invalid config
+    -----------------------------------------------------------------------*/
+    int addDevice(const struct MODBUS_DEVICE_CONFIG &config);
+
+    // Disconnect device, its queued requests fail with POOL_ERROR_DEVICE_REMOVED
+    void removeDevice(int deviceId);
+
+    int getDeviceCnt() const;
+    uint32_t getThreadCnt() const;
+
+    // Largest request of device, e.g. found by ModbusBlockSizeProbe. False: invalid device
+    bool setBlockSize(int deviceId, const struct MODBUS_BLOCK_SIZE &blockSize);
+    struct MODBUS_BLOCK_SIZE getBlockSize(int deviceId) const;
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:       readInputRegisters/readHoldRegisters
+    PURPOSE:        Queue a read request of device
+    ARGUMENTS:      int deviceId        -- device ID of addDevice()
+                    uint16_t regOffset  -- register offset address
+                    uint16_t regCnt     -- count of registers
+    RETURNS:        true - queued, false - invalid device or argument
+    -----------------------------------------------------------------------*/
+    bool readInputRegisters(int deviceId, uint16_t regOffset, uint16_t regCnt);
+    bool readHoldRegisters(int deviceId, uint16_t regOffset, uint16_t regCnt);
+
+    // Queue a write request, dataP is regCnt uint16_t in host byte order
+    bool writeHoldRegister(int deviceId, uint16_t regOffset, uint16_t regValue);
+    bool writeMultiRegisters(int deviceId, uint16_t regOffset, const char *dataP, uint16_t regCnt);
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:       transact
+    PURPOSE:        Queue a request of device and track its own result
+    ARGUMENTS:      int deviceId            -- device ID of addDevice()
+                    uint8_t functionCode    -- FC03/FC04/FC06/FC16
+                    uint16_t regOffset      -- register offset address
+                    uint16_t regCnt         -- count of registers
+                    const char *dataP       -- regCnt uint16_t in host byte order of write
+    RETURNS:        Handle completed in the worker thread of device,
+                    STATUS_REJECTED at once if device or argument is invalid.
+                    Signals are emitted for the request as well.
+    -----------------------------------------------------------------------*/
+    ModbusTransaction transact(int deviceId, uint8_t functionCode, uint16_t regOffset, uint16_t regCnt,
+                               const char *dataP = NULL);
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:       transactPdu
+    PURPOSE:        Queue an encoded request PDU of any function code,
+                    e.g. FC20/FC21 of ModbusFileTransfer
+    ARGUMENTS:      int deviceId            -- device ID of addDevice()
+                    const QByteArray &pdu   -- function code + data, MODBUS_MAX_PDU_LEN at most
+    RETURNS:        Handle completed with the whole response PDU by getData(),
+                    STATUS_REJECTED at once if device or PDU is invalid.
+                    Only requestFailed() is emitted for the request.
+    -----------------------------------------------------------------------*/
+    ModbusTransaction transactPdu(int deviceId, const QByteArray &pdu);
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:       addPoll
+    PURPOSE:        Read registers of device periodically
+    ARGUMENTS:      int deviceId        -- device ID of addDevice()
+                    uint8_t functionCode -- MB_FUNC_READ_HOLDING_REGISTER or
+                                            MB_FUNC_READ_INPUT_REGISTER
+                    uint16_t regOffset  -- register offset address
+                    uint16_t regCnt     -- count of registers, split into requests
+                                           of maxReadRegCnt of the device
+                    uint32_t periodInMs -- poll period, a poll is not queued
+                                           again while the last one is pending
+    RETURNS:        Poll ID for removePoll(), -1: invalid device or argument
+    -----------------------------------------------------------------------*/
+    int addPoll(int deviceId, uint8_t functionCode, uint16_t regOffset, uint16_t regCnt, uint32_t periodInMs);
+    void removePoll(int pollId);
+
+signals:
+    // Read response of device, same as ModbusTCP::newResponseMsg()
+    void newResponseMsg(int deviceId, const MODBUS_READ_FEEDBACK &msg);
+
+    // Write request of device completed
+    void writeCompleted(int deviceId, int regOffset, int regCnt);
+
+    // errorCode: Modbus exception code or POOL_ERROR_CODE
+    void requestFailed(int deviceId, int functionCode, int regOffset, int errorCode);
+
+    // connectedCnt: connections of device currently connected
+    void deviceConnectionChanged(int deviceId, int connectedCnt);
+
+    // Device is parked after repeated timeouts, its requests fail with POOL_ERROR_DEVICE_PARKED
+    // except a probe now and then, or it answers again
+    void deviceParked(int deviceId, bool parked);
+
+private:
+    QList<QThread *> threadList;
+    QList<ModbusTCPPoolWorker *> workerList;
+    QList<int> workerDeviceCntList;     // Devices of each worker
+
+    QHash<int, int> deviceWorkerHash;   // Device ID to worker index
+    QHash<int, int> pollDeviceHash;     // Poll ID to device ID
+    QHash<int, struct MODBUS_BLOCK_SIZE> deviceBlockSizeHash;
+
+    int nextDeviceId;
+    int nextPollId;
+
+    mutable QMutex mutex;
+
+    // Return worker of device, NULL: device not found
+    ModbusTCPPoolWorker *getWorker(int deviceId);
+
+    // Queue a request to the worker of device
+    bool queueRequest(int deviceId, uint8_t functionCode, uint16_t regOffset, uint16_t regCnt,
+                      const QByteArray &data = QByteArray(), const ModbusTransaction &transaction = ModbusTransaction(),
+                      bool isPdu = false);
+};
+
+
+// Request of one transaction
+struct MODBUS_POOL_REQUEST
+{
+    uint8_t functionCode;
+    uint16_t regOffset;
+    uint16_t regCnt;
+    QByteArray data;        // Register values of write, host byte order, or request PDU
+    bool isPdu;             // True: data is the encoded request PDU, see transactPdu()
+    int pollId;             // -1: not issued by poll
+    ModbusTransaction transaction;  // Null if queued without handle
+
+    MODBUS_POOL_REQUEST() :
+        functionCode(MB_FUNC_NONE),
+        regOffset(0),
+        regCnt(0),
+        isPdu(false),
+        pollId(-1)
+    {
+    }
+};
+
+/*
+ Worker of ModbusTCPPool, lives in its own QThread. All members are only
+ touched in that thread except commandList, which is filled by the pool.
+*/
+class ModbusTCPPoolWorker : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ModbusTCPPoolWorker(QObject *parent = 0);
+    virtual ~ModbusTCPPoolWorker();
+
+    enum COMMAND_TYPE
+    {
+        CMD_ADD_DEVICE = 0,
+        CMD_REMOVE_DEVICE,
+        CMD_REQUEST,
+        CMD_ADD_POLL,
+        CMD_REMOVE_POLL,
+        CMD_SET_BLOCK_SIZE
+    };
+
+    struct COMMAND
+    {
+        COMMAND_TYPE type;
+        int deviceId;
+        int pollId;
+        uint32_t periodInMs;
+        struct MODBUS_DEVICE_CONFIG config;
+        struct MODBUS_POOL_REQUEST request;
+    };
+
+    // Called by pool in any thread, the command is handled in worker thread
+    void pushCommand(const struct COMMAND &command);
+
+public slots:
+    // Create tick timer in worker thread
+    void init();
+
+    // Close all connections in worker thread before the thread quits
+    void shutdown();
+
+    void processCommands();
+
+signals:
+    void newResponseMsg(int deviceId, const MODBUS_READ_FEEDBACK &msg);
+    void writeCompleted(int deviceId, int regOffset, int regCnt);
+    void requestFailed(int deviceId, int functionCode, int regOffset, int errorCode);
+    void deviceConnectionChanged(int deviceId, int connectedCnt);
+    void deviceParked(int deviceId, bool parked);
+
+private:
+    enum
+    {
+        TICK_IN_MS = 10
+    };
+
+    struct DEVICE;
+
+    struct CONNECTION
+    {
+        TCPClient *client;
+        DEVICE *deviceP;
+        uint32_t timerId;           // Timeout timer in timeoutWheel
+        bool busy;                  // True: request is outstanding
+        uint16_t transactionId;
+        uint32_t retryCnt;
+        int64_t txTimeInMs;         // Time of last transmit
+        struct MODBUS_POOL_REQUEST request;
+    };
+
+    struct DEVICE
+    {
+        int deviceId;
+        struct MODBUS_DEVICE_CONFIG config;
+        QList<CONNECTION *> connList;
+        QList<struct MODBUS_POOL_REQUEST> txQueue;
+        int connectedCnt;
+        ModbusRtoEstimator rto;     // Timeout from RTT of all connections
+    };
+
+    struct POLL
+    {
+        int pollId;
+        int deviceId;
+        uint32_t timerId;           // Period timer in pollWheel
+        uint32_t periodInMs;
+        uint32_t pendingCnt;        // Requests of last poll queued or outstanding
+        struct MODBUS_POOL_REQUEST request;
+    };
+
+    QMutex mutex;                   // Lock of commandList
+    QList<struct COMMAND> commandList;
+
+    QHash<int, DEVICE *> deviceHash;
+    QHash<QObject *, CONNECTION *> connHash;    // TCPClient to connection
+    QHash<int, POLL *> pollHash;
+    QVector<CONNECTION *> connTimerList;        // Timer ID to connection
+    QVector<POLL *> pollTimerList;              // Timer ID to poll
+
+    TimerWheel timeoutWheel;
+    TimerWheel pollWheel;
+    QTimer *tickTmr;
+    QElapsedTimer clock;
+    int64_t lastTickInMs;
+
+    QByteArray txBuf;               // Shared encoding buffer
+
+    void addDevice(int deviceId, const struct MODBUS_DEVICE_CONFIG &config);
+    void removeDevice(int deviceId);
+
+    // Close connections and free device, no request is reported, handles are cancelled
+    void deleteDevice(DEVICE *deviceP);
+
+    void addPoll(int pollId, int deviceId, const struct MODBUS_POOL_REQUEST &request, uint32_t periodInMs);
+    void removePoll(int pollId);
+
+    // Queue request of device and send it if a connection is idle
+    void queueRequest(DEVICE *deviceP, const struct MODBUS_POOL_REQUEST &request);
+
+    // Queue the registers of poll in blocks of maxReadRegCnt of device
+    void queuePoll(DEVICE *deviceP, POLL *pollP);
+
+    // Send queued requests on idle connections of device
+    void dispatch(DEVICE *deviceP);
+
+    // Encode request into txBuf and send it, start timeout timer
+    bool transmit(CONNECTION *connP);
+
+    // Request of connection is done, free the connection for next request.
+    // A poll is pending until its request is reported by response or failRequest()
+    void finishRequest(CONNECTION *connP);
+
+    // Report failed request, errorCode: exception code or POOL_ERROR_CODE
+    void failRequest(DEVICE *deviceP, const struct MODBUS_POOL_REQUEST &request, int errorCode);
+
+    // Allow the poll to be queued again
+    void clearPollPending(int pollId);
+
+    // Parse response ADU of connection
+    void parseResponse(CONNECTION *connP, const QByteArray &adu);
+
+private slots:
+    void tick();
+    void handleResponse(QByteArray adu);
+    void handleConnectionChanged(bool connected);
+};
+
+#endif // MODBUSTCPPOOL_H
@@ -94,6 +94,7 @@ void ModbusTCPWidget::bindModel(ModbusTCP *clientP)
         m_modbusTCP->setAutoReconnect(m_autoConnectToServerFlag);
 
         connect(m_modbusTCP, SIGNAL(connectionChanged(bool)), this, SLOT(updateConnectionStatus(bool)));
+        connect(m_modbusTCP, SIGNAL(connectFailed(QString)), this, SLOT(connectFailedStatus(QString)));
         connect(m_modbusTCP, SIGNAL(newDataReady(QByteArray)), this, SLOT(readDataFromModbus(QByteArray)));
         connect(m_modbusTCP, SIGNAL(newDataTx(QByteArray)), this, SLOT(updateTxDataToLog(QByteArray)));
 
@@ -284,37 +285,45 @@ void ModbusTCPWidget::on_pushButton_connect_clicked()
         return;
     }
 
-    // Toggle flag
-    isRunning = !isRunning;
-
-    if(true == isRunning)
+    if(!isRunning && !m_modbusTCP->isConnecting())
     {
-        // Connect to server
-        isRunning = m_modbusTCP->connectToServer(ui->lineEdit_serverIP->text(), ui->lineEdit_serverPort->text().toInt());
-        logStr = tr("Connect to %1:%2 ").arg(ui->lineEdit_serverIP->text())
+        // Connect to server, the result is shown by updateConnectionStatus()/connectFailedStatus()
+        m_modbusTCP->connectToServer(ui->lineEdit_serverIP->text(), ui->lineEdit_serverPort->text().toInt());
+        logStr = tr("Connecting to %1:%2").arg(ui->lineEdit_serverIP->text())
                       .arg(ui->lineEdit_serverPort->text());
 
-        if(isRunning)
-        {
-            logStr.append(tr("succeed"));
-
-            m_modbusTCP->startPeriodTxService();
-        }
-        else
-        {
-            logStr.append(tr("failed"));
-        }
+        ui->pushButton_connect->setText(tr("Cancel"));
 
         // Update log
         updateToUILog(logStr);
     }
     else
     {
-        // Disconnect from server
+        // Disconnect from server, or cancel connecting
         m_modbusTCP->disconnectFromServer();
+
+        if(!isRunning)
+        {
+            ui->pushButton_connect->setText(tr("Connect"));
+        }
     }
 }
 
+void ModbusTCPWidget::connectFailedStatus(QString error)
+{
+    QString logStr = tr("Connect to %1:%2 failed, %3").arg(ui->lineEdit_serverIP->text())
+                            .arg(ui->lineEdit_serverPort->text()).arg(error);
+
+    // No retry is scheduled
+    if(!m_modbusTCP->isConnecting())
+    {
+        ui->pushButton_connect->setText(tr("Connect"));
+    }
+
+    // Update log
+    updateToUILog(logStr);
+}
+
 bool ModbusTCPWidget::getConnectionStatus() const
 {
     return isRunning;
@@ -324,7 +333,7 @@ void ModbusTCPWidget::autoConnectToServer()
 {
     if(m_autoConnectToServerFlag)
     {
-        if(!isRunning)
+        if(NULL != m_modbusTCP && !isRunning && !m_modbusTCP->isConnecting())
         {
             on_pushButton_connect_clicked();
         }
@@ -70,6 +70,7 @@ public slots:
 private slots:
 
     void updateConnectionStatus(bool connected);
+    void connectFailedStatus(QString error);
     void readDataFromModbus(QByteArray data);
     void updateTxDataToLog(QByteArray data);
 
@@ -0,0 +1,401 @@
+/**********************************************************************
+PACKAGE:        Communication
+FILE:           ModbusTransaction.cpp
+COPYRIGHT (C):  All rights reserved.
+
+PURPOSE:        Handle of one Modbus request, completed by the transport
+**********************************************************************/
+
+#include "ModbusTransaction.h"
+#include <QThread>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QWaitCondition>
+#include <QPointer>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QCoreApplication>
+
+// Result callback, receiver is tracked so a deleted receiver is skipped
+struct CALLBACK_INFO
+{
+    QPointer<QObject> receiver;
+    QByteArray method;      // Method name without arguments
+
+    ModbusTransaction::FINISHED_FUNC func;  // Used instead of receiver if not NULL
+    void *contextP;
+
+    CALLBACK_INFO() :
+        func(NULL),
+        contextP(NULL)
+    {
+    }
+};
+
+struct ModbusTransaction::STATE
+{
+    uint8_t functionCode;
+    uint16_t regOffset;
+    uint16_t regCnt;
+    QThread *thread;
+
+    STATUS status;
+    uint8_t exceptionCode;
+    QByteArray data;
+
+    QList<CALLBACK_INFO> callbackList;
+};
+
+/*
+ One lock and one condition for all transactions, a finish wakes all
+ waiters and each checks its own list. Hold time is a few assignments,
+ so it costs less than a mutex and condition per transaction.
+*/
+static QMutex stateMutex;
+static QWaitCondition finishedCondition;
+static bool metaTypeRegistered = false;
+
+// Event loop of a waiting transport thread is woken up at least this often
+static const int WAIT_POLL_IN_MS = 10;
+
+static void invokeCallback(const CALLBACK_INFO &callback, const ModbusTransaction &transaction)
+{
+    if(NULL != callback.func)
+    {
+        callback.func(transaction, callback.contextP);
+        return;
+    }
+
+    if(callback.receiver.isNull())
+    {
+        return;
+    }
+
+    QMetaObject::invokeMethod(callback.receiver.data(), callback.method.constData(),
+                              Qt::QueuedConnection, Q_ARG(ModbusTransaction, transaction));
+}
+
+// Callback of follow(), contextP is a heap copy of the follower
+static void finishFollower(const ModbusTransaction &leader, void *contextP)
+{
+    ModbusTransaction *followerP = static_cast<ModbusTransaction *>(contextP);
+
+    followerP->finish(leader.getStatus(), leader.getData(), leader.getExceptionCode());
+
+    delete followerP;
+}
+
+ModbusTransaction::ModbusTransaction()
+{
+}
+
+ModbusTransaction::ModbusTransaction(uint8_t functionCode, uint16_t regOffset, uint16_t regCnt, QThread *thread) :
+    d(new STATE)
+{
+    d->functionCode = functionCode;
+    d->regOffset = regOffset;
+    d->regCnt = regCnt;
+    d->thread = thread;
+    d->status = STATUS_PENDING;
+    d->exceptionCode = 0;
+}
+
+bool ModbusTransaction::isNull() const
+{
+    return d.isNull();
+}
+
+bool ModbusTransaction::operator==(const ModbusTransaction &other) const
+{
+    return d == other.d;
+}
+
+bool ModbusTransaction::isFinished() const
+{
+    return (STATUS_PENDING != getStatus());
+}
+
+bool ModbusTransaction::isOk() const
+{
+    return (STATUS_DONE == getStatus());
+}
+
+ModbusTransaction::STATUS ModbusTransaction::getStatus() const
+{
+    if(isNull())
+    {
+        return STATUS_CANCELLED;
+    }
+
+    QMutexLocker locker(&stateMutex);
+
+    return d->status;
+}
+
+uint8_t ModbusTransaction::getFunctionCode() const
+{
+    return isNull() ? MB_FUNC_NONE : d->functionCode;
+}
+
+uint16_t ModbusTransaction::getRegOffset() const
+{
+    return isNull() ? 0 : d->regOffset;
+}
+
+uint16_t ModbusTransaction::getRegCnt() const
+{
+    return isNull() ? 0 : d->regCnt;
+}
+
+uint8_t ModbusTransaction::getExceptionCode() const
+{
+    if(isNull())
+    {
+        return 0;
+    }
+
+    QMutexLocker locker(&stateMutex);
+
+    return d->exceptionCode;
+}
+
+QByteArray ModbusTransaction::getData() const
+{
+    if(isNull())
+    {
+        return QByteArray();
+    }
+
+    QMutexLocker locker(&stateMutex);
+
+    return d->data;
+}
+
+struct MODBUS_READ_FEEDBACK ModbusTransaction::getFeedback() const
+{
+    struct MODBUS_READ_FEEDBACK feedback;
+
+    feedback.address = getRegOffset();
+    feedback.buffer = getData();
+    feedback.len = feedback.buffer.size() / sizeof(uint16_t);
+    feedback.rdwrFlag = (MB_FUNC_READ_HOLDING_REGISTER == getFunctionCode() ||
+                         MB_FUNC_READ_INPUT_REGISTER == getFunctionCode()) ? MODBUS_RD_OPT : MODBUS_WR_OPT;
+
+    return feedback;
+}
+
+void ModbusTransaction::onFinished(QObject *receiver, const char *member)
+{
+    if(NULL == receiver || NULL == member)
+    {
+        return;
+    }
+
+    CALLBACK_INFO callback;
+    callback.receiver = receiver;
+
+    // SLOT() gives "1name(args)", invokeMethod() takes the name only
+    callback.method = QByteArray(('0' <= member[0] && member[0] <= '9') ? member + 1 : member);
+    if(callback.method.contains('('))
+    {
+        callback.method.truncate(callback.method.indexOf('('));
+    }
+
+    {
+        QMutexLocker locker(&stateMutex);
+
+        if(!metaTypeRegistered)
+        {
+            qRegisterMetaType<ModbusTransaction>("ModbusTransaction");
+            metaTypeRegistered = true;
+        }
+
+        if(!isNull() && STATUS_PENDING == d->status)
+        {
+            d->callbackList.append(callback);
+            return;
+        }
+    }
+
+    // Already finished
+    invokeCallback(callback, *this);
+}
+
+void ModbusTransaction::onFinished(FINISHED_FUNC func, void *contextP)
+{
+    if(NULL == func)
+    {
+        return;
+    }
+
+    CALLBACK_INFO callback;
+    callback.func = func;
+    callback.contextP = contextP;
+
+    {
+        QMutexLocker locker(&stateMutex);
+
+        if(!isNull() && STATUS_PENDING == d->status)
+        {
+            d->callbackList.append(callback);
+            return;
+        }
+    }
+
+    // Already finished
+    invokeCallback(callback, *this);
+}
+
+void ModbusTransaction::finish(STATUS status, const QByteArray &data, uint8_t exceptionCode)
+{
+    QList<CALLBACK_INFO> callbackList;
+
+    if(isNull() || STATUS_PENDING == status)
+    {
+        return;
+    }
+
+    {
+        QMutexLocker locker(&stateMutex);
+
+        if(STATUS_PENDING != d->status)
+        {
+            return;
+        }
+
+        d->status = status;
+        d->data = data;
+        d->exceptionCode = exceptionCode;
+
+        callbackList.swap(d->callbackList);
+
+        finishedCondition.wakeAll();
+    }
+
+    for(int i = 0; i < callbackList.size(); i++)
+    {
+        invokeCallback(callbackList.at(i), *this);
+    }
+}
+
+void ModbusTransaction::follow(const ModbusTransaction &leader)
+{
+    if(isNull())
+    {
+        return;
+    }
+
+    ModbusTransaction tempLeader = leader;
+    tempLeader.onFinished(&finishFollower, new ModbusTransaction(*this));
+}
+
+bool ModbusTransaction::waitForFinished(int timeoutInMs) const
+{
+    QList<ModbusTransaction> transactionList;
+    transactionList.append(*this);
+
+    return (0 == wait(transactionList, true, timeoutInMs));
+}
+
+bool ModbusTransaction::waitForAll(const QList<ModbusTransaction> &transactionList, int timeoutInMs)
+{
+    return (0 == wait(transactionList, true, timeoutInMs));
+}
+
+int ModbusTransaction::waitForAny(const QList<ModbusTransaction> &transactionList, int timeoutInMs)
+{
+    if(transactionList.isEmpty())
+    {
+        return -1;
+    }
+
+    return wait(transactionList, false, timeoutInMs);
+}
+
+int ModbusTransaction::checkFinished(const QList<ModbusTransaction> &transactionList, bool waitAll)
+{
+    // Called with stateMutex locked
+    for(int i = 0; i < transactionList.size(); i++)
+    {
+        const ModbusTransaction &transaction = transactionList.at(i);
+        bool finished = transaction.isNull() || STATUS_PENDING != transaction.d->status;
+
+        if(!waitAll && finished)
+        {
+            return i;
+        }
+
+        if(waitAll && !finished)
+        {
+            return -1;
+        }
+    }
+
+    return waitAll ? 0 : -1;
+}
+
+int ModbusTransaction::wait(const QList<ModbusTransaction> &transactionList, bool waitAll, int timeoutInMs)
+{
+    QThread *currentThread = QThread::currentThread();
+    bool inTransportThread = false;
+    int ret = -1;
+
+    QElapsedTimer elapsedTime;
+    elapsedTime.start();
+
+    for(int i = 0; i < transactionList.size(); i++)
+    {
+        if(!transactionList.at(i).isNull() && transactionList.at(i).d->thread == currentThread)
+        {
+            inTransportThread = true;
+            break;
+        }
+    }
+
+    if(!inTransportThread)
+    {
+        QMutexLocker locker(&stateMutex);
+
+        while(-1 == (ret = checkFinished(transactionList, waitAll)))
+        {
+            if(timeoutInMs < 0)
+            {
+                finishedCondition.wait(&stateMutex);
+                continue;
+            }
+
+            qint64 remainingInMs = timeoutInMs - elapsedTime.elapsed();
+            if(remainingInMs <= 0)
+            {
+                break;
+            }
+
+            finishedCondition.wait(&stateMutex, (unsigned long)remainingInMs);
+        }
+
+        return ret;
+    }
+
+    // The transport completes them from this thread's events, keep them running.
+    // The timer wakes the loop for the timeout and for other threads' transactions.
+    QTimer pollTmr;
+    pollTmr.start(WAIT_POLL_IN_MS);
+
+    while(true)
+    {
+        {
+            QMutexLocker locker(&stateMutex);
+            ret = checkFinished(transactionList, waitAll);
+        }
+
+        if(-1 != ret || (timeoutInMs >= 0 && elapsedTime.elapsed() >= timeoutInMs))
+        {
+            break;
+        }
+
+        QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents);
+    }
+
+    return ret;
+}
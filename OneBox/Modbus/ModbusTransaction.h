@@ -0,0 +1,153 @@
+/**********************************************************************
+PACKAGE:        Communication
+FILE:           ModbusTransaction.h
+COPYRIGHT (C):  All rights reserved.
+
+PURPOSE:        Handle of one Modbus request, completed by the transport
+**********************************************************************/
+
+#ifndef MODBUSTRANSACTION_H
+#define MODBUSTRANSACTION_H
+
+#include <stdint.h>
+#include <QObject>
+#include <QByteArray>
+#include <QList>
+#include <QMetaType>
+#include <QSharedPointer>
+
+#include "ModbusData.h"
+
+class QThread;
+
+/*
+ transact() of ModbusTCP/ModbusRTU/ModbusTCPPool returns a
+ ModbusTransaction, which completes with the response registers, the
+ exception code, timeout or rejection of this very request. The handle
+ is implicitly shared and thread safe, copies refer to one transaction.
+
+    ModbusTransaction t = modbusTCP->transact(MB_FUNC_READ_HOLDING_REGISTER, 0, 10);
+    t.onFinished(this, SLOT(handleTransaction(ModbusTransaction)));
+
+ The slot is always queued, never called inside the transport. Blocking
+ waitForFinished()/waitForAll()/waitForAny() are allowed in any thread,
+ in the thread of the transport they run its event loop while waiting,
+ so hundreds of transactions may be outstanding in a single wait.
+
+ The broadcast signals of the transports, e.g. newResponseMsg(), are
+ still emitted for every response.
+*/
+class ModbusTransaction
+{
+public:
+    enum STATUS
+    {
+        STATUS_PENDING = 0,
+        STATUS_DONE,                // Response received, see getData()
+        STATUS_EXCEPTION,           // Exception response, see getExceptionCode()
+        STATUS_TIMEOUT,             // No response after all retries
+        STATUS_INVALID_RESPONSE,    // Response does not match the request
+        STATUS_REJECTED,            // Invalid argument or Tx queue full, never sent
+        STATUS_CANCELLED,           // Transport or device is gone
+        STATUS_UNREACHABLE          // Device parked after repeated timeouts, never sent
+    };
+
+    // Null handle, finish() does nothing, isFinished() is true
+    ModbusTransaction();
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		ModbusTransaction
+    PURPOSE:		Create a pending transaction, used by transports
+    ARGUMENTS:		uint8_t functionCode    -- function code of request
+                    uint16_t regOffset      -- register offset address
+                    uint16_t regCnt         -- count of registers
+                    QThread *thread         -- thread the transport completes it in
+    RETURNS:		None
+    -----------------------------------------------------------------------*/
+    ModbusTransaction(uint8_t functionCode, uint16_t regOffset, uint16_t regCnt, QThread *thread);
+
+    bool isNull() const;
+    bool isFinished() const;
+
+    // True: both handles refer to one transaction
+    bool operator==(const ModbusTransaction &other) const;
+
+    // True: finished with STATUS_DONE
+    bool isOk() const;
+
+    STATUS getStatus() const;
+    uint8_t getFunctionCode() const;
+    uint16_t getRegOffset() const;
+    uint16_t getRegCnt() const;
+
+    // Exception code of STATUS_EXCEPTION, otherwise 0
+    uint8_t getExceptionCode() const;
+
+    // Registers of read response as received, big endian.
+    // Whole response PDU of a request queued as PDU, e.g. ModbusTCPPool::transactPdu()
+    QByteArray getData() const;
+
+    // Read response in the layout of the broadcast signals
+    struct MODBUS_READ_FEEDBACK getFeedback() const;
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		onFinished
+    PURPOSE:		Call slot of receiver once finished, immediately queued
+                    if already finished. Skipped if receiver is deleted.
+    ARGUMENTS:		QObject *receiver       -- receiver object
+                    const char *member      -- SLOT(name(ModbusTransaction))
+    RETURNS:		None
+    -----------------------------------------------------------------------*/
+    void onFinished(QObject *receiver, const char *member);
+
+    // Plain callback, called in the thread that finishes the transaction
+    typedef void (*FINISHED_FUNC)(const ModbusTransaction &transaction, void *contextP);
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		onFinished
+    PURPOSE:		Call func once finished, directly in the finishing thread,
+                    at once in the calling thread if already finished. Used by
+                    adapters without a QObject, e.g. ModbusCoroutine.h
+    ARGUMENTS:		FINISHED_FUNC func      -- callback, must not block
+                    void *contextP          -- passed to func
+    RETURNS:		None
+    -----------------------------------------------------------------------*/
+    void onFinished(FINISHED_FUNC func, void *contextP);
+
+    // Wait until finished, timeoutInMs < 0: no timeout. True: finished
+    bool waitForFinished(int timeoutInMs = -1) const;
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		finish
+    PURPOSE:		Complete the transaction, used by transports, only the
+                    first call takes effect
+    ARGUMENTS:		STATUS status               -- result
+                    const QByteArray &data      -- registers of read response
+                    uint8_t exceptionCode       -- exception code of STATUS_EXCEPTION
+    RETURNS:		None
+    -----------------------------------------------------------------------*/
+    void finish(STATUS status, const QByteArray &data = QByteArray(), uint8_t exceptionCode = 0);
+
+    // Finish with the result of leader, used when a transport merges a request into a queued one
+    void follow(const ModbusTransaction &leader);
+
+    // Wait until all are finished, true: all finished before timeout
+    static bool waitForAll(const QList<ModbusTransaction> &transactionList, int timeoutInMs = -1);
+
+    // Wait until one is finished, return its index, -1: timeout or empty list
+    static int waitForAny(const QList<ModbusTransaction> &transactionList, int timeoutInMs = -1);
+
+private:
+    struct STATE;
+    QSharedPointer<STATE> d;
+
+    // waitForAll()/waitForAny(), return as checkFinished(), -1: timeout
+    static int wait(const QList<ModbusTransaction> &transactionList, bool waitAll, int timeoutInMs);
+
+    // waitAll: 0 if all are finished, otherwise index of first finished, -1: not yet
+    static int checkFinished(const QList<ModbusTransaction> &transactionList, bool waitAll);
+};
+
+Q_DECLARE_METATYPE(ModbusTransaction)
+
+#endif // MODBUSTRANSACTION_H
@@ -15,18 +15,29 @@ TEMPLATE = app
 SOURCES += App/main.cpp \
     App/MainWindow.cpp \
     Modbus/ModbusCommBase.cpp \
+    Modbus/ModbusRegisterView.cpp \
+    Modbus/ModbusTransaction.cpp \
+    Modbus/ModbusRtoEstimator.cpp \
+    Modbus/ModbusBlockSizeProbe.cpp \
+    Modbus/ModbusScanner.cpp \
+    Modbus/ModbusFileTransfer.cpp \
     Modbus/ModbusRTU/ModbusRTU.cpp \
     Modbus/ModbusRTU/ModbusRTUWidget.cpp \
+    Modbus/ModbusASCII/ModbusASCII.cpp \
     Modbus/ModbusTCP/ModbusTCP.cpp \
     Modbus/ModbusTCP/ModbusTCPWidget.cpp \
+    Modbus/ModbusTCP/ModbusTCPPool.cpp \
     TCPServer/TcpServerWidget.cpp \
     TCPServer/TcpServer.cpp \
     TCPClient/TcpClientWidget.cpp \
     TCPClient/TcpClient.cpp \
+    TCPClient/TcpLoadGenerator.cpp \
     UDPServer/UdpServerWidget.cpp \
     UDPServer/UdpServer.cpp \
+    UDPServer/UdpShardServer.cpp \
     UDPClient/UdpClientWidget.cpp \
     UDPClient/UdpClient.cpp \
+    UDPClient/UdpTrafficGenerator.cpp \
     SerialPort/SerialDebugWidget.cpp \
     SerialPort/QSerialPort.cpp \
     SerialPort/qextserialbase.cpp \
@@ -34,24 +45,44 @@ SOURCES += App/main.cpp \
     Utility/Log/FileLog.cpp \
     Utility/Buffer/LoopBuffer.cpp \
     Utility/Buffer/FifoBuffer.cpp \
+    Utility/Framer/StreamFramer.cpp \
+    Utility/Timer/TimerWheel.cpp \
+    Utility/Socket/DatagramBatch.cpp \
+    Utility/Socket/PeerTable.cpp \
+    Utility/Socket/SequenceAnalyzer.cpp \
+    Utility/Stat/LatencyHistogram.cpp \
     Utility/QUtilityBox.cpp
 
 HEADERS  += App/MainWindow.h \
     Modbus/ModbusCommBase.h \
     Modbus/ModbusData.h \
+    Modbus/ModbusPdu.h \
+    Modbus/ModbusTransaction.h \
+    Modbus/ModbusCoroutine.h \
+    Modbus/ModbusRequestCoalescer.h \
+    Modbus/ModbusRtoEstimator.h \
+    Modbus/ModbusBlockSizeProbe.h \
+    Modbus/ModbusScanner.h \
+    Modbus/ModbusFileTransfer.h \
+    Modbus/ModbusRegisterView.h \
     Modbus/ModbusRTU/ModbusRTU.h \
     Modbus/ModbusRTU/ModbusRTUWidget.h \
+    Modbus/ModbusASCII/ModbusASCII.h \
     Modbus/ModbusTCP/ModbusTCP.h \
     Modbus/ModbusTCP/ModbusTCPWidget.h \
+    Modbus/ModbusTCP/ModbusTCPPool.h \
     Modbus/endian_proc.h \
     TCPServer/TcpServerWidget.h \
     TCPServer/TcpServer.h \
     TCPClient/TcpClientWidget.h \
     TCPClient/TcpClient.h \
+    TCPClient/TcpLoadGenerator.h \
     UDPServer/UdpServerWidget.h \
     UDPServer/UdpServer.h \
+    UDPServer/UdpShardServer.h \
     UDPClient/UdpClientWidget.h \
     UDPClient/UdpClient.h \
+    UDPClient/UdpTrafficGenerator.h \
     SerialPort/SerialDebugWidget.h \
     SerialPort/QSerialPort.h \
     SerialPort/qextserialbase.h \
@@ -60,6 +91,12 @@ HEADERS  += App/MainWindow.h \
     Utility/Log/FileLog.h \
     Utility/Buffer/LoopBuffer.h \
     Utility/Buffer/FifoBuffer.h \
+    Utility/Framer/StreamFramer.h \
+    Utility/Timer/TimerWheel.h \
+    Utility/Socket/DatagramBatch.h \
+    Utility/Socket/PeerTable.h \
+    Utility/Socket/SequenceAnalyzer.h \
+    Utility/Stat/LatencyHistogram.h \
     Utility/QUtilityBox.h \
     Utility/QtBaseType.h
 
@@ -90,6 +127,7 @@ INCLUDEPATH += $$PWD/UDPClient
 INCLUDEPATH += $$PWD/TCPServer
 INCLUDEPATH += $$PWD/TCPClient
 INCLUDEPATH += $$PWD/Modbus/ModbusRTU
+INCLUDEPATH += $$PWD/Modbus/ModbusASCII
 INCLUDEPATH += $$PWD/Modbus/ModbusTCP
 INCLUDEPATH += $$PWD/Modbus
 
@@ -98,5 +136,9 @@ INCLUDEPATH += $$PWD/Utility
 INCLUDEPATH += $$PWD/Utility/Buffer
 INCLUDEPATH += $$PWD/Utility/Log
 INCLUDEPATH += $$PWD/Utility/CRC
+INCLUDEPATH += $$PWD/Utility/Framer
+INCLUDEPATH += $$PWD/Utility/Timer
+INCLUDEPATH += $$PWD/Utility/Socket
+INCLUDEPATH += $$PWD/Utility/Stat
 LIBS +=
 
@@ -7,6 +7,8 @@ PURPOSE:        TCP Client interface
 **********************************************************************/
 
 #include "TcpClient.h"
+#include <QPointer>
+#include <QDateTime>
 
 #undef TCP_CLIENT_DEBUG_TRACE
 
@@ -14,25 +16,55 @@ TCPClient::TCPClient(QObject *parent) :
     QThread(parent),
     tcpClient(new QTcpSocket),
     fifoBuf(new FIFOBuffer),
+    framer(NULL),
     hostAddr(QHostAddress::Any),
     listenPort(0),
     m_timeOutInMS(1000),
-    isRunning(false)
+    isRunning(false),
+    connState(STATE_DISCONNECTED),
+    connectTmr(new QTimer),
+    reconnectTmr(new QTimer),
+    autoReconnectFlag(false),
+    minBackoffInMs(DEFAULT_MIN_BACKOFF_IN_MS),
+    maxBackoffInMs(DEFAULT_MAX_BACKOFF_IN_MS),
+    reconnectAttempt(0),
+    jitterState((uint32_t)QDateTime::currentMSecsSinceEpoch() ^ (uint32_t)(quintptr)this)
 {
+    // Clients and processes started together draw different delays, xorshift32 never leaves 0
+    if(0 == jitterState)
+    {
+        jitterState = 2463534242U;
+    }
+
     resetTxRxCnt();
 
     // Disconnect all connections
     tcpClient->abort();
 
+    connectTmr->setSingleShot(true);
+    reconnectTmr->setSingleShot(true);
+
+    connect(tcpClient, SIGNAL(connected()), this, SLOT(handleConnected()));
     connect(tcpClient, SIGNAL(readyRead()), this, SLOT(readPendingData()));
     connect(tcpClient, SIGNAL(disconnected()), this, SLOT(removeConnection()));
     connect(tcpClient, SIGNAL(error(QAbstractSocket::SocketError)), this, SLOT(readError(QAbstractSocket::SocketError)));
+
+    connect(connectTmr, SIGNAL(timeout()), this, SLOT(handleConnectTimeout()));
+    connect(reconnectTmr, SIGNAL(timeout()), this, SLOT(handleReconnectTimeout()));
 }
 
 TCPClient::~TCPClient()
 {
+    // No reconnect or signal while the socket is deleted
+    connState = STATE_DISCONNECTED;
+    disconnect(tcpClient, 0, this, 0);
+
+    delete connectTmr;
+    delete reconnectTmr;
+
     delete tcpClient;
     delete fifoBuf;
+    delete framer;
 }
 
 void TCPClient::run()
@@ -51,17 +83,21 @@ void TCPClient::readPendingData()
 
     if(!temp.isEmpty())
     {
+        if(NULL == framer)
         {
-            QMutexLocker locker(&mutex);
-            fifoBuf->pushData(temp.data(), temp.size());
+            reportRxData(temp);
+        }
+        else
+        {
+            // Only report whole messages
+            QList<QByteArray> frames;
+            framer->pushData(temp, frames);
+
+            for(int i = 0; i < frames.size(); i++)
+            {
+                reportRxData(frames.at(i));
+            }
         }
-
-        rxPacketCnt++;
-        rxTotalBytesSize += temp.size();
-
-        // Emit signal
-        emit newDataReady();
-        emit newDataReady(temp);
 
 #ifdef TCP_CLIENT_DEBUG_TRACE
         QString ipPortStr;
@@ -84,12 +120,48 @@ void TCPClient::readPendingData()
     }
 }
 
+void TCPClient::reportRxData(const QByteArray &data)
+{
+    {
+        QMutexLocker locker(&mutex);
 
-void TCPClient::readError(QAbstractSocket::SocketError)
+        if(NULL != fifoBuf)
+        {
+            fifoBuf->pushData(data.constData(), data.size());
+        }
+    }
+
+    rxPacketCnt++;
+    rxTotalBytesSize += data.size();
+
+    // Emit signal
+    emit newDataReady();
+    emit newDataReady(data);
+}
+
+void TCPClient::setFramer(StreamFramer *framerP)
 {
-    tcpClient->disconnectFromHost();
+    if(framerP == framer)
+    {
+        return;
+    }
+
+    delete framer;
+    framer = framerP;
+}
 
+void TCPClient::readError(QAbstractSocket::SocketError)
+{
     qDebug() << "TCPClient::readError():" << tcpClient->errorString();
+
+    // Connection refused, host unreachable, etc. no disconnected() follows
+    if(STATE_CONNECTING == connState)
+    {
+        handleConnectFailure(tcpClient->errorString());
+        return;
+    }
+
+    tcpClient->disconnectFromHost();
 }
 
 void TCPClient::removeConnection()
@@ -97,54 +169,236 @@ void TCPClient::removeConnection()
     // If the client in UnconnectedState
     if(tcpClient->state() == QAbstractSocket::UnconnectedState)
     {
+        // Lost by peer or network, not by disconnectFromServer()
+        bool lostFlag = (STATE_CONNECTED == connState);
+
+        connectTmr->stop();
+        connState = STATE_DISCONNECTED;
         isRunning = false;
 
+        // A slot may delete this client
+        QPointer<TCPClient> guard(this);
+
         // Emit signals to notice connection changed
         emit connectionOut();
+
+        if(guard.isNull())
+        {
+            return;
+        }
+
         emit connectionChanged(isRunning);
+
+        if(lostFlag && !guard.isNull())
+        {
+            scheduleReconnect();
+        }
     }
 }
 
 bool TCPClient::connectToServer(const QHostAddress &ip, uint16_t port)
 {
-    bool ret = false;
+    if(ip.isNull() || 0 == port)
+    {
+        return false;
+    }
+
+    // Drop the current connection or attempt quietly
+    if(STATE_DISCONNECTED != connState)
+    {
+        bool connectedFlag = isRunning;
+
+        connState = STATE_DISCONNECTED;
+        connectTmr->stop();
+        reconnectTmr->stop();
+        tcpClient->abort();
+
+        if(connectedFlag && isRunning)
+        {
+            isRunning = false;
+
+            // Emit signal
+            emit connectionChanged(isRunning);
+        }
+    }
 
     hostAddr = ip;
     listenPort = port;
-    tcpClient->connectToHost(ip, port);
+    reconnectAttempt = 0;
+
+    startConnect();
+
+    return true;
+}
 
-    if(tcpClient->waitForConnected(m_timeOutInMS))
+bool TCPClient::connectToServer(QString ip, uint16_t port)
+{
+    return connectToServer(QHostAddress(ip), port);
+}
+
+void TCPClient::startConnect()
+{
+    // Drop the partial message of last connection
+    if(NULL != framer)
     {
-        ret = true;
-        isRunning = true;
+        framer->clear();
+    }
 
-        // Emit signals
-        emit connectionChanged(isRunning);
-        emit serverChanged(ip, port);
+    connState = STATE_CONNECTING;
+
+    tcpClient->abort();
+    tcpClient->connectToHost(hostAddr, listenPort);
+
+    connectTmr->start(m_timeOutInMS);
+}
+
+void TCPClient::handleConnected()
+{
+    if(STATE_CONNECTING != connState)
+    {
+        return;
     }
 
-    return ret;
+    connectTmr->stop();
+    connState = STATE_CONNECTED;
+    reconnectAttempt = 0;
+    isRunning = true;
+
+    // Emit signals
+    emit connectionChanged(isRunning);
+    emit serverChanged(hostAddr, listenPort);
 }
 
-bool TCPClient::connectToServer(QString ip, uint16_t port)
+void TCPClient::handleConnectTimeout()
 {
-    return connectToServer(QHostAddress(ip), port);
+    if(STATE_CONNECTING == connState)
+    {
+        handleConnectFailure(tr("Connect timeout"));
+    }
+    else if(STATE_DISCONNECTING == connState)
+    {
+        // Peer does not close in time, disconnected() is emitted by abort()
+        qDebug() << "TCPClient::handleConnectTimeout() disconnect timeout, abort";
+
+        tcpClient->abort();
+    }
+}
+
+void TCPClient::handleConnectFailure(const QString &error)
+{
+    connectTmr->stop();
+    connState = STATE_DISCONNECTED;
+
+    tcpClient->abort();
+
+    // A slot may delete this client
+    QPointer<TCPClient> guard(this);
+
+    // Emit signal
+    emit connectFailed(error);
+
+    if(!guard.isNull())
+    {
+        scheduleReconnect();
+    }
+}
+
+void TCPClient::scheduleReconnect()
+{
+    if(!autoReconnectFlag || hostAddr.isNull() || 0 == listenPort)
+    {
+        return;
+    }
+
+    // Exponential backoff, min * 2^attempt, limited by max
+    uint32_t backoffInMs = minBackoffInMs;
+    for(uint32_t i = 0; i < reconnectAttempt && backoffInMs < maxBackoffInMs; i++)
+    {
+        backoffInMs *= 2;
+    }
+
+    if(backoffInMs > maxBackoffInMs)
+    {
+        backoffInMs = maxBackoffInMs;
+    }
+
+    jitterState ^= jitterState << 13;
+    jitterState ^= jitterState >> 17;
+    jitterState ^= jitterState << 5;
+
+    // Random delay in [backoff / 2, backoff], clients of one server do not retry together
+    uint32_t delayInMs = backoffInMs / 2 + jitterState % (backoffInMs / 2 + 1);
+
+    reconnectAttempt++;
+    connState = STATE_RECONNECT_WAIT;
+    reconnectTmr->start(delayInMs);
+
+    // Emit signal
+    emit reconnectScheduled(delayInMs);
+}
+
+void TCPClient::handleReconnectTimeout()
+{
+    if(STATE_RECONNECT_WAIT == connState)
+    {
+        startConnect();
+    }
 }
 
 void TCPClient::disconnectFromServer()
 {
+    reconnectTmr->stop();
+    connectTmr->stop();
+
+    if(STATE_CONNECTED != connState)
+    {
+        // Cancel connecting or reconnecting
+        connState = STATE_DISCONNECTED;
+        tcpClient->abort();
+
+        return;
+    }
+
+    connState = STATE_DISCONNECTING;
+
+    // disconnected() is emitted once pending data is written, abort if it takes too long
     tcpClient->disconnectFromHost();
-    if(tcpClient->state() == QAbstractSocket::UnconnectedState ||
-             tcpClient->waitForDisconnected(m_timeOutInMS))
+
+    if(STATE_DISCONNECTING == connState)
     {
-        qDebug() << "TCPClient::disconnected successfully";
+        connectTmr->start(m_timeOutInMS);
     }
-    else
+}
+
+void TCPClient::setAutoReconnect(bool flag, uint32_t minDelayInMs, uint32_t maxDelayInMs)
+{
+    autoReconnectFlag = flag;
+
+    minBackoffInMs = (minDelayInMs > 0) ? minDelayInMs : 1;
+    maxBackoffInMs = (maxDelayInMs > minBackoffInMs) ? maxDelayInMs : minBackoffInMs;
+
+    if(!autoReconnectFlag && STATE_RECONNECT_WAIT == connState)
     {
-        qDebug() << "TCPClient::disconnectFromServer() errorString =" << tcpClient->errorString();
+        reconnectTmr->stop();
+        connState = STATE_DISCONNECTED;
     }
 }
 
+void TCPClient::setConnectTimeout(uint32_t timeoutInMs)
+{
+    m_timeOutInMS = timeoutInMs;
+}
+
+TCPClient::CONNECTION_STATE TCPClient::getConnectionState() const
+{
+    return connState;
+}
+
+bool TCPClient::isConnecting() const
+{
+    return (STATE_CONNECTING == connState || STATE_RECONNECT_WAIT == connState);
+}
+
 uint32_t TCPClient::getListenPort() const
 {
     return listenPort;
@@ -160,6 +414,12 @@ bool TCPClient::getUndealData(char *dataP, uint32_t &len)
     bool ret = false;
     QMutexLocker locker(&mutex);
 
+    if(NULL == fifoBuf)
+    {
+        len = 0;
+        return ret;
+    }
+
     // Pop data from FIFO
     ret = fifoBuf->popData(dataP, len);
 
@@ -171,6 +431,12 @@ bool TCPClient::getUndealData(QByteArray &data)
     bool ret = false;
     uint32_t len = 0;
     QByteArray tempData;
+
+    if(NULL == fifoBuf)
+    {
+        return ret;
+    }
+
     tempData.reserve(fifoBuf->getSize());
 
     // Pop data from FIFO
@@ -184,6 +450,21 @@ bool TCPClient::getUndealData(QByteArray &data)
     return ret;
 }
 
+void TCPClient::setRxFifoEnabled(bool flag)
+{
+    QMutexLocker locker(&mutex);
+
+    if(flag && NULL == fifoBuf)
+    {
+        fifoBuf = new FIFOBuffer;
+    }
+    else if(!flag && NULL != fifoBuf)
+    {
+        delete fifoBuf;
+        fifoBuf = NULL;
+    }
+}
+
 bool TCPClient::sendData(const char *data, uint32_t len)
 {
     bool ret = false;
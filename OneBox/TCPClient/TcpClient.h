@@ -13,8 +13,10 @@ PURPOSE:        TCP Client interface
 #include <QTcpSocket>
 #include <QHostAddress>
 #include <QMutex>
+#include <QTimer>
 
 #include "FifoBuffer.h"
+#include "StreamFramer.h"
 
 
 class TCPClient : public QThread
@@ -26,13 +28,49 @@ public:
 
     void run();
 
-    // Connect to Server
+    // State of connection
+    enum CONNECTION_STATE
+    {
+        STATE_DISCONNECTED = 0,
+        STATE_CONNECTING,       // Wait for connected() or connect timeout
+        STATE_CONNECTED,
+        STATE_RECONNECT_WAIT,   // Wait for backoff time before next connect
+        STATE_DISCONNECTING     // Wait for disconnected() or disconnect timeout
+    };
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		connectToServer
+    PURPOSE:		Start connecting to server, do not wait for the result
+    ARGUMENTS:		const QHostAddress &ip  -- server address
+                    uint16_t port           -- server port
+    RETURNS:		True: connecting started, the result is reported by
+                    connectionChanged(true) or connectFailed()
+    -----------------------------------------------------------------------*/
     bool connectToServer(const QHostAddress &ip = QHostAddress::Any, uint16_t port = 0);
     bool connectToServer(QString ip, uint16_t port = 0);
 
-    // Disconnect from server
+    // Disconnect from server or cancel connecting/reconnecting, do not wait
     void disconnectFromServer();
 
+    /*-----------------------------------------------------------------------
+    FUNCTION:		setAutoReconnect
+    PURPOSE:		Reconnect after connect failure or connection lost
+    ARGUMENTS:		bool flag               -- true: reconnect automatically
+                    uint32_t minDelayInMs   -- delay of first retry
+                    uint32_t maxDelayInMs   -- delay is doubled per retry up to it
+    RETURNS:		None
+    -----------------------------------------------------------------------*/
+    void setAutoReconnect(bool flag, uint32_t minDelayInMs = DEFAULT_MIN_BACKOFF_IN_MS,
+                          uint32_t maxDelayInMs = DEFAULT_MAX_BACKOFF_IN_MS);
+
+    // Timeout of connect and graceful disconnect
+    void setConnectTimeout(uint32_t timeoutInMs);
+
+    CONNECTION_STATE getConnectionState() const;
+
+    // True: connecting, or waiting for next reconnect
+    bool isConnecting() const;
+
     uint32_t getListenPort() const;
     QHostAddress getHostAddress() const;
 
@@ -41,10 +79,22 @@ public:
     bool getUndealData(char *dataP, uint32_t &len);
     bool getUndealData(QByteArray &data);
 
+    // False: rx data is only reported by newDataReady(QByteArray), the FIFO is freed
+    void setRxFifoEnabled(bool flag);
+
     // Send data to server
     bool sendData(const char *data, uint32_t len);
     bool sendData(QByteArray &data);
 
+    /*-----------------------------------------------------------------------
+    FUNCTION:		setFramer
+    PURPOSE:		Set the framer used to split rx stream into whole messages
+    ARGUMENTS:		StreamFramer *framerP -- framer, TCPClient owns it
+                                             NULL: report raw stream chunks
+    RETURNS:		None
+    -----------------------------------------------------------------------*/
+    void setFramer(StreamFramer *framerP);
+
     uint32_t getTxDiagramCnt() const;
     uint32_t getRxDiagramCnt() const;
 
@@ -55,6 +105,12 @@ public:
 
     bool getRunningStatus() const;
 
+    enum
+    {
+        DEFAULT_MIN_BACKOFF_IN_MS = 500,
+        DEFAULT_MAX_BACKOFF_IN_MS = 30000
+    };
+
 signals:
     void newDataReady(void);
     void newDataReady(QByteArray);
@@ -64,10 +120,18 @@ signals:
     void serverChanged(QHostAddress address, uint16_t port);
     void connectionChanged(bool connected);
 
+    // Connect attempt failed, reconnect is scheduled if auto reconnect is set
+    void connectFailed(QString error);
+
+    // Next connect attempt starts after delayInMs
+    void reconnectScheduled(int delayInMs);
+
 private:
     QTcpSocket *tcpClient;
 
-    FIFOBuffer *fifoBuf;
+    FIFOBuffer *fifoBuf;    // Rx data for getUndealData(), NULL: disabled
+
+    StreamFramer *framer;   // Undealt rx data of the connection, NULL: raw mode
 
     QHostAddress hostAddr;
     uint16_t listenPort;
@@ -83,10 +147,36 @@ private:
 
     bool isRunning;    // True: connected to server, false: disconnected
 
+    CONNECTION_STATE connState;
+    QTimer *connectTmr;         // Connect/disconnect timeout
+    QTimer *reconnectTmr;       // Backoff before reconnect
+
+    bool autoReconnectFlag;
+    uint32_t minBackoffInMs;
+    uint32_t maxBackoffInMs;
+    uint32_t reconnectAttempt;  // Failed attempts since last connected
+    uint32_t jitterState;       // xorshift32 state of reconnect jitter, seeded per client
+
+    // Push rx message to FIFO and notice host
+    void reportRxData(const QByteArray &data);
+
+    // Start one connect attempt
+    void startConnect();
+
+    // Handle failed connect attempt
+    void handleConnectFailure(const QString &error);
+
+    // Start reconnect timer with exponential backoff and jitter
+    void scheduleReconnect();
+
 private slots:
     void readPendingData();
     void removeConnection();
     void readError(QAbstractSocket::SocketError);
+
+    void handleConnected();
+    void handleConnectTimeout();
+    void handleReconnectTimeout();
 };
 
 #endif // CTCPCLIENT_H
@@ -93,6 +93,7 @@ void TcpClientWidget::bindModel(TCPClient *clientP)
 
         connect(tcpClient, SIGNAL(serverChanged(QHostAddress,uint16_t)), this, SLOT(updateServerInfo(QHostAddress,uint16_t)));
         connect(tcpClient, SIGNAL(connectionChanged(bool)), this, SLOT(updateConnectionStatus(bool)));
+        connect(tcpClient, SIGNAL(connectFailed(QString)), this, SLOT(connectFailedStatus(QString)));
 
         isRunning = tcpClient->getRunningStatus();
         updateConnectionStatus(isRunning);
@@ -174,41 +175,53 @@ void TcpClientWidget::on_pushButton_connect_clicked()
 {
     QString logStr;
 
-    // Toggle flag
-    isRunning = !isRunning;
-
-    if(true == isRunning)
+    if(!isRunning && !tcpClient->isConnecting())
     {
-        // Connect to server
-        isRunning = tcpClient->connectToServer(ui->lineEdit_IP->text(), ui->lineEdit_listenPort->text().toInt());
-        logStr.append(tr("Connect to %1:").arg(ui->lineEdit_IP->text()));
+        // Connect to server, the result is shown by updateConnectionStatus()/connectFailedStatus()
+        tcpClient->connectToServer(ui->lineEdit_IP->text(), ui->lineEdit_listenPort->text().toInt());
+        logStr.append(tr("Connecting to %1:").arg(ui->lineEdit_IP->text()));
         logStr.append(ui->lineEdit_listenPort->text());
-        if(isRunning)
-        {
-            logStr.append(" succeed");
-        }
-        else
-        {
-            logStr.append(" failed");
-        }
+
+        ui->pushButton_connect->setText(tr("Cancel"));
 
         // Update log
         updateLogData(logStr);
     }
     else
     {
-        // Disconnect from server
+        // Disconnect from server, or cancel connecting
         tcpClient->disconnectFromServer();
+
+        if(!isRunning)
+        {
+            ui->pushButton_connect->setText(tr("Connect"));
+        }
     }
 }
 
+void TcpClientWidget::connectFailedStatus(QString error)
+{
+    QString logStr;
+
+    logStr.append(tr("Connect to %1:").arg(ui->lineEdit_IP->text()));
+    logStr.append(ui->lineEdit_listenPort->text());
+    logStr.append(" failed, ");
+    logStr.append(error);
+
+    ui->pushButton_connect->setText(tr("Connect"));
+
+    // Update log
+    updateLogData(logStr);
+}
+
 bool TcpClientWidget::connectToServer(QString ip, uint16_t port)
 {
     ui->lineEdit_IP->setText(ip);
     ui->lineEdit_listenPort->setText(QString::number(port));
     on_pushButton_connect_clicked();
 
-    return isRunning;
+    // Connected or connecting
+    return (isRunning || tcpClient->isConnecting());
 }
 
 void TcpClientWidget::on_pushButton_send_clicked()
@@ -408,6 +421,17 @@ void TcpClientWidget::updateServerInfo(QHostAddress address, uint16_t port)
 
 void TcpClientWidget::updateConnectionStatus(bool connected)
 {
+    if(connected && !isRunning)
+    {
+        QString logStr;
+        logStr.append(tr("Connect to %1:").arg(ui->lineEdit_IP->text()));
+        logStr.append(ui->lineEdit_listenPort->text());
+        logStr.append(" succeed");
+
+        // Update log
+        updateLogData(logStr);
+    }
+
     isRunning = connected;
 
     if(connected)
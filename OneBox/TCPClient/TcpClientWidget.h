@@ -89,6 +89,8 @@ private slots:
 
     void updateConnectionStatus(bool connected);
 
+    void connectFailedStatus(QString error);
+
     void on_lineEdit_IP_editingFinished();
 
     void on_lineEdit_listenPort_editingFinished();
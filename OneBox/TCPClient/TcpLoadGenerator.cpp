@@ -0,0 +1,468 @@
+/**********************************************************************
+PACKAGE:        Communication
+FILE:           TcpLoadGenerator.cpp
+COPYRIGHT (C):  All rights reserved.
+
+PURPOSE:        TCP throughput/latency load generator built on TCPClient
+**********************************************************************/
+
+#include "TcpLoadGenerator.h"
+#include <QDebug>
+
+TCPLoadGenerator::TCPLoadGenerator(QObject *parent) :
+    QObject(parent),
+    sendTmr(new QTimer(this)),
+    sampleTmr(new QTimer(this)),
+    durationTmr(new QTimer(this)),
+    nextRequestId(0),
+    nextClientIndex(0),
+    connectedCnt(0),
+    connectResultCnt(0),
+    scheduledCnt(0),
+    sentCnt(0),
+    completedCnt(0),
+    errorCnt(0),
+    rxBytes(0),
+    sampleStartInNs(0),
+    stopInNs(0),
+    isRunning(false),
+    isSending(false)
+{
+    sendTmr->setInterval(SEND_PERIOD_IN_MS);
+    sampleTmr->setInterval(SAMPLE_PERIOD_IN_MS);
+    durationTmr->setSingleShot(true);
+
+#if QT_VERSION >= 0x050000
+    sendTmr->setTimerType(Qt::PreciseTimer);
+#endif
+
+    connect(sendTmr, SIGNAL(timeout()), this, SLOT(sendTick()));
+    connect(sampleTmr, SIGNAL(timeout()), this, SLOT(sampleTick()));
+    connect(durationTmr, SIGNAL(timeout()), this, SLOT(stop()));
+}
+
+TCPLoadGenerator::~TCPLoadGenerator()
+{
+    closeConnections();
+}
+
+bool TCPLoadGenerator::start(const struct TCP_LOAD_CONFIG &config)
+{
+    if(isRunning)
+    {
+        return false;
+    }
+
+    m_config = config;
+
+    if(m_config.payloadSize < 4)
+    {
+        m_config.payloadSize = 4;
+    }
+
+    if(0 == m_config.concurrency)
+    {
+        m_config.concurrency = 1;
+    }
+
+    request = QByteArray(m_config.payloadSize, 0);
+
+    nextRequestId = 0;
+    nextClientIndex = 0;
+    scheduledCnt = 0;
+    sentCnt = 0;
+    completedCnt = 0;
+    errorCnt = 0;
+    rxBytes = 0;
+
+    totalHistogram.reset();
+    sampleHistogram.reset();
+    sampleList.clear();
+
+    if(0 == m_config.connectionCnt || m_config.address.isNull() || 0 == m_config.port)
+    {
+        return false;
+    }
+
+    connectedCnt = 0;
+    connectResultCnt = 0;
+    isRunning = true;
+    isSending = false;
+    stopInNs = 0;
+
+    // All connections are opened in parallel
+    for(uint32_t i = 0; i < m_config.connectionCnt; i++)
+    {
+        TCPClient *client = new TCPClient(this);
+
+        // Echoed stream is cut into requests
+        client->setFramer(new FixedSizeFramer(m_config.payloadSize));
+
+        connect(client, SIGNAL(newDataReady(QByteArray)), this, SLOT(handleResponse(QByteArray)));
+        connect(client, SIGNAL(connectionOut()), this, SLOT(handleConnectionOut()));
+        connect(client, SIGNAL(connectionChanged(bool)), this, SLOT(handleConnected(bool)));
+        connect(client, SIGNAL(connectFailed(QString)), this, SLOT(handleConnectFailed(QString)));
+
+        clientIndexHash.insert(client, clientList.size());
+        clientList.append(client);
+    }
+
+    pendingList.resize(clientList.size());
+
+    for(int i = 0; i < clientList.size(); i++)
+    {
+        clientList[i]->connectToServer(m_config.address, m_config.port);
+    }
+
+    return true;
+}
+
+void TCPLoadGenerator::handleConnected(bool connected)
+{
+    // Disconnection is handled by handleConnectionOut()
+    if(!connected || isSending || 0 != stopInNs)
+    {
+        return;
+    }
+
+    connectedCnt++;
+    connectResultCnt++;
+
+    checkConnectResult();
+}
+
+void TCPLoadGenerator::handleConnectFailed(QString error)
+{
+    qDebug() << "TCPLoadGenerator::handleConnectFailed() connection" << clientIndexHash.value(sender(), -1) << error;
+
+    connectResultCnt++;
+
+    checkConnectResult();
+}
+
+void TCPLoadGenerator::checkConnectResult()
+{
+    if(connectResultCnt < (uint32_t)clientList.size())
+    {
+        return;
+    }
+
+    if(0 == connectedCnt)
+    {
+        closeConnections();
+
+        // Emit signal
+        emit loadFinished();
+
+        return;
+    }
+
+    isSending = true;
+
+    clock.start();
+    sampleStartInNs = 0;
+
+    if(m_config.ratePerSec > 0)
+    {
+        sendTmr->start();
+    }
+    else
+    {
+        // Closed loop, fill the window of every connection
+        for(int i = 0; i < clientList.size(); i++)
+        {
+            if(!clientList.at(i)->getRunningStatus())
+            {
+                continue;
+            }
+
+            for(uint32_t n = 0; n < m_config.concurrency; n++)
+            {
+                sendRequest(i, clock.nsecsElapsed());
+            }
+        }
+    }
+
+    sampleTmr->start();
+
+    if(m_config.durationInMs > 0)
+    {
+        durationTmr->start(m_config.durationInMs);
+    }
+}
+
+void TCPLoadGenerator::stop()
+{
+    if(!isSending)
+    {
+        // Still connecting, give up
+        if(isRunning)
+        {
+            stopInNs = 1;
+            closeConnections();
+
+            // Emit signal
+            emit loadFinished();
+        }
+
+        return;
+    }
+
+    isSending = false;
+    stopInNs = clock.nsecsElapsed();
+
+    sendTmr->stop();
+    durationTmr->stop();
+
+    QTimer::singleShot(DRAIN_TIME_IN_MS, this, SLOT(finish()));
+}
+
+void TCPLoadGenerator::finish()
+{
+    if(!isRunning)
+    {
+        return;
+    }
+
+    sampleTmr->stop();
+
+    // The last partial period
+    if(sampleHistogram.getTotalCnt() > 0)
+    {
+        sampleTick();
+    }
+
+    // Outstanding requests are lost
+    for(int i = 0; i < pendingList.size(); i++)
+    {
+        errorCnt += pendingList.at(i).size();
+    }
+
+    closeConnections();
+
+    // Emit signal
+    emit loadFinished();
+}
+
+void TCPLoadGenerator::closeConnections()
+{
+    for(int i = 0; i < clientList.size(); i++)
+    {
+        disconnect(clientList[i], 0, this, 0);
+
+        clientList[i]->disconnectFromServer();
+
+        // May be called from a signal of the client, e.g. connectFailed()
+        clientList[i]->deleteLater();
+    }
+
+    clientList.clear();
+    clientIndexHash.clear();
+    pendingList.clear();
+
+    isRunning = false;
+    isSending = false;
+}
+
+bool TCPLoadGenerator::sendRequest(int clientIndex, int64_t intendedInNs)
+{
+    uint32_t id = nextRequestId++;
+
+    request[0] = (char)(id >> 24);
+    request[1] = (char)(id >> 16);
+    request[2] = (char)(id >> 8);
+    request[3] = (char)id;
+
+    // Record before write, the response may be handled in the same event loop
+    pendingList[clientIndex].insert(id, intendedInNs);
+
+    if(!clientList[clientIndex]->sendData(request))
+    {
+        pendingList[clientIndex].remove(id);
+        errorCnt++;
+
+        return false;
+    }
+
+    sentCnt++;
+
+    return true;
+}
+
+void TCPLoadGenerator::sendTick()
+{
+    // Requests due since start at target rate
+    int64_t nowInNs = clock.nsecsElapsed();
+    uint64_t dueCnt = (uint64_t)((double)nowInNs * m_config.ratePerSec / 1e9);
+    uint32_t sendCnt = 0;
+
+    while(scheduledCnt < dueCnt && sendCnt < MAX_SEND_PER_TICK)
+    {
+        // Latency counts from the time the request should be sent
+        int64_t intendedInNs = (int64_t)(scheduledCnt * 1e9 / m_config.ratePerSec);
+
+        sendRequest(nextClientIndex, intendedInNs);
+        nextClientIndex = (nextClientIndex + 1) % clientList.size();
+
+        scheduledCnt++;
+        sendCnt++;
+    }
+
+    // Too far behind, skip the requests which can not be sent in time
+    if(scheduledCnt < dueCnt)
+    {
+        errorCnt += dueCnt - scheduledCnt;
+        scheduledCnt = dueCnt;
+    }
+}
+
+void TCPLoadGenerator::handleResponse(QByteArray data)
+{
+    int64_t nowInNs = clock.nsecsElapsed();
+    int clientIndex = clientIndexHash.value(sender(), -1);
+
+    if(clientIndex < 0 || data.size() < 4)
+    {
+        return;
+    }
+
+    const uint8_t *dataP = (const uint8_t *)data.constData();
+    uint32_t id = ((uint32_t)dataP[0] << 24) | ((uint32_t)dataP[1] << 16) | ((uint32_t)dataP[2] << 8) | dataP[3];
+
+    QHash<uint32_t, int64_t>::iterator it = pendingList[clientIndex].find(id);
+
+    if(it == pendingList[clientIndex].end())
+    {
+        errorCnt++;
+        return;
+    }
+
+    uint64_t latencyInUs = (nowInNs > it.value()) ? (uint64_t)(nowInNs - it.value()) / 1000 : 0;
+    pendingList[clientIndex].erase(it);
+
+    totalHistogram.record(latencyInUs);
+    sampleHistogram.record(latencyInUs);
+
+    completedCnt++;
+    rxBytes += data.size();
+
+    // Closed loop, keep the window full
+    if(isSending && 0 == m_config.ratePerSec)
+    {
+        sendRequest(clientIndex, nowInNs);
+    }
+}
+
+void TCPLoadGenerator::handleConnectionOut()
+{
+    int clientIndex = clientIndexHash.value(sender(), -1);
+
+    if(clientIndex < 0)
+    {
+        return;
+    }
+
+    qDebug() << "TCPLoadGenerator::handleConnectionOut() connection" << clientIndex << "closed by peer";
+
+    // The requests of this connection will never be answered
+    errorCnt += pendingList.at(clientIndex).size();
+    pendingList[clientIndex].clear();
+}
+
+void TCPLoadGenerator::sampleTick()
+{
+    int64_t nowInNs = clock.nsecsElapsed();
+    double periodInS = (nowInNs - sampleStartInNs) / 1e9;
+
+    struct TCP_LOAD_SAMPLE sample;
+    sample.timeInMs = (uint32_t)(nowInNs / 1000000);
+    sample.completedCnt = (uint32_t)sampleHistogram.getTotalCnt();
+    sample.requestPerSec = (periodInS > 0) ? sample.completedCnt / periodInS : 0;
+    sample.p50InUs = sampleHistogram.getValueAtPercentile(50);
+    sample.p99InUs = sampleHistogram.getValueAtPercentile(99);
+
+    sampleList.append(sample);
+
+    sampleHistogram.reset();
+    sampleStartInNs = nowInNs;
+
+    // Emit signal
+    emit sampleReady(sample.timeInMs, sample.requestPerSec, sample.p99InUs);
+}
+
+bool TCPLoadGenerator::getRunningStatus() const
+{
+    return isRunning;
+}
+
+uint64_t TCPLoadGenerator::getSentCnt() const
+{
+    return sentCnt;
+}
+
+uint64_t TCPLoadGenerator::getCompletedCnt() const
+{
+    return completedCnt;
+}
+
+uint64_t TCPLoadGenerator::getErrorCnt() const
+{
+    return errorCnt;
+}
+
+const LatencyHistogram &TCPLoadGenerator::getHistogram() const
+{
+    return totalHistogram;
+}
+
+const QList<struct TCP_LOAD_SAMPLE> &TCPLoadGenerator::getSampleList() const
+{
+    return sampleList;
+}
+
+QString TCPLoadGenerator::getReport() const
+{
+    QString report;
+    double durationInS = 0;
+
+    if(clock.isValid())
+    {
+        durationInS = ((stopInNs > 0) ? stopInNs : clock.nsecsElapsed()) / 1e9;
+    }
+
+    report.append(QString("Target: %1:%2, connections: %3/%4, %5\n")
+                  .arg(m_config.address.toString()).arg(m_config.port)
+                  .arg(connectedCnt).arg(m_config.connectionCnt)
+                  .arg((m_config.ratePerSec > 0) ? QString("open loop %1 req/s").arg(m_config.ratePerSec)
+                                                 : QString("closed loop concurrency %1").arg(m_config.concurrency)));
+
+    report.append(QString("Requests: sent %1, completed %2, error %3 in %4 s\n")
+                  .arg(sentCnt).arg(completedCnt).arg(errorCnt).arg(durationInS, 0, 'f', 2));
+
+    if(durationInS > 0)
+    {
+        report.append(QString("Throughput: %1 req/s, %2 MB/s\n")
+                      .arg(completedCnt / durationInS, 0, 'f', 1)
+                      .arg(rxBytes / durationInS / 1e6, 0, 'f', 3));
+    }
+
+    report.append(QString("Latency(us): min %1, mean %2, p50 %3, p90 %4, p99 %5, p99.9 %6, max %7\n")
+                  .arg(totalHistogram.getMin())
+                  .arg(totalHistogram.getMean(), 0, 'f', 1)
+                  .arg(totalHistogram.getValueAtPercentile(50))
+                  .arg(totalHistogram.getValueAtPercentile(90))
+                  .arg(totalHistogram.getValueAtPercentile(99))
+                  .arg(totalHistogram.getValueAtPercentile(99.9))
+                  .arg(totalHistogram.getMax()));
+
+    for(int i = 0; i < sampleList.size(); i++)
+    {
+        const struct TCP_LOAD_SAMPLE &sample = sampleList.at(i);
+
+        report.append(QString("  %1 ms: %2 req/s, p50 %3 us, p99 %4 us\n")
+                      .arg(sample.timeInMs).arg(sample.requestPerSec, 0, 'f', 1)
+                      .arg(sample.p50InUs).arg(sample.p99InUs));
+    }
+
+    return report;
+}
@@ -0,0 +1,184 @@
+/**********************************************************************
+PACKAGE:        Communication
+FILE:           TcpLoadGenerator.h
+COPYRIGHT (C):  All rights reserved.
+
+PURPOSE:        TCP throughput/latency load generator built on TCPClient
+**********************************************************************/
+
+#ifndef TCPLOADGENERATOR_H
+#define TCPLOADGENERATOR_H
+
+#include <QObject>
+#include <QHostAddress>
+#include <QByteArray>
+#include <QList>
+#include <QVector>
+#include <QHash>
+#include <QTimer>
+#include <QElapsedTimer>
+
+#include "TcpClient.h"
+#include "LatencyHistogram.h"
+
+/*
+ TCPLoadGenerator opens connectionCnt TCPClient connections to an echo
+ server, e.g. TCPServer with setEchoEnabled(true), and measures the time
+ from request to echoed response,
+
+ request: [request ID, 4 bytes big-endian][zero fill to payloadSize]
+
+ Each connection splits the echoed stream with FixedSizeFramer and finds
+ the request by its ID, so out of order responses are matched as well.
+
+ Open loop (ratePerSec > 0): requests are sent round robin at the target
+ rate whatever the responses are, latency counts from the intended send
+ time, so a stalled server is not hidden by fewer requests.
+ Closed loop (ratePerSec = 0): every connection keeps concurrency requests
+ outstanding, a new request is sent once a response arrives.
+
+ Latency is recorded in us into LatencyHistogram, throughput and p99 of
+ every second are kept as TCP_LOAD_SAMPLE.
+*/
+
+struct TCP_LOAD_CONFIG
+{
+    QHostAddress address;       // Target
+    uint16_t port;
+
+    uint32_t connectionCnt;
+    uint32_t ratePerSec;        // Requests per second of all connections, 0: closed loop
+    uint32_t concurrency;       // Outstanding requests per connection in closed loop
+    uint32_t payloadSize;       // Request size, at least 4 bytes
+    uint32_t durationInMs;      // Test time, 0: until stop()
+
+    TCP_LOAD_CONFIG() :
+        port(0),
+        connectionCnt(1),
+        ratePerSec(0),
+        concurrency(1),
+        payloadSize(64),
+        durationInMs(10000)
+    {
+    }
+};
+
+// Throughput and latency of one period
+struct TCP_LOAD_SAMPLE
+{
+    uint32_t timeInMs;          // End of period since start
+    uint32_t completedCnt;      // Responses in period
+    double requestPerSec;
+    uint64_t p50InUs;
+    uint64_t p99InUs;
+};
+
+class TCPLoadGenerator : public QObject
+{
+    Q_OBJECT
+public:
+    explicit TCPLoadGenerator(QObject *parent = 0);
+    virtual ~TCPLoadGenerator();
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		start
+    PURPOSE:		Connect to target, sending starts when all connect attempts complete
+    ARGUMENTS:		const struct TCP_LOAD_CONFIG &config -- target, rate and payload
+    RETURNS:		True: connecting started, loadFinished() is emitted if none connected
+    -----------------------------------------------------------------------*/
+    bool start(const struct TCP_LOAD_CONFIG &config);
+
+    bool getRunningStatus() const;
+
+    uint64_t getSentCnt() const;
+    uint64_t getCompletedCnt() const;
+
+    // Requests failed to send, or responses of unknown request ID
+    uint64_t getErrorCnt() const;
+
+    // Latency of all responses in us
+    const LatencyHistogram &getHistogram() const;
+
+    // Throughput over time
+    const QList<struct TCP_LOAD_SAMPLE> &getSampleList() const;
+
+    // Return the test result as text
+    QString getReport() const;
+
+public slots:
+    // Stop sending, wait for outstanding responses, then emit loadFinished()
+    void stop();
+
+signals:
+    // Emitted every SAMPLE_PERIOD_IN_MS
+    void sampleReady(uint32_t timeInMs, double requestPerSec, double p99InUs);
+
+    // All connections are closed, result is ready
+    void loadFinished();
+
+private:
+    enum
+    {
+        SEND_PERIOD_IN_MS = 1,
+        SAMPLE_PERIOD_IN_MS = 1000,
+        DRAIN_TIME_IN_MS = 1000,    // Wait for outstanding responses after stop()
+        MAX_SEND_PER_TICK = 10000   // Limit of one tick after the event loop is stalled
+    };
+
+    struct TCP_LOAD_CONFIG m_config;
+
+    QList<TCPClient *> clientList;
+    QVector<QHash<uint32_t, int64_t> > pendingList;     // Request ID to send time of each connection
+    QHash<QObject *, int> clientIndexHash;              // TCPClient to index of clientList
+
+    QElapsedTimer clock;
+    QTimer *sendTmr;            // Open loop send tick
+    QTimer *sampleTmr;
+    QTimer *durationTmr;
+
+    QByteArray request;         // Request template, ID is written per request
+    uint32_t nextRequestId;
+    uint32_t nextClientIndex;   // Round robin in open loop
+
+    uint32_t connectedCnt;
+    uint32_t connectResultCnt;  // Connect attempts completed, succeeded or failed
+
+    uint64_t scheduledCnt;      // Requests due by open loop rate
+    uint64_t sentCnt;
+    uint64_t completedCnt;
+    uint64_t errorCnt;
+    uint64_t rxBytes;
+
+    LatencyHistogram totalHistogram;
+    LatencyHistogram sampleHistogram;   // Latency of current period
+    QList<struct TCP_LOAD_SAMPLE> sampleList;
+
+    int64_t sampleStartInNs;
+    int64_t stopInNs;           // Time of stop(), 0: sending
+
+    bool isRunning;             // True: connections are open
+    bool isSending;             // False: wait for outstanding responses
+
+    // Send one request on connection, intendedInNs is the start of latency
+    bool sendRequest(int clientIndex, int64_t intendedInNs);
+
+    // Close all connections
+    void closeConnections();
+
+    // Start sending once all connect attempts complete
+    void checkConnectResult();
+
+private slots:
+    void handleResponse(QByteArray data);
+    void handleConnectionOut();
+    void handleConnected(bool connected);
+    void handleConnectFailed(QString error);
+
+    void sendTick();
+    void sampleTick();
+
+    // Called after DRAIN_TIME_IN_MS of stop()
+    void finish();
+};
+
+#endif // TCPLOADGENERATOR_H
@@ -8,6 +8,20 @@ PURPOSE:        TCP Server interface
 
 #include "TcpServer.h"
 #include <QMutexLocker>
+#include <QTimer>
+#include <QDebug>
+#include <string.h>
+
+#ifdef Q_OS_UNIX
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#endif
+
+#ifdef Q_OS_LINUX
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#endif
 
 #undef TCP_SERVER_DEBUG_TRACE
 
@@ -15,13 +29,29 @@ TCPServer::TCPServer(QObject *parent) :
     QThread(parent),
     tcpServer(new QTcpServer(this)),
     fifoBuf(new FIFOBuffer),
+    framerPrototype(NULL),
     hostAddr(QHostAddress::Any),
     listenPort(0),
     m_timeOutInMS(1000),
-    isRunning(false)
+    isRunning(false),
+    txHighWatermark(DEFAULT_TX_HIGH_WATERMARK),
+    txLowWatermark(DEFAULT_TX_LOW_WATERMARK),
+    slowConsumerPolicy(SLOW_CONSUMER_PAUSE),
+    txDropCnt(0),
+    timerWheel(new TimerWheel),
+    timerWheelTmr(new QTimer),
+    lastTickInMs(0),
+    idleTimeoutInMs(0),
+    heartbeatInMs(0),
+    keepAliveEnabled(false),
+    keepAliveIdleInSec(60),
+    keepAliveIntervalInSec(10),
+    keepAliveProbeCnt(5),
+    echoFlag(false)
 {
     tcpClientList.clear();
     connect(tcpServer, SIGNAL(newConnection()), this, SLOT(acceptConnection()));
+    connect(timerWheelTmr, SIGNAL(timeout()), this, SLOT(timerWheelTick()));
 
     resetTxRxCnt();
 }
@@ -30,8 +60,18 @@ TCPServer::~TCPServer()
 {
     stopListen();
 
+    // Release the context of remaining connections
+    while(!connectionHash.isEmpty())
+    {
+        releaseConnection(connectionHash.begin().key());
+    }
+
     delete tcpServer;
     delete fifoBuf;
+    delete framerPrototype;
+
+    delete timerWheelTmr;
+    delete timerWheel;
 }
 
 void TCPServer::run()
@@ -50,8 +90,26 @@ void TCPServer::acceptConnection()
 
     tcpClientList.append(currentClient);
 
+    // Each connection owns its framer, rx data of clients are never mixed
+    struct TCP_CONNECTION_INFO info;
+    info.framer = (NULL != framerPrototype) ? framerPrototype->clone() : NULL;
+    info.groupMask = 0;
+    info.txPaused = false;
+    info.abortPending = false;
+    info.peakQueuedBytes = 0;
+    info.dropPacketCnt = 0;
+    info.dropBytes = 0;
+    info.timerId = timerWheel->allocateId();
+    info.heartbeatSent = false;
+    connectionHash.insert(currentClient, info);
+    timerSocketHash.insert(info.timerId, currentClient);
+
+    applyKeepAlive(currentClient);
+    restartIdleTimer(currentClient);
+
     connect(currentClient, SIGNAL(readyRead()), this, SLOT(readPendingData()));
     connect(currentClient, SIGNAL(disconnected()), this, SLOT(removeConnection()));
+    connect(currentClient, SIGNAL(bytesWritten(qint64)), this, SLOT(updateTxQueue(qint64)));
 
     // Emit signals to notice connection changed
     emit connectionIn(getClientInfo(tcpClientList.size() - 1));
@@ -68,6 +126,7 @@ void TCPServer::removeConnection()
             // Emit signals to notice connection changed
             emit connectionOut(getClientInfo(i));
 
+            releaseConnection(tcpClientList[i]);
             tcpClientList.removeAt(i);
         }
     }
@@ -75,9 +134,16 @@ void TCPServer::removeConnection()
 
 void TCPServer::readPendingData()
 {
-    // Search all clients
+    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+
+    // Search all clients, only read the client which emits readyRead()
     for(int i = 0; i < tcpClientList.length(); i++)
     {
+        if(NULL != socket && socket != tcpClientList[i])
+        {
+            continue;
+        }
+
         QByteArray temp = tcpClientList[i]->readAll();
 
         if(temp.isEmpty())
@@ -86,30 +152,39 @@ void TCPServer::readPendingData()
         }
         else
         {
-            {
-                QMutexLocker locker(&mutex);
-                fifoBuf->pushData(temp.data(), temp.size());
-            }
+            // Connection is alive, restart idle timer
+            restartIdleTimer(tcpClientList[i]);
 
-            rxPacketCnt++;
-            rxTotalBytesSize += temp.size();
+            StreamFramer *framerP = connectionHash.value(tcpClientList[i]).framer;
 
-            // Emit signal
-            emit newDataReady(i);
-            emit newDataReady(i, temp);
+            if(NULL == framerP)
+            {
+                reportRxData(i, temp);
+            }
+            else
+            {
+                // Only report whole messages
+                QList<QByteArray> frames;
+                framerP->pushData(temp, frames);
+
+                for(int n = 0; n < frames.size(); n++)
+                {
+                    reportRxData(i, frames.at(n));
+                }
+            }
 
 #ifdef TCP_SERVER_DEBUG_TRACE
             QString ipPortStr;
-            ipPortStr = currentClient->peerAddress().toString();
+            ipPortStr = tcpClientList[i]->peerAddress().toString();
             ipPortStr.append(":");
-            ipPortStr.append(QString::number(currentClient->peerPort()));
+            ipPortStr.append(QString::number(tcpClientList[i]->peerPort()));
 
             QString tmpStr;
             tmpStr.clear();
 
-            for(int i = 0; i < temp.size(); i++)
+            for(int n = 0; n < temp.size(); n++)
             {
-                tmpStr.append(QString::number((uint8_t)temp.at(i), 16).rightJustified(2, '0').toUpper());
+                tmpStr.append(QString::number((uint8_t)temp.at(n), 16).rightJustified(2, '0').toUpper());
                 tmpStr.append(" ");
             }
 
@@ -120,6 +195,70 @@ void TCPServer::readPendingData()
     }
 }
 
+void TCPServer::reportRxData(int clientIndex, const QByteArray &data)
+{
+    {
+        QMutexLocker locker(&mutex);
+        fifoBuf->pushData(data.constData(), data.size());
+    }
+
+    rxPacketCnt++;
+    rxTotalBytesSize += data.size();
+
+    // Emit signal
+    emit newDataReady(clientIndex);
+    emit newDataReady(clientIndex, data);
+
+    if(echoFlag)
+    {
+        sendData(clientIndex, data.constData(), data.size());
+    }
+}
+
+void TCPServer::setEchoEnabled(bool flag)
+{
+    echoFlag = flag;
+}
+
+bool TCPServer::getEchoFlag() const
+{
+    return echoFlag;
+}
+
+void TCPServer::releaseConnection(QTcpSocket *socket)
+{
+    if(connectionHash.contains(socket))
+    {
+        struct TCP_CONNECTION_INFO info = connectionHash.value(socket);
+
+        delete info.framer;
+
+        timerWheel->releaseId(info.timerId);
+        timerSocketHash.remove(info.timerId);
+
+        connectionHash.remove(socket);
+    }
+}
+
+void TCPServer::setFramer(StreamFramer *framerP)
+{
+    if(framerP == framerPrototype)
+    {
+        return;
+    }
+
+    delete framerPrototype;
+    framerPrototype = framerP;
+
+    // Apply the new framer to the established connections
+    QHash<QTcpSocket*, struct TCP_CONNECTION_INFO>::iterator it;
+    for(it = connectionHash.begin(); it != connectionHash.end(); ++it)
+    {
+        delete it.value().framer;
+        it.value().framer = (NULL != framerPrototype) ? framerPrototype->clone() : NULL;
+    }
+}
+
 bool TCPServer::beginListen(const QHostAddress &address, uint16_t port)
 {
     bool ret = tcpServer->listen(address, port);
@@ -264,8 +403,11 @@ void TCPServer::sendData(uint32_t clientIndex, const char *data, uint32_t len)
         return;
     }
 
+    // No copy, data is only used during this call
+    QByteArray payload = QByteArray::fromRawData(data, len);
+
     // If not in connected state then return
-    if(tcpClientList[clientIndex]->state() != QAbstractSocket::ConnectedState)
+    if(!writeToSocket(tcpClientList[clientIndex], QByteArray(), payload))
     {
         return;
     }
@@ -273,10 +415,11 @@ void TCPServer::sendData(uint32_t clientIndex, const char *data, uint32_t len)
     txPacketCnt++;
     txTotalBytesSize += len;
 
-    tcpClientList[clientIndex]->write(data, len);
-
     // Emit signal
-    emit newDataTx(getClientAddress(clientIndex), getClientPort(clientIndex), QByteArray(data, len));
+    if(isTxSignalConnected())
+    {
+        emit newDataTx(getClientAddress(clientIndex), getClientPort(clientIndex), QByteArray(data, len));
+    }
 }
 
 void TCPServer::sendData(uint32_t clientIndex, QByteArray &data)
@@ -284,6 +427,535 @@ void TCPServer::sendData(uint32_t clientIndex, QByteArray &data)
     sendData(clientIndex, data.constData(), data.size());
 }
 
+uint32_t TCPServer::broadcast(const QByteArray &payload, const QByteArray &header)
+{
+    return sendToClients(0, payload, header);
+}
+
+uint32_t TCPServer::sendToGroup(uint32_t groupId, const QByteArray &payload, const QByteArray &header)
+{
+    if(groupId >= MAX_GROUP_CNT)
+    {
+        return 0;
+    }
+
+    return sendToClients(1u << groupId, payload, header);
+}
+
+bool TCPServer::addClientToGroup(uint32_t clientIndex, uint32_t groupId)
+{
+    if(clientIndex >= (uint32_t)tcpClientList.size() || groupId >= MAX_GROUP_CNT)
+    {
+        return false;
+    }
+
+    QHash<QTcpSocket*, struct TCP_CONNECTION_INFO>::iterator it = connectionHash.find(tcpClientList[clientIndex]);
+    if(it == connectionHash.end())
+    {
+        return false;
+    }
+
+    it.value().groupMask |= (1u << groupId);
+
+    return true;
+}
+
+bool TCPServer::removeClientFromGroup(uint32_t clientIndex, uint32_t groupId)
+{
+    if(clientIndex >= (uint32_t)tcpClientList.size() || groupId >= MAX_GROUP_CNT)
+    {
+        return false;
+    }
+
+    QHash<QTcpSocket*, struct TCP_CONNECTION_INFO>::iterator it = connectionHash.find(tcpClientList[clientIndex]);
+    if(it == connectionHash.end())
+    {
+        return false;
+    }
+
+    it.value().groupMask &= ~(1u << groupId);
+
+    return true;
+}
+
+uint32_t TCPServer::sendToClients(uint32_t groupMask, const QByteArray &payload, const QByteArray &header)
+{
+    uint32_t cnt = 0;
+    uint32_t len = header.size() + payload.size();
+    bool txSignalFlag = isTxSignalConnected();
+    QByteArray txData;
+
+    if(0 == len)
+    {
+        return cnt;
+    }
+
+    // Only build the tx data for signal once, all receivers share it
+    if(txSignalFlag)
+    {
+        txData = header;
+        txData.append(payload);
+    }
+
+    for(int i = 0; i < tcpClientList.size(); i++)
+    {
+        if(0 != groupMask && 0 == (connectionHash.value(tcpClientList[i]).groupMask & groupMask))
+        {
+            continue;
+        }
+
+        if(!writeToSocket(tcpClientList[i], header, payload))
+        {
+            continue;
+        }
+
+        cnt++;
+        txPacketCnt++;
+        txTotalBytesSize += len;
+
+        // Emit signal
+        if(txSignalFlag)
+        {
+            emit newDataTx(getClientAddress(i), getClientPort(i), txData);
+        }
+    }
+
+    return cnt;
+}
+
+bool TCPServer::writeToSocket(QTcpSocket *socket, const QByteArray &header, const QByteArray &payload)
+{
+    qint64 written = 0;
+
+    if(NULL == socket || socket->state() != QAbstractSocket::ConnectedState)
+    {
+        return false;
+    }
+
+    if(!checkTxQueue(socket, header.size() + payload.size()))
+    {
+        return false;
+    }
+
+#ifdef Q_OS_UNIX
+    // Nothing pending in Qt write buffer, write header + payload to kernel
+    // with one sendmsg() call, the order of stream is not broken
+    if(0 == socket->bytesToWrite())
+    {
+        struct iovec iov[2];
+        struct msghdr msg;
+        int iovCnt = 0;
+        int flags = MSG_DONTWAIT;
+
+#ifdef MSG_NOSIGNAL
+        flags |= MSG_NOSIGNAL;
+#endif
+
+        if(!header.isEmpty())
+        {
+            iov[iovCnt].iov_base = (void *)header.constData();
+            iov[iovCnt].iov_len = header.size();
+            iovCnt++;
+        }
+
+        if(!payload.isEmpty())
+        {
+            iov[iovCnt].iov_base = (void *)payload.constData();
+            iov[iovCnt].iov_len = payload.size();
+            iovCnt++;
+        }
+
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = iovCnt;
+
+        ssize_t ret = ::sendmsg(socket->socketDescriptor(), &msg, flags);
+        if(ret > 0)
+        {
+            written = ret;
+        }
+    }
+#endif
+
+    // Queue the rest in Qt write buffer, e.g. kernel buffer is full
+    if(written < header.size())
+    {
+        socket->write(header.constData() + written, header.size() - written);
+        socket->write(payload);
+    }
+    else if(written < header.size() + payload.size())
+    {
+        written -= header.size();
+        socket->write(payload.constData() + written, payload.size() - written);
+    }
+
+    QHash<QTcpSocket*, struct TCP_CONNECTION_INFO>::iterator it = connectionHash.find(socket);
+    if(it != connectionHash.end() && socket->bytesToWrite() > it.value().peakQueuedBytes)
+    {
+        it.value().peakQueuedBytes = socket->bytesToWrite();
+    }
+
+    return true;
+}
+
+bool TCPServer::checkTxQueue(QTcpSocket *socket, uint32_t len)
+{
+    QHash<QTcpSocket*, struct TCP_CONNECTION_INFO>::iterator it = connectionHash.find(socket);
+    if(it == connectionHash.end())
+    {
+        return true;
+    }
+
+    struct TCP_CONNECTION_INFO &info = it.value();
+    uint32_t queuedBytes = socket->bytesToWrite();
+
+    if(info.abortPending)
+    {
+        return false;
+    }
+
+    // Paused client is writable again only below low watermark
+    if(info.txPaused && queuedBytes <= txLowWatermark)
+    {
+        info.txPaused = false;
+
+        // Emit signal
+        emit txResumed(tcpClientList.indexOf(socket));
+    }
+
+    if(!info.txPaused && (queuedBytes + len) <= txHighWatermark)
+    {
+        return true;
+    }
+
+    switch(slowConsumerPolicy)
+    {
+    case SLOW_CONSUMER_PAUSE:
+        if(!info.txPaused)
+        {
+            info.txPaused = true;
+
+            // Emit signal
+            emit txPaused(tcpClientList.indexOf(socket));
+
+            // Accept the message crossing the watermark if it is not larger than
+            // the watermark itself, so the queue stays below 2 * high watermark
+            if(queuedBytes < txHighWatermark && len <= txHighWatermark)
+            {
+                return true;
+            }
+        }
+        break;
+    case SLOW_CONSUMER_DROP:
+        if(!info.txPaused)
+        {
+            info.txPaused = true;
+
+            // Emit signal
+            emit txPaused(tcpClientList.indexOf(socket));
+        }
+        break;
+    case SLOW_CONSUMER_DISCONNECT:
+        // Abort later, tcpClientList may be iterated by caller
+        info.abortPending = true;
+        QTimer::singleShot(0, this, SLOT(abortSlowClients()));
+
+#ifdef TCP_SERVER_DEBUG_TRACE
+        qDebug() << "TCPServer::checkTxQueue() abort slow client" << socket->peerAddress().toString();
+#endif
+        break;
+    default:
+        break;
+    }
+
+    info.dropPacketCnt++;
+    info.dropBytes += len;
+    txDropCnt++;
+
+    return false;
+}
+
+void TCPServer::updateTxQueue(qint64 bytes)
+{
+    Q_UNUSED(bytes);
+    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
+
+    QHash<QTcpSocket*, struct TCP_CONNECTION_INFO>::iterator it = connectionHash.find(socket);
+    if(it == connectionHash.end())
+    {
+        return;
+    }
+
+    if(it.value().txPaused && socket->bytesToWrite() <= txLowWatermark)
+    {
+        it.value().txPaused = false;
+
+        // Emit signal
+        emit txResumed(tcpClientList.indexOf(socket));
+    }
+}
+
+void TCPServer::abortSlowClients()
+{
+    QList<QTcpSocket*> abortList;
+
+    QHash<QTcpSocket*, struct TCP_CONNECTION_INFO>::iterator it;
+    for(it = connectionHash.begin(); it != connectionHash.end(); ++it)
+    {
+        if(it.value().abortPending)
+        {
+            abortList.append(it.key());
+        }
+    }
+
+    // abort() emits disconnected(), connection is removed in removeConnection()
+    for(int i = 0; i < abortList.size(); i++)
+    {
+        abortList[i]->abort();
+    }
+}
+
+void TCPServer::setTxWatermark(uint32_t highBytes, uint32_t lowBytes)
+{
+    if(0 == highBytes || lowBytes > highBytes)
+    {
+        return;
+    }
+
+    txHighWatermark = highBytes;
+    txLowWatermark = lowBytes;
+}
+
+void TCPServer::setSlowConsumerPolicy(SLOW_CONSUMER_POLICY policy)
+{
+    slowConsumerPolicy = policy;
+}
+
+bool TCPServer::isClientWritable(uint32_t clientIndex)
+{
+    if(clientIndex >= (uint32_t)tcpClientList.size())
+    {
+        return false;
+    }
+
+    QTcpSocket *socket = tcpClientList[clientIndex];
+    struct TCP_CONNECTION_INFO info = connectionHash.value(socket);
+
+    if(info.abortPending || socket->state() != QAbstractSocket::ConnectedState)
+    {
+        return false;
+    }
+
+    return info.txPaused ? (socket->bytesToWrite() <= txLowWatermark)
+                         : (socket->bytesToWrite() < txHighWatermark);
+}
+
+bool TCPServer::getClientTxStat(uint32_t clientIndex, struct TCP_TX_QUEUE_STAT &stat)
+{
+    memset(&stat, 0, sizeof(struct TCP_TX_QUEUE_STAT));
+
+    if(clientIndex >= (uint32_t)tcpClientList.size())
+    {
+        return false;
+    }
+
+    QTcpSocket *socket = tcpClientList[clientIndex];
+    struct TCP_CONNECTION_INFO info = connectionHash.value(socket);
+
+    stat.queuedBytes = socket->bytesToWrite();
+    stat.peakQueuedBytes = info.peakQueuedBytes;
+    stat.dropPacketCnt = info.dropPacketCnt;
+    stat.dropBytes = info.dropBytes;
+    stat.paused = info.txPaused;
+
+    return true;
+}
+
+uint32_t TCPServer::getTotalQueuedBytes()
+{
+    uint32_t total = 0;
+
+    for(int i = 0; i < tcpClientList.size(); i++)
+    {
+        total += tcpClientList[i]->bytesToWrite();
+    }
+
+    return total;
+}
+
+uint32_t TCPServer::getTxDropCnt() const
+{
+    return txDropCnt;
+}
+
+void TCPServer::setIdleTimeout(uint32_t timeoutInMs)
+{
+    idleTimeoutInMs = timeoutInMs;
+
+    // Apply to the established connections
+    for(int i = 0; i < tcpClientList.size(); i++)
+    {
+        restartIdleTimer(tcpClientList[i]);
+    }
+
+    updateTimerWheelTmr();
+}
+
+void TCPServer::setHeartbeat(uint32_t intervalInMs, const QByteArray &message)
+{
+    heartbeatMsg = message;
+    heartbeatInMs = message.isEmpty() ? 0 : intervalInMs;
+
+    // Apply to the established connections
+    for(int i = 0; i < tcpClientList.size(); i++)
+    {
+        restartIdleTimer(tcpClientList[i]);
+    }
+
+    updateTimerWheelTmr();
+}
+
+void TCPServer::setKeepAlive(bool enable, int idleInSec, int intervalInSec, int probeCnt)
+{
+    keepAliveEnabled = enable;
+    keepAliveIdleInSec = idleInSec;
+    keepAliveIntervalInSec = intervalInSec;
+    keepAliveProbeCnt = probeCnt;
+
+    // Apply to the established connections
+    for(int i = 0; i < tcpClientList.size(); i++)
+    {
+        applyKeepAlive(tcpClientList[i]);
+    }
+}
+
+void TCPServer::restartIdleTimer(QTcpSocket *socket)
+{
+    QHash<QTcpSocket*, struct TCP_CONNECTION_INFO>::iterator it = connectionHash.find(socket);
+    if(it == connectionHash.end())
+    {
+        return;
+    }
+
+    uint32_t timeoutInMs = idleTimeoutInMs;
+
+    // Heartbeat first if it comes earlier than idle timeout
+    if(0 != heartbeatInMs && (0 == idleTimeoutInMs || heartbeatInMs < idleTimeoutInMs))
+    {
+        timeoutInMs = heartbeatInMs;
+    }
+
+    it.value().heartbeatSent = false;
+
+    if(0 == timeoutInMs)
+    {
+        timerWheel->cancel(it.value().timerId);
+    }
+    else
+    {
+        timerWheel->schedule(it.value().timerId, timeoutInMs);
+    }
+}
+
+void TCPServer::updateTimerWheelTmr()
+{
+    if(0 == idleTimeoutInMs && 0 == heartbeatInMs)
+    {
+        timerWheelTmr->stop();
+    }
+    else if(!timerWheelTmr->isActive())
+    {
+        timerWheelClock.start();
+        lastTickInMs = 0;
+        timerWheelTmr->start(timerWheel->getTickInMs());
+    }
+}
+
+void TCPServer::timerWheelTick()
+{
+    QList<uint32_t> expiredIds;
+    int64_t nowInMs = timerWheelClock.elapsed();
+    uint32_t elapsedInMs = (uint32_t)(nowInMs - lastTickInMs);
+
+    lastTickInMs = nowInMs;
+
+    // Late or coalesced ticks of the timer do not delay the timeouts
+    timerWheel->advance(elapsedInMs, expiredIds);
+
+    for(int i = 0; i < expiredIds.size(); i++)
+    {
+        uint32_t id = expiredIds.at(i);
+        QTcpSocket *socket = timerSocketHash.value(id, NULL);
+
+        QHash<QTcpSocket*, struct TCP_CONNECTION_INFO>::iterator it = connectionHash.find(socket);
+        if(NULL == socket || it == connectionHash.end())
+        {
+            continue;
+        }
+
+        bool heartbeatFlag = (0 != heartbeatInMs) && !it.value().heartbeatSent &&
+                (0 == idleTimeoutInMs || heartbeatInMs < idleTimeoutInMs);
+
+        if(heartbeatFlag)
+        {
+            if(writeToSocket(socket, QByteArray(), heartbeatMsg))
+            {
+                txPacketCnt++;
+                txTotalBytesSize += heartbeatMsg.size();
+            }
+
+            if(0 != idleTimeoutInMs)
+            {
+                // Wait for the rest of idle timeout
+                it.value().heartbeatSent = true;
+                timerWheel->schedule(id, idleTimeoutInMs - heartbeatInMs);
+            }
+            else
+            {
+                timerWheel->schedule(id, heartbeatInMs);
+            }
+        }
+        else if(0 != idleTimeoutInMs)
+        {
+#ifdef TCP_SERVER_DEBUG_TRACE
+            qDebug() << "TCPServer::timerWheelTick() idle timeout" << getClientInfo(tcpClientList.indexOf(socket));
+#endif
+
+            // Emit signals to notice connection timeout
+            emit connectionTimeout(getClientInfo(tcpClientList.indexOf(socket)));
+
+            // abort() emits disconnected(), connection is removed in removeConnection()
+            socket->abort();
+        }
+    }
+}
+
+void TCPServer::applyKeepAlive(QTcpSocket *socket)
+{
+    if(NULL == socket)
+    {
+        return;
+    }
+
+    socket->setSocketOption(QAbstractSocket::KeepAliveOption, keepAliveEnabled ? 1 : 0);
+
+#ifdef Q_OS_LINUX
+    if(keepAliveEnabled)
+    {
+        int fd = socket->socketDescriptor();
+
+        setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, &keepAliveIdleInSec, sizeof(keepAliveIdleInSec));
+        setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, &keepAliveIntervalInSec, sizeof(keepAliveIntervalInSec));
+        setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT, &keepAliveProbeCnt, sizeof(keepAliveProbeCnt));
+    }
+#endif
+}
+
+bool TCPServer::isTxSignalConnected()
+{
+    return receivers(SIGNAL(newDataTx(QHostAddress,uint16_t,QByteArray))) > 0;
+}
+
 uint32_t TCPServer::getTxDiagramCnt() const
 {
     return txPacketCnt;
@@ -311,6 +983,8 @@ void TCPServer::resetTxRxCnt()
 
     txTotalBytesSize = 0;
     rxTotalBytesSize = 0;
+
+    txDropCnt = 0;
 }
 
 bool TCPServer::getRunningStatus() const
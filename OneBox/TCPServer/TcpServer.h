@@ -16,8 +16,14 @@ PURPOSE:        TCP Server interface
 #include <QHostAddress>
 #include <QByteArray>
 #include <QMutex>
+#include <QHash>
+#include <QElapsedTimer>
+
+#include <QTimer>
 
 #include "FifoBuffer.h"
+#include "StreamFramer.h"
+#include "TimerWheel.h"
 
 
 class TCPServer : public QThread
@@ -53,6 +59,39 @@ public:
     void sendData(uint32_t clientIndex, const char *data, uint32_t len);
     void sendData(uint32_t clientIndex, QByteArray &data);
 
+    /*-----------------------------------------------------------------------
+    FUNCTION:		broadcast
+    PURPOSE:		Send the same message to all connected clients
+    ARGUMENTS:		const QByteArray &payload -- message, shared by all clients
+                    const QByteArray &header  -- optional header sent before payload
+    RETURNS:		The count of clients the message is sent to
+    -----------------------------------------------------------------------*/
+    uint32_t broadcast(const QByteArray &payload, const QByteArray &header = QByteArray());
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		sendToGroup
+    PURPOSE:		Send the same message to all clients of group
+    ARGUMENTS:		uint32_t groupId          -- group ID, 0 ~ (MAX_GROUP_CNT - 1)
+                    const QByteArray &payload -- message, shared by all clients
+                    const QByteArray &header  -- optional header sent before payload
+    RETURNS:		The count of clients the message is sent to
+    -----------------------------------------------------------------------*/
+    uint32_t sendToGroup(uint32_t groupId, const QByteArray &payload, const QByteArray &header = QByteArray());
+
+    // Add/remove client to/from group, a client can join several groups
+    bool addClientToGroup(uint32_t clientIndex, uint32_t groupId);
+    bool removeClientFromGroup(uint32_t clientIndex, uint32_t groupId);
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		setFramer
+    PURPOSE:		Set the framer used to split rx stream into whole messages
+    ARGUMENTS:		StreamFramer *framerP -- framer prototype, cloned for each
+                                             connection, TCPServer owns it
+                                             NULL: report raw stream chunks
+    RETURNS:		None
+    -----------------------------------------------------------------------*/
+    void setFramer(StreamFramer *framerP);
+
     uint32_t getTxDiagramCnt() const;
     uint32_t getRxDiagramCnt() const;
 
@@ -63,6 +102,87 @@ public:
 
     bool getRunningStatus() const;
 
+    // Policy when the tx queue of a client exceeds high watermark
+    enum SLOW_CONSUMER_POLICY
+    {
+        SLOW_CONSUMER_PAUSE = 0,    // Accept the message crossing high watermark up to its size, then reject until below low watermark
+        SLOW_CONSUMER_DROP,         // Drop messages until below low watermark
+        SLOW_CONSUMER_DISCONNECT    // Abort the connection
+    };
+
+    // Tx queue statistics of one client
+    struct TCP_TX_QUEUE_STAT
+    {
+        uint32_t queuedBytes;       // Bytes waiting in write buffer
+        uint32_t peakQueuedBytes;   // Maximum of queuedBytes
+        uint32_t dropPacketCnt;     // Messages dropped by watermark
+        uint32_t dropBytes;         // Bytes dropped by watermark
+        bool paused;                // True: queue is above high watermark
+    };
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		setTxWatermark
+    PURPOSE:		Set the tx queue watermarks of each client
+    ARGUMENTS:		uint32_t highBytes -- slow consumer policy applies above it
+                    uint32_t lowBytes  -- client is writable again below it
+    RETURNS:		None
+    -----------------------------------------------------------------------*/
+    void setTxWatermark(uint32_t highBytes, uint32_t lowBytes);
+
+    // Set the policy for slow consumer
+    void setSlowConsumerPolicy(SLOW_CONSUMER_POLICY policy);
+
+    // True: client tx queue is below high watermark
+    bool isClientWritable(uint32_t clientIndex);
+
+    // Return tx queue statistics of client
+    bool getClientTxStat(uint32_t clientIndex, struct TCP_TX_QUEUE_STAT &stat);
+
+    // Return the sum of queued bytes of all clients
+    uint32_t getTotalQueuedBytes();
+
+    // Return the count of messages dropped by watermark
+    uint32_t getTxDropCnt() const;
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		setIdleTimeout
+    PURPOSE:		Close the connection without rx data for a period
+    ARGUMENTS:		uint32_t timeoutInMs -- idle timeout, 0: disabled
+    RETURNS:		None
+    -----------------------------------------------------------------------*/
+    void setIdleTimeout(uint32_t timeoutInMs);
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		setHeartbeat
+    PURPOSE:		Send heartbeat to the client without rx data for a period
+    ARGUMENTS:		uint32_t intervalInMs       -- heartbeat interval, 0: disabled
+                    const QByteArray &message   -- heartbeat message
+    RETURNS:		None
+    -----------------------------------------------------------------------*/
+    void setHeartbeat(uint32_t intervalInMs, const QByteArray &message);
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		setKeepAlive
+    PURPOSE:		Set TCP keepalive of the connections
+    ARGUMENTS:		bool enable         -- true: enable SO_KEEPALIVE
+                    int idleInSec       -- TCP_KEEPIDLE, idle time before probe
+                    int intervalInSec   -- TCP_KEEPINTVL, time between probes
+                    int probeCnt        -- TCP_KEEPCNT, probes before drop
+    RETURNS:		None
+    -----------------------------------------------------------------------*/
+    void setKeepAlive(bool enable, int idleInSec = 60, int intervalInSec = 10, int probeCnt = 5);
+
+    // Send every rx message back to its client, e.g. as the target of TCPLoadGenerator
+    void setEchoEnabled(bool flag);
+    bool getEchoFlag() const;
+
+    enum
+    {
+        MAX_GROUP_CNT = 32,
+        DEFAULT_TX_HIGH_WATERMARK = 1024 * 1024,
+        DEFAULT_TX_LOW_WATERMARK = 256 * 1024
+    };
+
 signals:
     void connectionIn(QString);
     void connectionOut(QString);
@@ -73,13 +193,42 @@ signals:
     void serverChanged(QHostAddress address, uint16_t port);
     void connectionChanged(bool connected);
 
+    // Tx queue of client crosses high/low watermark, producers shall pause/resume
+    void txPaused(int clientIndex);
+    void txResumed(int clientIndex);
+
+    // Connection is closed by idle timeout
+    void connectionTimeout(QString);
+
 private:
+
+    // Per-connection context
+    struct TCP_CONNECTION_INFO
+    {
+        StreamFramer *framer;   // Undealt rx data of this connection, NULL: raw mode
+        uint32_t groupMask;     // Bit n set: client is in group n
+
+        // Tx queue state
+        bool txPaused;          // True: queue is above high watermark
+        bool abortPending;      // True: abort by slow consumer policy
+        uint32_t peakQueuedBytes;
+        uint32_t dropPacketCnt;
+        uint32_t dropBytes;
+
+        // Idle timeout state
+        uint32_t timerId;       // Timer ID in timerWheel
+        bool heartbeatSent;     // True: heartbeat sent, wait for rx data
+    };
+
     QTcpServer *tcpServer;
     QList<QTcpSocket*> tcpClientList;
     QTcpSocket *currentClient;
 
     FIFOBuffer *fifoBuf;
 
+    StreamFramer *framerPrototype;  // Cloned for each new connection
+    QHash<QTcpSocket*, struct TCP_CONNECTION_INFO> connectionHash;
+
     QHostAddress hostAddr;
     uint16_t listenPort;
 
@@ -94,13 +243,71 @@ private:
 
     bool isRunning;   // Flag to indicate server is running or not
 
+    uint32_t txHighWatermark;   // Tx queue high watermark in bytes
+    uint32_t txLowWatermark;    // Tx queue low watermark in bytes
+    SLOW_CONSUMER_POLICY slowConsumerPolicy;
+    uint32_t txDropCnt;         // Total messages dropped by watermark
+
+    TimerWheel *timerWheel;     // Idle timers of all connections
+    QTimer *timerWheelTmr;      // Drive timerWheel
+    QElapsedTimer timerWheelClock;  // Wheel advances by measured time, ticks may be late
+    int64_t lastTickInMs;
+    QHash<uint32_t, QTcpSocket*> timerSocketHash;   // Timer ID to connection
+
+    uint32_t idleTimeoutInMs;   // Idle timeout, 0: disabled
+    uint32_t heartbeatInMs;     // Heartbeat interval, 0: disabled
+    QByteArray heartbeatMsg;    // Heartbeat message
+
+    bool keepAliveEnabled;      // TCP keepalive
+    int keepAliveIdleInSec;
+    int keepAliveIntervalInSec;
+    int keepAliveProbeCnt;
+
+    bool echoFlag;              // True: send rx message back to client
+
+    // Restart idle timer of connection, called when rx data
+    void restartIdleTimer(QTcpSocket *socket);
+
+    // Start/stop timerWheelTmr according to idle timeout and heartbeat setting
+    void updateTimerWheelTmr();
+
+    // Apply TCP keepalive setting to socket
+    void applyKeepAlive(QTcpSocket *socket);
+
+    // Check tx queue watermark before write, false: message shall not be sent
+    bool checkTxQueue(QTcpSocket *socket, uint32_t len);
+
     QHostAddress getClientAddress(uint32_t clientIndex);
     quint16 getClientPort(uint32_t clientIndex);
 
+    // Push rx message to FIFO and notice host
+    void reportRxData(int clientIndex, const QByteArray &data);
+
+    // Release the context of connection
+    void releaseConnection(QTcpSocket *socket);
+
+    // Write header + payload to socket with one gather call if possible
+    bool writeToSocket(QTcpSocket *socket, const QByteArray &header, const QByteArray &payload);
+
+    // Send message to clients whose groupMask matches, 0: all clients
+    uint32_t sendToClients(uint32_t groupMask, const QByteArray &payload, const QByteArray &header);
+
+    // True: newDataTx() is connected, the tx data copy is needed
+    bool isTxSignalConnected();
+
 private slots:
     void acceptConnection();
     void removeConnection();
     void readPendingData();
+
+    // Resume client once tx queue drains below low watermark
+    void updateTxQueue(qint64 bytes);
+
+    // Abort the connections marked by slow consumer policy
+    void abortSlowClients();
+
+    // Check expired idle timers
+    void timerWheelTick();
 };
 
 #endif // TCPSERVER_H
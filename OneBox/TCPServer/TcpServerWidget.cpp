@@ -207,10 +207,7 @@ void TcpServerWidget::on_pushButton_send_clicked()
     // Send msg to all
     if((ui->comboBox_clients->count() - 1) == ui->comboBox_clients->currentIndex())
     {
-        for(uint32_t i = 0; i < tcpServer->getConnectionCount(); i++)
-        {
-            sendData(i, tempTxBuf);
-        }
+        tcpServer->broadcast(tempTxBuf);
     }
     else
     {
@@ -16,16 +16,27 @@ UDPClient::UDPClient(QObject *parent) :
     QThread(parent),
     udpSocket(NULL),
     fifoBuf(new FIFOBuffer),
-    isRunning(false)
+    isRunning(false),
+    datagramBatch(NULL),
+    generator(NULL)
 {
     resetTxRxCnt();
 
+    qRegisterMetaType<UDP_DATAGRAM_LIST>("UDP_DATAGRAM_LIST");
+
+    // Use batch path by default if supported
+    setBatchEnabled(DatagramBatch::isSupported());
+
     connect(this, SIGNAL(startListen()), this, SLOT(startSocket()));
     connect(this, SIGNAL(stopListen()), this, SLOT(stopSocket()));
 }
 
 UDPClient::~UDPClient()
 {
+    // Generator uses the socket
+    stopGenerator();
+    delete generator;
+
     if(NULL != udpSocket)
     {
         delete udpSocket;
@@ -33,6 +44,7 @@ UDPClient::~UDPClient()
     }
 
     delete fifoBuf;
+    delete datagramBatch;
 }
 
 void UDPClient::run()
@@ -119,6 +131,123 @@ void UDPClient::sendData(QByteArray &data)
     sendData(data.constData(), data.size());
 }
 
+uint32_t UDPClient::sendData(const QList<QByteArray> &datagrams)
+{
+    int sentCnt = -1;
+
+    // When socket is close, do not send out data
+    if(!isRunning || datagrams.isEmpty() || hostAddr.isNull() || 0 == serverPort)
+    {
+        return 0;
+    }
+
+    if(NULL != datagramBatch)
+    {
+        sentCnt = datagramBatch->send(udpSocket->socketDescriptor(), datagrams, hostAddr, serverPort);
+    }
+
+    // Batch path is not available, send one by one
+    if(sentCnt < 0)
+    {
+        sentCnt = 0;
+
+        while(sentCnt < datagrams.size()
+              && udpSocket->writeDatagram(datagrams.at(sentCnt), hostAddr, serverPort) >= 0)
+        {
+            sentCnt++;
+        }
+    }
+
+    bool txSignalFlag = receivers(SIGNAL(newDataTx(QHostAddress,int,QByteArray))) > 0;
+
+    for(int i = 0; i < sentCnt; i++)
+    {
+        txPacketCnt++;
+        txTotalBytesSize += datagrams.at(i).size();
+
+        if(txSignalFlag)
+        {
+            // Emit signal
+            emit newDataTx(hostAddr, serverPort, datagrams.at(i));
+        }
+    }
+
+    return sentCnt;
+}
+
+void UDPClient::setBatchEnabled(bool flag, uint32_t batchCnt, uint32_t maxDatagramSize)
+{
+    delete datagramBatch;
+    datagramBatch = NULL;
+
+    if(flag && DatagramBatch::isSupported())
+    {
+        datagramBatch = new DatagramBatch(batchCnt, maxDatagramSize);
+    }
+}
+
+bool UDPClient::getBatchFlag() const
+{
+    return (NULL != datagramBatch);
+}
+
+bool UDPClient::startGenerator(const struct UDP_GENERATOR_CONFIG &config)
+{
+    stopGenerator();
+
+    if(!isRunning || NULL == udpSocket)
+    {
+        return false;
+    }
+
+    struct UDP_GENERATOR_CONFIG generatorConfig = config;
+
+    if(generatorConfig.address.isNull())
+    {
+        generatorConfig.address = hostAddr;
+        generatorConfig.port = serverPort;
+    }
+
+    if(generatorConfig.address.isNull() || 0 == generatorConfig.port)
+    {
+        return false;
+    }
+
+    delete generator;
+    generator = new UDPTrafficGenerator(generatorConfig, udpSocket->socketDescriptor());
+
+    if(generator->getTargetPps() <= 0)
+    {
+        return false;
+    }
+
+    connect(generator, SIGNAL(rateReport(double,double)), this, SIGNAL(generatorRateReport(double,double)));
+    connect(generator, SIGNAL(generatorFinished(quint64)), this, SIGNAL(generatorFinished(quint64)));
+    connect(generator, SIGNAL(generatorFailed(QString)), this, SIGNAL(generatorFailed(QString)));
+
+    generator->start(QThread::HighPriority);
+
+    return true;
+}
+
+void UDPClient::stopGenerator()
+{
+    if(NULL != generator)
+    {
+        generator->stopGenerator();
+    }
+}
+
+bool UDPClient::getGeneratorStatus() const
+{
+    return (NULL != generator && generator->isRunning());
+}
+
+const UDPTrafficGenerator *UDPClient::getGenerator() const
+{
+    return generator;
+}
+
 void UDPClient::readPendingDatagrams()
 {
     while (udpSocket->hasPendingDatagrams())
@@ -141,6 +270,7 @@ void UDPClient::readPendingDatagrams()
             // Emit signal
             emit newDataReady();
             emit newDataReady(0, temp);
+            emit newDataRx(clientAddr, clientPort, temp);
 
 #ifdef UDP_CLIENT_DEBUG_TRACE
             QString ipPortStr;
@@ -161,6 +291,113 @@ void UDPClient::readPendingDatagrams()
             qDebug() << tmpStr;
 #endif
         }
+
+        // Qt socket notifier is enabled again by readDatagram() above,
+        // then read the rest datagrams in batch
+        if(NULL != datagramBatch && NULL != udpSocket)
+        {
+            readDatagramBatch();
+        }
+
+        if(NULL == udpSocket)
+        {
+            break;
+        }
+    }
+}
+
+void UDPClient::readDatagramBatch()
+{
+    int socketFd = udpSocket->socketDescriptor();
+
+    // Skip the copy for signals which are not connected
+    bool rxSignalFlag = receivers(SIGNAL(newDataReady(int,QByteArray))) > 0;
+    bool rxSenderSignalFlag = receivers(SIGNAL(newDataRx(QHostAddress,int,QByteArray))) > 0;
+    bool batchSignalFlag = receivers(SIGNAL(newDatagramBatch(UDP_DATAGRAM_LIST))) > 0;
+
+    while(NULL != udpSocket)
+    {
+        int cnt = datagramBatch->receive(socketFd);
+        if(cnt <= 0)
+        {
+            break;
+        }
+
+        // Push the whole batch with one lock
+        {
+            QMutexLocker locker(&mutex);
+
+            for(int i = 0; i < cnt; i++)
+            {
+                fifoBuf->pushData(datagramBatch->getData(i), datagramBatch->getSize(i));
+            }
+        }
+
+        UDP_DATAGRAM_LIST datagramList;
+
+        for(int i = 0; i < cnt; i++)
+        {
+            uint32_t len = datagramBatch->getSize(i);
+
+            // Sender address is converted only when it changes
+            if(0 == i || !datagramBatch->isSameSender(i, i - 1))
+            {
+                clientAddr = datagramBatch->getAddress(i);
+                clientPort = datagramBatch->getPort(i);
+            }
+
+            if(datagramBatch->isTruncated(i))
+            {
+                rxTruncatedCnt++;
+
+#ifdef UDP_CLIENT_DEBUG_TRACE
+                qDebug() << "UDPClient::readDatagramBatch() datagram truncated to" << len;
+#endif
+            }
+
+            if(0 == len)
+            {
+                continue;
+            }
+
+            rxPacketCnt++;
+            rxTotalBytesSize += len;
+
+            // Emit signal
+            emit newDataReady();
+
+            if(rxSignalFlag)
+            {
+                emit newDataReady(0, QByteArray(datagramBatch->getData(i), len));
+            }
+
+            if(rxSenderSignalFlag)
+            {
+                emit newDataRx(clientAddr, clientPort, QByteArray(datagramBatch->getData(i), len));
+            }
+
+            if(batchSignalFlag)
+            {
+                struct UDP_DATAGRAM datagram;
+                datagram.data = QByteArray(datagramBatch->getData(i), len);
+                datagram.address = clientAddr;
+                datagram.port = clientPort;
+
+                datagramList.append(datagram);
+            }
+        }
+
+        if(batchSignalFlag && !datagramList.isEmpty())
+        {
+            // Emit signal
+            emit newDatagramBatch(datagramList);
+        }
+
+        // Socket is drained
+        if((uint32_t)cnt < datagramBatch->getBatchCnt())
+        {
+            break;
+        }
     }
 }
 
@@ -247,6 +484,11 @@ uint32_t UDPClient::getTotalRxBytes() const
     return rxTotalBytesSize;
 }
 
+uint32_t UDPClient::getRxTruncatedCnt() const
+{
+    return rxTruncatedCnt;
+}
+
 void UDPClient::resetTxRxCnt()
 {
     txPacketCnt = 0;
@@ -254,6 +496,7 @@ void UDPClient::resetTxRxCnt()
 
     txTotalBytesSize = 0;
     rxTotalBytesSize = 0;
+    rxTruncatedCnt = 0;
 }
 
 bool UDPClient::getRunningStatus() const
@@ -278,6 +521,9 @@ void UDPClient::startSocket()
 
 void UDPClient::stopSocket()
 {
+    // Generator uses the socket
+    stopGenerator();
+
     if(NULL != udpSocket)
     {
         udpSocket->close();
@@ -15,6 +15,8 @@ PURPOSE:        UDP Client interface
 #include <QMutex>
 
 #include "FifoBuffer.h"
+#include "DatagramBatch.h"
+#include "UdpTrafficGenerator.h"
 
 class UDPClient : public QThread
 {
@@ -44,12 +46,46 @@ public:
     void sendData(const char *data, uint32_t len);
     void sendData(QByteArray &data);
 
+    /*-----------------------------------------------------------------------
+    FUNCTION:		sendData
+    PURPOSE:		Send a batch of datagrams to server, sendmmsg() on Linux
+    ARGUMENTS:		const QList<QByteArray> &datagrams  -- datagrams to send
+    RETURNS:		The count of datagrams sent
+    -----------------------------------------------------------------------*/
+    uint32_t sendData(const QList<QByteArray> &datagrams);
+
+    // Enable/disable recvmmsg()/sendmmsg() batch path, Linux only
+    void setBatchEnabled(bool flag, uint32_t batchCnt = DatagramBatch::DEFAULT_BATCH_CNT,
+                         uint32_t maxDatagramSize = DatagramBatch::DEFAULT_MAX_DATAGRAM_SIZE);
+    bool getBatchFlag() const;
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		startGenerator
+    PURPOSE:		Start sending datagrams at target rate in a thread
+    ARGUMENTS:		const struct UDP_GENERATOR_CONFIG &config -- rate and payload,
+                                                                 null address: current server
+    RETURNS:		True: started, false: socket is closed or rate is 0
+    -----------------------------------------------------------------------*/
+    bool startGenerator(const struct UDP_GENERATOR_CONFIG &config);
+
+    // Stop generator, also stopped when socket is closed
+    void stopGenerator();
+
+    // True: generator is sending
+    bool getGeneratorStatus() const;
+
+    // Return the generator of last startGenerator() for statistics, NULL: never started
+    const UDPTrafficGenerator *getGenerator() const;
+
     uint32_t getTxDiagramCnt() const;
     uint32_t getRxDiagramCnt() const;
 
     uint32_t getTotalTxBytes() const;
     uint32_t getTotalRxBytes() const;
 
+    // Datagrams cut at the max datagram size of the batch path
+    uint32_t getRxTruncatedCnt() const;
+
     void resetTxRxCnt();
 
     bool getRunningStatus() const;
@@ -58,6 +94,18 @@ signals:
     void newDataReady(void);
     void newDataReady(int, QByteArray);
     void newDataTx(QHostAddress, int, QByteArray);
+
+    // Received datagram with its sender, e.g. to drop datagrams not from the server
+    void newDataRx(QHostAddress, int, QByteArray);
+
+    // Datagrams got by one recvmmsg(), only emitted in batch path
+    void newDatagramBatch(UDP_DATAGRAM_LIST);
+
+    // Achieved rate of generator, about once per second
+    void generatorRateReport(double pps, double bitRate);
+    void generatorFinished(quint64 sentCnt);
+    void generatorFailed(QString error);
+
     void serverChanged(QHostAddress address, int port);
     void connectionChanged(bool connected);
 
@@ -84,11 +132,19 @@ private:
     uint32_t rxPacketCnt;
     uint32_t txTotalBytesSize;
     uint32_t rxTotalBytesSize;
+    uint32_t rxTruncatedCnt;    // Datagrams truncated by the batch path
 
     bool isRunning;    // True: socket init, false: socket close
 
     QMutex mutex;   // Mutex lock
 
+    DatagramBatch *datagramBatch;   // Batch rx/tx buffer, NULL: batch path disabled
+
+    UDPTrafficGenerator *generator; // Sends on socket of this client, NULL: never started
+
+    // Read the rest pending datagrams with recvmmsg()
+    void readDatagramBatch();
+
     void setHostAddress(const QHostAddress &address);
     void setServerPort(uint16_t port);
 
@@ -0,0 +1,333 @@
+/**********************************************************************
+PACKAGE:        Communication
+FILE:           UdpTrafficGenerator.cpp
+COPYRIGHT (C):  All rights reserved.
+
+PURPOSE:        Send UDP datagrams at a target rate for load test
+**********************************************************************/
+
+#include "UdpTrafficGenerator.h"
+#include <QElapsedTimer>
+#include <QUdpSocket>
+#include <QDebug>
+#include <string.h>
+#include <errno.h>
+
+UDPTrafficGenerator::UDPTrafficGenerator(const struct UDP_GENERATOR_CONFIG &config, int socketFd, QObject *parent) :
+    QThread(parent),
+    m_config(config),
+    m_socketFd(socketFd),
+    stopFlag(false),
+    sentCnt(0),
+    sentBytes(0),
+    blockedCnt(0),
+    elapsedInNs(0),
+    randomState(2463534242U)
+{
+    if(0 == m_config.payloadSize)
+    {
+        m_config.payloadSize = 1;
+    }
+
+    if(0 == m_config.burstCnt)
+    {
+        m_config.burstCnt = 1;
+    }
+
+    // Bit rate counts the payload only
+    if(m_config.ratePps > 0)
+    {
+        targetPps = m_config.ratePps;
+    }
+    else
+    {
+        targetPps = (double)m_config.bitRate / (8.0 * m_config.payloadSize);
+    }
+
+    // Build the template once, only the fields are written per datagram
+    QByteArray datagram(m_config.payloadSize, 0);
+
+    if(!m_config.pattern.isEmpty())
+    {
+        for(uint32_t i = 0; i < m_config.payloadSize; i++)
+        {
+            datagram[i] = m_config.pattern.at(i % m_config.pattern.size());
+        }
+    }
+
+    for(uint32_t i = 0; i < m_config.burstCnt; i++)
+    {
+        datagramList.append(datagram);
+
+        // Detach now, not in the send loop
+        datagramList[i].data();
+    }
+}
+
+UDPTrafficGenerator::~UDPTrafficGenerator()
+{
+    stopGenerator();
+}
+
+void UDPTrafficGenerator::writeField(char *dataP, uint32_t value)
+{
+    dataP[0] = (char)(value >> 24);
+    dataP[1] = (char)(value >> 16);
+    dataP[2] = (char)(value >> 8);
+    dataP[3] = (char)value;
+}
+
+void UDPTrafficGenerator::fillDatagram(QByteArray &datagram, uint32_t seq, uint32_t tsInUs)
+{
+    char *dataP = datagram.data();
+    uint32_t size = datagram.size();
+
+    if(0 != (m_config.fieldFlags & UDP_GENERATOR_FIELD_RANDOM))
+    {
+        for(uint32_t i = 0; i < size; i += 4)
+        {
+            randomState ^= randomState << 13;
+            randomState ^= randomState >> 17;
+            randomState ^= randomState << 5;
+
+            uint32_t len = (size - i < 4) ? (size - i) : 4;
+            memcpy(dataP + i, &randomState, len);
+        }
+    }
+
+    if(0 != (m_config.fieldFlags & UDP_GENERATOR_FIELD_SEQUENCE) && m_config.seqOffset + 4 <= size)
+    {
+        writeField(dataP + m_config.seqOffset, seq);
+    }
+
+    if(0 != (m_config.fieldFlags & UDP_GENERATOR_FIELD_TIMESTAMP) && m_config.tsOffset + 4 <= size)
+    {
+        writeField(dataP + m_config.tsOffset, tsInUs);
+    }
+}
+
+void UDPTrafficGenerator::run()
+{
+    if(targetPps <= 0 || m_config.address.isNull() || 0 == m_config.port)
+    {
+        return;
+    }
+
+    DatagramBatch *txBatch = NULL;
+    QUdpSocket *udpSocket = NULL;
+
+    if(m_socketFd >= 0 && DatagramBatch::isSupported())
+    {
+        txBatch = new DatagramBatch(m_config.burstCnt, m_config.payloadSize);
+    }
+    else
+    {
+        // Created in this thread, used only by this thread
+        udpSocket = new QUdpSocket;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    int64_t lastInNs = 0;
+    int64_t reportInNs = 0;
+    uint64_t reportCnt = 0;
+    uint64_t reportBytes = 0;
+
+    double tokens = 1;
+    uint32_t seq = 0;
+
+    while(!stopFlag)
+    {
+        int64_t nowInNs = timer.nsecsElapsed();
+
+        tokens += (nowInNs - lastInNs) * targetPps / 1e9;
+        if(tokens > m_config.burstCnt)
+        {
+            tokens = m_config.burstCnt;
+        }
+
+        lastInNs = nowInNs;
+        elapsedInNs = nowInNs;
+
+        // Report the rate of last period
+        if(nowInNs - reportInNs >= REPORT_PERIOD_IN_NS)
+        {
+            double periodInS = (nowInNs - reportInNs) / 1e9;
+
+            // Emit signal
+            emit rateReport((sentCnt - reportCnt) / periodInS, 8.0 * (sentBytes - reportBytes) / periodInS);
+
+            reportInNs = nowInNs;
+            reportCnt = sentCnt;
+            reportBytes = sentBytes;
+        }
+
+        uint32_t cnt = (uint32_t)tokens;
+
+        if(m_config.totalCnt > 0 && sentCnt + cnt > m_config.totalCnt)
+        {
+            cnt = (uint32_t)(m_config.totalCnt - sentCnt);
+        }
+
+        if(0 == cnt)
+        {
+            if(m_config.totalCnt > 0 && sentCnt >= m_config.totalCnt)
+            {
+                break;
+            }
+
+            // Sleep if the next token is far away, otherwise spin
+            int64_t waitInNs = (int64_t)((1 - tokens) * 1e9 / targetPps);
+
+            if(waitInNs > SPIN_THRESHOLD_IN_NS)
+            {
+                int64_t sleepInUs = waitInNs / 1000 - WAKE_UP_MARGIN_IN_US;
+
+                // A low rate sleeps in steps, stopGenerator() does not wait for the next token
+                usleep((sleepInUs > MAX_SLEEP_IN_US) ? (int64_t)MAX_SLEEP_IN_US : sleepInUs);
+            }
+            else
+            {
+                yieldCurrentThread();
+            }
+
+            continue;
+        }
+
+        uint32_t tsInUs = (uint32_t)(nowInNs / 1000);
+
+        for(uint32_t i = 0; i < cnt; i++)
+        {
+            fillDatagram(datagramList[i], seq + i, tsInUs);
+        }
+
+        int ret = -1;
+        int sendErrno = 0;
+
+        if(NULL != txBatch)
+        {
+            if(cnt == (uint32_t)datagramList.size())
+            {
+                ret = txBatch->send(m_socketFd, datagramList, m_config.address, m_config.port);
+            }
+            else
+            {
+                // Shares the data, not copied
+                ret = txBatch->send(m_socketFd, datagramList.mid(0, cnt), m_config.address, m_config.port);
+            }
+
+            sendErrno = errno;
+        }
+        else
+        {
+            ret = 0;
+
+            while((uint32_t)ret < cnt
+                  && udpSocket->writeDatagram(datagramList.at(ret), m_config.address, m_config.port) >= 0)
+            {
+                ret++;
+            }
+
+#ifdef Q_OS_UNIX
+            sendErrno = errno;
+#else
+            // No errno of the failed send, retry as before
+            sendErrno = EAGAIN;
+#endif
+        }
+
+        if(ret <= 0)
+        {
+            // Socket buffer is full, keep the tokens and try later
+            if(EAGAIN == sendErrno || EWOULDBLOCK == sendErrno || ENOBUFS == sendErrno)
+            {
+                blockedCnt++;
+                yieldCurrentThread();
+
+                continue;
+            }
+
+            // Unreachable network or closed socket does not recover by retrying
+            errorString = QString::fromLocal8Bit(strerror(sendErrno));
+            break;
+        }
+
+        tokens -= ret;
+        seq += ret;
+
+        sentCnt += ret;
+        sentBytes += (uint64_t)ret * m_config.payloadSize;
+    }
+
+    elapsedInNs = timer.nsecsElapsed();
+
+    delete txBatch;
+    delete udpSocket;
+
+    if(!errorString.isEmpty())
+    {
+        // Emit signal
+        emit generatorFailed(errorString);
+    }
+    else if(m_config.totalCnt > 0 && sentCnt >= m_config.totalCnt)
+    {
+        // Emit signal
+        emit generatorFinished(sentCnt);
+    }
+}
+
+void UDPTrafficGenerator::stopGenerator()
+{
+    stopFlag = true;
+
+    if(isRunning())
+    {
+        wait();
+    }
+}
+
+uint64_t UDPTrafficGenerator::getSentCnt() const
+{
+    return sentCnt;
+}
+
+uint64_t UDPTrafficGenerator::getSentBytes() const
+{
+    return sentBytes;
+}
+
+QString UDPTrafficGenerator::getErrorString() const
+{
+    return errorString;
+}
+
+uint64_t UDPTrafficGenerator::getBlockedCnt() const
+{
+    return blockedCnt;
+}
+
+double UDPTrafficGenerator::getAchievedPps() const
+{
+    if(elapsedInNs <= 0)
+    {
+        return 0;
+    }
+
+    return sentCnt * 1e9 / elapsedInNs;
+}
+
+double UDPTrafficGenerator::getAchievedBitRate() const
+{
+    if(elapsedInNs <= 0)
+    {
+        return 0;
+    }
+
+    return 8.0 * sentBytes * 1e9 / elapsedInNs;
+}
+
+double UDPTrafficGenerator::getTargetPps() const
+{
+    return targetPps;
+}
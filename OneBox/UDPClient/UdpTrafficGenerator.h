@@ -0,0 +1,159 @@
+/**********************************************************************
+PACKAGE:        Communication
+FILE:           UdpTrafficGenerator.h
+COPYRIGHT (C):  All rights reserved.
+
+PURPOSE:        Send UDP datagrams at a target rate for load test
+**********************************************************************/
+
+#ifndef UDPTRAFFICGENERATOR_H
+#define UDPTRAFFICGENERATOR_H
+
+#include <QThread>
+#include <QHostAddress>
+#include <QByteArray>
+#include <QList>
+#include <QString>
+
+#include "DatagramBatch.h"
+
+/*
+ UDPTrafficGenerator sends datagrams in its own thread, the rate is kept by
+ a token bucket with nanosecond clock,
+
+ tokens += elapsedInNs * ratePps / 1e9, tokens <= burstCnt
+ send floor(tokens) datagrams with one sendmmsg(), tokens -= sent
+
+ The thread sleeps when the next token is far away and spins on yield
+ when it is close, so the rate does not depend on timer granularity.
+
+ Payload template, all fields are big-endian,
+
+ offset:  seqOffset      tsOffset
+          |              |
+ payload: [seq, 4 bytes]..[timestamp in us, 4 bytes]..[fill pattern or random]
+
+ The layout matches SequenceAnalyzer(seqOffset, 4, true) with
+ setTimestampField(tsOffset, 4, 1.0) on the receiver.
+
+ On Linux the datagrams are sent on the socket of UDPClient, so the
+ replies come back to it. On other platforms the generator opens its
+ own QUdpSocket and sends one datagram per call.
+*/
+
+// Payload fields, combined as flags
+enum UDP_GENERATOR_FIELD
+{
+    UDP_GENERATOR_FIELD_SEQUENCE = 0x01,    // Incrementing sequence number
+    UDP_GENERATOR_FIELD_TIMESTAMP = 0x02,   // Sender time in us
+    UDP_GENERATOR_FIELD_RANDOM = 0x04       // Random fill, refreshed per datagram
+};
+
+struct UDP_GENERATOR_CONFIG
+{
+    QHostAddress address;       // Destination
+    uint16_t port;
+
+    uint32_t ratePps;           // Datagrams per second, 0: use bitRate
+    uint64_t bitRate;           // Payload bits per second, used if ratePps is 0
+    uint32_t payloadSize;       // Bytes of each datagram
+    uint32_t burstCnt;          // Bucket depth, also max datagrams per sendmmsg()
+    uint64_t totalCnt;          // Datagrams to send, 0: until stopped
+
+    uint32_t fieldFlags;        // UDP_GENERATOR_FIELD flags
+    uint32_t seqOffset;
+    uint32_t tsOffset;
+    QByteArray pattern;         // Fill pattern repeated in payload, empty: zero
+
+    UDP_GENERATOR_CONFIG() :
+        port(0),
+        ratePps(1000),
+        bitRate(0),
+        payloadSize(64),
+        burstCnt(32),
+        totalCnt(0),
+        fieldFlags(UDP_GENERATOR_FIELD_SEQUENCE | UDP_GENERATOR_FIELD_TIMESTAMP),
+        seqOffset(0),
+        tsOffset(4)
+    {
+    }
+};
+
+class UDPTrafficGenerator : public QThread
+{
+    Q_OBJECT
+public:
+    /*-----------------------------------------------------------------------
+    FUNCTION:		UDPTrafficGenerator
+    PURPOSE:		Construct a generator, start it with start()
+    ARGUMENTS:		const struct UDP_GENERATOR_CONFIG &config -- rate and payload
+                    int socketFd                              -- socket to send on, -1: own socket
+                    QObject *parent                           -- parent
+    RETURNS:		None
+    -----------------------------------------------------------------------*/
+    UDPTrafficGenerator(const struct UDP_GENERATOR_CONFIG &config, int socketFd, QObject *parent = 0);
+    virtual ~UDPTrafficGenerator();
+
+    void run();
+
+    // Stop thread, wait until it exits
+    void stopGenerator();
+
+    // Statistics, can be read while running
+    uint64_t getSentCnt() const;
+    uint64_t getSentBytes() const;
+    uint64_t getBlockedCnt() const;
+
+    // Achieved rate since start
+    double getAchievedPps() const;
+    double getAchievedBitRate() const;
+
+    // Return the target rate in datagrams per second
+    double getTargetPps() const;
+
+    // Reason the run stopped on a send error, empty if none
+    QString getErrorString() const;
+
+signals:
+    // Emitted about once per second with the rate of last period
+    void rateReport(double pps, double bitRate);
+
+    // Emitted when totalCnt datagrams are sent
+    void generatorFinished(quint64 sentCnt);
+
+    // Emitted when a send error other than a full socket buffer stops the run
+    void generatorFailed(QString error);
+
+private:
+    enum
+    {
+        REPORT_PERIOD_IN_NS = 1000000000,
+        SPIN_THRESHOLD_IN_NS = 200000,      // Spin if next token is closer than it
+        WAKE_UP_MARGIN_IN_US = 50,          // Wake up earlier than next token
+        MAX_SLEEP_IN_US = 100000            // Check stop flag and report at least this often
+    };
+
+    struct UDP_GENERATOR_CONFIG m_config;
+    int m_socketFd;
+
+    double targetPps;
+
+    volatile bool stopFlag;
+
+    volatile uint64_t sentCnt;
+    volatile uint64_t sentBytes;
+    volatile uint64_t blockedCnt;      // sendmmsg() returns socket buffer full
+    volatile int64_t elapsedInNs;      // Running time, updated by thread
+    QString errorString;                // Set by thread before it exits
+
+    uint32_t randomState;               // xorshift32 state
+
+    QList<QByteArray> datagramList;     // Preallocated datagrams, reused per batch
+
+    // Fill fields of datagram before it is sent
+    void fillDatagram(QByteArray &datagram, uint32_t seq, uint32_t tsInUs);
+
+    static void writeField(char *dataP, uint32_t value);
+};
+
+#endif // UDPTRAFFICGENERATOR_H
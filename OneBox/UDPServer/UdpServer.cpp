@@ -9,6 +9,14 @@ PURPOSE:        UDP Server interface
 #include "UdpServer.h"
 #include <QMutexLocker>
 #include <QDebug>
+#include <string.h>
+
+#ifdef Q_OS_UNIX
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <errno.h>
+#endif
 
 //#define UDP_SERVER_DEBUG_TRACE
 
@@ -16,22 +24,44 @@ UDPServer::UDPServer(QObject *parent) :
     QThread(parent),
     udpSocket(NULL),
     fifoBuf(new FIFOBuffer(8000, 1500)),
+    peerTable(new PeerTable),
+    idleTimerWheel(new TimerWheel),
+    idleCheckTmr(new QTimer),
+    clientIdleTimeoutInMs(0),
+    lastIdleCheckInMs(0),
+    seqAnalyzer(NULL),
     txPacketCnt(0),
     rxPacketCnt(0),
     txTotalBytesSize(0),
     rxTotalBytesSize(0),
+    rxTruncatedCnt(0),
     isRunning(false),
     timerForCheck(NULL),
     lostCheckImMs(500),
-    lostCheckEnabled(false)
+    lostCheckEnabled(false),
+    datagramBatch(NULL),
+    batchFlag(DatagramBatch::isSupported()),
+    batchCnt(DatagramBatch::DEFAULT_BATCH_CNT),
+    batchMaxDatagramSize(DatagramBatch::DEFAULT_MAX_DATAGRAM_SIZE),
+    rxBufferSize(0)
 {
     // Register data type to remove warning while running
     qRegisterMetaType<QAbstractSocket::SocketError>("SocketError");
+    qRegisterMetaType<UDP_DATAGRAM_LIST>("UDP_DATAGRAM_LIST");
+
+    // Use batch path by default if supported
+    applyBatchSetting();
 
     connect(this, SIGNAL(startConnectionCheck()), this, SLOT(startCheckTimer()));
     connect(this, SIGNAL(stopConnectionCheck()), this, SLOT(stopCheckTimer()));
     connect(this, SIGNAL(startListen()), this, SLOT(startSocket()));
     connect(this, SIGNAL(stopListen()), this, SLOT(stopSocket()));
+
+    // Always queued, also if set by a slot of the datagrams being read
+    connect(this, SIGNAL(batchSettingChanged()), this, SLOT(applyBatchSetting()), Qt::QueuedConnection);
+    connect(idleCheckTmr, SIGNAL(timeout()), this, SLOT(idleClientCheck()));
+
+    upTimer.start();
 }
 
 UDPServer::~UDPServer()
@@ -43,6 +73,12 @@ UDPServer::~UDPServer()
     }
 
     delete fifoBuf;
+    delete datagramBatch;
+
+    delete idleCheckTmr;
+    delete idleTimerWheel;
+    delete peerTable;
+    delete seqAnalyzer;
 }
 
 void UDPServer::run()
@@ -86,6 +122,15 @@ void UDPServer::startSocket()
     connect(udpSocket, SIGNAL(readyRead()), this, SLOT(readPendingDatagrams()));
     connect(udpSocket, SIGNAL(error(QAbstractSocket::SocketError)), this, SLOT(handleError(QAbstractSocket::SocketError)));
 
+    applyReceiveBufferSize();
+    applyTimestampOption();
+
+    // Socket is new, join the groups again
+    for(int i = 0; i < membershipList.size(); i++)
+    {
+        applyMembership(membershipList.at(i), true);
+    }
+
     isRunning = true;
 
     // Emit signal
@@ -127,7 +172,7 @@ void UDPServer::readPendingDatagrams()
         }
 
         // If client is new, add it to list
-        addClientToList(clientAddr, clientPort);
+        uint32_t peerId = addClientToList(clientAddr, clientPort);
 
         if(!temp.isEmpty())
         {
@@ -139,7 +184,14 @@ void UDPServer::readPendingDatagrams()
             rxPacketCnt++;
             rxTotalBytesSize += temp.size();
 
-            int index = getClientIndex(clientAddr, clientPort);
+            updateClientRx(peerId, temp.size(), upTimer.elapsed());
+
+            if(NULL != seqAnalyzer)
+            {
+                seqAnalyzer->analyze(peerId, temp.constData(), temp.size(), upTimer.nsecsElapsed() / 1000);
+            }
+
+            int index = peerTable->getPosition(peerId);
             if(index != -1)
             {
                 // Emit signal
@@ -166,6 +218,137 @@ void UDPServer::readPendingDatagrams()
             qDebug() << tmpStr;
 #endif
         }
+
+        // Qt socket notifier is enabled again by readDatagram() above,
+        // then read the rest datagrams in batch
+        if(NULL != datagramBatch && NULL != udpSocket)
+        {
+            readDatagramBatch();
+        }
+
+        if(NULL == udpSocket)
+        {
+            break;
+        }
+    }
+}
+
+void UDPServer::readDatagramBatch()
+{
+    int socketFd = udpSocket->socketDescriptor();
+
+    // Skip the copy for signals which are not connected
+    bool rxSignalFlag = receivers(SIGNAL(newDataReady(int,QByteArray))) > 0;
+    bool batchSignalFlag = receivers(SIGNAL(newDatagramBatch(UDP_DATAGRAM_LIST))) > 0;
+
+    while(NULL != udpSocket)
+    {
+        int cnt = datagramBatch->receive(socketFd);
+        if(cnt <= 0)
+        {
+            break;
+        }
+
+        // Push the whole batch with one lock
+        {
+            QMutexLocker locker(&mutex);
+
+            for(int i = 0; i < cnt; i++)
+            {
+                fifoBuf->pushData(datagramBatch->getData(i), datagramBatch->getSize(i));
+            }
+        }
+
+        UDP_DATAGRAM_LIST datagramList;
+        int64_t nowInUs = upTimer.nsecsElapsed() / 1000;
+        int64_t nowInMs = nowInUs / 1000;
+
+        // Kernel stamp of the last datagram maps the others onto upTimer
+        int64_t lastStampInUs = (NULL != seqAnalyzer) ? datagramBatch->getTimestampInUs(cnt - 1) : -1;
+        uint32_t peerId = PeerTable::INVALID_ID;
+        int index = -1;
+
+        for(int i = 0; i < cnt; i++)
+        {
+            uint32_t len = datagramBatch->getSize(i);
+
+            // Sender address is converted only when it changes
+            if(0 == i || !datagramBatch->isSameSender(i, i - 1))
+            {
+                clientAddr = datagramBatch->getAddress(i);
+                clientPort = datagramBatch->getPort(i);
+
+                // If client is new, add it to list
+                peerId = addClientToList(clientAddr, clientPort);
+                index = peerTable->getPosition(peerId);
+            }
+
+            if(datagramBatch->isTruncated(i))
+            {
+                rxTruncatedCnt++;
+
+#ifdef UDP_SERVER_DEBUG_TRACE
+                qDebug() << "UDPServer::readDatagramBatch() datagram truncated to" << len;
+#endif
+            }
+
+            if(0 == len)
+            {
+                continue;
+            }
+
+            rxPacketCnt++;
+            rxTotalBytesSize += len;
+
+            updateClientRx(peerId, len, nowInMs);
+
+            if(NULL != seqAnalyzer)
+            {
+                // Arrival of each datagram, recvmmsg() returns the whole batch at once
+                int64_t arrivalInUs = nowInUs;
+                int64_t stampInUs = datagramBatch->getTimestampInUs(i);
+
+                if(stampInUs >= 0 && lastStampInUs >= stampInUs)
+                {
+                    arrivalInUs = nowInUs - (lastStampInUs - stampInUs);
+                }
+
+                seqAnalyzer->analyze(peerId, datagramBatch->getData(i), len, arrivalInUs);
+            }
+
+            if(index != -1)
+            {
+                // Emit signal
+                emit newDataReady(index);
+
+                if(rxSignalFlag)
+                {
+                    emit newDataReady(index, QByteArray(datagramBatch->getData(i), len));
+                }
+            }
+
+            if(batchSignalFlag)
+            {
+                struct UDP_DATAGRAM datagram;
+                datagram.data = QByteArray(datagramBatch->getData(i), len);
+                datagram.address = clientAddr;
+                datagram.port = clientPort;
+
+                datagramList.append(datagram);
+            }
+        }
+
+        if(batchSignalFlag && !datagramList.isEmpty())
+        {
+            // Emit signal
+            emit newDatagramBatch(datagramList);
+        }
+
+        // Socket is drained
+        if((uint32_t)cnt < datagramBatch->getBatchCnt())
+        {
+            break;
+        }
     }
 }
 
@@ -192,22 +375,43 @@ QHostAddress UDPServer::getHostAddress() const
 
 uint32_t UDPServer::getConnectionCount() const
 {
-    return clientList.size();
+    return peerTable->getPeerCnt();
 }
 
 QString UDPServer::getClientInfo(uint32_t clientIndex)
 {
     QString infoStr = "";
-    if(clientIndex < (uint32_t)clientList.size())
+    const struct UDP_PEER_INFO *peerP = peerTable->getPeer(peerTable->getPeerId(clientIndex));
+
+    if(NULL != peerP)
     {
-        infoStr = clientList[clientIndex].address.toString();
+        infoStr = peerP->address.toString();
         infoStr.append(":");
-        infoStr.append(QString::number(clientList[clientIndex].port));
+        infoStr.append(QString::number(peerP->port));
     }
 
     return infoStr;
 }
 
+uint32_t UDPServer::getClientId(uint32_t clientIndex) const
+{
+    return peerTable->getPeerId(clientIndex);
+}
+
+bool UDPServer::getClientStat(uint32_t clientIndex, struct UDP_PEER_INFO &info) const
+{
+    const struct UDP_PEER_INFO *peerP = peerTable->getPeer(peerTable->getPeerId(clientIndex));
+
+    if(NULL == peerP)
+    {
+        return false;
+    }
+
+    info = *peerP;
+
+    return true;
+}
+
 bool UDPServer::getUndealData(char *dataP, uint32_t &len)
 {
     bool ret = false;
@@ -239,13 +443,19 @@ bool UDPServer::getUndealData(QByteArray &data)
 
 void UDPServer::sendData(uint32_t clientIndex, const char *data, uint32_t len)
 {
-    if(clientIndex >= (uint32_t)clientList.size())
+    const struct UDP_PEER_INFO *peerP = peerTable->getPeer(peerTable->getPeerId(clientIndex));
+
+    if(NULL == peerP)
     {
         //qDebug("clientIndex %d is out of connections", clientIndex);
         return;
     }
 
-    sendData(clientList[clientIndex].address, clientList[clientIndex].port, data, len);
+    // Copy address, the peer may be removed by slot of newDataTx()
+    QHostAddress address = peerP->address;
+    uint16_t port = peerP->port;
+
+    sendData(address, port, data, len);
 }
 
 void UDPServer::sendData(uint32_t clientIndex, QByteArray &data)
@@ -273,6 +483,13 @@ void UDPServer::sendData(QHostAddress &address, uint16_t port, const char *data,
         txPacketCnt++;
         txTotalBytesSize += len;
 
+        struct UDP_PEER_INFO *peerP = peerTable->getPeer(peerTable->find(address, port));
+        if(NULL != peerP)
+        {
+            peerP->txPacketCnt++;
+            peerP->txBytes += len;
+        }
+
         // Emit signal
         emit newDataTx(address, port, QByteArray(data, len));
     }
@@ -283,82 +500,491 @@ void UDPServer::sendData(QHostAddress &address, uint16_t port, QByteArray &data)
     sendData(address, port, data.constData(), data.size());
 }
 
-void UDPServer::addClientToList(QHostAddress address, uint16_t port)
+uint32_t UDPServer::sendData(QHostAddress &address, uint16_t port, const QList<QByteArray> &datagrams)
 {
-    int index = -1;
+    QMutexLocker locker(&mutex);
 
-    struct INCOMING_CLIENT_INFO temp;
-    temp.address = address;
-    temp.port = port;
+    int sentCnt = -1;
 
-    for(index = 0; index < clientList.size(); index++)
+    // When socket is close, do not send out data
+    if(NULL == udpSocket || datagrams.isEmpty())
+    {
+        return 0;
+    }
+
+    if(NULL != datagramBatch)
     {
-        if(clientList[index].address == address
-                && clientList[index].port == port)
+        sentCnt = datagramBatch->send(udpSocket->socketDescriptor(), datagrams, address, port);
+    }
+
+    // Batch path is not available, send one by one
+    if(sentCnt < 0)
+    {
+        sentCnt = 0;
+
+        while(sentCnt < datagrams.size()
+              && udpSocket->writeDatagram(datagrams.at(sentCnt), address, port) >= 0)
         {
-            break;
+            sentCnt++;
         }
     }
 
-    // If not exist in list, add it to list
-    if(index >= clientList.size())
+    bool txSignalFlag = receivers(SIGNAL(newDataTx(QHostAddress,int,QByteArray))) > 0;
+    struct UDP_PEER_INFO *peerP = peerTable->getPeer(peerTable->find(address, port));
+
+    for(int i = 0; i < sentCnt; i++)
     {
-        clientList.append(temp);
+        txPacketCnt++;
+        txTotalBytesSize += datagrams.at(i).size();
 
-        // Emit signals to notice connection changed
-        emit connectionIn(getClientInfo(clientList.size() - 1));
+        if(NULL != peerP)
+        {
+            peerP->txPacketCnt++;
+            peerP->txBytes += datagrams.at(i).size();
+        }
+
+        if(txSignalFlag)
+        {
+            // Emit signal
+            emit newDataTx(address, port, datagrams.at(i));
+        }
+    }
+
+    return sentCnt;
+}
+
+void UDPServer::setBatchEnabled(bool flag, uint32_t batchCnt, uint32_t maxDatagramSize)
+{
+    {
+        QMutexLocker locker(&mutex);
+
+        batchFlag = flag && DatagramBatch::isSupported();
+        this->batchCnt = batchCnt;
+        batchMaxDatagramSize = maxDatagramSize;
+    }
+
+    // Emit signal
+    emit batchSettingChanged();
+}
+
+bool UDPServer::getBatchFlag() const
+{
+    return batchFlag;
+}
+
+void UDPServer::applyBatchSetting()
+{
+    // sendData() uses the batch under the same lock
+    QMutexLocker locker(&mutex);
+
+    delete datagramBatch;
+    datagramBatch = NULL;
+
+    if(batchFlag)
+    {
+        datagramBatch = new DatagramBatch(batchCnt, batchMaxDatagramSize);
+    }
+}
+
+bool UDPServer::joinMulticastGroup(const QHostAddress &groupAddress, const QNetworkInterface &iface)
+{
+    return joinMulticastGroup(groupAddress, QHostAddress(), iface);
+}
+
+bool UDPServer::joinMulticastGroup(const QHostAddress &groupAddress, const QHostAddress &sourceAddress,
+                                   const QNetworkInterface &iface)
+{
+    QMutexLocker locker(&mutex);
+
+    if(findMembership(groupAddress, sourceAddress, iface) >= 0)
+    {
+        return true;
+    }
+
+    struct MULTICAST_MEMBERSHIP membership;
+    membership.groupAddress = groupAddress;
+    membership.sourceAddress = sourceAddress;
+    membership.iface = iface;
+
+    // Socket is not bound yet, join in startSocket()
+    if(NULL != udpSocket && !applyMembership(membership, true))
+    {
+        return false;
+    }
+
+    membershipList.append(membership);
+
+    return true;
+}
+
+bool UDPServer::leaveMulticastGroup(const QHostAddress &groupAddress, const QNetworkInterface &iface)
+{
+    return leaveMulticastGroup(groupAddress, QHostAddress(), iface);
+}
+
+bool UDPServer::leaveMulticastGroup(const QHostAddress &groupAddress, const QHostAddress &sourceAddress,
+                                    const QNetworkInterface &iface)
+{
+    QMutexLocker locker(&mutex);
+
+    int index = findMembership(groupAddress, sourceAddress, iface);
+    if(index < 0)
+    {
+        return false;
+    }
+
+    bool ret = true;
+    if(NULL != udpSocket)
+    {
+        ret = applyMembership(membershipList.at(index), false);
     }
+
+    membershipList.removeAt(index);
+
+    return ret;
 }
 
-void UDPServer::removeClientFromList(QHostAddress address, uint16_t port)
+uint32_t UDPServer::getMulticastGroupCount() const
 {
-    int index = -1;
-    struct INCOMING_CLIENT_INFO temp;
-    temp.address = address;
-    temp.port = port;
+    return membershipList.size();
+}
 
-    for(index = 0; index < clientList.size(); index++)
+int UDPServer::findMembership(const QHostAddress &groupAddress, const QHostAddress &sourceAddress,
+                              const QNetworkInterface &iface) const
+{
+    for(int i = 0; i < membershipList.size(); i++)
     {
-        if(clientList[index].address == address
-                && clientList[index].port == port)
+        const struct MULTICAST_MEMBERSHIP &membership = membershipList.at(i);
+
+        if(membership.groupAddress == groupAddress
+                && membership.sourceAddress == sourceAddress
+                && membership.iface.index() == iface.index())
         {
-            break;
+            return i;
         }
     }
 
-    // If exist in list, remove it from list
-    if(index < clientList.size())
+    return -1;
+}
+
+bool UDPServer::applyMembership(const struct MULTICAST_MEMBERSHIP &membership, bool joinFlag)
+{
+    bool ret = false;
+    QString logStr;
+
+#ifdef Q_OS_LINUX
+    if(joinFlag)
     {
-        // Emit signals to notice connection changed
-        emit connectionOut(getClientInfo(index));
+        // Only receive the groups joined by this socket, not all groups of the host,
+        // set on every join as a group may be joined after bind
+        int value = 0;
+        setsockopt(udpSocket->socketDescriptor(), IPPROTO_IP, IP_MULTICAST_ALL, &value, sizeof(value));
+    }
+#endif
+
+    if(membership.sourceAddress.isNull())
+    {
+        // Any source, Qt handles IPv4/IPv6 and interface
+        if(membership.iface.isValid())
+        {
+            ret = joinFlag ? udpSocket->joinMulticastGroup(membership.groupAddress, membership.iface)
+                           : udpSocket->leaveMulticastGroup(membership.groupAddress, membership.iface);
+        }
+        else
+        {
+            ret = joinFlag ? udpSocket->joinMulticastGroup(membership.groupAddress)
+                           : udpSocket->leaveMulticastGroup(membership.groupAddress);
+        }
+    }
+    else
+    {
+#ifdef Q_OS_LINUX
+        // Source-specific multicast, protocol independent API of RFC 3678
+        struct group_source_req req;
+        memset(&req, 0, sizeof(req));
+
+        req.gsr_interface = membership.iface.isValid() ? membership.iface.index() : 0;
+
+        int level = IPPROTO_IP;
+        const QHostAddress *addressP[2] = {&membership.groupAddress, &membership.sourceAddress};
+        struct sockaddr_storage *sockAddrP[2] = {&req.gsr_group, &req.gsr_source};
+
+        for(int i = 0; i < 2; i++)
+        {
+            if(QAbstractSocket::IPv4Protocol == addressP[i]->protocol())
+            {
+                struct sockaddr_in *inP = (struct sockaddr_in *)sockAddrP[i];
+                inP->sin_family = AF_INET;
+                inP->sin_addr.s_addr = htonl(addressP[i]->toIPv4Address());
+            }
+            else
+            {
+                struct sockaddr_in6 *in6P = (struct sockaddr_in6 *)sockAddrP[i];
+                Q_IPV6ADDR ipv6 = addressP[i]->toIPv6Address();
+
+                in6P->sin6_family = AF_INET6;
+                memcpy(&in6P->sin6_addr, &ipv6, sizeof(in6P->sin6_addr));
+                level = IPPROTO_IPV6;
+            }
+        }
+
+        ret = (0 == setsockopt(udpSocket->socketDescriptor(), level,
+                               joinFlag ? MCAST_JOIN_SOURCE_GROUP : MCAST_LEAVE_SOURCE_GROUP,
+                               &req, sizeof(req)));
+
+        if(!ret && ENOBUFS == errno)
+        {
+            logStr = tr("Too many multicast groups, check net.ipv4.igmp_max_memberships");
+        }
+#else
+        logStr = tr("Source-specific multicast is only supported on Linux");
+#endif
+    }
+
+    if(!ret)
+    {
+        if(logStr.isEmpty())
+        {
+            logStr = tr("%1 multicast group %2 failed").arg(joinFlag ? tr("Join") : tr("Leave"))
+                    .arg(membership.groupAddress.toString());
+        }
+
+        qDebug() << "UDPServer::applyMembership()" << logStr;
+
+        // Emit signal
+        emit message(logStr);
+    }
+
+    return ret;
+}
+
+void UDPServer::setReceiveBufferSize(int sizeInBytes)
+{
+    QMutexLocker locker(&mutex);
+
+    rxBufferSize = sizeInBytes;
+
+    if(NULL != udpSocket)
+    {
+        applyReceiveBufferSize();
+    }
+}
+
+void UDPServer::applyReceiveBufferSize()
+{
+    if(rxBufferSize <= 0)
+    {
+        return;
+    }
+
+#ifdef Q_OS_UNIX
+    int fd = udpSocket->socketDescriptor();
+
+#ifdef Q_OS_LINUX
+    // SO_RCVBUFFORCE ignores net.core.rmem_max, needs CAP_NET_ADMIN
+    if(0 == setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &rxBufferSize, sizeof(rxBufferSize)))
+    {
+        return;
+    }
+#endif
+
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rxBufferSize, sizeof(rxBufferSize));
 
-        clientList.removeAt(index);
+    if(getReceiveBufferSize() < rxBufferSize)
+    {
+        qDebug() << "UDPServer::applyReceiveBufferSize() limited by system to" << getReceiveBufferSize();
+    }
+#else
+    udpSocket->setSocketOption(QAbstractSocket::ReceiveBufferSizeSocketOption, rxBufferSize);
+#endif
+}
+
+void UDPServer::applyTimestampOption()
+{
+    DatagramBatch::setTimestampEnabled(udpSocket->socketDescriptor(), NULL != seqAnalyzer);
+}
+
+int UDPServer::getReceiveBufferSize() const
+{
+    if(NULL == udpSocket)
+    {
+        return rxBufferSize;
     }
+
+#ifdef Q_OS_UNIX
+    int value = 0;
+    socklen_t len = sizeof(value);
+
+    getsockopt(udpSocket->socketDescriptor(), SOL_SOCKET, SO_RCVBUF, &value, &len);
+
+    return value;
+#else
+    return udpSocket->socketOption(QAbstractSocket::ReceiveBufferSizeSocketOption).toInt();
+#endif
 }
 
-int UDPServer::getClientIndex(QHostAddress address, uint16_t port)
+uint32_t UDPServer::addClientToList(const QHostAddress &address, uint16_t port)
 {
-    int index = -1;
-    struct INCOMING_CLIENT_INFO temp;
-    temp.address = address;
-    temp.port = port;
+    bool newFlag = false;
+    uint32_t peerId = peerTable->insert(address, port, upTimer.elapsed(), &newFlag);
 
-    for(index = 0; index < clientList.size(); index++)
+    // If not exist in list, add it to list
+    if(newFlag)
     {
-        if(clientList[index].address == address
-                && clientList[index].port == port)
+        if(clientIdleTimeoutInMs > 0)
         {
-            break;
+            idleTimerWheel->schedule(peerId, clientIdleTimeoutInMs);
         }
+
+        // Emit signals to notice connection changed
+        emit connectionIn(getClientInfo(peerTable->getPosition(peerId)));
     }
 
+    return peerId;
+}
+
+void UDPServer::removeClientFromList(const QHostAddress &address, uint16_t port)
+{
+    removeClientFromList(peerTable->find(address, port));
+}
+
+void UDPServer::removeClientFromList(uint32_t peerId)
+{
+    int index = peerTable->getPosition(peerId);
+
+    // If exist in list, remove it from list
+    if(index >= 0)
+    {
+        // Emit signals to notice connection changed
+        emit connectionOut(getClientInfo(index));
+
+        idleTimerWheel->cancel(peerId);
+        peerTable->remove(peerId);
+
+        // Peer ID may be reused by a new client
+        if(NULL != seqAnalyzer)
+        {
+            seqAnalyzer->reset(peerId);
+        }
+    }
+}
+
+int UDPServer::getClientIndex(const QHostAddress &address, uint16_t port) const
+{
     // If not exist in list, return -1
-    if(index >= clientList.size())
+    return peerTable->getPosition(peerTable->find(address, port));
+}
+
+void UDPServer::updateClientRx(uint32_t peerId, uint32_t len, int64_t nowInMs)
+{
+    struct UDP_PEER_INFO *peerP = peerTable->getPeer(peerId);
+
+    if(NULL != peerP)
+    {
+        peerP->rxPacketCnt++;
+        peerP->rxBytes += len;
+
+        // Idle timer is not restarted here, it checks last seen time when expired
+        peerP->lastSeenInMs = nowInMs;
+    }
+}
+
+void UDPServer::setClientIdleTimeout(uint32_t timeoutInMs)
+{
+    clientIdleTimeoutInMs = timeoutInMs;
+
+    idleTimerWheel->clear();
+
+    if(0 == clientIdleTimeoutInMs)
     {
-        index = -1;
+        idleCheckTmr->stop();
+        return;
     }
 
-    return index;
+    // Start idle timer of the existing clients
+    for(uint32_t i = 0; i < peerTable->getPeerCnt(); i++)
+    {
+        idleTimerWheel->schedule(peerTable->getPeerId(i), clientIdleTimeoutInMs);
+    }
+
+    lastIdleCheckInMs = upTimer.elapsed();
+    idleCheckTmr->start(idleTimerWheel->getTickInMs());
+}
+
+uint32_t UDPServer::getClientIdleTimeout() const
+{
+    return clientIdleTimeoutInMs;
+}
+
+void UDPServer::setSequenceAnalyzer(SequenceAnalyzer *analyzer)
+{
+    if(analyzer == seqAnalyzer)
+    {
+        return;
+    }
+
+    delete seqAnalyzer;
+    seqAnalyzer = analyzer;
+
+    QMutexLocker locker(&mutex);
+
+    if(NULL != udpSocket)
+    {
+        applyTimestampOption();
+    }
+}
+
+bool UDPServer::getSequenceCheckFlag() const
+{
+    return (NULL != seqAnalyzer);
+}
+
+bool UDPServer::getClientSeqStat(uint32_t clientIndex, struct SEQ_STREAM_STAT &stat) const
+{
+    if(NULL == seqAnalyzer)
+    {
+        return false;
+    }
+
+    return seqAnalyzer->getStat(peerTable->getPeerId(clientIndex), stat);
+}
+
+void UDPServer::idleClientCheck()
+{
+    QList<uint32_t> expiredIds;
+    int64_t nowInMs = upTimer.elapsed();
+    uint32_t elapsedInMs = (uint32_t)(nowInMs - lastIdleCheckInMs);
+
+    lastIdleCheckInMs = nowInMs;
+
+    // Late or coalesced ticks of the timer do not delay the timeouts
+    idleTimerWheel->advance(elapsedInMs, expiredIds);
+
+    for(int i = 0; i < expiredIds.size(); i++)
+    {
+        uint32_t peerId = expiredIds.at(i);
+        const struct UDP_PEER_INFO *peerP = peerTable->getPeer(peerId);
+
+        if(NULL == peerP)
+        {
+            continue;
+        }
+
+        int64_t idleInMs = nowInMs - peerP->lastSeenInMs;
+
+        if(idleInMs >= (int64_t)clientIdleTimeoutInMs)
+        {
+#ifdef UDP_SERVER_DEBUG_TRACE
+            qDebug() << "UDPServer::idleClientCheck() remove client" << getClientInfo(peerTable->getPosition(peerId));
+#endif
+            removeClientFromList(peerId);
+        }
+        else
+        {
+            // Rx data after timer started, wait for the rest time
+            idleTimerWheel->schedule(peerId, clientIdleTimeoutInMs - (uint32_t)idleInMs);
+        }
+    }
 }
 
 uint32_t UDPServer::getTxDiagramCnt() const
@@ -381,6 +1007,11 @@ uint32_t UDPServer::getTotalRxBytes() const
     return rxTotalBytesSize;
 }
 
+uint32_t UDPServer::getRxTruncatedCnt() const
+{
+    return rxTruncatedCnt;
+}
+
 void UDPServer::resetTxRxCnt()
 {
     txPacketCnt = 0;
@@ -388,6 +1019,22 @@ void UDPServer::resetTxRxCnt()
 
     txTotalBytesSize = 0;
     rxTotalBytesSize = 0;
+    rxTruncatedCnt = 0;
+
+    for(uint32_t i = 0; i < peerTable->getPeerCnt(); i++)
+    {
+        struct UDP_PEER_INFO *peerP = peerTable->getPeer(peerTable->getPeerId(i));
+
+        peerP->rxPacketCnt = 0;
+        peerP->txPacketCnt = 0;
+        peerP->rxBytes = 0;
+        peerP->txBytes = 0;
+    }
+
+    if(NULL != seqAnalyzer)
+    {
+        seqAnalyzer->resetAll();
+    }
 }
 
 void UDPServer::startCheckTimer()
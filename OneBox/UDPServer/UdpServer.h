@@ -12,11 +12,17 @@ PURPOSE:        UDP Server interface
 #include <QThread>
 #include <QUdpSocket>
 #include <QHostAddress>
+#include <QNetworkInterface>
 #include <QList>
 #include <QMutex>
 #include <QTimer>
+#include <QElapsedTimer>
 
 #include "FifoBuffer.h"
+#include "DatagramBatch.h"
+#include "PeerTable.h"
+#include "SequenceAnalyzer.h"
+#include "TimerWheel.h"
 
 class UDPServer : public QThread
 {
@@ -38,6 +44,36 @@ public:
 
     QString getClientInfo(uint32_t clientIndex);
 
+    // Return the stable peer ID of client, PeerTable::INVALID_ID: not exist
+    uint32_t getClientId(uint32_t clientIndex) const;
+
+    // Get address, tx/rx counters and first/last seen time of client
+    bool getClientStat(uint32_t clientIndex, struct UDP_PEER_INFO &info) const;
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		setClientIdleTimeout
+    PURPOSE:		Remove the client without rx data for a period
+    ARGUMENTS:		uint32_t timeoutInMs -- idle timeout, 0: disabled, client is never removed
+    RETURNS:		None
+    -----------------------------------------------------------------------*/
+    void setClientIdleTimeout(uint32_t timeoutInMs);
+    uint32_t getClientIdleTimeout() const;
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		setSequenceAnalyzer
+    PURPOSE:		Analyze loss/reorder/jitter of each client by sequence field
+    ARGUMENTS:		SequenceAnalyzer *analyzer -- UDPServer takes ownership,
+                                                  NULL: analysis disabled
+    RETURNS:		None
+    -----------------------------------------------------------------------*/
+    void setSequenceAnalyzer(SequenceAnalyzer *analyzer);
+
+    // True: sequence analysis is enabled
+    bool getSequenceCheckFlag() const;
+
+    // Get loss/duplicate/reorder/jitter statistics of client
+    bool getClientSeqStat(uint32_t clientIndex, struct SEQ_STREAM_STAT &stat) const;
+
     // True: if there is undeal data in buffer
     // False: no data in buffer
     bool getUndealData(char *dataP, uint32_t &len);
@@ -51,12 +87,78 @@ public:
     void sendData(QHostAddress &address, uint16_t port, const char *data, uint32_t len);
     void sendData(QHostAddress &address, uint16_t port, QByteArray &data);
 
+    /*-----------------------------------------------------------------------
+    FUNCTION:		sendData
+    PURPOSE:		Send a batch of datagrams to one client, sendmmsg() on Linux
+    ARGUMENTS:		QHostAddress &address               -- client address
+                    uint16_t port                       -- client port
+                    const QList<QByteArray> &datagrams  -- datagrams to send
+    RETURNS:		The count of datagrams sent
+    -----------------------------------------------------------------------*/
+    uint32_t sendData(QHostAddress &address, uint16_t port, const QList<QByteArray> &datagrams);
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		setBatchEnabled
+    PURPOSE:		Enable/disable recvmmsg()/sendmmsg() batch path, Linux only
+    ARGUMENTS:		bool flag                   -- true: enabled
+                    uint32_t batchCnt           -- datagrams per system call
+                    uint32_t maxDatagramSize    -- longer datagram is truncated
+    RETURNS:		None
+    -----------------------------------------------------------------------*/
+    void setBatchEnabled(bool flag, uint32_t batchCnt = DatagramBatch::DEFAULT_BATCH_CNT,
+                         uint32_t maxDatagramSize = DatagramBatch::DEFAULT_MAX_DATAGRAM_SIZE);
+
+    // Get batch path flag
+    bool getBatchFlag() const;
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		joinMulticastGroup
+    PURPOSE:		Join a IPv4/IPv6 multicast group, kept after socket is bound again
+    ARGUMENTS:		const QHostAddress &groupAddress    -- multicast group
+                    const QNetworkInterface &iface      -- interface, invalid: default
+    RETURNS:		True: joined, or saved if socket is not bound yet
+    -----------------------------------------------------------------------*/
+    bool joinMulticastGroup(const QHostAddress &groupAddress, const QNetworkInterface &iface = QNetworkInterface());
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		joinMulticastGroup
+    PURPOSE:		Source-specific join, only receive the group from sourceAddress, Linux only
+    ARGUMENTS:		const QHostAddress &groupAddress    -- multicast group
+                    const QHostAddress &sourceAddress   -- sender of the group
+                    const QNetworkInterface &iface      -- interface, invalid: default
+    RETURNS:		True: joined, or saved if socket is not bound yet
+    -----------------------------------------------------------------------*/
+    bool joinMulticastGroup(const QHostAddress &groupAddress, const QHostAddress &sourceAddress,
+                            const QNetworkInterface &iface = QNetworkInterface());
+
+    // Leave a group joined by joinMulticastGroup()
+    bool leaveMulticastGroup(const QHostAddress &groupAddress, const QNetworkInterface &iface = QNetworkInterface());
+    bool leaveMulticastGroup(const QHostAddress &groupAddress, const QHostAddress &sourceAddress,
+                             const QNetworkInterface &iface = QNetworkInterface());
+
+    // Return the count of joined multicast groups
+    uint32_t getMulticastGroupCount() const;
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		setReceiveBufferSize
+    PURPOSE:		Set SO_RCVBUF of socket, kept after socket is bound again
+    ARGUMENTS:		int sizeInBytes -- buffer size, 0: system default
+    RETURNS:		None
+    -----------------------------------------------------------------------*/
+    void setReceiveBufferSize(int sizeInBytes);
+
+    // Return SO_RCVBUF of socket, the kernel may double or limit the setting
+    int getReceiveBufferSize() const;
+
     uint32_t getTxDiagramCnt() const;
     uint32_t getRxDiagramCnt() const;
 
     uint32_t getTotalTxBytes() const;
     uint32_t getTotalRxBytes() const;
 
+    // Datagrams cut at the max datagram size of the batch path
+    uint32_t getRxTruncatedCnt() const;
+
     // Reset Tx/Rx count
     void resetTxRxCnt();
 
@@ -80,20 +182,20 @@ signals:
     void newDataTx(QHostAddress, int, QByteArray);
     void message(const QString& info);
 
+    // Datagrams got by one recvmmsg(), only emitted in batch path
+    void newDatagramBatch(UDP_DATAGRAM_LIST);
+
     void startListen();
     void stopListen();
 
+    // Batch setting changed, applied in the thread of socket
+    void batchSettingChanged();
+
     void serverChanged(QHostAddress address, int port);
     void connectionChanged(bool connected);
 
 private:
 
-    struct INCOMING_CLIENT_INFO
-    {
-       QHostAddress address;
-       uint16_t port;
-    };
-
     enum
     {
         MAX_ERROR_CNT = 2
@@ -109,12 +211,21 @@ private:
     QHostAddress clientAddr;    // Incoming IP
     uint16_t clientPort;        // Incoming port
 
-    QList<struct INCOMING_CLIENT_INFO> clientList;
+    PeerTable *peerTable;       // Incoming clients
+    QElapsedTimer upTimer;      // Time base of client last seen time
+
+    TimerWheel *idleTimerWheel; // Idle timer of clients, timer ID is peer ID
+    QTimer *idleCheckTmr;       // Drive idleTimerWheel
+    uint32_t clientIdleTimeoutInMs;
+    int64_t lastIdleCheckInMs;  // upTimer of last idleClientCheck(), wheel advances by measured time
+
+    SequenceAnalyzer *seqAnalyzer;  // Sequence analysis of clients, stream ID is peer ID
 
     uint32_t txPacketCnt;
     uint32_t rxPacketCnt;
     uint32_t txTotalBytesSize;
     uint32_t rxTotalBytesSize;
+    uint32_t rxTruncatedCnt;    // Datagrams truncated by the batch path
 
     QMutex mutex;   // Mutex lock
 
@@ -123,22 +234,65 @@ private:
     int lostCheckImMs;      // lost check period in ms
     bool lostCheckEnabled;  // Flag used to enable/disable lost check
 
-    // Add new client to list
-    void addClientToList(QHostAddress address, uint16_t port);
+    DatagramBatch *datagramBatch;   // Batch rx/tx buffer, NULL: batch path disabled
+
+    // Setting of setBatchEnabled(), guarded by mutex until applyBatchSetting()
+    bool batchFlag;
+    uint32_t batchCnt;
+    uint32_t batchMaxDatagramSize;
+
+    struct MULTICAST_MEMBERSHIP
+    {
+        QHostAddress groupAddress;
+        QHostAddress sourceAddress;     // Null: any source
+        QNetworkInterface iface;
+    };
+
+    QList<struct MULTICAST_MEMBERSHIP> membershipList;  // Joined groups, joined again in startSocket()
+    int rxBufferSize;           // SO_RCVBUF, 0: system default
+
+    // Join/leave one group on current socket
+    bool applyMembership(const struct MULTICAST_MEMBERSHIP &membership, bool joinFlag);
+
+    // Index of group in membershipList, -1: not exist
+    int findMembership(const QHostAddress &groupAddress, const QHostAddress &sourceAddress,
+                       const QNetworkInterface &iface) const;
+
+    // Apply rxBufferSize to current socket
+    void applyReceiveBufferSize();
+
+    // Kernel receive time of datagrams while sequence analysis is enabled, jitter of a batch
+    void applyTimestampOption();
+
+    // Read the rest pending datagrams with recvmmsg()
+    void readDatagramBatch();
+
+    // Add new client to list if not exist, return peer ID
+    uint32_t addClientToList(const QHostAddress &address, uint16_t port);
 
     // Remove client from list
-    void removeClientFromList(QHostAddress address, uint16_t port);
+    void removeClientFromList(const QHostAddress &address, uint16_t port);
+    void removeClientFromList(uint32_t peerId);
 
     // According to address & port, get index from list
-    int getClientIndex(QHostAddress address, uint16_t port);
+    int getClientIndex(const QHostAddress &address, uint16_t port) const;
+
+    // Update rx counters and last seen time of client
+    void updateClientRx(uint32_t peerId, uint32_t len, int64_t nowInMs);
 
 private slots:
     void readPendingDatagrams();
+
+    // Replace datagramBatch in the thread of socket, readDatagramBatch() never sees it change
+    void applyBatchSetting();
     void handleError(QAbstractSocket::SocketError errNo);
     void startCheckTimer();    // Start check timer
     void stopCheckTimer();    // Stop check timer
     void lostConnectionCheck();
 
+    // Remove the idle clients
+    void idleClientCheck();
+
     // Start socket
     void startSocket();
 
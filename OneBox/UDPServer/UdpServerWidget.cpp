@@ -28,7 +28,9 @@ UdpServerWidget::UdpServerWidget(QWidget *parent) :
     refreshTimer(new QTimer),
     refreshInMs(1000),
     showTxPacketFlag(true),
-    showRxPacketFlag(true)
+    showRxPacketFlag(true),
+    seqOffset(0),
+    seqSize(4)
 {
     ui->setupUi(this);
 
@@ -107,6 +109,8 @@ void UdpServerWidget::bindModel(UDPServer *serverP)
         isRunning = udpServer->getRunningStatus();
         updateConnectionStatus(isRunning);
 
+        ui->checkBox_seqCheck->setChecked(udpServer->getSequenceCheckFlag());
+
         // If server is not running, start listen
         if(!isRunning)
         {
@@ -177,6 +181,28 @@ void UdpServerWidget::loadSettingFromIniFile()
     }
     ui->lineEdit_listenPort->setText(QString::number(listenPort));
 
+    if(currentSetting->contains("SeqOffset"))
+    {
+        // Load sequence number offset
+        seqOffset = currentSetting->value("SeqOffset").toUInt();
+    }
+    else
+    {
+        // Init the default value
+        currentSetting->setValue("SeqOffset", seqOffset);
+    }
+
+    if(currentSetting->contains("SeqSize"))
+    {
+        // Load sequence number size
+        seqSize = currentSetting->value("SeqSize").toUInt();
+    }
+    else
+    {
+        // Init the default value
+        currentSetting->setValue("SeqSize", seqSize);
+    }
+
     currentSetting->endGroup();
 }
 
@@ -454,6 +480,75 @@ void UdpServerWidget::updateUI()
 
     lastRxPacketCnt = udpServer->getRxDiagramCnt();
     lastTxPacketCnt = udpServer->getTxDiagramCnt();
+
+    updateSeqStat();
+}
+
+void UdpServerWidget::updateSeqStat()
+{
+    struct SEQ_STREAM_STAT stat;
+    int64_t lostCnt = 0;
+    uint64_t expectedCnt = 0;
+    uint32_t reorderCnt = 0;
+    uint32_t duplicateCnt = 0;
+    double jitterInMs = 0;
+
+    if(!udpServer->getSequenceCheckFlag())
+    {
+        return;
+    }
+
+    uint32_t clientCnt = udpServer->getConnectionCount();
+    uint32_t firstIndex = ui->comboBox_clients->currentIndex();
+    uint32_t lastIndex = firstIndex;
+
+    // The last item is "All", show the sum of all clients and the max jitter
+    if((ui->comboBox_clients->count() - 1) == ui->comboBox_clients->currentIndex())
+    {
+        firstIndex = 0;
+        lastIndex = (clientCnt > 0) ? (clientCnt - 1) : 0;
+    }
+
+    for(uint32_t i = firstIndex; i <= lastIndex && i < clientCnt; i++)
+    {
+        if(udpServer->getClientSeqStat(i, stat))
+        {
+            lostCnt += stat.lostCnt;
+            expectedCnt += stat.expectedCnt;
+            reorderCnt += stat.reorderCnt;
+            duplicateCnt += stat.duplicateCnt;
+
+            if(stat.jitterInMs > jitterInMs)
+            {
+                jitterInMs = stat.jitterInMs;
+            }
+        }
+    }
+
+    QString lostStr = QString::number(lostCnt);
+    if(expectedCnt > 0 && lostCnt > 0)
+    {
+        lostStr.append(QString(" (%1%)").arg(100.0 * lostCnt / expectedCnt, 0, 'f', 3));
+    }
+
+    ui->label_lostCnt->setText(lostStr);
+    ui->label_reorderCnt->setText(QString("%1/%2").arg(reorderCnt).arg(duplicateCnt));
+    ui->label_jitterValue->setText(QString::number(jitterInMs, 'f', 3));
+}
+
+void UdpServerWidget::on_checkBox_seqCheck_clicked(bool checked)
+{
+    if(NULL == udpServer)
+    {
+        return;
+    }
+
+    // Sequence number at seqOffset, see SeqOffset/SeqSize in ini file
+    udpServer->setSequenceAnalyzer(checked ? new SequenceAnalyzer(seqOffset, seqSize) : NULL);
+
+    ui->label_lostCnt->setText("0");
+    ui->label_reorderCnt->setText("0");
+    ui->label_jitterValue->setText("0");
 }
 
 void UdpServerWidget::on_checkBox_hex_clicked(bool checked)
@@ -108,6 +108,8 @@ private slots:
 
     void on_checkBox_showRx_clicked(bool checked);
 
+    void on_checkBox_seqCheck_clicked(bool checked);
+
 private:
     Ui::UdpServerWidget *ui;
 
@@ -129,6 +131,9 @@ private:
 
     bool showTxPacketFlag;  // flag used to enable Tx packet display in log area
     bool showRxPacketFlag;  // flag used to enable Rx packet display in log area
+
+    uint32_t seqOffset;     // Offset of sequence number in datagram, for Seq Check
+    uint32_t seqSize;       // Size of sequence number, 1/2/4 bytes
     
     QMutex m_mutex; // Mutex
 
@@ -140,6 +145,9 @@ private:
     // Update setting to ini file
     void updateSettingToFile();
 
+    // Update loss/reorder/jitter of selected client
+    void updateSeqStat();
+
     // Update log in TextEdit area
     void updateLogData(QString logStr);
 
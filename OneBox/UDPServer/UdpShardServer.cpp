@@ -0,0 +1,504 @@
+/**********************************************************************
+PACKAGE:        Communication
+FILE:           UdpShardServer.cpp
+COPYRIGHT (C):  All rights reserved.
+
+PURPOSE:        Multi-thread UDP Server with SO_REUSEPORT sockets
+**********************************************************************/
+
+#include "UdpShardServer.h"
+#include <QMutexLocker>
+#include <QDebug>
+#include <string.h>
+
+#ifdef Q_OS_LINUX
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+//#define UDP_SHARD_SERVER_DEBUG_TRACE
+
+UDPShardWorker::UDPShardWorker(int shardIndex, int socketFd, int coreIndex, bool batchSignalFlag, QObject *parent) :
+    QThread(parent),
+    m_shardIndex(shardIndex),
+    m_socketFd(socketFd),
+    m_coreIndex(coreIndex),
+    m_batchSignalFlag(batchSignalFlag),
+    stopFlag(false),
+    fifoBuf(NULL),
+    datagramBatch(new DatagramBatch),
+    rxPacketCnt(0),
+    rxTotalBytesSize(0),
+    rxBatchCnt(0)
+{
+    // A datagram received whole is stored whole
+    fifoBuf = new FIFOBuffer(FIFO_DEPTH, datagramBatch->getMaxDatagramSize());
+}
+
+UDPShardWorker::~UDPShardWorker()
+{
+    stopWorker();
+
+    delete fifoBuf;
+    delete datagramBatch;
+}
+
+void UDPShardWorker::run()
+{
+#ifdef Q_OS_LINUX
+    pinToCore();
+
+    struct pollfd pollFd;
+    pollFd.fd = m_socketFd;
+    pollFd.events = POLLIN;
+
+    while(!stopFlag)
+    {
+        // Wait with timeout, so stopFlag is checked even without data
+        pollFd.revents = 0;
+        if(poll(&pollFd, 1, POLL_TIMEOUT_IN_MS) <= 0)
+        {
+            continue;
+        }
+
+        // Drain the socket
+        while(!stopFlag)
+        {
+            int cnt = datagramBatch->receive(m_socketFd);
+            if(cnt <= 0)
+            {
+                break;
+            }
+
+            UDP_DATAGRAM_LIST datagramList;
+
+            // Push the whole batch and count it with one lock, counters are read by other threads
+            {
+                QMutexLocker locker(&mutex);
+
+                for(int i = 0; i < cnt; i++)
+                {
+                    fifoBuf->pushData(datagramBatch->getData(i), datagramBatch->getSize(i));
+
+                    rxPacketCnt++;
+                    rxTotalBytesSize += datagramBatch->getSize(i);
+                }
+
+                rxBatchCnt++;
+            }
+
+            for(int i = 0; i < cnt; i++)
+            {
+                if(m_batchSignalFlag && datagramBatch->getSize(i) > 0)
+                {
+                    struct UDP_DATAGRAM datagram;
+                    datagram.data = QByteArray(datagramBatch->getData(i), datagramBatch->getSize(i));
+                    datagram.address = datagramBatch->getAddress(i);
+                    datagram.port = datagramBatch->getPort(i);
+
+                    datagramList.append(datagram);
+                }
+            }
+
+            // Emit signal
+            emit newDataReady(m_shardIndex);
+
+            if(!datagramList.isEmpty())
+            {
+                emit newDatagramBatch(datagramList);
+            }
+
+            if((uint32_t)cnt < datagramBatch->getBatchCnt())
+            {
+                break;
+            }
+        }
+    }
+#endif
+}
+
+void UDPShardWorker::stopWorker()
+{
+    stopFlag = true;
+    wait();
+}
+
+void UDPShardWorker::pinToCore()
+{
+#ifdef Q_OS_LINUX
+    if(m_coreIndex < 0)
+    {
+        return;
+    }
+
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    CPU_SET(m_coreIndex, &cpuSet);
+
+    if(0 != pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet))
+    {
+        qDebug() << "UDPShardWorker::pinToCore() failed, core =" << m_coreIndex;
+    }
+#endif
+}
+
+bool UDPShardWorker::getUndealData(char *dataP, uint32_t &len)
+{
+    QMutexLocker locker(&mutex);
+
+    // Pop data from FIFO
+    return fifoBuf->popData(dataP, len);
+}
+
+uint32_t UDPShardWorker::getRxDiagramCnt() const
+{
+    QMutexLocker locker(&mutex);
+
+    return rxPacketCnt;
+}
+
+uint32_t UDPShardWorker::getTotalRxBytes() const
+{
+    QMutexLocker locker(&mutex);
+
+    return rxTotalBytesSize;
+}
+
+uint32_t UDPShardWorker::getRxBatchCnt() const
+{
+    QMutexLocker locker(&mutex);
+
+    return rxBatchCnt;
+}
+
+void UDPShardWorker::resetRxCnt()
+{
+    QMutexLocker locker(&mutex);
+
+    rxPacketCnt = 0;
+    rxTotalBytesSize = 0;
+    rxBatchCnt = 0;
+}
+
+
+UDPShardServer::UDPShardServer(QObject *parent) :
+    QObject(parent),
+    popShardIndex(0),
+    txBatch(new DatagramBatch(1, 1)),
+    txPacketCnt(0),
+    txTotalBytesSize(0),
+    isRunning(false)
+{
+    qRegisterMetaType<UDP_DATAGRAM_LIST>("UDP_DATAGRAM_LIST");
+}
+
+UDPShardServer::~UDPShardServer()
+{
+    stop();
+
+    delete txBatch;
+}
+
+int UDPShardServer::openSocket(const QHostAddress &address, uint16_t port)
+{
+#ifdef Q_OS_LINUX
+    struct sockaddr_storage sockAddr;
+    socklen_t addrLen = 0;
+    int family = AF_INET6;
+
+    memset(&sockAddr, 0, sizeof(sockAddr));
+
+    if(QAbstractSocket::IPv4Protocol == address.protocol())
+    {
+        struct sockaddr_in *inP = (struct sockaddr_in *)&sockAddr;
+        inP->sin_family = AF_INET;
+        inP->sin_port = htons(port);
+        inP->sin_addr.s_addr = htonl(address.toIPv4Address());
+
+        family = AF_INET;
+        addrLen = sizeof(struct sockaddr_in);
+    }
+    else
+    {
+        // IPv6 address, or any address of dual stack
+        struct sockaddr_in6 *in6P = (struct sockaddr_in6 *)&sockAddr;
+        in6P->sin6_family = AF_INET6;
+        in6P->sin6_port = htons(port);
+
+        if(QAbstractSocket::IPv6Protocol == address.protocol())
+        {
+            Q_IPV6ADDR ipv6 = address.toIPv6Address();
+            memcpy(&in6P->sin6_addr, &ipv6, sizeof(in6P->sin6_addr));
+        }
+
+        addrLen = sizeof(struct sockaddr_in6);
+    }
+
+    int fd = socket(family, SOCK_DGRAM, 0);
+    if(fd < 0)
+    {
+        return -1;
+    }
+
+    int value = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &value, sizeof(value));
+
+    if(0 != setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &value, sizeof(value)))
+    {
+        qDebug() << "UDPShardServer::openSocket() SO_REUSEPORT is not supported, errno =" << errno;
+        close(fd);
+        return -1;
+    }
+
+    if(AF_INET6 == family)
+    {
+        // Accept IPv4 on IPv6 socket
+        value = (QAbstractSocket::IPv6Protocol == address.protocol()) ? 1 : 0;
+        setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &value, sizeof(value));
+    }
+
+    if(0 != bind(fd, (struct sockaddr *)&sockAddr, addrLen))
+    {
+        qDebug() << "UDPShardServer::openSocket() bind failed, errno =" << errno;
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+#else
+    Q_UNUSED(address);
+    Q_UNUSED(port);
+
+    return -1;
+#endif
+}
+
+bool UDPShardServer::start(const QHostAddress &address, uint16_t port, uint32_t shardCnt, bool pinFlag)
+{
+    stop();
+
+    if(!DatagramBatch::isSupported())
+    {
+        // Emit signal
+        emit message(tr("UDP shard server is only supported on Linux"));
+        return false;
+    }
+
+    int coreCnt = QThread::idealThreadCount();
+    if(coreCnt <= 0)
+    {
+        coreCnt = 1;
+    }
+
+    if(0 == shardCnt)
+    {
+        shardCnt = coreCnt;
+    }
+
+    // Skip the copy for signals which are not connected
+    bool batchSignalFlag = receivers(SIGNAL(newDatagramBatch(UDP_DATAGRAM_LIST))) > 0;
+
+    for(uint32_t i = 0; i < shardCnt; i++)
+    {
+        int fd = openSocket(address, port);
+        if(fd < 0)
+        {
+            stop();
+
+            // Emit signal
+            emit message(tr("UDP shard server open socket %1 failed").arg(i));
+            return false;
+        }
+
+        socketFdList.append(fd);
+
+        UDPShardWorker *workerP = new UDPShardWorker(i, fd, pinFlag ? (int)(i % coreCnt) : -1, batchSignalFlag);
+
+        // Forward the signals of worker thread, queued to the thread of server
+        connect(workerP, SIGNAL(newDataReady(int)), this, SIGNAL(newDataReady(int)));
+        connect(workerP, SIGNAL(newDatagramBatch(UDP_DATAGRAM_LIST)), this, SIGNAL(newDatagramBatch(UDP_DATAGRAM_LIST)));
+
+        workerList.append(workerP);
+    }
+
+    for(int i = 0; i < workerList.size(); i++)
+    {
+        workerList[i]->start();
+    }
+
+    isRunning = true;
+
+    return true;
+}
+
+void UDPShardServer::stop()
+{
+    for(int i = 0; i < workerList.size(); i++)
+    {
+        workerList[i]->stopWorker();
+        disconnect(workerList[i], 0, this, 0);
+        delete workerList[i];
+    }
+
+    workerList.clear();
+
+#ifdef Q_OS_LINUX
+    for(int i = 0; i < socketFdList.size(); i++)
+    {
+        close(socketFdList[i]);
+    }
+#endif
+
+    socketFdList.clear();
+    popShardIndex = 0;
+
+    isRunning = false;
+}
+
+bool UDPShardServer::getUndealData(char *dataP, uint32_t &len)
+{
+    uint32_t shardCnt = workerList.size();
+
+    // Round robin, one shard can not starve the others
+    for(uint32_t i = 0; i < shardCnt; i++)
+    {
+        uint32_t index = (popShardIndex + i) % shardCnt;
+
+        if(workerList[index]->getUndealData(dataP, len))
+        {
+            popShardIndex = (index + 1) % shardCnt;
+            return true;
+        }
+    }
+
+    len = 0;
+
+    return false;
+}
+
+bool UDPShardServer::getUndealData(QByteArray &data)
+{
+    bool ret = false;
+    uint32_t len = 0;
+
+    // Largest slot of the shard FIFOs
+    data.resize(DatagramBatch::DEFAULT_MAX_DATAGRAM_SIZE);
+
+    // Pop data from FIFO
+    ret = getUndealData(data.data(), len);
+
+    // Resize data to the real size
+    data.resize(len);
+
+    return ret;
+}
+
+bool UDPShardServer::sendData(const QHostAddress &address, uint16_t port, const char *data, uint32_t len)
+{
+    QMutexLocker locker(&txMutex);
+
+    if(NULL == data || 0 == len || socketFdList.isEmpty())
+    {
+        return false;
+    }
+
+    QList<QByteArray> datagrams;
+    datagrams.append(QByteArray::fromRawData(data, len));
+
+    if(txBatch->send(socketFdList.at(0), datagrams, address, port) <= 0)
+    {
+        return false;
+    }
+
+    txPacketCnt++;
+    txTotalBytesSize += len;
+
+    return true;
+}
+
+uint32_t UDPShardServer::getRxDiagramCnt() const
+{
+    uint32_t cnt = 0;
+
+    for(int i = 0; i < workerList.size(); i++)
+    {
+        cnt += workerList[i]->getRxDiagramCnt();
+    }
+
+    return cnt;
+}
+
+uint32_t UDPShardServer::getTotalRxBytes() const
+{
+    uint32_t cnt = 0;
+
+    for(int i = 0; i < workerList.size(); i++)
+    {
+        cnt += workerList[i]->getTotalRxBytes();
+    }
+
+    return cnt;
+}
+
+uint32_t UDPShardServer::getTxDiagramCnt() const
+{
+    QMutexLocker locker(&txMutex);
+
+    return txPacketCnt;
+}
+
+uint32_t UDPShardServer::getTotalTxBytes() const
+{
+    QMutexLocker locker(&txMutex);
+
+    return txTotalBytesSize;
+}
+
+uint32_t UDPShardServer::getShardCnt() const
+{
+    return workerList.size();
+}
+
+uint32_t UDPShardServer::getShardRxDiagramCnt(uint32_t shardIndex) const
+{
+    if(shardIndex >= (uint32_t)workerList.size())
+    {
+        return 0;
+    }
+
+    return workerList[shardIndex]->getRxDiagramCnt();
+}
+
+uint32_t UDPShardServer::getShardRxBatchCnt(uint32_t shardIndex) const
+{
+    if(shardIndex >= (uint32_t)workerList.size())
+    {
+        return 0;
+    }
+
+    return workerList[shardIndex]->getRxBatchCnt();
+}
+
+void UDPShardServer::resetTxRxCnt()
+{
+    for(int i = 0; i < workerList.size(); i++)
+    {
+        workerList[i]->resetRxCnt();
+    }
+
+    QMutexLocker locker(&txMutex);
+
+    txPacketCnt = 0;
+    txTotalBytesSize = 0;
+}
+
+bool UDPShardServer::getRunningStatus() const
+{
+    return isRunning;
+}
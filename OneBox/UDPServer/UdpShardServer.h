@@ -0,0 +1,161 @@
+/**********************************************************************
+PACKAGE:        Communication
+FILE:           UdpShardServer.h
+COPYRIGHT (C):  All rights reserved.
+
+PURPOSE:        Multi-thread UDP Server with SO_REUSEPORT sockets
+**********************************************************************/
+
+#ifndef UDPSHARDSERVER_H
+#define UDPSHARDSERVER_H
+
+#include <QObject>
+#include <QThread>
+#include <QHostAddress>
+#include <QList>
+#include <QMutex>
+
+#include "FifoBuffer.h"
+#include "DatagramBatch.h"
+
+/*
+ UDPShardServer opens shardCnt sockets on the same address and port with
+ SO_REUSEPORT, each socket is read by its own UDPShardWorker thread,
+
+ shard 0: socket0 -> UDPShardWorker0 -> fifoBuf0 --+
+ shard 1: socket1 -> UDPShardWorker1 -> fifoBuf1 --+--> getUndealData()
+ ...                                               |
+ shard n: socketn -> UDPShardWorkern -> fifoBufn --+
+
+ The kernel selects the socket by the hash of (address, port) of datagram,
+ so all datagrams of one client go to the same shard and keep their order.
+ Linux only, start() returns false on other platforms.
+*/
+
+class UDPShardWorker : public QThread
+{
+    Q_OBJECT
+public:
+    UDPShardWorker(int shardIndex, int socketFd, int coreIndex, bool batchSignalFlag, QObject *parent = 0);
+    virtual ~UDPShardWorker();
+
+    void run();
+
+    // Stop thread, wait until it exits
+    void stopWorker();
+
+    // Pop one datagram from the ring buffer of this shard
+    bool getUndealData(char *dataP, uint32_t &len);
+
+    uint32_t getRxDiagramCnt() const;
+    uint32_t getTotalRxBytes() const;
+    uint32_t getRxBatchCnt() const;
+
+    void resetRxCnt();
+
+signals:
+    // Emitted once per recvmmsg() batch
+    void newDataReady(int shardIndex);
+    void newDatagramBatch(UDP_DATAGRAM_LIST);
+
+private:
+    enum
+    {
+        POLL_TIMEOUT_IN_MS = 100,
+        FIFO_DEPTH = 8000       // Each slot takes the largest datagram of datagramBatch
+    };
+
+    int m_shardIndex;
+    int m_socketFd;
+    int m_coreIndex;            // -1: not pinned
+    bool m_batchSignalFlag;     // True: emit newDatagramBatch()
+
+    volatile bool stopFlag;
+
+    FIFOBuffer *fifoBuf;        // Ring buffer of this shard
+    mutable QMutex mutex;       // Lock between worker and consumer, guards FIFO and counters
+
+    DatagramBatch *datagramBatch;
+
+    uint32_t rxPacketCnt;
+    uint32_t rxTotalBytesSize;
+    uint32_t rxBatchCnt;
+
+    // Pin current thread to core
+    void pinToCore();
+};
+
+
+class UDPShardServer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit UDPShardServer(QObject *parent = 0);
+    virtual ~UDPShardServer();
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		start
+    PURPOSE:		Open shardCnt sockets with SO_REUSEPORT and start the threads
+    ARGUMENTS:		const QHostAddress &address -- listen address
+                    uint16_t port               -- listen port
+                    uint32_t shardCnt           -- count of sockets/threads, 0: one per core
+                    bool pinFlag                -- true: pin thread i to core i
+    RETURNS:		True: all shards started, false: failed
+    -----------------------------------------------------------------------*/
+    bool start(const QHostAddress &address, uint16_t port, uint32_t shardCnt = 0, bool pinFlag = false);
+
+    // Stop all threads and close sockets
+    void stop();
+
+    // True: if there is undeal data in buffer
+    // False: no data in buffer
+    bool getUndealData(char *dataP, uint32_t &len);
+    bool getUndealData(QByteArray &data);
+
+    // Send data with the socket of shard 0
+    bool sendData(const QHostAddress &address, uint16_t port, const char *data, uint32_t len);
+
+    // Aggregated statistics of all shards
+    uint32_t getRxDiagramCnt() const;
+    uint32_t getTotalRxBytes() const;
+    uint32_t getTxDiagramCnt() const;
+    uint32_t getTotalTxBytes() const;
+
+    // Statistics of one shard
+    uint32_t getShardCnt() const;
+    uint32_t getShardRxDiagramCnt(uint32_t shardIndex) const;
+    uint32_t getShardRxBatchCnt(uint32_t shardIndex) const;
+
+    // Reset Tx/Rx count
+    void resetTxRxCnt();
+
+    bool getRunningStatus() const;
+
+signals:
+    // Datagrams are pushed to ring buffer of shard, emitted once per batch
+    void newDataReady(int shardIndex);
+
+    // Datagrams with sender address, emitted if connected before start()
+    void newDatagramBatch(UDP_DATAGRAM_LIST);
+
+    void message(const QString& info);
+
+private:
+    QList<UDPShardWorker *> workerList;
+    QList<int> socketFdList;
+
+    uint32_t popShardIndex;     // Shard to pop first, round robin
+
+    DatagramBatch *txBatch;     // Tx vector for sendData()
+    mutable QMutex txMutex;     // Guards txBatch and Tx counters
+
+    uint32_t txPacketCnt;
+    uint32_t txTotalBytesSize;
+
+    bool isRunning;
+
+    // Open a socket with SO_REUSEPORT, return -1 if failed
+    int openSocket(const QHostAddress &address, uint16_t port);
+};
+
+#endif // UDPSHARDSERVER_H
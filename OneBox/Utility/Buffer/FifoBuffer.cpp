@@ -59,6 +59,82 @@ bool FIFOBuffer::pushData(const char *dataP, uint32_t len)
     return ret;
 }
 
+char *FIFOBuffer::getPushBuffer()
+{
+    return fifoBufferP[bufferPushIndex];
+}
+
+bool FIFOBuffer::commitData(uint32_t len)
+{
+    bool ret = false;
+
+    if(0 == len)
+    {
+        return ret;
+    }
+
+    if(len >= bufferSize)
+    {
+        len = bufferSize;
+    }
+
+    // Data is already in buffer, store write length
+    sizeIndex[bufferPushIndex] = len;
+
+    // Move forward index
+    bufferPushIndex = (bufferPushIndex + 1) % bufferDepth;
+
+    ret = true;
+
+#ifdef FIFO_BUFFER_DEBUG_TRACE
+    qDebug() << "commitData() bufferPushIndex = " << bufferPushIndex << "len = " << len;
+#endif
+
+    return ret;
+}
+
+uint32_t FIFOBuffer::getCount() const
+{
+    // Push index equals pop index when empty or full
+    if(bufferPushIndex == bufferPopIndex)
+    {
+        return (0 == sizeIndex[bufferPopIndex]) ? 0 : bufferDepth;
+    }
+
+    return (bufferPushIndex + bufferDepth - bufferPopIndex) % bufferDepth;
+}
+
+char *FIFOBuffer::getData(uint32_t index, uint32_t &len)
+{
+    if(index >= getCount())
+    {
+        len = 0;
+        return NULL;
+    }
+
+    index = (bufferPopIndex + index) % bufferDepth;
+    len = sizeIndex[index];
+
+    return fifoBufferP[index];
+}
+
+bool FIFOBuffer::updateData(uint32_t index, uint32_t len)
+{
+    if(index >= getCount() || 0 == len)
+    {
+        return false;
+    }
+
+    if(len >= bufferSize)
+    {
+        len = bufferSize;
+    }
+
+    sizeIndex[(bufferPopIndex + index) % bufferDepth] = len;
+
+    return true;
+}
+
 bool FIFOBuffer::popData(char *dataP, uint32_t &len)
 {
     bool ret = false;
@@ -86,9 +162,6 @@ bool FIFOBuffer::popData(char *dataP, uint32_t &len)
     memcpy(dataP, fifoBufferP[bufferPopIndex], sizeIndex[bufferPopIndex]);
     len = sizeIndex[bufferPopIndex];
 
-    // Pop succeed, clear this bufferPopIndex area
-    memset(fifoBufferP[bufferPopIndex], 0, bufferSize);
-
     // Clear index size, it means there's no data and writeable
     sizeIndex[bufferPopIndex] = 0;
 
@@ -33,6 +33,21 @@ public:
     // Read data from buffer
     bool popData(char *dataP, uint32_t &len);
 
+    // Buffer of next push, getSize() bytes, fill it in place then call commitData()
+    char *getPushBuffer();
+
+    // Push len bytes already written to getPushBuffer()
+    bool commitData(uint32_t len);
+
+    // Count of entries waiting to be popped
+    uint32_t getCount() const;
+
+    // Entry index counted from the next pop, NULL if not queued, may be rewritten in place
+    char *getData(uint32_t index, uint32_t &len);
+
+    // Set length of entry index after rewriting it in place
+    bool updateData(uint32_t index, uint32_t len);
+
     // Clear FIFO buffer
     void clear();
 
@@ -10,6 +10,17 @@ PURPOSE:        CRC calculation
 
 CRCUtility::CRCUtility()
 {
+    for(uint32_t i = 0; i < 256; i++)
+    {
+        uint32_t value = i;
+
+        for(int j = 0; j < 8; j++)
+        {
+            value = (value & 1) ? ((value >> 1) ^ 0xEDB88320) : (value >> 1);
+        }
+
+        crc32Table[i] = value;
+    }
 }
 
 CRCUtility::~CRCUtility()
@@ -68,3 +79,14 @@ uint16_t CRCUtility::modbus_crc16(const uint8_t *dataP, uint16_t length)
     return cr;
 }
 
+uint32_t CRCUtility::crc32(uint32_t crc, const uint8_t *dataP, uint32_t length)
+{
+    crc = ~crc;
+
+    for(uint32_t i = 0; i < length; i++)
+    {
+        crc = crc32Table[(crc ^ dataP[i]) & 0xff] ^ (crc >> 8);
+    }
+
+    return ~crc;
+}
@@ -41,7 +41,19 @@ public:
     RETURNS:        Return 16-bit crc value
     -----------------------------------------------------------------------*/
     uint16_t modbus_crc16(const uint8_t *dataP, uint16_t length);
-    
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:       crc32
+    PURPOSE:        calculate CRC-32 (IEEE 802.3, same as zlib) incrementally
+    ARGUMENTS:      uint32_t crc, CRC of the data before, 0 for the first block
+                    const uint8_t *dataP, data buffer pointer
+                    uint32_t length, data length
+    RETURNS:        Return 32-bit crc value of all data so far
+    -----------------------------------------------------------------------*/
+    uint32_t crc32(uint32_t crc, const uint8_t *dataP, uint32_t length);
+
+private:
+    uint32_t crc32Table[256];   // Table of reflected polynomial 0xEDB88320
 };
 
 #endif // CRCUTILITY_H
@@ -0,0 +1,467 @@
+/**********************************************************************
+PACKAGE:        Utility
+FILE:           StreamFramer.cpp
+COPYRIGHT (C):  All rights reserved.
+
+PURPOSE:        Split a TCP byte stream into whole messages
+**********************************************************************/
+
+#include "StreamFramer.h"
+#include <string.h>
+
+//#define STREAM_FRAMER_DEBUG_TRACE
+
+#ifdef STREAM_FRAMER_DEBUG_TRACE
+#include <QDebug>
+#endif
+
+StreamFramer::StreamFramer() :
+    maxFrameSize(DEFAULT_MAX_FRAME_SIZE),
+    dropBytesCnt(0)
+{
+}
+
+StreamFramer::~StreamFramer()
+{
+}
+
+int StreamFramer::pushData(const char *dataP, uint32_t len, QList<QByteArray> &frames)
+{
+    int cnt = 0;
+    const char *headP = NULL;
+    uint32_t readPos = 0;
+    uint32_t totalLen = 0;
+    bool inPlace = false;
+
+    if(NULL == dataP || 0 == len)
+    {
+        return cnt;
+    }
+
+    // No undealt data, parse the incoming chunk in place to avoid one copy
+    // Otherwise append it to the undealt data of last call
+    inPlace = rxBuf.isEmpty();
+    if(!inPlace)
+    {
+        rxBuf.append(dataP, len);
+    }
+
+    while(true)
+    {
+        headP = inPlace ? dataP : rxBuf.constData();
+        totalLen = inPlace ? len : (uint32_t)rxBuf.size();
+
+        if(readPos >= totalLen)
+        {
+            break;
+        }
+
+        uint32_t undealLen = totalLen - readPos;
+        int frameLen = checkFrame(headP + readPos, undealLen);
+
+        if(frameLen > 0)
+        {
+            frames.append(getPayload(headP + readPos, frameLen));
+            readPos += frameLen;
+            cnt++;
+
+            resetState();
+        }
+        else if(frameLen < 0 || undealLen > maxFrameSize)
+        {
+#ifdef STREAM_FRAMER_DEBUG_TRACE
+            qDebug() << "StreamFramer::pushData() drop invalid data, len =" << undealLen;
+#endif
+            // Invalid message, drop all undealt data and resync with next chunk
+            dropBytesCnt += undealLen;
+            readPos += undealLen;
+
+            resetState();
+        }
+        else
+        {
+            // Wait for the rest of message
+            break;
+        }
+    }
+
+    if(inPlace)
+    {
+        // Keep the incomplete tail for next call
+        if(readPos < len)
+        {
+            rxBuf.append(dataP + readPos, len - readPos);
+        }
+    }
+    else if(readPos > 0)
+    {
+        rxBuf.remove(0, readPos);
+    }
+
+    return cnt;
+}
+
+int StreamFramer::pushData(const QByteArray &data, QList<QByteArray> &frames)
+{
+    return pushData(data.constData(), data.size(), frames);
+}
+
+void StreamFramer::clear()
+{
+    rxBuf.clear();
+    resetState();
+}
+
+uint32_t StreamFramer::getPendingSize() const
+{
+    return rxBuf.size();
+}
+
+void StreamFramer::setMaxFrameSize(uint32_t maxSize)
+{
+    if(maxSize > 0)
+    {
+        maxFrameSize = maxSize;
+    }
+}
+
+uint32_t StreamFramer::getMaxFrameSize() const
+{
+    return maxFrameSize;
+}
+
+uint32_t StreamFramer::getDropBytesCnt() const
+{
+    return dropBytesCnt;
+}
+
+QByteArray StreamFramer::getPayload(const char *dataP, uint32_t frameLen) const
+{
+    return QByteArray(dataP, frameLen);
+}
+
+
+LengthPrefixFramer::LengthPrefixFramer(uint32_t lengthOffset, uint32_t lengthSize,
+                                       bool bigEndian, int32_t lengthAdjust) :
+    m_lengthOffset(lengthOffset),
+    m_lengthSize(lengthSize),
+    m_bigEndian(bigEndian),
+    m_lengthAdjust(lengthAdjust),
+    expectedLen(0)
+{
+    // Only 1/2/4 bytes length field is supported
+    if(m_lengthSize != 1 && m_lengthSize != 2 && m_lengthSize != 4)
+    {
+        m_lengthSize = 2;
+    }
+}
+
+LengthPrefixFramer::~LengthPrefixFramer()
+{
+}
+
+StreamFramer *LengthPrefixFramer::clone() const
+{
+    LengthPrefixFramer *framerP = new LengthPrefixFramer(m_lengthOffset, m_lengthSize, m_bigEndian, m_lengthAdjust);
+    framerP->setMaxFrameSize(maxFrameSize);
+
+    return framerP;
+}
+
+int LengthPrefixFramer::checkFrame(const char *dataP, uint32_t len)
+{
+    uint32_t headerLen = m_lengthOffset + m_lengthSize;
+
+    // Decode length field only once per message
+    if(0 == expectedLen)
+    {
+        if(len < headerLen)
+        {
+            return 0;
+        }
+
+        const uint8_t *lenP = (const uint8_t *)dataP + m_lengthOffset;
+        uint32_t value = 0;
+
+        for(uint32_t i = 0; i < m_lengthSize; i++)
+        {
+            if(m_bigEndian)
+            {
+                value = (value << 8) | lenP[i];
+            }
+            else
+            {
+                value |= (uint32_t)lenP[i] << (8 * i);
+            }
+        }
+
+        int64_t frameLen = (int64_t)value + m_lengthAdjust;
+        if(frameLen < (int64_t)headerLen || frameLen > (int64_t)maxFrameSize)
+        {
+            return -1;
+        }
+
+        expectedLen = (uint32_t)frameLen;
+    }
+
+    return (len >= expectedLen) ? (int)expectedLen : 0;
+}
+
+void LengthPrefixFramer::resetState()
+{
+    expectedLen = 0;
+}
+
+
+DelimiterFramer::DelimiterFramer(const QByteArray &delimiter, bool stripDelimiter) :
+    m_delimiter(delimiter),
+    m_stripDelimiter(stripDelimiter),
+    scannedLen(0)
+{
+    if(m_delimiter.isEmpty())
+    {
+        m_delimiter = QByteArray("\n");
+    }
+}
+
+DelimiterFramer::~DelimiterFramer()
+{
+}
+
+StreamFramer *DelimiterFramer::clone() const
+{
+    DelimiterFramer *framerP = new DelimiterFramer(m_delimiter, m_stripDelimiter);
+    framerP->setMaxFrameSize(maxFrameSize);
+
+    return framerP;
+}
+
+int DelimiterFramer::checkFrame(const char *dataP, uint32_t len)
+{
+    uint32_t delimiterLen = m_delimiter.size();
+    char lastChar = m_delimiter.at(delimiterLen - 1);
+
+    // Continue from where last scan stopped, search the last delimiter char
+    // then compare the chars before it
+    uint32_t pos = (scannedLen > delimiterLen - 1) ? scannedLen : (delimiterLen - 1);
+
+    while(pos < len)
+    {
+        const char *foundP = (const char *)memchr(dataP + pos, lastChar, len - pos);
+        if(NULL == foundP)
+        {
+            break;
+        }
+
+        pos = foundP - dataP;
+        if(0 == memcmp(foundP - (delimiterLen - 1), m_delimiter.constData(), delimiterLen - 1))
+        {
+            return pos + 1;
+        }
+
+        pos++;
+    }
+
+    scannedLen = len;
+
+    return 0;
+}
+
+void DelimiterFramer::resetState()
+{
+    scannedLen = 0;
+}
+
+QByteArray DelimiterFramer::getPayload(const char *dataP, uint32_t frameLen) const
+{
+    if(m_stripDelimiter)
+    {
+        frameLen -= m_delimiter.size();
+    }
+
+    return QByteArray(dataP, frameLen);
+}
+
+
+FixedSizeFramer::FixedSizeFramer(uint32_t frameSize) :
+    m_frameSize(frameSize)
+{
+    if(0 == m_frameSize)
+    {
+        m_frameSize = 1;
+    }
+}
+
+FixedSizeFramer::~FixedSizeFramer()
+{
+}
+
+StreamFramer *FixedSizeFramer::clone() const
+{
+    FixedSizeFramer *framerP = new FixedSizeFramer(m_frameSize);
+    framerP->setMaxFrameSize(maxFrameSize);
+
+    return framerP;
+}
+
+int FixedSizeFramer::checkFrame(const char *dataP, uint32_t len)
+{
+    Q_UNUSED(dataP);
+
+    if(m_frameSize > maxFrameSize)
+    {
+        return -1;
+    }
+
+    return (len >= m_frameSize) ? (int)m_frameSize : 0;
+}
+
+void FixedSizeFramer::resetState()
+{
+}
+
+
+MbapFramer::MbapFramer() :
+    // Length field at byte 4-5, ADU length = 6 + length field
+    LengthPrefixFramer(4, 2, true, 6)
+{
+    setMaxFrameSize(MBAP_MAX_ADU_LEN);
+}
+
+MbapFramer::~MbapFramer()
+{
+}
+
+StreamFramer *MbapFramer::clone() const
+{
+    return new MbapFramer;
+}
+
+int MbapFramer::checkFrame(const char *dataP, uint32_t len)
+{
+    // Protocol ID at byte 2-3 shall be 0x0000 for Modbus
+    if(len >= 4 && (0 != dataP[2] || 0 != dataP[3]))
+    {
+        return -1;
+    }
+
+    int frameLen = LengthPrefixFramer::checkFrame(dataP, len);
+
+    // At least unit ID + function code
+    if(frameLen > 0 && frameLen < MBAP_HEADER_LEN + 1)
+    {
+        frameLen = -1;
+    }
+
+    return frameLen;
+}
+
+
+ModbusAsciiFramer::ModbusAsciiFramer() :
+    DelimiterFramer(QByteArray("\r\n"), true)
+{
+    setMaxFrameSize(ASCII_MAX_ADU_LEN);
+}
+
+ModbusAsciiFramer::~ModbusAsciiFramer()
+{
+}
+
+StreamFramer *ModbusAsciiFramer::clone() const
+{
+    return new ModbusAsciiFramer;
+}
+
+QByteArray ModbusAsciiFramer::getPayload(const char *dataP, uint32_t frameLen) const
+{
+    uint32_t endPos = frameLen - 2;     // CRLF
+    const char *startP = NULL;
+    const char *foundP = (const char *)memchr(dataP, ':', endPos);
+
+    // Message starts after the last ':', usually the first char of line
+    while(NULL != foundP)
+    {
+        startP = foundP + 1;
+        foundP = (const char *)memchr(startP, ':', dataP + endPos - startP);
+    }
+
+    if(NULL == startP)
+    {
+#ifdef STREAM_FRAMER_DEBUG_TRACE
+        qDebug() << "ModbusAsciiFramer::getPayload() line without ':', len =" << frameLen;
+#endif
+        return QByteArray();
+    }
+
+    return QByteArray(startP, dataP + endPos - startP);
+}
+
+
+ModbusRtuFramer::ModbusRtuFramer()
+{
+    setMaxFrameSize(RTU_MAX_ADU_LEN);
+}
+
+ModbusRtuFramer::~ModbusRtuFramer()
+{
+}
+
+StreamFramer *ModbusRtuFramer::clone() const
+{
+    return new ModbusRtuFramer;
+}
+
+int ModbusRtuFramer::checkFrame(const char *dataP, uint32_t len)
+{
+    uint32_t frameLen = 0;
+
+    if(len < RTU_HEADER_LEN)
+    {
+        return 0;
+    }
+
+    uint8_t functionCode = (uint8_t)dataP[1];
+
+    if(0 != (functionCode & 0x80))
+    {
+        frameLen = RTU_HEADER_LEN + 1 + RTU_CRC_LEN;
+    }
+    else
+    {
+        switch(functionCode)
+        {
+        case 0x01:
+        case 0x02:
+        case 0x03:
+        case 0x04:
+        case 0x14:
+        case 0x15:
+        case 0x17:
+            // Byte count follows the function code
+            if(len < RTU_HEADER_LEN + 1)
+            {
+                return 0;
+            }
+
+            frameLen = RTU_HEADER_LEN + 1 + (uint8_t)dataP[2] + RTU_CRC_LEN;
+            break;
+        case 0x05:
+        case 0x06:
+        case 0x0F:
+        case 0x10:
+            frameLen = RTU_HEADER_LEN + 4 + RTU_CRC_LEN;
+            break;
+        default:
+#ifdef STREAM_FRAMER_DEBUG_TRACE
+            qDebug() << "ModbusRtuFramer::checkFrame() unknown function code" << functionCode;
+#endif
+            return -1;
+        }
+    }
+
+    return (len >= frameLen) ? (int)frameLen : 0;
+}
+
+void ModbusRtuFramer::resetState()
+{
+}
@@ -0,0 +1,248 @@
+/**********************************************************************
+PACKAGE:        Utility
+FILE:           StreamFramer.h
+COPYRIGHT (C):  All rights reserved.
+
+PURPOSE:        Split a TCP byte stream into whole messages
+**********************************************************************/
+
+#ifndef STREAMFRAMER_H
+#define STREAMFRAMER_H
+
+#include <stdint.h>
+#include <QByteArray>
+#include <QList>
+
+/*
+ StreamFramer keeps the undealt bytes of one connection and cuts whole
+ messages out of them. The parsing is incremental, each subclass remembers
+ how far it has already scanned, so every received byte is inspected once
+ no matter how many readyRead() chunks a message is split into.
+
+ Every connection must own its framer instance, use clone() to create a
+ new framer with the same settings from a prototype.
+*/
+
+class StreamFramer
+{
+public:
+    StreamFramer();
+    virtual ~StreamFramer();
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		clone
+    PURPOSE:		Create a new framer with the same settings and empty buffer
+    ARGUMENTS:		None
+    RETURNS:		New framer, the caller owns it
+    -----------------------------------------------------------------------*/
+    virtual StreamFramer *clone() const = 0;
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		pushData
+    PURPOSE:		Append stream data and extract the complete messages
+    ARGUMENTS:		const char *dataP           -- received data pointer
+                    uint32_t len                -- received data length
+                    QList<QByteArray> &frames   -- complete messages appended here
+    RETURNS:		The count of messages extracted
+    -----------------------------------------------------------------------*/
+    int pushData(const char *dataP, uint32_t len, QList<QByteArray> &frames);
+    int pushData(const QByteArray &data, QList<QByteArray> &frames);
+
+    // Drop the undealt bytes, e.g. when the connection is re-established
+    void clear();
+
+    // Return the size of bytes waiting for the rest of a message
+    uint32_t getPendingSize() const;
+
+    // Messages longer than maxSize are treated as garbage and dropped
+    void setMaxFrameSize(uint32_t maxSize);
+    uint32_t getMaxFrameSize() const;
+
+    // Return the count of bytes dropped because of invalid message
+    uint32_t getDropBytesCnt() const;
+
+protected:
+    enum
+    {
+        DEFAULT_MAX_FRAME_SIZE = 65536
+    };
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		checkFrame
+    PURPOSE:		Check whether a complete message starts at dataP
+    ARGUMENTS:		const char *dataP   -- start of the undealt data
+                    uint32_t len        -- length of the undealt data
+    RETURNS:		> 0, length of the complete message
+                    0, need more data
+                    < 0, invalid data, the undealt data will be dropped
+    -----------------------------------------------------------------------*/
+    virtual int checkFrame(const char *dataP, uint32_t len) = 0;
+
+    // Reset the scan state, called after a message is extracted or dropped
+    virtual void resetState() = 0;
+
+    // Return the part of message reported to host, default is whole message
+    virtual QByteArray getPayload(const char *dataP, uint32_t frameLen) const;
+
+    uint32_t maxFrameSize;
+
+private:
+    QByteArray rxBuf;       // Undealt data of this connection
+    uint32_t dropBytesCnt;  // Count of dropped bytes
+};
+
+
+// Message with length field in header, e.g. [len_hi][len_lo][payload...]
+class LengthPrefixFramer : public StreamFramer
+{
+public:
+    /*-----------------------------------------------------------------------
+    FUNCTION:		LengthPrefixFramer
+    PURPOSE:		Construct a length-prefixed framer
+    ARGUMENTS:		uint32_t lengthOffset   -- offset of length field in header
+                    uint32_t lengthSize     -- size of length field, 1/2/4 bytes
+                    bool bigEndian          -- byte order of length field
+                    int32_t lengthAdjust    -- message length = length field + lengthAdjust
+    RETURNS:		None
+    -----------------------------------------------------------------------*/
+    LengthPrefixFramer(uint32_t lengthOffset = 0, uint32_t lengthSize = 2,
+                       bool bigEndian = true, int32_t lengthAdjust = 2);
+    virtual ~LengthPrefixFramer();
+
+    virtual StreamFramer *clone() const;
+
+protected:
+    virtual int checkFrame(const char *dataP, uint32_t len);
+    virtual void resetState();
+
+    uint32_t m_lengthOffset;
+    uint32_t m_lengthSize;
+    bool m_bigEndian;
+    int32_t m_lengthAdjust;
+
+private:
+    uint32_t expectedLen;   // Message length decoded from header, 0: header not complete
+};
+
+
+// Message terminated by delimiter, e.g. "\r\n"
+class DelimiterFramer : public StreamFramer
+{
+public:
+    // stripDelimiter, true: report message without delimiter
+    DelimiterFramer(const QByteArray &delimiter = QByteArray("\r\n"), bool stripDelimiter = false);
+    virtual ~DelimiterFramer();
+
+    virtual StreamFramer *clone() const;
+
+protected:
+    virtual int checkFrame(const char *dataP, uint32_t len);
+    virtual void resetState();
+    virtual QByteArray getPayload(const char *dataP, uint32_t frameLen) const;
+
+private:
+    QByteArray m_delimiter;
+    bool m_stripDelimiter;
+    uint32_t scannedLen;    // Bytes already scanned without delimiter found
+};
+
+
+// Message with fixed size
+class FixedSizeFramer : public StreamFramer
+{
+public:
+    explicit FixedSizeFramer(uint32_t frameSize = 1);
+    virtual ~FixedSizeFramer();
+
+    virtual StreamFramer *clone() const;
+
+protected:
+    virtual int checkFrame(const char *dataP, uint32_t len);
+    virtual void resetState();
+
+private:
+    uint32_t m_frameSize;
+};
+
+
+// ModbusTCP ADU, MBAP header length field at byte 4-5 counts unit ID + PDU
+class MbapFramer : public LengthPrefixFramer
+{
+public:
+    MbapFramer();
+    virtual ~MbapFramer();
+
+    virtual StreamFramer *clone() const;
+
+protected:
+    virtual int checkFrame(const char *dataP, uint32_t len);
+
+private:
+    enum
+    {
+        MBAP_HEADER_LEN = 7,
+        MBAP_MAX_ADU_LEN = 260
+    };
+};
+
+
+/*
+ Modbus ASCII ADU, ':' + hex chars + CRLF. The CRLF search of
+ DelimiterFramer is memchr based, vectorized by the C library, and
+ continues where the last chunk stopped. Reported message is the hex
+ chars between the last ':' and CRLF, a ':' inside restarts the message
+ as the standard demands. A line without ':' is reported empty.
+*/
+class ModbusAsciiFramer : public DelimiterFramer
+{
+public:
+    ModbusAsciiFramer();
+    virtual ~ModbusAsciiFramer();
+
+    virtual StreamFramer *clone() const;
+
+protected:
+    virtual QByteArray getPayload(const char *dataP, uint32_t frameLen) const;
+
+private:
+    enum
+    {
+        // ':' + 2 hex chars of 255 bytes (address + PDU of 253 + LRC) + CRLF
+        ASCII_MAX_ADU_LEN = 513
+    };
+};
+
+
+/*
+ Modbus RTU response ADU on a byte stream, e.g. RTU over TCP gateways.
+ RTU has no length field, the length follows from the function code,
+
+    exception (FC | 0x80):          address + FC + code + CRC = 5
+    FC01-04, FC14/15/17:            address + FC + byte count + data + CRC
+    FC05/06/0F/10:                  address + FC + 4 bytes + CRC = 8
+
+ other function codes can not be framed, the undealt data is dropped.
+ CRC is checked by the receiver.
+*/
+class ModbusRtuFramer : public StreamFramer
+{
+public:
+    ModbusRtuFramer();
+    virtual ~ModbusRtuFramer();
+
+    virtual StreamFramer *clone() const;
+
+protected:
+    virtual int checkFrame(const char *dataP, uint32_t len);
+    virtual void resetState();
+
+private:
+    enum
+    {
+        RTU_HEADER_LEN = 2,     // Address + function code
+        RTU_CRC_LEN = 2,
+        RTU_MAX_ADU_LEN = 256
+    };
+};
+
+#endif // STREAMFRAMER_H
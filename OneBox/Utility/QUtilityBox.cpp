@@ -14,6 +14,7 @@ PURPOSE:        General tool box, provide buffer convert function and etc.
 #include <QDateTime>
 #include <QApplication>
 #include <QDebug>
+#include <string.h>
 
 QUtilityBox::QUtilityBox()
 {
@@ -201,31 +202,25 @@ QFileInfoList QUtilityBox::sortFileListByInt(QFileInfoList &list)
 
 QByteArray QUtilityBox::convertFloat32ToInt16(const QByteArray data)
 {
-    QByteArray out;
     const int FLOAT32_BYTES = 4;
-    out.clear();
+    int cnt = data.size() / FLOAT32_BYTES;
 
-    if(!data.isEmpty())
-    {
-        for(int i = 0; i < (data.size() / FLOAT32_BYTES); i++)
-        {
-            QByteArray tmp = data.mid(i * FLOAT32_BYTES, FLOAT32_BYTES);
+    // Output is written in place, no temporary QByteArray per value
+    QByteArray out(cnt * (int)sizeof(int16_t), 0);
+
+    const char *inP = data.constData();
+    int16_t *outP = (int16_t *)out.data();
 
-            float *pfloat = (float *)tmp.data();
-            int16_t value = (int16_t)(*pfloat);
+    for(int i = 0; i < cnt; i++)
+    {
+        float value = 0;
 
-            // Do not work tmp.toFloat();
-            //bool ok;
-            //int16_t value = (int16_t)(tmp.toFloat(&ok));
-            //qDebug("int16 value = %d, float32 value = %f", value, tmp.toFloat());
+        // Data may be unaligned
+        memcpy(&value, inP + i * FLOAT32_BYTES, FLOAT32_BYTES);
 
-            //qDebug("int16 value = %d, float32 *pfloat = %f", value, *pfloat);
-            out.append((char*)&value, sizeof(int16_t));
-        }
+        outP[i] = (int16_t)value;
     }
 
-    //qDebug("out.size() = %d, data.size() = %d", out.size(), data.size());
-
     return out;
 }
 
@@ -0,0 +1,414 @@
+/**********************************************************************
+PACKAGE:        Utility
+FILE:           DatagramBatch.cpp
+COPYRIGHT (C):  All rights reserved.
+
+PURPOSE:        Receive/send a batch of datagrams with one system call
+**********************************************************************/
+
+#include "DatagramBatch.h"
+#include <string.h>
+
+#ifdef Q_OS_LINUX
+#include <errno.h>
+#include <time.h>
+#include <netinet/in.h>
+#endif
+
+DatagramBatch::DatagramBatch(uint32_t batchCnt, uint32_t maxDatagramSize) :
+    m_batchCnt(batchCnt),
+    m_maxDatagramSize(maxDatagramSize),
+    rxCnt(0),
+    slabP(NULL)
+{
+    if(0 == m_batchCnt)
+    {
+        m_batchCnt = DEFAULT_BATCH_CNT;
+    }
+
+    if(0 == m_maxDatagramSize)
+    {
+        m_maxDatagramSize = DEFAULT_MAX_DATAGRAM_SIZE;
+    }
+
+#ifdef Q_OS_LINUX
+    slabP = new char [m_batchCnt * m_maxDatagramSize];
+    msgVecP = new struct mmsghdr [m_batchCnt];
+    iovP = new struct iovec [m_batchCnt];
+    addrP = new struct sockaddr_storage [m_batchCnt];
+    ctrlP = new char [m_batchCnt * CTRL_LEN];
+    txMsgVecP = new struct mmsghdr [m_batchCnt];
+    txIovP = new struct iovec [m_batchCnt];
+
+    memset(msgVecP, 0, sizeof(struct mmsghdr) * m_batchCnt);
+#endif
+}
+
+DatagramBatch::~DatagramBatch()
+{
+    delete []slabP;
+
+#ifdef Q_OS_LINUX
+    delete []msgVecP;
+    delete []iovP;
+    delete []addrP;
+    delete []ctrlP;
+    delete []txMsgVecP;
+    delete []txIovP;
+#endif
+}
+
+bool DatagramBatch::isSupported()
+{
+#ifdef Q_OS_LINUX
+    return true;
+#else
+    return false;
+#endif
+}
+
+int DatagramBatch::receive(int socketFd)
+{
+    rxCnt = 0;
+
+#ifdef Q_OS_LINUX
+    if(socketFd < 0)
+    {
+        return -1;
+    }
+
+    // msg_hdr fields are overwritten by kernel, set them again for every call
+    for(uint32_t i = 0; i < m_batchCnt; i++)
+    {
+        iovP[i].iov_base = slabP + i * m_maxDatagramSize;
+        iovP[i].iov_len = m_maxDatagramSize;
+
+        msgVecP[i].msg_hdr.msg_name = &addrP[i];
+        msgVecP[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+        msgVecP[i].msg_hdr.msg_iov = &iovP[i];
+        msgVecP[i].msg_hdr.msg_iovlen = 1;
+        msgVecP[i].msg_hdr.msg_control = ctrlP + i * CTRL_LEN;
+        msgVecP[i].msg_hdr.msg_controllen = CTRL_LEN;
+        msgVecP[i].msg_hdr.msg_flags = 0;
+        msgVecP[i].msg_len = 0;
+    }
+
+    int ret = -1;
+    do
+    {
+        ret = recvmmsg(socketFd, msgVecP, m_batchCnt, MSG_DONTWAIT, NULL);
+    } while(ret < 0 && EINTR == errno);
+
+    if(ret < 0)
+    {
+        return (EAGAIN == errno || EWOULDBLOCK == errno) ? 0 : -1;
+    }
+
+    rxCnt = ret;
+
+    return ret;
+#else
+    Q_UNUSED(socketFd);
+
+    return -1;
+#endif
+}
+
+uint32_t DatagramBatch::getCount() const
+{
+    return rxCnt;
+}
+
+const char *DatagramBatch::getData(uint32_t index) const
+{
+    if(index >= rxCnt)
+    {
+        return NULL;
+    }
+
+    return slabP + index * m_maxDatagramSize;
+}
+
+uint32_t DatagramBatch::getSize(uint32_t index) const
+{
+#ifdef Q_OS_LINUX
+    if(index < rxCnt)
+    {
+        // msg_len counts the bytes copied to the buffer, clamp it anyway
+        return (msgVecP[index].msg_len > m_maxDatagramSize) ? m_maxDatagramSize : msgVecP[index].msg_len;
+    }
+#else
+    Q_UNUSED(index);
+#endif
+
+    return 0;
+}
+
+bool DatagramBatch::isTruncated(uint32_t index) const
+{
+#ifdef Q_OS_LINUX
+    if(index < rxCnt)
+    {
+        return 0 != (msgVecP[index].msg_hdr.msg_flags & MSG_TRUNC);
+    }
+#else
+    Q_UNUSED(index);
+#endif
+
+    return false;
+}
+
+QHostAddress DatagramBatch::getAddress(uint32_t index) const
+{
+#ifdef Q_OS_LINUX
+    if(index < rxCnt)
+    {
+        return QHostAddress((const struct sockaddr *)&addrP[index]);
+    }
+#else
+    Q_UNUSED(index);
+#endif
+
+    return QHostAddress();
+}
+
+uint16_t DatagramBatch::getPort(uint32_t index) const
+{
+#ifdef Q_OS_LINUX
+    if(index < rxCnt)
+    {
+        if(AF_INET == addrP[index].ss_family)
+        {
+            return ntohs(((const struct sockaddr_in *)&addrP[index])->sin_port);
+        }
+        else if(AF_INET6 == addrP[index].ss_family)
+        {
+            return ntohs(((const struct sockaddr_in6 *)&addrP[index])->sin6_port);
+        }
+    }
+#else
+    Q_UNUSED(index);
+#endif
+
+    return 0;
+}
+
+bool DatagramBatch::isSameSender(uint32_t index1, uint32_t index2) const
+{
+#ifdef Q_OS_LINUX
+    if(index1 >= rxCnt || index2 >= rxCnt)
+    {
+        return false;
+    }
+
+    const struct sockaddr_storage &addr1 = addrP[index1];
+    const struct sockaddr_storage &addr2 = addrP[index2];
+
+    if(addr1.ss_family != addr2.ss_family)
+    {
+        return false;
+    }
+
+    if(AF_INET == addr1.ss_family)
+    {
+        const struct sockaddr_in *in1P = (const struct sockaddr_in *)&addr1;
+        const struct sockaddr_in *in2P = (const struct sockaddr_in *)&addr2;
+
+        return in1P->sin_port == in2P->sin_port
+                && in1P->sin_addr.s_addr == in2P->sin_addr.s_addr;
+    }
+    else if(AF_INET6 == addr1.ss_family)
+    {
+        const struct sockaddr_in6 *in1P = (const struct sockaddr_in6 *)&addr1;
+        const struct sockaddr_in6 *in2P = (const struct sockaddr_in6 *)&addr2;
+
+        return in1P->sin6_port == in2P->sin6_port
+                && 0 == memcmp(&in1P->sin6_addr, &in2P->sin6_addr, sizeof(in1P->sin6_addr));
+    }
+#else
+    Q_UNUSED(index1);
+    Q_UNUSED(index2);
+#endif
+
+    return false;
+}
+
+int64_t DatagramBatch::getTimestampInUs(uint32_t index) const
+{
+#ifdef Q_OS_LINUX
+    if(index >= rxCnt)
+    {
+        return -1;
+    }
+
+    // Only present if SO_TIMESTAMPNS is set on the socket
+    const struct msghdr *hdrP = &msgVecP[index].msg_hdr;
+
+    for(struct cmsghdr *cmsgP = CMSG_FIRSTHDR(hdrP); NULL != cmsgP;
+        cmsgP = CMSG_NXTHDR((struct msghdr *)hdrP, cmsgP))
+    {
+        if(SOL_SOCKET == cmsgP->cmsg_level && SCM_TIMESTAMPNS == cmsgP->cmsg_type)
+        {
+            struct timespec ts;
+            memcpy(&ts, CMSG_DATA(cmsgP), sizeof(ts));
+
+            return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+        }
+    }
+#else
+    Q_UNUSED(index);
+#endif
+
+    return -1;
+}
+
+bool DatagramBatch::setTimestampEnabled(int socketFd, bool flag)
+{
+#ifdef Q_OS_LINUX
+    int value = flag ? 1 : 0;
+
+    return (0 == setsockopt(socketFd, SOL_SOCKET, SO_TIMESTAMPNS, &value, sizeof(value)));
+#else
+    Q_UNUSED(socketFd);
+    Q_UNUSED(flag);
+
+    return false;
+#endif
+}
+
+int DatagramBatch::send(int socketFd, const QList<QByteArray> &datagrams, const QHostAddress &address, uint16_t port)
+{
+#ifdef Q_OS_LINUX
+    struct sockaddr_storage sockAddr;
+    socklen_t addrLen = toSockAddr(socketFd, address, port, sockAddr);
+
+    if(socketFd < 0 || 0 == addrLen)
+    {
+        return -1;
+    }
+
+    int sentCnt = 0;
+    int totalCnt = datagrams.size();
+
+    // Send batchCnt datagrams per call, the data is not copied
+    while(sentCnt < totalCnt)
+    {
+        uint32_t cnt = 0;
+
+        while(cnt < m_batchCnt && (sentCnt + (int)cnt) < totalCnt)
+        {
+            const QByteArray &data = datagrams.at(sentCnt + cnt);
+
+            txIovP[cnt].iov_base = (void *)data.constData();
+            txIovP[cnt].iov_len = data.size();
+
+            memset(&txMsgVecP[cnt], 0, sizeof(struct mmsghdr));
+            txMsgVecP[cnt].msg_hdr.msg_name = &sockAddr;
+            txMsgVecP[cnt].msg_hdr.msg_namelen = addrLen;
+            txMsgVecP[cnt].msg_hdr.msg_iov = &txIovP[cnt];
+            txMsgVecP[cnt].msg_hdr.msg_iovlen = 1;
+
+            cnt++;
+        }
+
+        int ret = sendmmsg(socketFd, txMsgVecP, cnt, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if(ret < 0)
+        {
+            if(EINTR == errno)
+            {
+                continue;
+            }
+
+            // Socket buffer is full or error, report the sent count
+            return (0 == sentCnt) ? -1 : sentCnt;
+        }
+
+        sentCnt += ret;
+
+        if((uint32_t)ret < cnt)
+        {
+            break;
+        }
+    }
+
+    return sentCnt;
+#else
+    Q_UNUSED(socketFd);
+    Q_UNUSED(datagrams);
+    Q_UNUSED(address);
+    Q_UNUSED(port);
+
+    return -1;
+#endif
+}
+
+uint32_t DatagramBatch::getBatchCnt() const
+{
+    return m_batchCnt;
+}
+
+uint32_t DatagramBatch::getMaxDatagramSize() const
+{
+    return m_maxDatagramSize;
+}
+
+#ifdef Q_OS_LINUX
+socklen_t DatagramBatch::toSockAddr(int socketFd, const QHostAddress &address, uint16_t port,
+                                    struct sockaddr_storage &sockAddr)
+{
+    struct sockaddr_storage localAddr;
+    socklen_t localLen = sizeof(localAddr);
+
+    memset(&sockAddr, 0, sizeof(sockAddr));
+
+    // The destination shall match the family of socket, e.g. IPv4 on dual stack socket
+    if(getsockname(socketFd, (struct sockaddr *)&localAddr, &localLen) < 0)
+    {
+        return 0;
+    }
+
+    if(AF_INET == localAddr.ss_family)
+    {
+        if(QAbstractSocket::IPv4Protocol != address.protocol())
+        {
+            return 0;
+        }
+
+        struct sockaddr_in *inP = (struct sockaddr_in *)&sockAddr;
+        inP->sin_family = AF_INET;
+        inP->sin_port = htons(port);
+        inP->sin_addr.s_addr = htonl(address.toIPv4Address());
+
+        return sizeof(struct sockaddr_in);
+    }
+    else if(AF_INET6 == localAddr.ss_family)
+    {
+        struct sockaddr_in6 *in6P = (struct sockaddr_in6 *)&sockAddr;
+        in6P->sin6_family = AF_INET6;
+        in6P->sin6_port = htons(port);
+
+        if(QAbstractSocket::IPv4Protocol == address.protocol())
+        {
+            // IPv4-mapped IPv6 address ::ffff:a.b.c.d
+            uint32_t ipv4 = htonl(address.toIPv4Address());
+
+            in6P->sin6_addr.s6_addr[10] = 0xFF;
+            in6P->sin6_addr.s6_addr[11] = 0xFF;
+            memcpy(&in6P->sin6_addr.s6_addr[12], &ipv4, sizeof(ipv4));
+        }
+        else if(QAbstractSocket::IPv6Protocol == address.protocol())
+        {
+            Q_IPV6ADDR ipv6 = address.toIPv6Address();
+            memcpy(&in6P->sin6_addr, &ipv6, sizeof(in6P->sin6_addr));
+        }
+        else
+        {
+            return 0;
+        }
+
+        return sizeof(struct sockaddr_in6);
+    }
+
+    return 0;
+}
+#endif
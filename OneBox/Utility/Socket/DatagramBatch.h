@@ -0,0 +1,150 @@
+/**********************************************************************
+PACKAGE:        Utility
+FILE:           DatagramBatch.h
+COPYRIGHT (C):  All rights reserved.
+
+PURPOSE:        Receive/send a batch of datagrams with one system call
+**********************************************************************/
+
+#ifndef DATAGRAMBATCH_H
+#define DATAGRAMBATCH_H
+
+#include <stdint.h>
+#include <QByteArray>
+#include <QHostAddress>
+#include <QList>
+#include <QMetaType>
+
+#ifdef Q_OS_LINUX
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#endif
+
+/*
+ DatagramBatch wraps recvmmsg()/sendmmsg() on Linux. All receive buffers
+ are allocated once in one slab,
+
+ slabP[batchCnt][maxDatagramSize] =
+ {
+    datagram0[maxDatagramSize],
+    datagram1[maxDatagramSize],
+    ...
+ }
+
+ receive() fills up to batchCnt datagrams and their sender addresses with
+ one system call, the data is valid until next receive(). A datagram longer
+ than maxDatagramSize is truncated, check it with isTruncated().
+
+ The whole batch is returned by one system call at the same time, with
+ setTimestampEnabled() the kernel stamps each datagram on arrival, see
+ getTimestampInUs(), so inter-arrival times survive the batching.
+
+ On other platforms isSupported() returns false and the caller shall use
+ QUdpSocket::readDatagram()/writeDatagram() instead.
+*/
+
+// One received datagram with sender address
+struct UDP_DATAGRAM
+{
+    QByteArray data;
+    QHostAddress address;
+    uint16_t port;
+};
+
+typedef QList<struct UDP_DATAGRAM> UDP_DATAGRAM_LIST;
+
+Q_DECLARE_METATYPE(UDP_DATAGRAM_LIST)
+
+class DatagramBatch
+{
+public:
+    DatagramBatch(uint32_t batchCnt = DEFAULT_BATCH_CNT, uint32_t maxDatagramSize = DEFAULT_MAX_DATAGRAM_SIZE);
+    virtual ~DatagramBatch();
+
+    // True: batch system call is supported on this platform
+    static bool isSupported();
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		receive
+    PURPOSE:		Receive pending datagrams without blocking
+    ARGUMENTS:		int socketFd -- socket descriptor
+    RETURNS:		The count of received datagrams, 0: no datagram, -1: error
+    -----------------------------------------------------------------------*/
+    int receive(int socketFd);
+
+    // Return the count of datagrams got by last receive()
+    uint32_t getCount() const;
+
+    // Return the data of datagram in last receive()
+    const char *getData(uint32_t index) const;
+
+    // Return the bytes of datagram in the buffer, a truncated one is cut at
+    // maxDatagramSize and its original length is lost, see isTruncated()
+    uint32_t getSize(uint32_t index) const;
+
+    // True: datagram is longer than maxDatagramSize and truncated
+    bool isTruncated(uint32_t index) const;
+
+    // Return the sender of datagram in last receive()
+    QHostAddress getAddress(uint32_t index) const;
+    uint16_t getPort(uint32_t index) const;
+
+    // True: two datagrams are from the same sender, cheaper than comparing QHostAddress
+    bool isSameSender(uint32_t index1, uint32_t index2) const;
+
+    // Kernel receive time of datagram in us (wall clock), -1: not stamped, see setTimestampEnabled()
+    int64_t getTimestampInUs(uint32_t index) const;
+
+    // Set SO_TIMESTAMPNS of socket, false: not supported
+    static bool setTimestampEnabled(int socketFd, bool flag);
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		send
+    PURPOSE:		Send datagrams to one destination, batchCnt per system call
+    ARGUMENTS:		int socketFd                        -- socket descriptor
+                    const QList<QByteArray> &datagrams  -- datagrams to send
+                    const QHostAddress &address         -- destination address
+                    uint16_t port                       -- destination port
+    RETURNS:		The count of datagrams sent, -1: error
+    -----------------------------------------------------------------------*/
+    int send(int socketFd, const QList<QByteArray> &datagrams, const QHostAddress &address, uint16_t port);
+
+    uint32_t getBatchCnt() const;
+    uint32_t getMaxDatagramSize() const;
+
+    enum
+    {
+        DEFAULT_BATCH_CNT = 64,
+        DEFAULT_MAX_DATAGRAM_SIZE = 2048
+    };
+
+private:
+    uint32_t m_batchCnt;
+    uint32_t m_maxDatagramSize;
+    uint32_t rxCnt;             // Count of datagrams got by last receive()
+
+    char *slabP;                // Receive buffer of all datagrams
+
+#ifdef Q_OS_LINUX
+    struct mmsghdr *msgVecP;    // Message header of each datagram
+    struct iovec *iovP;         // Buffer of each datagram
+    struct sockaddr_storage *addrP;   // Sender of each datagram
+    char *ctrlP;                // Control data of each datagram, CTRL_LEN bytes, SCM_TIMESTAMPNS
+
+    enum
+    {
+        CTRL_LEN = 64           // Larger than CMSG_SPACE(sizeof(struct timespec))
+    };
+
+    // Send uses its own vectors, received datagrams stay valid while sending
+    struct mmsghdr *txMsgVecP;
+    struct iovec *txIovP;
+
+    // Convert address to the sockaddr of socket family
+    static socklen_t toSockAddr(int socketFd, const QHostAddress &address, uint16_t port,
+                                struct sockaddr_storage &sockAddr);
+#endif
+};
+
+#endif // DATAGRAMBATCH_H
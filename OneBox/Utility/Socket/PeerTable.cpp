@@ -0,0 +1,288 @@
+/**********************************************************************
+PACKAGE:        Utility
+FILE:           PeerTable.cpp
+COPYRIGHT (C):  All rights reserved.
+
+PURPOSE:        Hash table of UDP peers keyed by address and port
+**********************************************************************/
+
+#include "PeerTable.h"
+#include <string.h>
+
+PeerTable::PeerTable() :
+    slotP(NULL),
+    slotCnt(0),
+    usedSlotCnt(0)
+{
+    rehash(INIT_SLOT_CNT);
+}
+
+PeerTable::~PeerTable()
+{
+    delete []slotP;
+}
+
+void PeerTable::makeKey(const QHostAddress &address, uint8_t *key)
+{
+    memset(key, 0, 16);
+
+    if(QAbstractSocket::IPv4Protocol == address.protocol())
+    {
+        uint32_t ipv4 = address.toIPv4Address();
+
+        key[10] = 0xFF;
+        key[11] = 0xFF;
+        key[12] = (uint8_t)(ipv4 >> 24);
+        key[13] = (uint8_t)(ipv4 >> 16);
+        key[14] = (uint8_t)(ipv4 >> 8);
+        key[15] = (uint8_t)ipv4;
+    }
+    else if(QAbstractSocket::IPv6Protocol == address.protocol())
+    {
+        Q_IPV6ADDR ipv6 = address.toIPv6Address();
+        memcpy(key, &ipv6, 16);
+    }
+}
+
+uint32_t PeerTable::hashKey(const uint8_t *key, uint16_t port)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261U;
+
+    for(uint32_t i = 0; i < 16; i++)
+    {
+        hash = (hash ^ key[i]) * 16777619U;
+    }
+
+    hash = (hash ^ (uint8_t)(port >> 8)) * 16777619U;
+    hash = (hash ^ (uint8_t)port) * 16777619U;
+
+    // Mix the high bits into the low bits, slot index uses the low bits
+    hash ^= hash >> 16;
+
+    return hash;
+}
+
+uint32_t PeerTable::findSlot(const uint8_t *key, uint16_t port, uint32_t hash) const
+{
+    uint32_t mask = slotCnt - 1;
+    uint32_t index = hash & mask;
+    uint32_t insertIndex = SLOT_EMPTY;
+
+    // Load factor is kept under 1/2, there is always an empty slot
+    while(true)
+    {
+        uint32_t id = slotP[index];
+
+        if(SLOT_EMPTY == id)
+        {
+            return (SLOT_EMPTY != insertIndex) ? insertIndex : index;
+        }
+        else if(SLOT_DELETED == id)
+        {
+            if(SLOT_EMPTY == insertIndex)
+            {
+                insertIndex = index;
+            }
+        }
+        else
+        {
+            const struct PEER_NODE &node = nodeList.at(id);
+
+            if(node.hash == hash && node.port == port && 0 == memcmp(node.key, key, 16))
+            {
+                return index;
+            }
+        }
+
+        index = (index + 1) & mask;
+    }
+}
+
+void PeerTable::rehash(uint32_t newSlotCnt)
+{
+    delete []slotP;
+
+    slotCnt = newSlotCnt;
+    slotP = new uint32_t [slotCnt];
+    usedSlotCnt = 0;
+
+    for(uint32_t i = 0; i < slotCnt; i++)
+    {
+        slotP[i] = SLOT_EMPTY;
+    }
+
+    for(int id = 0; id < nodeList.size(); id++)
+    {
+        struct PEER_NODE &node = nodeList[id];
+
+        if(node.position < 0)
+        {
+            continue;
+        }
+
+        uint32_t index = findSlot(node.key, node.port, node.hash);
+        slotP[index] = id;
+        node.slotIndex = index;
+        usedSlotCnt++;
+    }
+}
+
+uint32_t PeerTable::insert(const QHostAddress &address, uint16_t port, int64_t nowInMs, bool *newFlag)
+{
+    uint8_t key[16];
+    makeKey(address, key);
+
+    uint32_t hash = hashKey(key, port);
+    uint32_t index = findSlot(key, port, hash);
+
+    if(NULL != newFlag)
+    {
+        *newFlag = false;
+    }
+
+    if(SLOT_EMPTY != slotP[index] && SLOT_DELETED != slotP[index])
+    {
+        return slotP[index];
+    }
+
+    // Keep load factor under 1/2, only clean the deleted marks if peers are not too many
+    if((usedSlotCnt + 1) * 2 > slotCnt)
+    {
+        rehash((uint32_t)(orderList.size() + 1) * 4 > slotCnt ? slotCnt * 2 : slotCnt);
+        index = findSlot(key, port, hash);
+    }
+
+    uint32_t id = INVALID_ID;
+    if(!freeIdList.isEmpty())
+    {
+        id = freeIdList.takeLast();
+    }
+    else
+    {
+        id = nodeList.size();
+        nodeList.append(PEER_NODE());
+    }
+
+    struct PEER_NODE &node = nodeList[id];
+    memcpy(node.key, key, 16);
+    node.port = port;
+    node.hash = hash;
+    node.slotIndex = index;
+    node.position = orderList.size();
+
+    node.info.address = address;
+    node.info.port = port;
+    node.info.rxPacketCnt = 0;
+    node.info.txPacketCnt = 0;
+    node.info.rxBytes = 0;
+    node.info.txBytes = 0;
+    node.info.firstSeenInMs = nowInMs;
+    node.info.lastSeenInMs = nowInMs;
+
+    if(SLOT_EMPTY == slotP[index])
+    {
+        usedSlotCnt++;
+    }
+
+    slotP[index] = id;
+    orderList.append(id);
+
+    if(NULL != newFlag)
+    {
+        *newFlag = true;
+    }
+
+    return id;
+}
+
+uint32_t PeerTable::find(const QHostAddress &address, uint16_t port) const
+{
+    uint8_t key[16];
+    makeKey(address, key);
+
+    uint32_t index = findSlot(key, port, hashKey(key, port));
+    uint32_t id = slotP[index];
+
+    return (SLOT_EMPTY == id || SLOT_DELETED == id) ? (uint32_t)INVALID_ID : id;
+}
+
+bool PeerTable::remove(uint32_t peerId)
+{
+    if(NULL == getPeer(peerId))
+    {
+        return false;
+    }
+
+    struct PEER_NODE &node = nodeList[peerId];
+
+    // Keep the probe chain, mark the slot as deleted
+    slotP[node.slotIndex] = SLOT_DELETED;
+
+    // The peers after it move forward
+    orderList.removeAt(node.position);
+    for(int i = node.position; i < orderList.size(); i++)
+    {
+        nodeList[orderList.at(i)].position = i;
+    }
+
+    node.position = -1;
+    node.info.address.clear();
+    freeIdList.append(peerId);
+
+    return true;
+}
+
+void PeerTable::clear()
+{
+    nodeList.clear();
+    freeIdList.clear();
+    orderList.clear();
+
+    rehash(INIT_SLOT_CNT);
+}
+
+struct UDP_PEER_INFO *PeerTable::getPeer(uint32_t peerId)
+{
+    if(peerId >= (uint32_t)nodeList.size() || nodeList.at(peerId).position < 0)
+    {
+        return NULL;
+    }
+
+    return &nodeList[peerId].info;
+}
+
+const struct UDP_PEER_INFO *PeerTable::getPeer(uint32_t peerId) const
+{
+    if(peerId >= (uint32_t)nodeList.size() || nodeList.at(peerId).position < 0)
+    {
+        return NULL;
+    }
+
+    return &nodeList.at(peerId).info;
+}
+
+uint32_t PeerTable::getPeerCnt() const
+{
+    return orderList.size();
+}
+
+uint32_t PeerTable::getPeerId(uint32_t position) const
+{
+    if(position >= (uint32_t)orderList.size())
+    {
+        return INVALID_ID;
+    }
+
+    return orderList.at(position);
+}
+
+int PeerTable::getPosition(uint32_t peerId) const
+{
+    if(peerId >= (uint32_t)nodeList.size())
+    {
+        return -1;
+    }
+
+    return nodeList.at(peerId).position;
+}
@@ -0,0 +1,126 @@
+/**********************************************************************
+PACKAGE:        Utility
+FILE:           PeerTable.h
+COPYRIGHT (C):  All rights reserved.
+
+PURPOSE:        Hash table of UDP peers keyed by address and port
+**********************************************************************/
+
+#ifndef PEERTABLE_H
+#define PEERTABLE_H
+
+#include <stdint.h>
+#include <QHostAddress>
+#include <QList>
+#include <QVector>
+
+/*
+ PeerTable finds a peer by (address, port) in O(1) with an open addressing
+ hash table (linear probing). The hash slots only keep the peer ID, peers
+ are stored in an array indexed by peer ID,
+
+ slotP[] = { EMPTY, id3, id0, DELETED, EMPTY, id1, ... }
+ nodeP[] = { peer0, peer1, peer2, peer3, ... }
+
+ so the peer ID is stable until the peer is removed, and it can be used as
+ a dense index for other tables, e.g. TimerWheel.
+
+ The table also keeps the peers in arrival order, the position is the
+ "client index" used by UI, it is updated only when a peer is removed.
+*/
+
+// Information and counters of one peer
+struct UDP_PEER_INFO
+{
+    QHostAddress address;
+    uint16_t port;
+
+    uint32_t rxPacketCnt;
+    uint32_t txPacketCnt;
+    uint64_t rxBytes;
+    uint64_t txBytes;
+
+    int64_t firstSeenInMs;      // Time of first datagram
+    int64_t lastSeenInMs;       // Time of last datagram
+};
+
+class PeerTable
+{
+public:
+    PeerTable();
+    virtual ~PeerTable();
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		insert
+    PURPOSE:		Find a peer, add it if not exist
+    ARGUMENTS:		const QHostAddress &address -- peer address
+                    uint16_t port               -- peer port
+                    int64_t nowInMs             -- current time, used as first/last seen time
+                    bool *newFlag               -- set true if peer is added, can be NULL
+    RETURNS:		Peer ID
+    -----------------------------------------------------------------------*/
+    uint32_t insert(const QHostAddress &address, uint16_t port, int64_t nowInMs, bool *newFlag = NULL);
+
+    // Return peer ID, INVALID_ID: not exist
+    uint32_t find(const QHostAddress &address, uint16_t port) const;
+
+    // Remove a peer, its ID may be reused by a new peer
+    bool remove(uint32_t peerId);
+
+    // Remove all peers
+    void clear();
+
+    // Return peer info, NULL: peer ID is invalid
+    struct UDP_PEER_INFO *getPeer(uint32_t peerId);
+    const struct UDP_PEER_INFO *getPeer(uint32_t peerId) const;
+
+    // Return the count of peers
+    uint32_t getPeerCnt() const;
+
+    // Convert between peer ID and the position in arrival order
+    uint32_t getPeerId(uint32_t position) const;
+    int getPosition(uint32_t peerId) const;
+
+    enum
+    {
+        INVALID_ID = 0xFFFFFFFF
+    };
+
+private:
+    enum
+    {
+        INIT_SLOT_CNT = 64,
+        SLOT_EMPTY = 0xFFFFFFFF,
+        SLOT_DELETED = 0xFFFFFFFE
+    };
+
+    struct PEER_NODE
+    {
+        uint8_t key[16];        // IPv6 address, IPv4 is mapped to ::ffff:a.b.c.d
+        uint16_t port;
+        uint32_t hash;
+        uint32_t slotIndex;     // Hash slot of this peer
+        int position;           // Position in arrival order, -1: node is free
+        struct UDP_PEER_INFO info;
+    };
+
+    QVector<struct PEER_NODE> nodeList;     // Peers indexed by peer ID
+    QList<uint32_t> freeIdList;             // Free peer IDs
+    QList<uint32_t> orderList;              // Peer IDs in arrival order
+
+    uint32_t *slotP;            // Hash slots, peer ID or SLOT_EMPTY/SLOT_DELETED
+    uint32_t slotCnt;           // Power of 2
+    uint32_t usedSlotCnt;       // Slots of peers and deleted marks
+
+    // Convert address to hash key
+    static void makeKey(const QHostAddress &address, uint8_t *key);
+    static uint32_t hashKey(const uint8_t *key, uint16_t port);
+
+    // Return the slot of key, or the slot to insert it if not exist
+    uint32_t findSlot(const uint8_t *key, uint16_t port, uint32_t hash) const;
+
+    // Enlarge hash slots and insert all peers again
+    void rehash(uint32_t newSlotCnt);
+};
+
+#endif // PEERTABLE_H
@@ -0,0 +1,312 @@
+/**********************************************************************
+PACKAGE:        Utility
+FILE:           SequenceAnalyzer.cpp
+COPYRIGHT (C):  All rights reserved.
+
+PURPOSE:        Loss, duplicate, reorder and jitter statistics of datagram streams
+**********************************************************************/
+
+#include "SequenceAnalyzer.h"
+#include <string.h>
+
+SequenceAnalyzer::SequenceAnalyzer(uint32_t seqOffset, uint32_t seqSize, bool bigEndian) :
+    m_seqOffset(seqOffset),
+    m_seqSize(seqSize),
+    m_bigEndian(bigEndian),
+    m_tsOffset(-1),
+    m_tsSize(4),
+    m_tsUnitInUs(1000.0)
+{
+    // Only 1/2/4 bytes sequence number is supported
+    if(m_seqSize != 1 && m_seqSize != 2 && m_seqSize != 4)
+    {
+        m_seqSize = 4;
+    }
+
+    seqModulus = (uint64_t)1 << (8 * m_seqSize);
+    windowSize = (seqModulus / 2 < WINDOW_SIZE) ? (uint32_t)(seqModulus / 2) : (uint32_t)WINDOW_SIZE;
+}
+
+SequenceAnalyzer::~SequenceAnalyzer()
+{
+}
+
+void SequenceAnalyzer::setTimestampField(int32_t tsOffset, uint32_t tsSize, double tsUnitInUs)
+{
+    m_tsOffset = tsOffset;
+    m_tsSize = (tsSize != 1 && tsSize != 2 && tsSize != 4) ? 4 : tsSize;
+    m_tsUnitInUs = (tsUnitInUs > 0) ? tsUnitInUs : 1000.0;
+
+    // Jitter of the old setting is meaningless
+    for(int i = 0; i < streamList.size(); i++)
+    {
+        streamList[i].arrivalValid = false;
+        streamList[i].deltaValid = false;
+    }
+}
+
+uint32_t SequenceAnalyzer::readField(const char *dataP, uint32_t size) const
+{
+    const uint8_t *fieldP = (const uint8_t *)dataP;
+    uint32_t value = 0;
+
+    for(uint32_t i = 0; i < size; i++)
+    {
+        if(m_bigEndian)
+        {
+            value = (value << 8) | fieldP[i];
+        }
+        else
+        {
+            value |= (uint32_t)fieldP[i] << (8 * i);
+        }
+    }
+
+    return value;
+}
+
+bool SequenceAnalyzer::testBit(const struct SEQ_STREAM_STATE &state, uint64_t extSeq) const
+{
+    uint32_t pos = (uint32_t)(extSeq % WINDOW_SIZE);
+
+    return 0 != (state.windowBits[pos / 64] & ((uint64_t)1 << (pos % 64)));
+}
+
+void SequenceAnalyzer::setBit(struct SEQ_STREAM_STATE &state, uint64_t extSeq)
+{
+    uint32_t pos = (uint32_t)(extSeq % WINDOW_SIZE);
+
+    state.windowBits[pos / 64] |= ((uint64_t)1 << (pos % 64));
+}
+
+void SequenceAnalyzer::clearRange(struct SEQ_STREAM_STATE &state, uint64_t fromSeq, uint64_t toSeq)
+{
+    // A jump longer than window clears the whole window
+    if(toSeq - fromSeq + 1 >= WINDOW_SIZE)
+    {
+        memset(state.windowBits, 0, sizeof(state.windowBits));
+        return;
+    }
+
+    for(uint64_t seq = fromSeq; seq <= toSeq; seq++)
+    {
+        uint32_t pos = (uint32_t)(seq % WINDOW_SIZE);
+
+        state.windowBits[pos / 64] &= ~((uint64_t)1 << (pos % 64));
+    }
+}
+
+void SequenceAnalyzer::initStream(struct SEQ_STREAM_STATE &state, uint64_t extSeq)
+{
+    memset(&state, 0, sizeof(state));
+
+    state.initialized = true;
+    state.firstSeq = extSeq;
+    state.lastRawSeq = (uint32_t)extSeq;
+    state.uniqueCnt = 1;
+
+    state.stat.receivedCnt = 1;
+    state.stat.expectedCnt = 1;
+    state.stat.highestSeq = extSeq;
+
+    setBit(state, extSeq);
+}
+
+void SequenceAnalyzer::updateJitter(struct SEQ_STREAM_STATE &state, const char *dataP, uint32_t len, int64_t arrivalInUs)
+{
+    bool tsFlag = (m_tsOffset >= 0) && (len >= (uint32_t)m_tsOffset + m_tsSize);
+    uint32_t ts = tsFlag ? readField(dataP + m_tsOffset, m_tsSize) : 0;
+
+    if(state.arrivalValid)
+    {
+        int64_t arrivalDelta = arrivalInUs - state.lastArrivalInUs;
+        double d = 0;
+        bool dFlag = false;
+
+        if(tsFlag)
+        {
+            // D = (Rj - Ri) - (Sj - Si), timestamp difference is signed for wrap
+            int64_t tsModulus = (int64_t)1 << (8 * m_tsSize);
+            int64_t tsDelta = ((int64_t)ts - state.lastTs) % tsModulus;
+
+            if(tsDelta >= tsModulus / 2)
+            {
+                tsDelta -= tsModulus;
+            }
+            else if(tsDelta < -tsModulus / 2)
+            {
+                tsDelta += tsModulus;
+            }
+
+            d = (double)arrivalDelta - tsDelta * m_tsUnitInUs;
+            dFlag = true;
+        }
+        else
+        {
+            // No sender time, D is the difference of two inter-arrival time
+            if(state.deltaValid)
+            {
+                d = (double)(arrivalDelta - state.lastDeltaInUs);
+                dFlag = true;
+            }
+
+            state.lastDeltaInUs = arrivalDelta;
+            state.deltaValid = true;
+        }
+
+        if(dFlag)
+        {
+            if(d < 0)
+            {
+                d = -d;
+            }
+
+            state.jitterInUs += (d - state.jitterInUs) / 16.0;
+            state.stat.jitterInMs = state.jitterInUs / 1000.0;
+        }
+    }
+
+    state.lastArrivalInUs = arrivalInUs;
+    state.lastTs = ts;
+    state.arrivalValid = true;
+}
+
+void SequenceAnalyzer::analyze(uint32_t streamId, const char *dataP, uint32_t len, int64_t arrivalInUs)
+{
+    if(NULL == dataP)
+    {
+        return;
+    }
+
+    if(streamId >= (uint32_t)streamList.size())
+    {
+        int oldSize = streamList.size();
+        streamList.resize(streamId + 1);
+
+        for(int i = oldSize; i < streamList.size(); i++)
+        {
+            memset(&streamList[i], 0, sizeof(struct SEQ_STREAM_STATE));
+        }
+    }
+
+    struct SEQ_STREAM_STATE &state = streamList[streamId];
+
+    if(len < m_seqOffset + m_seqSize)
+    {
+        state.stat.shortCnt++;
+        return;
+    }
+
+    uint32_t rawSeq = readField(dataP + m_seqOffset, m_seqSize);
+
+    if(!state.initialized)
+    {
+        uint32_t shortCnt = state.stat.shortCnt;
+
+        initStream(state, rawSeq);
+        state.stat.shortCnt = shortCnt;
+
+        updateJitter(state, dataP, len, arrivalInUs);
+        return;
+    }
+
+    struct SEQ_STREAM_STAT &stat = state.stat;
+    uint64_t delta = ((uint64_t)rawSeq + seqModulus - state.lastRawSeq) % seqModulus;
+
+    stat.receivedCnt++;
+
+    if(0 == delta)
+    {
+        // Same as the highest one
+        stat.duplicateCnt++;
+    }
+    else if(delta < seqModulus / 2)
+    {
+        // In order or lost some datagrams before it
+        if(rawSeq < state.lastRawSeq)
+        {
+            state.cycles += seqModulus;
+        }
+
+        uint64_t extSeq = state.cycles + rawSeq;
+
+        clearRange(state, stat.highestSeq + 1, extSeq);
+        setBit(state, extSeq);
+
+        stat.highestSeq = extSeq;
+        state.lastRawSeq = rawSeq;
+        state.uniqueCnt++;
+    }
+    else
+    {
+        // Older than the highest one
+        uint64_t backDelta = seqModulus - delta;
+
+        if(backDelta <= stat.highestSeq && backDelta < windowSize)
+        {
+            uint64_t extSeq = stat.highestSeq - backDelta;
+
+            if(testBit(state, extSeq))
+            {
+                stat.duplicateCnt++;
+            }
+            else
+            {
+                setBit(state, extSeq);
+                state.uniqueCnt++;
+                stat.reorderCnt++;
+
+                // Arrived earlier than the first one
+                if(extSeq < state.firstSeq)
+                {
+                    state.firstSeq = extSeq;
+                }
+            }
+        }
+        else
+        {
+            // Out of window, can not tell duplicate, count as reordered
+            stat.reorderCnt++;
+        }
+    }
+
+    stat.expectedCnt = stat.highestSeq - state.firstSeq + 1;
+    stat.lostCnt = (int64_t)stat.expectedCnt - (int64_t)state.uniqueCnt;
+
+    updateJitter(state, dataP, len, arrivalInUs);
+}
+
+bool SequenceAnalyzer::getStat(uint32_t streamId, struct SEQ_STREAM_STAT &stat) const
+{
+    if(streamId >= (uint32_t)streamList.size() || !streamList.at(streamId).initialized)
+    {
+        return false;
+    }
+
+    stat = streamList.at(streamId).stat;
+
+    return true;
+}
+
+void SequenceAnalyzer::reset(uint32_t streamId)
+{
+    if(streamId < (uint32_t)streamList.size())
+    {
+        memset(&streamList[streamId], 0, sizeof(struct SEQ_STREAM_STATE));
+    }
+}
+
+void SequenceAnalyzer::resetAll()
+{
+    streamList.clear();
+}
+
+double SequenceAnalyzer::getLossRate(const struct SEQ_STREAM_STAT &stat)
+{
+    if(0 == stat.expectedCnt || stat.lostCnt <= 0)
+    {
+        return 0;
+    }
+
+    return 100.0 * stat.lostCnt / stat.expectedCnt;
+}
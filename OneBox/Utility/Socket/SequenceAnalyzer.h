@@ -0,0 +1,147 @@
+/**********************************************************************
+PACKAGE:        Utility
+FILE:           SequenceAnalyzer.h
+COPYRIGHT (C):  All rights reserved.
+
+PURPOSE:        Loss, duplicate, reorder and jitter statistics of datagram streams
+**********************************************************************/
+
+#ifndef SEQUENCEANALYZER_H
+#define SEQUENCEANALYZER_H
+
+#include <stdint.h>
+#include <QVector>
+
+/*
+ SequenceAnalyzer reads a sequence number (and optional sender timestamp)
+ at a fixed offset of each datagram, and keeps the statistics of every
+ stream, the stream ID is a small integer, e.g. peer ID of PeerTable.
+
+ The statistics follow RFC 3550 Appendix A,
+ - sequence number is extended with wrap cycles
+ - expected = highest extended sequence - first sequence + 1
+ - lost = expected - unique received
+ - a window of the latest WINDOW_SIZE sequence numbers is kept as bitmap
+   to tell duplicate from late(reordered) datagrams
+ - jitter J += (|D| - J) / 16, D is the transit time difference of two
+   datagrams, or the inter-arrival time difference if no timestamp field
+
+ Every datagram is handled in O(1).
+*/
+
+// Statistics of one stream
+struct SEQ_STREAM_STAT
+{
+    uint32_t receivedCnt;       // All analyzed datagrams, including duplicates
+    uint32_t duplicateCnt;      // Sequence number already received
+    uint32_t reorderCnt;        // Arrived after a higher sequence number
+    uint32_t shortCnt;          // Too short to hold the fields, not analyzed
+
+    uint64_t expectedCnt;       // Highest - first + 1
+    int64_t lostCnt;            // Expected - unique received
+
+    uint64_t highestSeq;        // Highest extended sequence number
+    double jitterInMs;          // Inter-arrival jitter
+};
+
+class SequenceAnalyzer
+{
+public:
+    /*-----------------------------------------------------------------------
+    FUNCTION:		SequenceAnalyzer
+    PURPOSE:		Construct an analyzer with sequence field setting
+    ARGUMENTS:		uint32_t seqOffset  -- offset of sequence number in datagram
+                    uint32_t seqSize    -- size of sequence number, 1/2/4 bytes
+                    bool bigEndian      -- byte order of the fields
+    RETURNS:		None
+    -----------------------------------------------------------------------*/
+    SequenceAnalyzer(uint32_t seqOffset = 0, uint32_t seqSize = 4, bool bigEndian = true);
+    virtual ~SequenceAnalyzer();
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		setTimestampField
+    PURPOSE:		Set sender timestamp field used by jitter
+    ARGUMENTS:		int32_t tsOffset    -- offset of timestamp, -1: no timestamp
+                    uint32_t tsSize     -- size of timestamp, 1/2/4 bytes
+                    double tsUnitInUs   -- time of one timestamp unit in us
+    RETURNS:		None
+    -----------------------------------------------------------------------*/
+    void setTimestampField(int32_t tsOffset, uint32_t tsSize = 4, double tsUnitInUs = 1000.0);
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		analyze
+    PURPOSE:		Update the statistics of stream with one datagram
+    ARGUMENTS:		uint32_t streamId       -- stream ID
+                    const char *dataP       -- datagram
+                    uint32_t len            -- datagram length
+                    int64_t arrivalInUs     -- arrival time
+    RETURNS:		None
+    -----------------------------------------------------------------------*/
+    void analyze(uint32_t streamId, const char *dataP, uint32_t len, int64_t arrivalInUs);
+
+    // Get statistics of stream, false: no datagram analyzed
+    bool getStat(uint32_t streamId, struct SEQ_STREAM_STAT &stat) const;
+
+    // Forget one stream, e.g. when its ID is reused
+    void reset(uint32_t streamId);
+
+    // Forget all streams
+    void resetAll();
+
+    // Return the loss rate of stat in percent
+    static double getLossRate(const struct SEQ_STREAM_STAT &stat);
+
+private:
+    enum
+    {
+        WINDOW_SIZE = 1024,
+        WINDOW_WORD_CNT = WINDOW_SIZE / 64
+    };
+
+    struct SEQ_STREAM_STATE
+    {
+        bool initialized;
+        uint64_t firstSeq;          // Extended sequence of first datagram
+        uint64_t uniqueCnt;         // Received without duplicates
+        uint32_t lastRawSeq;        // Highest raw sequence number
+        uint64_t cycles;            // Wrap count * seqModulus
+
+        bool arrivalValid;          // True: lastArrivalInUs/lastTs are valid
+        int64_t lastArrivalInUs;
+        uint32_t lastTs;            // Sender timestamp of last datagram
+        bool deltaValid;            // True: lastDeltaInUs is valid
+        int64_t lastDeltaInUs;      // Inter-arrival time of last datagram, no timestamp mode
+        double jitterInUs;
+
+        uint64_t windowBits[WINDOW_WORD_CNT];  // Received flag of latest sequences
+
+        struct SEQ_STREAM_STAT stat;
+    };
+
+    uint32_t m_seqOffset;
+    uint32_t m_seqSize;
+    bool m_bigEndian;
+
+    int32_t m_tsOffset;
+    uint32_t m_tsSize;
+    double m_tsUnitInUs;
+
+    uint64_t seqModulus;        // 2^(8 * seqSize)
+    uint32_t windowSize;        // Min(WINDOW_SIZE, seqModulus / 2)
+
+    QVector<struct SEQ_STREAM_STATE> streamList;    // Indexed by stream ID
+
+    // Read unsigned field of 1/2/4 bytes
+    uint32_t readField(const char *dataP, uint32_t size) const;
+
+    void initStream(struct SEQ_STREAM_STATE &state, uint64_t extSeq);
+
+    // Bitmap of sequence window
+    bool testBit(const struct SEQ_STREAM_STATE &state, uint64_t extSeq) const;
+    void setBit(struct SEQ_STREAM_STATE &state, uint64_t extSeq);
+    void clearRange(struct SEQ_STREAM_STATE &state, uint64_t fromSeq, uint64_t toSeq);
+
+    void updateJitter(struct SEQ_STREAM_STATE &state, const char *dataP, uint32_t len, int64_t arrivalInUs);
+};
+
+#endif // SEQUENCEANALYZER_H
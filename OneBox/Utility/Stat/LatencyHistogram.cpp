@@ -0,0 +1,193 @@
+/**********************************************************************
+PACKAGE:        Utility
+FILE:           LatencyHistogram.cpp
+COPYRIGHT (C):  All rights reserved.
+
+PURPOSE:        Log-linear histogram of latency with fixed relative error
+**********************************************************************/
+
+#include "LatencyHistogram.h"
+
+const uint64_t LatencyHistogram::DEFAULT_HIGHEST_VALUE;
+
+LatencyHistogram::LatencyHistogram(uint64_t highestValue) :
+    m_highestValue(highestValue)
+{
+    if(m_highestValue < SUB_BUCKET_CNT)
+    {
+        m_highestValue = SUB_BUCKET_CNT;
+    }
+
+    countList.resize(getIndex(m_highestValue) + 1);
+
+    reset();
+}
+
+LatencyHistogram::~LatencyHistogram()
+{
+}
+
+uint32_t LatencyHistogram::getIndex(uint64_t value)
+{
+    if(value < SUB_BUCKET_CNT)
+    {
+        return (uint32_t)value;
+    }
+
+    // Position of the highest set bit, >= SUB_BUCKET_BITS
+    uint32_t msb = 0;
+    for(uint64_t tmp = value; tmp > 1; tmp >>= 1)
+    {
+        msb++;
+    }
+
+    // value >> shift is in [SUB_BUCKET_HALF_CNT, SUB_BUCKET_CNT)
+    uint32_t shift = msb - (SUB_BUCKET_BITS - 1);
+
+    return SUB_BUCKET_CNT + (shift - 1) * SUB_BUCKET_HALF_CNT
+            + (uint32_t)(value >> shift) - SUB_BUCKET_HALF_CNT;
+}
+
+uint64_t LatencyHistogram::getHighestEquivalentValue(uint32_t index)
+{
+    if(index < SUB_BUCKET_CNT)
+    {
+        return index;
+    }
+
+    uint32_t offset = index - SUB_BUCKET_CNT;
+    uint32_t shift = offset / SUB_BUCKET_HALF_CNT + 1;
+    uint64_t subBucket = offset % SUB_BUCKET_HALF_CNT + SUB_BUCKET_HALF_CNT;
+
+    return ((subBucket + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(uint64_t value)
+{
+    if(value > m_highestValue)
+    {
+        overflowCnt++;
+        value = m_highestValue;
+    }
+
+    countList[getIndex(value)]++;
+
+    if(0 == totalCnt || value < minValue)
+    {
+        minValue = value;
+    }
+
+    if(value > maxValue)
+    {
+        maxValue = value;
+    }
+
+    totalCnt++;
+    sum += value;
+}
+
+void LatencyHistogram::add(const LatencyHistogram &other)
+{
+    int cnt = (countList.size() < other.countList.size()) ? countList.size() : other.countList.size();
+
+    for(int i = 0; i < cnt; i++)
+    {
+        countList[i] += other.countList.at(i);
+    }
+
+    if(0 == other.totalCnt)
+    {
+        return;
+    }
+
+    if(0 == totalCnt || other.minValue < minValue)
+    {
+        minValue = other.minValue;
+    }
+
+    if(other.maxValue > maxValue)
+    {
+        maxValue = other.maxValue;
+    }
+
+    totalCnt += other.totalCnt;
+    overflowCnt += other.overflowCnt;
+    sum += other.sum;
+}
+
+void LatencyHistogram::reset()
+{
+    countList.fill(0);
+
+    totalCnt = 0;
+    overflowCnt = 0;
+    minValue = 0;
+    maxValue = 0;
+    sum = 0;
+}
+
+uint64_t LatencyHistogram::getTotalCnt() const
+{
+    return totalCnt;
+}
+
+uint64_t LatencyHistogram::getMin() const
+{
+    return minValue;
+}
+
+uint64_t LatencyHistogram::getMax() const
+{
+    return maxValue;
+}
+
+double LatencyHistogram::getMean() const
+{
+    if(0 == totalCnt)
+    {
+        return 0;
+    }
+
+    return sum / totalCnt;
+}
+
+uint64_t LatencyHistogram::getOverflowCnt() const
+{
+    return overflowCnt;
+}
+
+uint64_t LatencyHistogram::getValueAtPercentile(double percentile) const
+{
+    if(0 == totalCnt)
+    {
+        return 0;
+    }
+
+    if(percentile > 100)
+    {
+        percentile = 100;
+    }
+
+    // At least one value is counted
+    uint64_t targetCnt = (uint64_t)(percentile / 100 * totalCnt + 0.5);
+    if(0 == targetCnt)
+    {
+        targetCnt = 1;
+    }
+
+    uint64_t cnt = 0;
+
+    for(int i = 0; i < countList.size(); i++)
+    {
+        cnt += countList.at(i);
+
+        if(cnt >= targetCnt)
+        {
+            uint64_t value = getHighestEquivalentValue(i);
+
+            return (value > maxValue) ? maxValue : value;
+        }
+    }
+
+    return maxValue;
+}
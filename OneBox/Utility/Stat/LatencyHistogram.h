@@ -0,0 +1,95 @@
+/**********************************************************************
+PACKAGE:        Utility
+FILE:           LatencyHistogram.h
+COPYRIGHT (C):  All rights reserved.
+
+PURPOSE:        Log-linear histogram of latency with fixed relative error
+**********************************************************************/
+
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+#include <stdint.h>
+#include <QVector>
+
+/*
+ LatencyHistogram follows the layout of HdrHistogram. Values below
+ SUB_BUCKET_CNT are counted exactly, above it every power of two range is
+ split into SUB_BUCKET_CNT / 2 linear sub-buckets,
+
+ [0, 256)       : 256 buckets, width 1
+ [256, 512)     : 128 buckets, width 2
+ [512, 1024)    : 128 buckets, width 4
+ ...
+ [2^k, 2^(k+1)) : 128 buckets, width 2^(k-7)
+
+ So every recorded value is kept within 1/128 (< 0.8%) relative error,
+ record() is O(1) and the memory does not depend on the sample count.
+ The unit of value is chosen by the caller, e.g. us.
+*/
+
+class LatencyHistogram
+{
+public:
+    /*-----------------------------------------------------------------------
+    FUNCTION:		LatencyHistogram
+    PURPOSE:		Construct an empty histogram
+    ARGUMENTS:		uint64_t highestValue -- larger values are counted as highestValue
+    RETURNS:		None
+    -----------------------------------------------------------------------*/
+    explicit LatencyHistogram(uint64_t highestValue = DEFAULT_HIGHEST_VALUE);
+    virtual ~LatencyHistogram();
+
+    // Count one value
+    void record(uint64_t value);
+
+    // Add all values of other histogram, both shall have the same highestValue
+    void add(const LatencyHistogram &other);
+
+    // Remove all values
+    void reset();
+
+    uint64_t getTotalCnt() const;
+    uint64_t getMin() const;
+    uint64_t getMax() const;
+    double getMean() const;
+
+    // Return the count of values larger than highestValue
+    uint64_t getOverflowCnt() const;
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		getValueAtPercentile
+    PURPOSE:		Get the value which percentile of values are less than or equal to
+    ARGUMENTS:		double percentile -- 0 ~ 100, e.g. 99.9
+    RETURNS:		Highest equivalent value of the bucket, 0: no value
+    -----------------------------------------------------------------------*/
+    uint64_t getValueAtPercentile(double percentile) const;
+
+    enum
+    {
+        SUB_BUCKET_BITS = 8,
+        SUB_BUCKET_CNT = 1 << SUB_BUCKET_BITS,
+        SUB_BUCKET_HALF_CNT = SUB_BUCKET_CNT / 2
+    };
+
+    // 1 hour in us
+    static const uint64_t DEFAULT_HIGHEST_VALUE = 3600000000ULL;
+
+private:
+    uint64_t m_highestValue;
+
+    QVector<uint64_t> countList;    // Count of each bucket
+
+    uint64_t totalCnt;
+    uint64_t overflowCnt;
+    uint64_t minValue;
+    uint64_t maxValue;
+    double sum;
+
+    static uint32_t getIndex(uint64_t value);
+
+    // Return the highest value counted in bucket
+    static uint64_t getHighestEquivalentValue(uint32_t index);
+};
+
+#endif // LATENCYHISTOGRAM_H
@@ -0,0 +1,290 @@
+/**********************************************************************
+PACKAGE:        Utility
+FILE:           TimerWheel.cpp
+COPYRIGHT (C):  All rights reserved.
+
+PURPOSE:        Hierarchical timer wheel for a large number of timeouts
+**********************************************************************/
+
+#include "TimerWheel.h"
+#include <string.h>
+
+TimerWheel::TimerWheel(uint32_t tickInMs) :
+    m_tickInMs(tickInMs),
+    currentTick(0),
+    remainderInMs(0),
+    nodeP(NULL),
+    capacity(0),
+    scheduledCnt(0),
+    freeSearchPos(0)
+{
+    if(0 == m_tickInMs)
+    {
+        m_tickInMs = DEFAULT_TICK_IN_MS;
+    }
+
+    for(uint32_t i = 0; i < LEVEL_CNT * SLOT_CNT; i++)
+    {
+        slotHead[i] = INVALID_ID;
+    }
+
+    reserve(INIT_CAPACITY - 1);
+}
+
+TimerWheel::~TimerWheel()
+{
+    delete []nodeP;
+}
+
+void TimerWheel::reserve(uint32_t id)
+{
+    if(id < capacity)
+    {
+        return;
+    }
+
+    uint32_t newCapacity = (0 == capacity) ? (uint32_t)INIT_CAPACITY : capacity;
+    while(newCapacity <= id)
+    {
+        newCapacity *= 2;
+    }
+
+    TIMER_NODE *newNodeP = new TIMER_NODE [newCapacity];
+    memset(newNodeP, 0, sizeof(TIMER_NODE) * newCapacity);
+
+    if(NULL != nodeP)
+    {
+        memcpy(newNodeP, nodeP, sizeof(TIMER_NODE) * capacity);
+        delete []nodeP;
+    }
+
+    nodeP = newNodeP;
+    capacity = newCapacity;
+}
+
+void TimerWheel::link(uint32_t id)
+{
+    TIMER_NODE &node = nodeP[id];
+    uint64_t delta = node.expireTick - currentTick;
+    uint32_t level = 0;
+
+    // Find the lowest level which can hold the delta
+    while(level < (LEVEL_CNT - 1) && delta >= ((uint64_t)1 << (SLOT_BITS * (level + 1))))
+    {
+        level++;
+    }
+
+    uint32_t slot = (uint32_t)(node.expireTick >> (SLOT_BITS * level)) & SLOT_MASK;
+    uint32_t index = level * SLOT_CNT + slot;
+
+    node.slotIndex = index;
+    node.prev = INVALID_ID;
+    node.next = slotHead[index];
+
+    if(INVALID_ID != slotHead[index])
+    {
+        nodeP[slotHead[index]].prev = id;
+    }
+
+    slotHead[index] = id;
+    node.active = true;
+}
+
+void TimerWheel::unlink(uint32_t id)
+{
+    TIMER_NODE &node = nodeP[id];
+
+    if(INVALID_ID != node.prev)
+    {
+        nodeP[node.prev].next = node.next;
+    }
+    else
+    {
+        slotHead[node.slotIndex] = node.next;
+    }
+
+    if(INVALID_ID != node.next)
+    {
+        nodeP[node.next].prev = node.prev;
+    }
+
+    node.prev = INVALID_ID;
+    node.next = INVALID_ID;
+    node.active = false;
+}
+
+void TimerWheel::schedule(uint32_t id, uint32_t timeoutInMs)
+{
+    if(INVALID_ID == id)
+    {
+        return;
+    }
+
+    reserve(id);
+
+    if(nodeP[id].active)
+    {
+        unlink(id);
+        scheduledCnt--;
+    }
+
+    // Round up to tick, at least 1 tick
+    uint64_t ticks = ((uint64_t)timeoutInMs + remainderInMs + m_tickInMs - 1) / m_tickInMs;
+    if(0 == ticks)
+    {
+        ticks = 1;
+    }
+    else if(ticks > MAX_TIMEOUT_TICKS)
+    {
+        ticks = MAX_TIMEOUT_TICKS;
+    }
+
+    nodeP[id].expireTick = currentTick + ticks;
+    link(id);
+    scheduledCnt++;
+}
+
+void TimerWheel::cancel(uint32_t id)
+{
+    if(id >= capacity || !nodeP[id].active)
+    {
+        return;
+    }
+
+    unlink(id);
+    scheduledCnt--;
+}
+
+bool TimerWheel::isScheduled(uint32_t id) const
+{
+    return (id < capacity) && nodeP[id].active;
+}
+
+void TimerWheel::cascade(uint32_t level)
+{
+    uint32_t slot = (uint32_t)(currentTick >> (SLOT_BITS * level)) & SLOT_MASK;
+    uint32_t index = level * SLOT_CNT + slot;
+    uint32_t id = slotHead[index];
+
+    // Detach the whole list, then link every timer again by its delta
+    slotHead[index] = INVALID_ID;
+
+    while(INVALID_ID != id)
+    {
+        uint32_t next = nodeP[id].next;
+        link(id);
+        id = next;
+    }
+}
+
+uint32_t TimerWheel::advance(uint32_t elapsedInMs, QList<uint32_t> &expiredIds)
+{
+    uint32_t cnt = 0;
+    uint64_t ticks = ((uint64_t)elapsedInMs + remainderInMs) / m_tickInMs;
+
+    remainderInMs = (uint32_t)(((uint64_t)elapsedInMs + remainderInMs) % m_tickInMs);
+
+    while(ticks-- > 0)
+    {
+        currentTick++;
+
+        // Level 0 wraps, cascade the higher levels
+        for(uint32_t level = 1; level < LEVEL_CNT; level++)
+        {
+            if(0 != ((currentTick >> (SLOT_BITS * (level - 1))) & SLOT_MASK))
+            {
+                break;
+            }
+
+            cascade(level);
+        }
+
+        // Expire all timers of current slot in level 0
+        uint32_t index = (uint32_t)currentTick & SLOT_MASK;
+        uint32_t id = slotHead[index];
+
+        while(INVALID_ID != id)
+        {
+            uint32_t next = nodeP[id].next;
+
+            unlink(id);
+            scheduledCnt--;
+
+            expiredIds.append(id);
+            cnt++;
+
+            id = next;
+        }
+
+        // Nothing to check, skip the idle ticks
+        if(0 == scheduledCnt)
+        {
+            currentTick += ticks;
+            ticks = 0;
+        }
+    }
+
+    return cnt;
+}
+
+uint32_t TimerWheel::allocateId()
+{
+    for(uint32_t i = 0; i < capacity; i++)
+    {
+        uint32_t id = (freeSearchPos + i) % capacity;
+
+        if(!nodeP[id].allocated)
+        {
+            nodeP[id].allocated = true;
+            freeSearchPos = id + 1;
+            return id;
+        }
+    }
+
+    // All IDs are used, enlarge the node array
+    uint32_t id = capacity;
+    reserve(id);
+
+    nodeP[id].allocated = true;
+    freeSearchPos = id + 1;
+
+    return id;
+}
+
+void TimerWheel::releaseId(uint32_t id)
+{
+    if(id >= capacity)
+    {
+        return;
+    }
+
+    cancel(id);
+    nodeP[id].allocated = false;
+}
+
+void TimerWheel::clear()
+{
+    for(uint32_t i = 0; i < capacity; i++)
+    {
+        nodeP[i].prev = INVALID_ID;
+        nodeP[i].next = INVALID_ID;
+        nodeP[i].active = false;
+    }
+
+    for(uint32_t i = 0; i < LEVEL_CNT * SLOT_CNT; i++)
+    {
+        slotHead[i] = INVALID_ID;
+    }
+
+    scheduledCnt = 0;
+}
+
+uint32_t TimerWheel::getTickInMs() const
+{
+    return m_tickInMs;
+}
+
+uint32_t TimerWheel::getScheduledCnt() const
+{
+    return scheduledCnt;
+}
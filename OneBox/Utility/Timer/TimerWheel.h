@@ -0,0 +1,123 @@
+/**********************************************************************
+PACKAGE:        Utility
+FILE:           TimerWheel.h
+COPYRIGHT (C):  All rights reserved.
+
+PURPOSE:        Hierarchical timer wheel for a large number of timeouts
+**********************************************************************/
+
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include <stdint.h>
+#include <QList>
+
+/*
+ The struct of TimerWheel is shown as below,
+
+ level 0: 64 slots, 1 tick per slot
+ level 1: 64 slots, 64 ticks per slot
+ level 2: 64 slots, 64^2 ticks per slot
+ level 3: 64 slots, 64^3 ticks per slot
+
+ A timer is linked into the slot of its expire tick, when level 0 wraps
+ the current slot of next level is cascaded down. schedule(), cancel()
+ and advance() for one tick are O(1), no matter how many timers exist.
+
+ Timer ID is a small integer used as array index, it is either chosen by
+ caller (e.g. a table slot) or got from allocateId(), do not mix them in
+ one TimerWheel.
+*/
+
+class TimerWheel
+{
+public:
+    explicit TimerWheel(uint32_t tickInMs = DEFAULT_TICK_IN_MS);
+    virtual ~TimerWheel();
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		schedule
+    PURPOSE:		Start or restart a timer
+    ARGUMENTS:		uint32_t id           -- timer ID
+                    uint32_t timeoutInMs  -- timeout, rounded up to tick
+    RETURNS:		None
+    -----------------------------------------------------------------------*/
+    void schedule(uint32_t id, uint32_t timeoutInMs);
+
+    // Stop a timer, do nothing if it is not scheduled
+    void cancel(uint32_t id);
+
+    // True: timer is scheduled and not expired yet
+    bool isScheduled(uint32_t id) const;
+
+    /*-----------------------------------------------------------------------
+    FUNCTION:		advance
+    PURPOSE:		Move the wheel forward by elapsed time
+    ARGUMENTS:		uint32_t elapsedInMs          -- elapsed time since last call
+                    QList<uint32_t> &expiredIds   -- expired timer IDs appended here
+    RETURNS:		The count of expired timers
+    -----------------------------------------------------------------------*/
+    uint32_t advance(uint32_t elapsedInMs, QList<uint32_t> &expiredIds);
+
+    // Get a free timer ID, release it with releaseId() when no longer used
+    uint32_t allocateId();
+    void releaseId(uint32_t id);
+
+    // Stop all timers
+    void clear();
+
+    uint32_t getTickInMs() const;
+
+    // Return the count of scheduled timers
+    uint32_t getScheduledCnt() const;
+
+    enum
+    {
+        DEFAULT_TICK_IN_MS = 100,
+        INVALID_ID = 0xFFFFFFFF
+    };
+
+private:
+    enum
+    {
+        LEVEL_CNT = 4,
+        SLOT_BITS = 6,
+        SLOT_CNT = 1 << SLOT_BITS,
+        SLOT_MASK = SLOT_CNT - 1,
+        MAX_TIMEOUT_TICKS = (1 << (SLOT_BITS * LEVEL_CNT)) - 1,
+        INIT_CAPACITY = 64
+    };
+
+    struct TIMER_NODE
+    {
+        uint32_t prev;          // Previous node in slot list, INVALID_ID: head
+        uint32_t next;          // Next node in slot list, INVALID_ID: tail
+        uint64_t expireTick;    // Absolute tick to expire
+        uint16_t slotIndex;     // level * SLOT_CNT + slot
+        bool active;            // True: linked in slot list
+        bool allocated;         // True: ID is got from allocateId()
+    };
+
+    uint32_t m_tickInMs;
+    uint64_t currentTick;
+    uint32_t remainderInMs;     // Elapsed time less than one tick
+
+    TIMER_NODE *nodeP;          // Timer nodes indexed by ID
+    uint32_t capacity;          // Size of nodeP[]
+    uint32_t slotHead[LEVEL_CNT * SLOT_CNT];   // First node of each slot
+
+    uint32_t scheduledCnt;
+    uint32_t freeSearchPos;     // Start position to search free ID
+
+    // Make sure nodeP[] can hold id
+    void reserve(uint32_t id);
+
+    // Link/unlink node into/from slot list
+    void link(uint32_t id);
+    void unlink(uint32_t id);
+
+    // Move the timers of current slot in level down to lower levels
+    void cascade(uint32_t level);
+};
+
+#endif // TIMERWHEEL_H